@@ -11,6 +11,12 @@ module Fluent
 
         MDSD_MAX_RECORD_SIZE = 128 * 1024-1
 
+        # max number of failed chunks whose send progress is kept for retry.
+        MAX_RESUMED_CHUNKS = 1024
+
+        # max number of records encoded in Ruby and sent in one batch.
+        MAX_BATCH_RECORDS = 1000
+
         def initialize()
             super
             require_relative 'Liboutmdsdrb'
@@ -18,6 +24,12 @@ module Fluent
             @mdsdMsgMaker = nil
             @mdsdLogger = nil
             @mdsdTagPrefix = nil
+            @chunkEncoder = nil
+            @mdsdTagRegexps = []
+
+            # chunk unique_id => index of the first record not sent yet
+            @chunkProgress = {}
+            @chunkProgressMutex = Mutex.new
         end
 
         desc 'full path to mdsd djson socket file'
@@ -30,6 +42,14 @@ module Fluent
         config_param :resend_interval_ms, :integer, :default => 30000
         desc 'timeout in millisecond when connecting to djsonsocket'
         config_param :conn_retry_timeout_ms, :integer, :default => 60000
+        desc 'more mdsd djson socket files. If set, records are sharded by source name among all the sockets'
+        config_param :extra_djsonsockets, :array, :default => []
+        desc 'mdsd source names whose records are sent to every socket'
+        config_param :mirror_sources, :array, :default => []
+        desc 'at shutdown, max milliseconds to wait for mdsd to ack the records already sent'
+        config_param :drain_timeout_ms, :integer, :default => 5000
+        desc 'if set, records not acked at shutdown are saved to this file and sent again at next start'
+        config_param :spill_file, :string, :default => nil
         desc 'the field name for the event emit time stamp'
         config_param :emit_timestamp_name, :string, :default => "FluentdIngestTimestamp"
         desc "the timestamp to use for records sent to mdsd"
@@ -38,6 +58,20 @@ module Fluent
         config_param :max_record_size, :integer, :default => MDSD_MAX_RECORD_SIZE
         desc "convert hash type to json string"
         config_param :convert_hash_to_json, :bool, :default => false
+        desc "decode buffer chunks and encode records in the native library. Nested arrays and hashes are sent as JSON text"
+        config_param :native_chunk_encoding, :bool, :default => false
+        desc "record the stage times of 1 out of every N records. 0 disables it"
+        config_param :flight_recorder_sample_rate, :integer, :default => 0
+        desc "file to dump the recorded stage times to when flight_recorder_dump_signal is received"
+        config_param :flight_recorder_dump_file, :string, :default => nil
+        desc "signal name to dump the recorded stage times"
+        config_param :flight_recorder_dump_signal, :string, :default => "WINCH"
+        desc "how unacked records are replayed after reconnecting to mdsd: interleave or replay_first"
+        config_param :replay_policy, :string, :default => "interleave"
+        desc "max percentage of socket time used to resend unacked records. 100 means no limit"
+        config_param :resend_share_percent, :integer, :default => 100
+        desc "socket I/O engine: poll or io_uring. io_uring falls back to poll if it is not available"
+        config_param :io_engine, :string, :default => "poll"
 
         # This method is called before starting.
         def configure(conf)
@@ -45,22 +79,70 @@ module Fluent
 
             Liboutmdsdrb::InitLogger($log.out.path, true)
             Liboutmdsdrb::SetLogLevel($log.level.to_s)
+            configure_flight_recorder()
 
             @mdsdMsgMaker = MdsdMsgMaker.new(@log, convert_hash_to_json)
-            @mdsdLogger = Liboutmdsdrb::SocketLogger.new(djsonsocket, acktimeoutms,
-                resend_interval_ms, conn_retry_timeout_ms)
+            # The loggers throw for an unknown engine, so check it first.
+            if !["poll", "io_uring"].include?(io_engine)
+                raise Fluent::ConfigError, "invalid io_engine: #{io_engine}"
+            end
+            if extra_djsonsockets.empty?
+                @mdsdLogger = Liboutmdsdrb::SocketLogger.new(djsonsocket, acktimeoutms,
+                    resend_interval_ms, conn_retry_timeout_ms, io_engine)
+            else
+                @mdsdLogger = Liboutmdsdrb::RoutingLogger.new([djsonsocket] + extra_djsonsockets,
+                    acktimeoutms, resend_interval_ms, conn_retry_timeout_ms, io_engine)
+                mirror_sources.each { |source| @mdsdLogger.AddMirrorSource(source) }
+            end
+            if !@mdsdLogger.SetReplayPolicy(replay_policy)
+                raise Fluent::ConfigError, "invalid replay_policy: #{replay_policy}"
+            end
+            if !@mdsdLogger.SetResendShare(resend_share_percent)
+                raise Fluent::ConfigError, "invalid resend_share_percent: #{resend_share_percent}"
+            end
             @mdsdTagPatterns = mdsd_tag_regex_patterns
+            @mdsdTagRegexps = compile_tag_patterns(@mdsdTagPatterns)
             @configured_max_record_size = [max_record_size, MDSD_MAX_RECORD_SIZE].min
+            if native_chunk_encoding
+                # The native encoder uses ECMAScript regex. A pattern it can't compile
+                # would be ignored, and its tags sent under another source name.
+                nativePatterns = Liboutmdsdrb::SourceResolver.new(@mdsdTagPatterns).GetNumPatterns()
+                if nativePatterns != @mdsdTagPatterns.size
+                    raise Fluent::ConfigError, "mdsd_tag_regex_patterns must be in ECMAScript regex syntax " +
+                        "with native_chunk_encoding: #{@mdsdTagPatterns}"
+                end
+                @chunkEncoder = Liboutmdsdrb::MsgpackChunkEncoder.new(@mdsdTagPatterns, emit_timestamp_name,
+                    use_source_timestamp, @configured_max_record_size)
+            end
         end
 
         # This method is called before starting.
         def start()
             super
+            if spill_file && File.exist?(spill_file)
+                nsent = @mdsdLogger.ReplaySpillFile(spill_file)
+                @log.info "Replayed #{nsent} records from spill file '#{spill_file}'"
+            end
         end
 
         # This method is called when shutting down.
         def shutdown()
             super
+            if not @mdsdLogger.WaitUntilAllAcked(drain_timeout_ms)
+                nleft = @mdsdLogger.GetNumItemsInCache()
+                @log.warn "#{nleft} records are not acked by mdsd after #{drain_timeout_ms} ms"
+                if spill_file
+                    nsaved = @mdsdLogger.SpillUnacked(spill_file)
+                    @log.info "Saved #{nsaved} records to spill file '#{spill_file}'"
+                end
+            end
+        end
+
+        # Return the metrics of the native logger, e.g. send and ack counters, drops
+        # by reason and latency percentiles, so that monitor_agent can export them.
+        def statistics()
+            stats = defined?(super) ? super : {}
+            stats.merge("mdsd" => JSON.parse(@mdsdLogger.GetStats()))
         end
 
         # This method is called when an event reaches to Fluentd.
@@ -79,35 +161,142 @@ module Fluent
         #
         # NOTE! This method is called by internal thread, not Fluentd's main thread.
         # So IO wait doesn't affect other plugins.
+        #
+        # The records are sent in order until the first failure. If it can be
+        # retried, the index of the failed record is kept, and the retry of the
+        # chunk resumes from it, so that the records already sent are not sent
+        # and stored by mdsd again.
         def write(chunk)
+            chunkId = chunk.unique_id
+            startIndex = @chunkProgressMutex.synchronize { @chunkProgress.delete(chunkId) } || 0
+
+            loop do
+                result = @chunkEncoder ? send_chunk_native(chunk, startIndex) : send_chunk_records(chunk, startIndex)
+                break if result.success
+
+                if result.retryable
+                    @chunkProgressMutex.synchronize {
+                        # Hash keeps insertion order, so shift drops the oldest chunk.
+                        @chunkProgress.shift if @chunkProgress.size >= MAX_RESUMED_CHUNKS
+                        @chunkProgress[chunkId] = result.failedIndex
+                    }
+                    raise "Sending chunk to mdsd failed at record #{result.failedIndex}"
+                end
+
+                # The failed record can never be sent. Drop it and send the rest, unless
+                # the failure is before startIndex, i.e. the rest of the chunk can't be decoded.
+                if result.failedIndex < startIndex
+                    @log.error "Dropping records from #{startIndex} of a chunk that can't be decoded"
+                    break
+                end
+                @log.error "Dropping record #{result.failedIndex} of a chunk that can't be sent to mdsd"
+                startIndex = result.failedIndex + 1
+            end
+            @log.flush
+        end
+
+private
+
+        # Set up the native flight recorder, which records the stage times of
+        # sampled records.
+        def configure_flight_recorder()
+            Liboutmdsdrb::SetFlightRecorderSampleRate(flight_recorder_sample_rate)
+            return if flight_recorder_dump_file.nil?
+
+            signo = Signal.list[flight_recorder_dump_signal.sub(/^SIG/, "")]
+            if signo.nil?
+                raise Fluent::ConfigError, "invalid flight_recorder_dump_signal: #{flight_recorder_dump_signal}"
+            end
+            if !Liboutmdsdrb::SetFlightRecorderDumpSignal(signo, flight_recorder_dump_file)
+                raise Fluent::ConfigError, "failed to set flight recorder dump signal #{flight_recorder_dump_signal}"
+            end
+        end
+
+        # Compile the tag regex patterns once. Raise ConfigError for an invalid pattern.
+        def compile_tag_patterns(patterns)
+            patterns.map { |pattern|
+                begin
+                    Regexp.new(pattern)
+                rescue RegexpError => ex
+                    raise Fluent::ConfigError, "invalid mdsd_tag_regex_patterns '#{pattern}': #{ex.message}"
+                end
+            }
+        end
+
+        # Send a chunk from record 'startIndex' with the native encoder. A file chunk
+        # is memory mapped by the encoder, so its records are never loaded as Ruby objects.
+        # Return the SendResult.
+        def send_chunk_native(chunk, startIndex)
+            if chunk.respond_to?(:path) && File.file?(chunk.path)
+                @chunkEncoder.SendChunkFileFrom(@mdsdLogger, chunk.path, startIndex)
+            else
+                @chunkEncoder.SendChunkDataFrom(@mdsdLogger, chunk.read, startIndex)
+            end
+        end
+
+        # Encode the records of a chunk from record 'startIndex' and send them in
+        # batches of at most MAX_BATCH_RECORDS, so that the memory used doesn't
+        # grow with the chunk size. Stop at the first failed batch. Return the
+        # SendResult, whose failedIndex is the record index in the chunk.
+        # NOTE: not all types are supported. The supported data types are
+        # defined in SchemaManager class.
+        def send_chunk_records(chunk, startIndex)
+            # The records of a chunk share a few tags. Resolve each tag once per chunk.
+            sources = Hash.new { |hash, tag| hash[tag] = @mdsdMsgMaker.create_mdsd_source(tag, @mdsdTagRegexps) }
+            sourceNames = []
+            dataStrs = []
+            indexes = []
+
+            index = 0
+            each_record(chunk) { |tag, record|
+                if index >= startIndex
+                    mdsdSource = sources[tag]
+                    dataStr = @mdsdMsgMaker.get_schema_value_str(record)
+                    if !record_too_large?(dataStr, mdsdSource)
+                        sourceNames << mdsdSource
+                        dataStrs << dataStr
+                        indexes << index
+                        @log.trace "source='#{mdsdSource}', data='#{dataStr}'"
+                    end
+                    if sourceNames.size >= MAX_BATCH_RECORDS
+                        result = send_record_batch(sourceNames, dataStrs, indexes, startIndex)
+                        return result if !result.success
+                        sourceNames.clear
+                        dataStrs.clear
+                        indexes.clear
+                    end
+                end
+                index += 1
+            }
+
+            send_record_batch(sourceNames, dataStrs, indexes, startIndex)
+        end
+
+        # Send a batch of encoded records. indexes are their record indexes in the
+        # chunk. Return the SendResult, whose failedIndex is the record index in the chunk.
+        def send_record_batch(sourceNames, dataStrs, indexes, startIndex)
+            result = @mdsdLogger.SendDjsonBatch(sourceNames, dataStrs)
+            if !result.success
+                result.failedIndex = indexes.fetch(result.failedIndex, startIndex)
+            end
+            result
+        end
+
+        # Yield the tag and the record of each chunk entry, with the emit timestamp added.
+        def each_record(chunk)
             if use_source_timestamp
                 chunk.msgpack_each {|(tag, time, record)|
                     # Ruby (version >= 1.9) hash preserves insertion order. So the following item is
                     # the last item when iterating the 'record' hash.
                     record[emit_timestamp_name] = Time.at(time)
-                    handle_record(tag, record)
+                    yield tag, record
                 }
             else
                 chunk.msgpack_each {|(tag, record)|
                     record[emit_timestamp_name] = Time.now
-                    handle_record(tag, record)
+                    yield tag, record
                 }
             end
-            @log.flush
-        end
-
-private
-        # Handle a regular record, which is hash of key, value pairs.
-        # NOTE: not all types are supported. The supported data types are
-        # defined in SchemaManager class.
-        def handle_record(tag, record)
-            mdsdSource = @mdsdMsgMaker.create_mdsd_source(tag, @mdsdTagPatterns)
-            dataStr = @mdsdMsgMaker.get_schema_value_str(record)
-            return if record_too_large?(dataStr, mdsdSource)
-            if not @mdsdLogger.SendDjson(mdsdSource, dataStr)
-                raise "Sending data (tag=#{tag}) to mdsd failed"
-            end
-            @log.trace "source='#{mdsdSource}', data='#{dataStr}'"
         end
 
         def record_too_large?(dataStr, mdsdSource)
@@ -240,10 +429,11 @@ class MdsdMsgMaker
     # extended syslog use case needs a pattern matching (e.g., mdsd.syslog.user.info to
     # mdsd.syslog.user, mdsd.syslog.local1.err to mdsd.syslog.local1 : This can be
     # expressed as regex "^mdsd\.syslog\.\w+" and the match will be returned as the
-    # corresponding mdsd source name.
+    # corresponding mdsd source name. The regex list can be Regexp objects, or
+    # strings, which are compiled on each call.
     def create_mdsd_source(tag, regex_list)
         regex_list.each { |regex|
-            match = tag.match /#{regex}/
+            match = tag.match(regex)
             if match
                 return match[0]
             end
@@ -36,6 +36,15 @@ class OutputMdsdTest < Test::Unit::TestCase
         mdsd_tag_regex_patterns [ "^mdsd\\.syslog" ]
         resend_interval_ms 30
         conn_retry_timeout_ms 60
+        drain_timeout_ms 100
+    ]
+
+    CONFIG3 = %[
+        log_level trace
+        djsonsocket /tmp/mytestsocket
+        acktimeoutms 1
+        extra_djsonsockets [ "/tmp/mytestsocket2" ]
+        mirror_sources [ "mdsd.critical" ]
     ]
 
     def create_driver(conf = CONFIG1)
@@ -49,6 +58,21 @@ class OutputMdsdTest < Test::Unit::TestCase
         assert_equal(1, d.instance.acktimeoutms, "acktimeoutms")
         assert_equal([ "^mdsd.syslog" ], d.instance.mdsd_tag_regex_patterns, "mdsd_tag_regex_patterns")
         assert_equal("testtimestamp", d.instance.emit_timestamp_name, "emit_timestamp_name")
+        assert_equal(5000, d.instance.drain_timeout_ms, "drain_timeout_ms")
+        assert_nil(d.instance.spill_file, "spill_file")
+        assert_equal(false, d.instance.native_chunk_encoding, "native_chunk_encoding")
+        assert_equal(0, d.instance.flight_recorder_sample_rate, "flight_recorder_sample_rate")
+        assert_nil(d.instance.flight_recorder_dump_file, "flight_recorder_dump_file")
+        assert_equal("interleave", d.instance.replay_policy, "replay_policy")
+        assert_equal(100, d.instance.resend_share_percent, "resend_share_percent")
+        assert_equal("poll", d.instance.io_engine, "io_engine")
+    end
+
+    def test_configure_routing()
+        d = create_driver(CONFIG3)
+
+        assert_equal([ "/tmp/mytestsocket2" ], d.instance.extra_djsonsockets, "extra_djsonsockets")
+        assert_equal([ "mdsd.critical" ], d.instance.mirror_sources, "mirror_sources")
     end
 
     def test_write_with_good_socket()
@@ -245,6 +269,12 @@ class MdsdMsgMakerTest < Test::Unit::TestCase
             actual_source_name = @msg_maker.create_mdsd_source(tag, regex_list)
             assert_equal(expected_source_name, actual_source_name, "Invalid source name returned")
         }
+        # Compiled patterns keep Ruby regex syntax.
+        compiled_list = [ /\Amdsd\.ext_syslog\.\w+\z/, /(?<facility>^mdsd\.syslog)/i ]
+        assert_equal("mdsd.ext_syslog.local1", @msg_maker.create_mdsd_source("mdsd.ext_syslog.local1", compiled_list))
+        assert_equal("mdsd.ext_syslog.local1.err", @msg_maker.create_mdsd_source("mdsd.ext_syslog.local1.err", compiled_list))
+        assert_equal("MDSD.syslog", @msg_maker.create_mdsd_source("MDSD.syslog.user.info", compiled_list))
+
         test_data2 = [ "any.tag.1", "any.tag.2" ]
         test_data2.each { |tag|
             actual_source_name = @msg_maker.create_mdsd_source(tag, [])
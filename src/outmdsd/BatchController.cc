@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "BatchController.h"
+
+using namespace EndpointLog;
+
+// The bytes limit never shrinks below this, so that small items can still be
+// batched by count.
+static constexpr size_t MinBatchBytes = 4096;
+
+BatchController::BatchController(
+    size_t maxItems,
+    size_t maxBytes,
+    std::chrono::microseconds maxLinger
+    )
+{
+    SetLimits(maxItems, maxBytes, maxLinger);
+}
+
+void
+BatchController::ValidateLimits(
+    size_t maxItems,
+    size_t maxBytes
+    )
+{
+    if (0 == maxItems) {
+        throw std::invalid_argument("BatchController: max items must be positive.");
+    }
+    if (0 == maxBytes) {
+        throw std::invalid_argument("BatchController: max bytes must be positive.");
+    }
+}
+
+void
+BatchController::SetLimits(
+    size_t maxItems,
+    size_t maxBytes,
+    std::chrono::microseconds maxLinger
+    )
+{
+    ValidateLimits(maxItems, maxBytes);
+    m_maxItems = maxItems;
+    m_maxBytes = maxBytes;
+    m_maxLingerUS = std::max<int64_t>(0, maxLinger.count());
+    m_batchItems = 1;
+    m_batchBytes = std::min(maxBytes, MinBatchBytes);
+}
+
+std::chrono::microseconds
+BatchController::GetLinger() const
+{
+    if (m_batchItems <= 1) {
+        return std::chrono::microseconds(0);
+    }
+    int64_t lingerUS = m_maxLingerUS;
+    int64_t ackLatencyUS = m_ackLatencyUS;
+    if (ackLatencyUS > 0) {
+        lingerUS = std::min(lingerUS, ackLatencyUS / 8);
+    }
+    return std::chrono::microseconds(lingerUS);
+}
+
+void
+BatchController::OnBatchSent(
+    size_t nitems,
+    size_t nbytes,
+    size_t queueDepth,
+    std::chrono::microseconds sendTime
+    )
+{
+    size_t batchItems = m_batchItems;
+    size_t batchBytes = m_batchBytes;
+    bool isFull = (nitems >= batchItems || nbytes >= batchBytes);
+
+    if (isFull && queueDepth > 0) {
+        // The queue grows faster than it is sent. Grow unless a batch already
+        // takes too long to send.
+        if (sendTime.count() <= m_maxLingerUS) {
+            m_batchItems = std::min<size_t>(m_maxItems, batchItems * 2);
+            m_batchBytes = std::min<size_t>(m_maxBytes, batchBytes * 2);
+        }
+    }
+    else if (0 == queueDepth && (!isFull || nitems <= 1)) {
+        // The queue is drained. A single item is an idle batch even if it
+        // fills the items limit, so that the bytes limit shrinks too.
+        m_batchItems = std::max<size_t>(1, batchItems / 2);
+        m_batchBytes = std::max<size_t>(std::min<size_t>(m_maxBytes, MinBatchBytes), batchBytes / 2);
+    }
+}
+
+void
+BatchController::OnAckLatency(
+    std::chrono::microseconds meanLatency
+    )
+{
+    m_ackLatencyUS = meanLatency.count();
+}
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef __ENDPOINTLOG_BATCHCONTROLLER_H__
+#define __ENDPOINTLOG_BATCHCONTROLLER_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace EndpointLog {
+
+/// This class decides how many items DataSender sends in one batch, and how
+/// long it waits for a batch to fill.
+///
+/// At low rates each item is sent alone right away. Under load, the batch
+/// limits double each time a full batch leaves a backlog in the queue, up to
+/// the configured max, so that fewer system calls carry more items. They are
+/// halved each time the queue is drained before a batch fills, down to a
+/// single item. A batch that takes longer to send than the linger bound
+/// doesn't grow any more, so one batch never delays the items behind it by
+/// much more than that.
+///
+/// While batching, the sender lingers for more items up to the max linger
+/// time, but not longer than 1/8 of the recent mean ack latency, so that the
+/// wait is small compared to the time mdsd takes anyway.
+///
+/// Update methods must be called by one thread. Getters are thread-safe.
+class BatchController
+{
+public:
+    /// Constructor. It starts with single-item batches.
+    /// <param name="maxItems">max items in a batch. 1 disables batching.</param>
+    /// <param name="maxBytes">max bytes in a batch. A batch can exceed it by one item.</param>
+    /// <param name="maxLinger">max time to wait for a batch to fill.</param>
+    /// Throw exception if maxItems or maxBytes is 0.
+    BatchController(size_t maxItems, size_t maxBytes, std::chrono::microseconds maxLinger);
+
+    ~BatchController() = default;
+
+    // not copyable, not movable
+    BatchController(const BatchController& other) = delete;
+    BatchController& operator=(const BatchController& other) = delete;
+
+    BatchController(BatchController&& other) = delete;
+    BatchController& operator=(BatchController&& other) = delete;
+
+    /// Change the limits. The current batch limits are reset to single items.
+    /// Throw exception if maxItems or maxBytes is 0.
+    void SetLimits(size_t maxItems, size_t maxBytes, std::chrono::microseconds maxLinger);
+
+    /// Return max items of the next batch.
+    size_t GetBatchItems() const { return m_batchItems; }
+
+    /// Return max bytes of the next batch.
+    size_t GetBatchBytes() const { return m_batchBytes; }
+
+    /// Return how long to wait for the next batch to fill. It is 0 for single-item batches.
+    std::chrono::microseconds GetLinger() const;
+
+    /// Update the limits after a batch is sent.
+    /// <param name="nitems">number of items in the batch.</param>
+    /// <param name="nbytes">number of bytes in the batch.</param>
+    /// <param name="queueDepth">number of items left in the queue.</param>
+    /// <param name="sendTime">time to send the batch.</param>
+    void OnBatchSent(size_t nitems, size_t nbytes, size_t queueDepth, std::chrono::microseconds sendTime);
+
+    /// Update the mean ack latency of the items acked recently.
+    void OnAckLatency(std::chrono::microseconds meanLatency);
+
+private:
+    static void ValidateLimits(size_t maxItems, size_t maxBytes);
+
+private:
+    std::atomic<size_t> m_maxItems;
+    std::atomic<size_t> m_maxBytes;
+    std::atomic<int64_t> m_maxLingerUS;
+
+    std::atomic<size_t> m_batchItems{1};
+    std::atomic<size_t> m_batchBytes;
+    std::atomic<int64_t> m_ackLatencyUS{0}; // 0 if unknown, e.g. no ack is expected.
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_BATCHCONTROLLER_H__
@@ -1,5 +1,6 @@
-#include "ConcurrentMap.h"
-#include "ConcurrentQueue.h"
+#include "InflightRing.h"
+#include "FairQueue.h"
+#include "EncodePool.h"
 #include "BufferedLogger.h"
 #include "Trace.h"
 #include "TraceMacros.h"
@@ -7,6 +8,9 @@
 #include "DataReader.h"
 #include "DataResender.h"
 #include "DataSender.h"
+#include "DjsonLogItem.h"
+#include "SpillFile.h"
+#include "Metrics.h"
 
 using namespace EndpointLog;
 
@@ -15,16 +19,24 @@ BufferedLogger::BufferedLogger(
     unsigned int ackTimeoutMS,
     unsigned int resendIntervalMS,
     unsigned int connRetryTimeoutMS,
-    size_t bufferLimit
+    size_t bufferLimit,
+    const std::string& ioEngine
     ):
-    m_sockClient(std::make_shared<SocketClient>(socketFile, connRetryTimeoutMS)),
-    m_dataCache(ackTimeoutMS? std::make_shared<ConcurrentMap<LogItemPtr>>() : nullptr),
-    m_incomingQueue(std::make_shared<ConcurrentQueue<LogItemPtr>>(bufferLimit)),
+    m_sockClient(std::make_shared<SocketClient>(socketFile, connRetryTimeoutMS,
+                 SocketClient::ParseIoEngine(ioEngine))),
+    m_dataCache(ackTimeoutMS? std::make_shared<InflightRing>() : nullptr),
+    m_incomingQueue(std::make_shared<FairQueue>(bufferLimit)),
     m_sockReader(new DataReader(m_sockClient, m_dataCache)),
     m_dataResender(ackTimeoutMS? new DataResender(m_sockClient, m_dataCache,
                    ackTimeoutMS, resendIntervalMS): nullptr),
     m_dataSender(new DataSender(m_sockClient, m_dataCache, m_incomingQueue))
 {
+    auto & metrics = m_sockClient->GetMetrics();
+    auto queue = m_incomingQueue;
+    metrics.SetGauge(MetricNames::QueueDepth, [queue] { return static_cast<int64_t>(queue->Size()); });
+    metrics.SetGauge(std::string(MetricNames::DropCountPrefix) + "queue_overflow",
+                     [queue] { return static_cast<int64_t>(queue->GetTotalDropped()); });
+    m_dataSender->SetResender(m_dataResender.get());
 }
 
 BufferedLogger::~BufferedLogger()
@@ -33,7 +45,10 @@ BufferedLogger::~BufferedLogger()
         ADD_INFO_TRACE;
 
         m_sockClient->Stop();
-        m_incomingQueue->stop_once_empty();
+        if (m_encodePool) {
+            m_encodePool->Stop();
+        }
+        m_incomingQueue->StopOnceEmpty();
 
         m_dataSender->Stop();
         if (m_dataResender) {
@@ -44,12 +59,6 @@ BufferedLogger::~BufferedLogger()
         if (m_senderTask.valid()) {
             m_senderTask.get();
         }
-        if (m_resenderTask.valid()) {
-            m_resenderTask.get();
-        }
-        if (m_readerTask.valid()) {
-            m_readerTask.get();
-        }
     }
     catch(const std::exception& ex)
     {
@@ -62,10 +71,17 @@ BufferedLogger::~BufferedLogger()
 void
 BufferedLogger::StartWorkers()
 {
+    {
+        // After this, SetEncodeThreads() can't change m_encodePool, which AddData()
+        // reads without lock once call_once() returns.
+        std::lock_guard<std::mutex> lk(m_startMutex);
+        m_isStarted = true;
+    }
     m_senderTask = std::async(std::launch::async, [this] { m_dataSender->Run(); });
-    m_readerTask = std::async(std::launch::async, [this] { m_sockReader->Run(); });
+    // The reader and resender run in the threads shared by all the loggers.
+    m_sockReader->Start();
     if (m_dataResender) {
-        m_resenderTask = std::async(std::launch::async, [this] {  m_dataResender->Run(); });
+        m_dataResender->Start();
     }
 }
 
@@ -78,7 +94,123 @@ BufferedLogger::AddData(
         throw std::invalid_argument("AddData(): unexpected NULL in input parameter.");
     }
     std::call_once(m_initOnceFlag, &BufferedLogger::StartWorkers, this);
-    m_incomingQueue->push(std::move(item));
+    item->RecordStage(FlightStage::Enqueue);
+    if (m_encodePool) {
+        m_encodePool->Push(std::move(item));
+    }
+    else {
+        m_incomingQueue->Push(std::move(item));
+    }
+}
+
+void
+BufferedLogger::SetSourceWeight(
+    const std::string & source,
+    unsigned int weight
+    )
+{
+    m_incomingQueue->SetSourceWeight(source, weight);
+}
+
+void
+BufferedLogger::SetSourceByteLimit(
+    const std::string & source,
+    size_t maxBytes
+    )
+{
+    m_incomingQueue->SetSourceByteLimit(source, maxBytes);
+}
+
+void
+BufferedLogger::SetDefaultSourceByteLimit(
+    size_t maxBytes
+    )
+{
+    m_incomingQueue->SetDefaultByteLimit(maxBytes);
+}
+
+void
+BufferedLogger::SetReplayPolicy(
+    ReplayPolicy policy
+    )
+{
+    if (m_dataResender) {
+        m_dataResender->SetReplayPolicy(policy);
+    }
+}
+
+void
+BufferedLogger::SetResendShare(
+    unsigned int percent
+    )
+{
+    if (m_dataResender) {
+        m_dataResender->SetResendShare(percent);
+    }
+}
+
+void
+BufferedLogger::SetBatchLimits(
+    size_t maxItems,
+    size_t maxBytes,
+    unsigned int maxLingerUS
+    )
+{
+    m_dataSender->SetBatchLimits(maxItems, maxBytes, std::chrono::microseconds(maxLingerUS));
+}
+
+void
+BufferedLogger::SetEncodeThreads(
+    unsigned int nthreads
+    )
+{
+    std::lock_guard<std::mutex> lk(m_startMutex);
+    if (m_isStarted) {
+        throw std::logic_error("SetEncodeThreads(): data is already added.");
+    }
+    auto & metrics = m_sockClient->GetMetrics();
+    if (m_encodePool) {
+        // The gauges of the old pool are replaced, so that it can be released.
+        m_encodePool->Stop();
+        auto busyUS = static_cast<int64_t>(m_encodePool->GetBusyMicroSeconds());
+        metrics.SetGauge(MetricNames::EncodeThreads, [] { return int64_t(0); });
+        metrics.SetGauge(MetricNames::EncodeQueueDepth, [] { return int64_t(0); });
+        metrics.SetGauge(MetricNames::EncodeBusyMicroSeconds, [busyUS] { return busyUS; });
+        m_encodePool.reset();
+    }
+    if (0 == nthreads) {
+        return;
+    }
+
+    auto queue = m_incomingQueue;
+    auto pool = std::make_shared<EncodePool>(nthreads, [queue](LogItemPtr item) { queue->Push(std::move(item)); });
+    metrics.SetGauge(MetricNames::EncodeThreads, [nthreads] { return static_cast<int64_t>(nthreads); });
+    metrics.SetGauge(MetricNames::EncodeQueueDepth, [pool] { return static_cast<int64_t>(pool->Size()); });
+    metrics.SetGauge(MetricNames::EncodeBusyMicroSeconds,
+                     [pool] { return static_cast<int64_t>(pool->GetBusyMicroSeconds()); });
+    m_encodePool = std::move(pool);
+}
+
+std::string
+BufferedLogger::GetIoEngine() const
+{
+    return SocketClient::GetIoEngineName(m_sockClient->GetIoEngine());
+}
+
+size_t
+BufferedLogger::GetNumDropped(
+    const std::string & source
+    ) const
+{
+    return m_incomingQueue->GetSourceStats(source).numDropped;
+}
+
+size_t
+BufferedLogger::GetNumBytesDropped(
+    const std::string & source
+    ) const
+{
+    return m_incomingQueue->GetSourceStats(source).numBytesDropped;
 }
 
 bool
@@ -87,11 +219,77 @@ BufferedLogger::WaitUntilAllSend(
     )
 {
     ADD_DEBUG_TRACE;
-    m_incomingQueue->stop_once_empty();
-    auto status = m_senderTask.wait_for(std::chrono::milliseconds(timeoutMS));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+    if (m_encodePool && !m_encodePool->WaitUntilEmpty(timeoutMS)) {
+        return false;
+    }
+    m_incomingQueue->StopOnceEmpty();
+    if (!m_senderTask.valid()) {
+        // No data was ever added.
+        return true;
+    }
+    auto status = m_senderTask.wait_until(deadline);
     return (std::future_status::ready == status);
 }
 
+bool
+BufferedLogger::WaitUntilAllAcked(
+    uint32_t timeoutMS
+    )
+{
+    ADD_INFO_TRACE;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+    if (!WaitUntilAllSend(timeoutMS)) {
+        Log(TraceLevel::Warning, "WaitUntilAllAcked timed out before all items are sent.");
+        return false;
+    }
+    if (!m_dataCache) {
+        return true;
+    }
+
+    if (m_dataResender) {
+        m_dataResender->ResendNow();
+    }
+    auto leftMS = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    if (m_dataCache->WaitUntilEmpty(leftMS > 0? leftMS : 0)) {
+        return true;
+    }
+    Log(TraceLevel::Warning, "WaitUntilAllAcked timed out after " << timeoutMS << " ms. Items left in cache: "
+        << m_dataCache->Size());
+    return false;
+}
+
+size_t
+BufferedLogger::SpillUnacked(
+    const std::string & filepath
+    )
+{
+    ADD_INFO_TRACE;
+
+    if (!m_dataCache) {
+        return 0;
+    }
+    auto items = m_dataCache->GetValues();
+    auto nsaved = SpillFile::Append(filepath, items);
+
+    m_dataCache->Erase(items);
+    return nsaved;
+}
+
+size_t
+BufferedLogger::ReplaySpillFile(
+    const std::string & filepath
+    )
+{
+    ADD_INFO_TRACE;
+
+    return SpillFile::Replay(filepath, [this](const std::string & source, const std::string & data) {
+        AddData(MakeLogItem<DjsonLogItem>(source, data));
+        return true;
+    });
+}
 
 size_t
 BufferedLogger::GetNumTagsRead() const
@@ -122,3 +320,9 @@ BufferedLogger::GetNumItemsInCache() const
 {
     return (m_dataCache? m_dataCache->Size() : 0);
 }
+
+std::string
+BufferedLogger::GetStats() const
+{
+    return m_sockClient->GetMetrics().GetStats();
+}
@@ -5,22 +5,30 @@
 
 #include <future>
 #include <memory>
+#include <string>
 #include "LogItemPtr.h"
 
 namespace EndpointLog {
 
-template<typename T> class ConcurrentQueue;
-template<typename T> class ConcurrentMap;
+class InflightRing;
+class FairQueue;
+class EncodePool;
 class SocketClient;
 class DataReader;
 class DataResender;
 class DataSender;
+enum class ReplayPolicy;
 
 // This class implements a data logger to a socket server with retry when socket
 // failure occurs. It uses multiple threads internally:
 // - The main thread will add the data to a shared, concurrent queue then move to
-//   next data item.
+//   next data item. The queue has a sub-queue for each source.
+// - Optional encode threads compose the data of the items before they are
+//   queued, in parallel, and queue them in the order they are added
+//   (see EncodePool class).
 // - A sender thread will pop and send data from the queue to the socket server.
+//   The sources take turns by their weights, so that a noisy source can't
+//   starve the others (see FairQueue class).
 // - A reader thread will read and process ack data from the socket server.
 // - An optional resender thread will resend data that failed to be sent before.
 //
@@ -37,13 +45,16 @@ public:
     /// <param name='resendIntervalMS'>message resend interval in milliseconds.</param>
     /// <param name='connRetryTimeoutMS'>number of milliseconds to timeout socket
     /// connect() retry </param>
-    /// <param name='bufferLimit'>max LogItem to buffer. 0 means no limit.</param>
+    /// <param name='bufferLimit'>max LogItem to buffer. 0 means no limit. When it is
+    /// reached, the oldest item of the source using the most buffer is dropped.</param>
+    /// <param name='ioEngine'>socket I/O engine. See SocketLogger.</param>
     BufferedLogger(
         const std::string& socketFile,
         unsigned int ackTimeoutMS,
         unsigned int resendIntervalMS,
         unsigned int connRetryTimeoutMS,
-        size_t bufferLimit
+        size_t bufferLimit,
+        const std::string& ioEngine = "poll"
         );
 
     ~BufferedLogger();
@@ -61,10 +72,70 @@ public:
     /// <param name='item'>A new logger item.</param>
     void AddData(LogItemPtr item);
 
+    /// Set the share of send bandwidth of a source. Default weight is 1.
+    /// A source with weight 2 can send twice the bytes of a source with weight 1.
+    /// Throw exception if weight is 0.
+    void SetSourceWeight(const std::string & source, unsigned int weight);
+
+    /// Set the max bytes a source can buffer. When it is reached, the oldest items
+    /// of the source are dropped. 0 means no limit.
+    void SetSourceByteLimit(const std::string & source, size_t maxBytes);
+
+    /// Set the max bytes buffered for each source without its own byte limit.
+    /// 0 means no limit, which is the default.
+    void SetDefaultSourceByteLimit(size_t maxBytes);
+
+    /// Set how the unacked items are replayed after a new connection is created
+    /// (see ReplayPolicy). Do nothing if there is no backup cache.
+    void SetReplayPolicy(ReplayPolicy policy);
+
+    /// Limit resending to 'percent' of the socket time (see DataResender::SetResendShare()).
+    /// Do nothing if there is no backup cache. Throw exception if percent is not in [1, 100].
+    void SetResendShare(unsigned int percent);
+
+    /// Set the limits of the adaptive send batches: max items, max bytes and
+    /// max microseconds to wait for a batch to fill (see BatchController).
+    /// maxItems of 1 sends each item alone. Throw exception if any limit is 0.
+    void SetBatchLimits(size_t maxItems, size_t maxBytes, unsigned int maxLingerUS);
+
+    /// Compose the data of the items on 'nthreads' encode threads before they
+    /// are queued, instead of on the sender thread. The items are still queued
+    /// in the order they are added. 0 turns it off, which is the default.
+    /// It must be called before any data is added. Throw exception otherwise.
+    void SetEncodeThreads(unsigned int nthreads);
+
+    /// Return the socket I/O engine in use: "poll" or "io_uring".
+    std::string GetIoEngine() const;
+
+    /// Return number of items of a source dropped because of buffer overflow.
+    size_t GetNumDropped(const std::string & source) const;
+
+    /// Return number of bytes of a source dropped because of buffer overflow.
+    size_t GetNumBytesDropped(const std::string & source) const;
+
     /// Wait until all the items are sent by the sender thread or timed out.
     /// Return true if all the items are sent out, false if timed out.
     bool WaitUntilAllSend(uint32_t timeoutMS);
 
+    /// Wait until all the items are sent by the sender thread and the backup
+    /// cache is empty, i.e. all the items are acknowledged or dropped after
+    /// ackTimeoutMS, or until timeoutMS in total. The reader and resender keep
+    /// on running while waiting, and the cached items are resent once immediately.
+    /// Return true if all done, false if timed out. After timeout,
+    /// GetNumItemsInCache() returns the number of items left in cache.
+    bool WaitUntilAllAcked(uint32_t timeoutMS);
+
+    /// Append the DJSON items in the backup cache to a file and remove them from
+    /// the cache, so that they can be sent by ReplaySpillFile() at next start.
+    /// Throw exception for any file error.
+    /// Return number of items saved.
+    size_t SpillUnacked(const std::string & filepath);
+
+    /// Add the records saved by SpillUnacked() to the logger, then remove the file.
+    /// Throw exception for any file error.
+    /// Return number of records added.
+    size_t ReplaySpillFile(const std::string & filepath);
+
     /// Return total number of ack tags processed by reader thread.
     size_t GetNumTagsRead() const;
 
@@ -81,23 +152,30 @@ public:
     /// or not acknowledged yet
     size_t GetNumItemsInCache() const;
 
+    /// Return a snapshot of all the metrics of the logger as a JSON object.
+    /// See SocketLogger::GetStats(). It also has the queue depth and the
+    /// number of items dropped because of queue overflow, and with encode
+    /// threads, the encode queue depth and the encode busy time.
+    std::string GetStats() const;
+
 private:
     void StartWorkers();
 
 private:
     std::shared_ptr<SocketClient> m_sockClient;
-    std::shared_ptr<ConcurrentMap<LogItemPtr>> m_dataCache; // to store <TAG, Item>
-    std::shared_ptr<ConcurrentQueue<LogItemPtr>> m_incomingQueue; // to store incoming data item.
+    std::shared_ptr<InflightRing> m_dataCache; // items sent but not acked yet
+    std::shared_ptr<FairQueue> m_incomingQueue; // to store incoming data item.
+    std::shared_ptr<EncodePool> m_encodePool;   // to encode items before they are queued. Can be NULL.
 
     std::future<void> m_senderTask;
-    std::future<void> m_readerTask;
-    std::future<void> m_resenderTask;
 
     std::unique_ptr<DataReader> m_sockReader;     // to read ack from socket server.
     std::unique_ptr<DataResender> m_dataResender; // to resend failed data to socket server.
     std::unique_ptr<DataSender> m_dataSender;     // to send data to socket server.
 
     std::once_flag m_initOnceFlag; // a flag to make sure something is called exactly once.
+    std::mutex m_startMutex;       // protect m_isStarted, and m_encodePool until the workers start.
+    bool m_isStarted = false;      // true once the workers are started by the first AddData().
 };
 
 } // namespace
@@ -0,0 +1,72 @@
+#pragma once
+#ifndef __ENDPOINTLOG_DATAFRAME_H__
+#define __ENDPOINTLOG_DATAFRAME_H__
+
+#include <string>
+#include <stdexcept>
+
+extern "C" {
+#include <sys/uio.h>
+}
+
+namespace EndpointLog {
+
+/// This class describes one message to send to the socket as a list of
+/// segments, so that the message can be sent with one sendmsg() call without
+/// first copying all the segments into one contiguous buffer.
+///
+/// The segments only point to the data. The caller must keep the data valid
+/// until the frame is sent.
+///
+class DataFrame
+{
+public:
+    /// Max number of segments in a frame.
+    constexpr static size_t MaxSegments = 8;
+
+    /// Add a segment of 'len' bytes. Empty segments are ignored.
+    /// Throw exception if there are already MaxSegments segments.
+    void Add(const char* data, size_t len)
+    {
+        if (0 == len) {
+            return;
+        }
+        if (MaxSegments == m_count) {
+            throw std::length_error("DataFrame::Add(): too many segments.");
+        }
+        m_segments[m_count].iov_base = const_cast<char*>(data);
+        m_segments[m_count].iov_len = len;
+        m_count++;
+        m_totalSize += len;
+    }
+
+    void Add(const std::string & str) { Add(str.data(), str.size()); }
+
+    const struct iovec* GetSegments() const { return m_segments; }
+
+    /// Return number of non-empty segments.
+    size_t GetCount() const { return m_count; }
+
+    /// Return total number of bytes of all segments.
+    size_t GetTotalSize() const { return m_totalSize; }
+
+    /// Return all the segments in one string.
+    std::string ToString() const
+    {
+        std::string str;
+        str.reserve(m_totalSize);
+        for (size_t i = 0; i < m_count; i++) {
+            str.append(static_cast<const char*>(m_segments[i].iov_base), m_segments[i].iov_len);
+        }
+        return str;
+    }
+
+private:
+    struct iovec m_segments[MaxSegments];
+    size_t m_count = 0;
+    size_t m_totalSize = 0;
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_DATAFRAME_H__
@@ -3,23 +3,77 @@ extern "C" {
 }
 #include <cassert>
 
-#include "ConcurrentMap.h"
+#include "InflightRing.h"
 #include "DataReader.h"
 #include "Exceptions.h"
 #include "Trace.h"
 #include "TraceMacros.h"
 #include "SocketClient.h"
+#include "LogItem.h"
+#include "WorkerRuntime.h"
+#include "Metrics.h"
 
 using namespace EndpointLog;
 
+static std::unordered_map<std::string, std::string> &
+GetAckStatusMap()
+{
+    static std::unordered_map<std::string, std::string> m = 
+    {
+        { "0", "ACK_SUCCESS" },
+        { "1", "ACK_FAILED" },
+        { "2", "ACK_UNKNOWN_SCHEMA_ID" },
+        { "3", "ACK_DECODE_ERROR" },
+        { "4", "ACK_INVALID_SOURCE" },
+        { "5", "ACK_DUPLICATE_SCHEMA_ID" }
+    };
+    return m;
+}
+
+static std::string
+GetAckStatusStr(
+    const std::string & ackCode
+    )
+{
+    const auto & m = GetAckStatusMap();
+    auto item = m.find(ackCode);
+    if (item == m.end()) {
+        return "Unknown-ACK-CODE";
+    }
+    return item->second;
+}
+
+// Ack status codes are "0" to "5". Return the code, or NumAckCodes for
+// an unknown code.
+static const size_t NumAckCodes = 6;
+
+static size_t
+GetAckCodeIndex(
+    const std::string & ackCode
+    )
+{
+    if (1 == ackCode.size() && ackCode[0] >= '0' && static_cast<size_t>(ackCode[0] - '0') < NumAckCodes) {
+        return ackCode[0] - '0';
+    }
+    return NumAckCodes;
+}
+
 DataReader::DataReader(
     const std::shared_ptr<SocketClient> & sockClient,
-    const std::shared_ptr<ConcurrentMap<LogItemPtr>> & dataCache
+    const std::shared_ptr<InflightRing> & dataCache
     ) :
     m_socketClient(sockClient),
     m_dataCache(dataCache)
 {
     assert(m_socketClient);
+
+    auto & metrics = m_socketClient->GetMetrics();
+    for (size_t i = 0; i < NumAckCodes; i++) {
+        auto name = MetricNames::AckCountPrefix + GetAckStatusStr(std::to_string(i));
+        m_ackCounters.push_back(&metrics.GetCounter(name));
+    }
+    m_ackCounters.push_back(&metrics.GetCounter(std::string(MetricNames::AckCountPrefix) + "UNKNOWN"));
+    m_sendToAckHistogram = &metrics.GetHistogram(MetricNames::SendToAckMicroSeconds);
 }
 
 DataReader::~DataReader()
@@ -35,68 +89,64 @@ DataReader::~DataReader()
 }
 
 void
-DataReader::Stop()
+DataReader::Start()
 {
     ADD_INFO_TRACE;
-    m_stopRead = true;
+
+    std::lock_guard<std::mutex> lck(m_startMutex);
+    if (m_runtime || m_stopRead) {
+        return;
+    }
+    m_runtime = WorkerRuntime::Get();
+    m_handlerId = m_runtime->AddReadHandler([this] { ReadAvailable(); });
+
+    auto runtime = m_runtime.get();
+    auto handlerId = m_handlerId;
+    m_connHandlerId = m_socketClient->AddConnectHandler([runtime, handlerId](int sockfd) {
+        runtime->WatchSocket(handlerId, sockfd);
+    });
+
+    // With io_uring, the data can be received before the socket is seen readable.
+    // The ring's fd is readable whenever there is any completion to read.
+    auto eventFd = m_socketClient->GetReadEventFd();
+    if (eventFd >= 0) {
+        runtime->WatchSocket(handlerId, eventFd);
+    }
 }
 
 void
-DataReader::Run()
+DataReader::Stop()
 {
     ADD_INFO_TRACE;
+    m_stopRead = true;
 
-    try {
-        std::string partialData;
-        while(true) {
-            if (!DoRead(partialData)) {
-                break;
-            }
-        }
-    }
-    catch(const ReaderInterruptException&) {
-        Log(TraceLevel::Info, "DataReader is interrupted. Abort reader thread.");
-    }
-    catch(const std::exception & ex) {
-        Log(TraceLevel::Error, "DataReader unexpected exception: " << ex.what());
+    std::lock_guard<std::mutex> lck(m_startMutex);
+    if (m_runtime) {
+        m_socketClient->RemoveConnectHandler(m_connHandlerId);
+        m_runtime->RemoveReadHandler(m_handlerId);
+        m_runtime.reset();
     }
 }
 
-bool
-DataReader::DoRead(
-    std::string & partialData
-    )
+void
+DataReader::ReadAvailable()
 {
-    ADD_DEBUG_TRACE;
+    ADD_TRACE_TRACE;
 
     char buf[512];
     try {
-        InterruptPoint();
-        auto readRtn = m_socketClient->Read(buf, sizeof(buf)-1);
-        if (-1 == readRtn) {
-            Log(TraceLevel::Debug, "SocketClient is stopped. Abort read.");
-            return false;
-        }
-
-        if (readRtn > 0) {
-            InterruptPoint();
+        while(!m_stopRead) {
+            auto readRtn = m_socketClient->ReadNoWait(buf, sizeof(buf)-1);
+            if (readRtn <= 0) {
+                break;
+            }
             buf[readRtn] = '\0';
-            partialData = ProcessData(partialData+buf);
-            Log(TraceLevel::Debug, "DoRead partialData='" << partialData << "'.");
+            m_partialData = ProcessData(m_partialData+buf);
         }
     }
     catch(const SocketException & ex) {
         Log(TraceLevel::Info, "SocketException " << ex.what());
     }
-    return true;
-}
-
-void
-DataReader::InterruptPoint() const
-{
-    if (m_stopRead) {
-        throw ReaderInterruptException();
-    }
 }
 
 std::string
@@ -169,39 +219,27 @@ DataReader::ProcessTag(
         return;
     }
 
-    if (m_dataCache) {
-        if (1 != m_dataCache->Erase(tag)) {
-            Log(TraceLevel::Warning, "tag '" << tag << "' is not found in backup cache");
-        }
-    }
+    // A tag without status is a success ack.
+    m_ackCounters[0]->Add();
+    EraseAckedItem(tag);
 }
 
-static std::unordered_map<std::string, std::string> &
-GetAckStatusMap()
-{
-    static std::unordered_map<std::string, std::string> m = 
-    {
-        { "0", "ACK_SUCCESS" },
-        { "1", "ACK_FAILED" },
-        { "2", "ACK_UNKNOWN_SCHEMA_ID" },
-        { "3", "ACK_DECODE_ERROR" },
-        { "4", "ACK_INVALID_SOURCE" },
-        { "5", "ACK_DUPLICATE_SCHEMA_ID" }
-    };
-    return m;
-}
-
-static std::string
-GetAckStatusStr(
-    const std::string & ackCode
+void
+DataReader::EraseAckedItem(
+    const std::string & tag
     )
 {
-    auto m = GetAckStatusMap();
-    auto item = m.find(ackCode);
-    if (item == m.end()) {
-        return "Unknown-ACK-CODE";
+    if (m_dataCache) {
+        uint64_t id = 0;
+        LogItemPtr item;
+        if (!LogItem::ParseTag(tag, id) || 1 != m_dataCache->Erase(id, item)) {
+            Log(TraceLevel::Warning, "tag '" << tag << "' is not found in backup cache");
+        }
+        else if (item) {
+            item->RecordStage(FlightStage::Ack);
+            m_sendToAckHistogram->Record(item->GetLastTouchMicroSeconds());
+        }
     }
-    return item->second;
 }
 
 void
@@ -219,16 +257,45 @@ DataReader::ProcessTag(
         return;
     }
 
-    if ("0" != ackStatus) {
+    m_ackCounters[GetAckCodeIndex(ackStatus)]->Add();
+
+    if ("2" == ackStatus) {
+        ProcessUnknownSchemaId(tag);
+    }
+    else if ("0" != ackStatus) {
         auto statusStr = GetAckStatusStr(ackStatus);
         Log(TraceLevel::Error, "unexpected mdsd ack status: " << statusStr << ", tag '" << tag << "'" );
     }
     else {
         // Only remove item from cache if ack status is 0 (Success)
-        if (m_dataCache) {
-            if (1 != m_dataCache->Erase(tag)) {
-                Log(TraceLevel::Warning, "tag '" << tag << "' is not found in backup cache");
-            }
+        EraseAckedItem(tag);
+    }
+}
+
+void
+DataReader::ProcessUnknownSchemaId(
+    const std::string & tag
+    )
+{
+    uint64_t schemaId = 0;
+    if (m_dataCache) {
+        uint64_t id = 0;
+        auto item = LogItem::ParseTag(tag, id)? m_dataCache->Get(id) : nullptr;
+        if (item) {
+            schemaId = item->GetSchemaId();
+        }
+        else {
+            Log(TraceLevel::Warning, "tag '" << tag << "' is not found in backup cache");
         }
     }
+
+    // If the schema id cannot be found, all schemas are sent again.
+    if (schemaId) {
+        m_socketClient->ResetSchemaId(schemaId);
+    }
+    else {
+        m_socketClient->ResetAllSchemaIds();
+    }
+    Log(TraceLevel::Warning, "mdsd ack status: ACK_UNKNOWN_SCHEMA_ID, tag '" << tag
+        << "', schema id " << schemaId << ". Schema will be resent.");
 }
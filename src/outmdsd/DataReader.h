@@ -5,12 +5,18 @@
 #include <memory>
 #include <atomic>
 #include <string>
+#include <mutex>
+#include <cstdint>
+#include <vector>
 #include "LogItemPtr.h"
 
 namespace EndpointLog {
 
-template<typename T> class ConcurrentMap;
+class InflightRing;
 class SocketClient;
+class WorkerRuntime;
+class Counter;
+class Histogram;
 
 /// This class implements a socket data reader. The data to be read
 /// are expected to be a series of either '<tagstr>\n' or '<tagstr>:<status-id>\n'.
@@ -18,7 +24,8 @@ class SocketClient;
 /// If a shared cache is given, the item whose key equals to <tagstr> will be removed
 /// from dataCache.
 ///
-/// Once started, DataReader will run in an infinite loop until told to stop.
+/// DataReader reads the data in the shared WorkerRuntime reactor thread
+/// whenever the socket is readable (see Start()).
 ///
 class DataReader {
 public:
@@ -26,7 +33,7 @@ public:
     /// <param name="sockClient">socket client</param>
     /// <param name="dataCache">shared cache for backup data. Can be NULL.</param>
     DataReader(const std::shared_ptr<SocketClient> & sockClient,
-        const std::shared_ptr<ConcurrentMap<LogItemPtr>> & dataCache);
+        const std::shared_ptr<InflightRing> & dataCache);
 
     ~DataReader();
 
@@ -37,23 +44,20 @@ public:
     DataReader(DataReader&& other) = default;
     DataReader& operator=(DataReader&& other) = default;
 
-    /// Run the reading process in an infinite loop until told to stop.
-    void Run();
+    /// Read the data in the WorkerRuntime reactor thread. It returns immediately.
+    void Start();
 
-    /// Notify the reader to stop.
+    /// Notify the reader to stop. If Start() was called, wait until
+    /// the reader is not running in the reactor thread.
     void Stop();
 
     /// Get total number of tags read. For testability.
     size_t GetNumTagsRead() const { return m_nTagsRead; }
 
 private:
-    /// Try to read data from the socket. Process the data if any.
-    /// <param name="partialData">To save partial data that are not processed yet</param>
-    /// Return true if valid data (including 0-byte) are read, return false otherwise.
-    bool DoRead(std::string& partialData);
-
-    /// Define interruption point in the loop.
-    void InterruptPoint() const;
+    /// Read and process all the data available in the socket. It is called
+    /// in the reactor thread when the socket is readable.
+    void ReadAvailable();
 
     /// Process data read from the socket.
     /// <param name='str'> data string to be processed </param>
@@ -70,13 +74,29 @@ private:
     void ProcessTag(const std::string & tag);
     void ProcessTag(const std::string & tag, const std::string & ackStatus);
 
+    /// Remove an acknowledged item from the cache, and record its send to ack time.
+    void EraseAckedItem(const std::string & tag);
+
+    /// Handle ack status ACK_UNKNOWN_SCHEMA_ID for an item. The item is kept
+    /// in the cache, and its schema will be sent again with its next resend.
+    void ProcessUnknownSchemaId(const std::string & tag);
+
 private:
     std::shared_ptr<SocketClient> m_socketClient;
-    std::shared_ptr<ConcurrentMap<LogItemPtr>> m_dataCache;
+    std::shared_ptr<InflightRing> m_dataCache;
 
     std::atomic<bool> m_stopRead{false};    /// flag to stop further reading.
 
+    std::shared_ptr<WorkerRuntime> m_runtime; /// set by Start().
+    uint64_t m_handlerId = 0;       /// read handler id in m_runtime.
+    uint64_t m_connHandlerId = 0;   /// connect handler id in m_socketClient.
+    std::string m_partialData;      /// data not processed yet.
+    std::mutex m_startMutex;        /// protect m_runtime and m_handlerId.
+
     std::atomic<size_t> m_nTagsRead{0}; /// number of tags read. for testability.
+
+    std::vector<Counter*> m_ackCounters;   /// ack counter of each status code. The last one is for unknown codes.
+    Histogram* m_sendToAckHistogram = nullptr; /// microseconds from send to ack.
 };
 
 } // namespace
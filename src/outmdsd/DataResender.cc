@@ -1,25 +1,40 @@
 #include <cassert>
+#include <algorithm>
 
-#include "ConcurrentMap.h"
+#include "InflightRing.h"
 #include "DataResender.h"
 #include "SocketClient.h"
 #include "Exceptions.h"
 #include "Trace.h"
 #include "TraceMacros.h"
 #include "LogItem.h"
+#include "WorkerRuntime.h"
+#include "Metrics.h"
+#include "TokenBucket.h"
 
 using namespace EndpointLog;
 
+// Max socket time in microseconds that resending can use at once.
+static constexpr double ResendBurstMicroSeconds = 2000;
+
+// Max number of items resent in one SocketClient::SendBatch().
+static constexpr size_t ResendBatchSize = 64;
+
+// Max milliseconds a resending turn waits for a TCP connect().
+static constexpr unsigned int ResendConnectTimeoutMS = 100;
+
 DataResender::DataResender(
     const std::shared_ptr<SocketClient> & sockClient,
-    const std::shared_ptr<ConcurrentMap<LogItemPtr>> & dataCache,
+    const std::shared_ptr<InflightRing> & dataCache,
     unsigned int ackTimeoutMS,
     unsigned int resendIntervalMS
     ) :
     m_socketClient(sockClient),
     m_dataCache(dataCache),
     m_ackTimeoutMS(ackTimeoutMS),
-    m_resendIntervalMS(resendIntervalMS)
+    m_resendIntervalMS(resendIntervalMS),
+    m_numReplaying(std::make_shared<std::atomic<int64_t>>(0)),
+    m_pacer(new TokenBucket(1000000, ResendBurstMicroSeconds))
 {
     assert(m_socketClient);
     assert(m_dataCache);
@@ -32,6 +47,27 @@ DataResender::DataResender(
         throw std::invalid_argument("DataResender: resend interval must be a positive integer.");
     }
 
+    auto & metrics = m_socketClient->GetMetrics();
+    m_resendCounter = &metrics.GetCounter(MetricNames::ResendCount);
+    m_ackTimeoutDropCounter = &metrics.GetCounter(std::string(MetricNames::DropCountPrefix) + "ack_timeout");
+    m_replayCounter = &metrics.GetCounter(MetricNames::ReplayCount);
+    m_replayItemsCounter = &metrics.GetCounter(MetricNames::ReplayItems);
+    m_replayHistogram = &metrics.GetHistogram(MetricNames::ReplayMicroSeconds);
+    m_paceWaitCounter = &metrics.GetCounter(MetricNames::ResendPaceWaitMicroSeconds);
+
+    auto numReplaying = m_numReplaying;
+    metrics.SetGauge(MetricNames::ReplayActive, [numReplaying] { return numReplaying->load(); });
+
+    auto cache = m_dataCache;
+    metrics.SetGauge(MetricNames::CacheItems, [cache] { return static_cast<int64_t>(cache->Size()); });
+    metrics.SetGauge(MetricNames::CacheBytes, [cache] { return static_cast<int64_t>(cache->GetBytes()); });
+
+    // Replay as soon as a new connection is created. The handler can't send,
+    // so it only starts the next resending turn.
+    m_connHandlerId = m_socketClient->AddConnectHandler([this](int) {
+        m_isReplayTurn = true;
+        ResendNow();
+    });
 }
 
 DataResender::~DataResender()
@@ -67,13 +103,50 @@ DataResender::Run()
     return counter;
 }
 
+void
+DataResender::Start()
+{
+    ADD_INFO_TRACE;
+
+    std::lock_guard<std::mutex> lck(m_timerMutex);
+    if (m_runtime || m_stopMe) {
+        return;
+    }
+    m_runtime = WorkerRuntime::Get();
+    m_timerId = m_runtime->AddTimer(m_resendIntervalMS, [this] { ResendOnce(); });
+}
+
 void
 DataResender::Stop()
 {
     ADD_INFO_TRACE;
 
+    m_socketClient->RemoveConnectHandler(m_connHandlerId);
+
+    std::shared_ptr<WorkerRuntime> runtime;
+    {
+        std::lock_guard<std::mutex> lck(m_timerMutex);
+        m_stopMe = true;
+        m_timerCV.notify_one();
+        runtime = std::move(m_runtime);
+    }
+    // RemoveTimer() waits for a running ResendOnce(), which must not be
+    // done under m_timerMutex, because ResendNow() can be called meanwhile.
+    if (runtime) {
+        runtime->RemoveTimer(m_timerId);
+    }
+}
+
+void
+DataResender::ResendNow()
+{
+    ADD_DEBUG_TRACE;
+
     std::lock_guard<std::mutex> lck(m_timerMutex);
-    m_stopMe = true;
+    if (m_runtime) {
+        m_runtime->TriggerTimer(m_timerId);
+    }
+    m_resendNow = true;
     m_timerCV.notify_one();
 }
 
@@ -83,10 +156,31 @@ DataResender::WaitForNextResend()
     ADD_TRACE_TRACE;
     std::unique_lock<std::mutex> lck(m_timerMutex);
 
-    // Wait for m_resendIntervalMS until it is told to abort by m_stopMe
-    m_timerCV.wait_for(lck, std::chrono::milliseconds(m_resendIntervalMS), [this] {
-        return m_stopMe.load();
+    // Wait for m_resendIntervalMS, or m_paceDelay set by a paced turn, until
+    // it is told to abort by m_stopMe, or to resend by m_resendNow.
+    std::chrono::microseconds waitTime = std::chrono::milliseconds(m_resendIntervalMS);
+    if (m_paceDelay.count() > 0) {
+        waitTime = m_paceDelay;
+        m_paceDelay = std::chrono::microseconds(0);
+    }
+    m_timerCV.wait_for(lck, waitTime, [this] {
+        return m_stopMe.load() || m_resendNow;
     });
+    m_resendNow = false;
+}
+
+void
+DataResender::DelayNextResend(
+    std::chrono::microseconds delay
+    )
+{
+    std::lock_guard<std::mutex> lck(m_timerMutex);
+    if (m_runtime) {
+        m_runtime->DelayTimer(m_timerId, delay);
+    }
+    else {
+        m_paceDelay = delay;
+    }
 }
 
 void
@@ -95,8 +189,31 @@ DataResender::ResendOnce()
     ADD_TRACE_TRACE;
 
     try {
+        // A turn started by a new connection only replays. If a sender has
+        // replayed already, the items must not be resent again.
+        bool isReplayTurn = m_isReplayTurn.exchange(false);
         if (m_dataCache->Size() > 0) {
-            ResendData();
+            // Connect before resending, so that the items are replayed in order
+            // if a new connection is created. The turn runs on a shared worker,
+            // so it only makes one short attempt, and leaves the retries to the
+            // senders. Otherwise a dead endpoint would hold the worker for the
+            // whole connect retry timeout.
+            if (!m_socketClient->TryConnect(ResendConnectTimeoutMS)) {
+                Log(TraceLevel::Trace, "DataResender: not connected. Skip resending.");
+                DropExpiredItems();
+                return;
+            }
+            if (m_socketClient->GetConnectionId() != m_replayedConnId) {
+                ReplayIfReconnected();
+            }
+            else if (!ContinueBacklog() && !isReplayTurn) {
+                ResendData();
+            }
+        }
+        else {
+            // Any backlog left is acked.
+            std::lock_guard<std::mutex> lck(m_replayMutex);
+            FinishBacklogUnlocked();
         }
     }
     catch(const std::exception& ex) {
@@ -104,50 +221,230 @@ DataResender::ResendOnce()
     }
 }
 
+void
+DataResender::DropExpiredItems()
+{
+    // Check whether any cached items need to be dropped
+    // The age check is cheap, so it runs while the cache is locked.
+    auto droppedItems = m_dataCache->EraseIf([this](const LogItemPtr & itemPtr)
+    {
+        return itemPtr && static_cast<unsigned int>(itemPtr->GetLastTouchMilliSeconds()) > m_ackTimeoutMS;
+    });
+    m_ackTimeoutDropCounter->Add(droppedItems.size());
+
+    for (const auto & item : droppedItems) {
+        item->RecordStage(FlightStage::Drop);
+        Log(TraceLevel::Trace, "obsolete key erased: '" << item->GetTag() << "'.");
+    }
+}
+
 void
 DataResender::ResendData()
 {
     ADD_TRACE_TRACE;
 
-    // Check whether any cached items need to be dropped
-    std::function<bool(LogItemPtr)> CheckItemAge = [this](LogItemPtr itemPtr)
-    {
-        if (itemPtr && static_cast<unsigned int>(itemPtr->GetLastTouchMilliSeconds()) > m_ackTimeoutMS) {
-            return true;
-        }
-        return false;
-    };
+    DropExpiredItems();
 
-    // To minimize locking on m_dataCache, copy it first. Then run filter function
-    // on the copied cache.
-    auto cacheBak = *m_dataCache;
-    auto keysToRemove = cacheBak.FilterEach(CheckItemAge);
+    // Copy the items, so that the cache is not locked while sending.
+    // Resend them oldest first.
+    auto items = m_dataCache->GetValues();
 
-    // The Erase() and FilterEach() are not protected together. It is OK that
-    // some key is gone in the data cache when Erase() is called.
-    m_dataCache->Erase(keysToRemove);
+    if (IsPaced()) {
+        std::lock_guard<std::mutex> lck(m_replayMutex);
+        m_backlog = std::move(items);
+        ResendBacklogUnlocked();
+        return;
+    }
 
-    for (const auto & key : keysToRemove) {
-        Log(TraceLevel::Trace, "obsolete key erased: '" << key << "'.");
+    size_t nsent = 0;
+    try {
+        ResendItems(items, nsent);
     }
+    catch(const SocketException & ex) {
+        Log(TraceLevel::Info, "SocketException: " << ex.what());
+    }
+    m_totalSend += nsent;
+    m_resendCounter->Add(nsent);
+    Log(TraceLevel::Trace, "ResendData(): m_totalSend=" << m_totalSend);
+}
 
-    // To minimize locking on m_dataCache, copy it first. Then send data in the
-    // copied cache.
-    auto cacheCopy = *m_dataCache;
+ReplayPolicy
+DataResender::ParseReplayPolicy(
+    const std::string & name
+    )
+{
+    if ("interleave" == name) {
+        return ReplayPolicy::Interleave;
+    }
+    if ("replay_first" == name) {
+        return ReplayPolicy::ReplayFirst;
+    }
+    throw std::invalid_argument("DataResender: unknown replay policy '" + name + "'.");
+}
+
+size_t
+DataResender::ReplayIfReconnected()
+{
+    if (m_socketClient->GetConnectionId() == m_replayedConnId) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lck(m_replayMutex);
+    auto connId = m_socketClient->GetConnectionId();
+    if (connId == m_replayedConnId) {
+        // replayed by another thread meanwhile.
+        return 0;
+    }
+    m_replayedConnId = connId;
+    auto connTime = m_socketClient->GetConnectionTime();
+
+    // The backlog of the old connection is replayed with the other items.
+    FinishBacklogUnlocked();
+
+    // The senders connect before they cache new items, so the items cached
+    // after the connection is created are sent on it, and are not replayed.
+    DropExpiredItems();
+    auto items = m_dataCache->GetValues();
+    items.erase(std::remove_if(items.begin(), items.end(),
+        [connTime](const LogItemPtr & item) { return !item || item->GetLastTouchTime() >= connTime; }),
+        items.end());
+    if (items.empty()) {
+        return 0;
+    }
+
+    ADD_DEBUG_TRACE;
+    m_backlog = std::move(items);
+    m_backlogIsReplay = true;
+    m_backlogStartTime = std::chrono::steady_clock::now();
+    *m_numReplaying = 1;
 
+    // With ReplayFirst, new items wait for the replay, so it isn't paced.
+    if (ReplayPolicy::Interleave == m_replayPolicy && IsPaced()) {
+        return ResendBacklogUnlocked();
+    }
+
+    size_t nsent = 0;
     try {
-        std::function<void(LogItemPtr)> SendItem = [this](LogItemPtr itemPtr)
-        {
-            if (itemPtr) {
-                m_socketClient->Send(itemPtr->GetData());
-                m_totalSend++;
+        ResendItems(m_backlog, nsent);
+    }
+    catch(const SocketException & ex) {
+        Log(TraceLevel::Info, "Replay is aborted by SocketException: " << ex.what());
+    }
+
+    m_totalSend += nsent;
+    m_replayItemsCounter->Add(nsent);
+    m_backlogNumSent = nsent;
+    FinishBacklogUnlocked();
+    return nsent;
+}
+
+void
+DataResender::SetResendShare(
+    unsigned int percent
+    )
+{
+    if (0 == percent || percent > 100) {
+        throw std::invalid_argument("DataResender: resend share must be in [1, 100]. Actual: " +
+            std::to_string(percent));
+    }
+    m_pacer->SetRate(percent * 10000.0, ResendBurstMicroSeconds);
+    m_resendShare = percent;
+}
+
+void
+DataResender::ResendItems(
+    const std::vector<LogItemPtr> & items,
+    size_t & nsent
+    )
+{
+    std::vector<LogItemPtr> batch;
+    batch.reserve(std::min(items.size(), ResendBatchSize));
+    for (size_t i = 0; i < items.size() && !m_stopMe; ) {
+        batch.clear();
+        for (; i < items.size() && batch.size() < ResendBatchSize; i++) {
+            if (items[i]) {
+                items[i]->RecordStage(FlightStage::Resend);
+                batch.push_back(items[i]);
+            }
+        }
+        // Never connect here: the turn runs on a shared worker. It ends at the
+        // first send that isn't connected, and the next turn connects.
+        m_socketClient->SendBatch(batch, false);
+        nsent += batch.size();
+    }
+}
+
+size_t
+DataResender::ResendBacklogUnlocked()
+{
+    size_t nsent = 0;
+    bool isDone = true;
+    try {
+        for (; m_backlogPos < m_backlog.size() && !m_stopMe; m_backlogPos++) {
+            // Don't wait for the pacer here: the turn runs on a shared worker.
+            // The next turn continues from this item when the wait is over.
+            auto waitTime = m_pacer->GetWaitTime();
+            if (waitTime.count() > 0) {
+                m_paceWaitCounter->Add(waitTime.count());
+                DelayNextResend(waitTime);
+                isDone = false;
+                break;
+            }
+
+            // Skip the items acked or dropped since the backlog was created.
+            const auto & item = m_backlog[m_backlogPos];
+            if (!item || !m_dataCache->Get(item->GetId())) {
+                continue;
             }
-        };
 
-        cacheCopy.ForEachUnsafe(SendItem);
-        Log(TraceLevel::Trace, "ResendData(): m_totalSend=" << m_totalSend);
+            auto startTime = std::chrono::steady_clock::now();
+            item->RecordStage(FlightStage::Resend);
+            m_socketClient->Send(item, false);
+            nsent++;
+            m_pacer->Consume((std::chrono::steady_clock::now() - startTime) / std::chrono::nanoseconds(1) / 1000.0);
+        }
     }
     catch(const SocketException & ex) {
-        Log(TraceLevel::Info, "SocketException: " << ex.what());
+        Log(TraceLevel::Info, "Paced resending is aborted by SocketException: " << ex.what());
+    }
+
+    m_backlogNumSent += nsent;
+    m_totalSend += nsent;
+    if (m_backlogIsReplay) {
+        m_replayItemsCounter->Add(nsent);
+    }
+    else {
+        m_resendCounter->Add(nsent);
+    }
+    if (isDone) {
+        FinishBacklogUnlocked();
+    }
+    return nsent;
+}
+
+bool
+DataResender::ContinueBacklog()
+{
+    std::lock_guard<std::mutex> lck(m_replayMutex);
+    if (m_backlog.empty()) {
+        return false;
+    }
+    ResendBacklogUnlocked();
+    return true;
+}
+
+void
+DataResender::FinishBacklogUnlocked()
+{
+    if (m_backlogIsReplay) {
+        *m_numReplaying = 0;
+        m_replayCounter->Add();
+        m_replayHistogram->Record((std::chrono::steady_clock::now() - m_backlogStartTime) / std::chrono::microseconds(1));
+        Log(TraceLevel::Info, "Replayed " << m_backlogNumSent << " of " << m_backlog.size()
+            << " unacked items on connection " << m_replayedConnId << ".");
     }
+    m_backlog = std::vector<LogItemPtr>();
+    m_backlogPos = 0;
+    m_backlogNumSent = 0;
+    m_backlogIsReplay = false;
 }
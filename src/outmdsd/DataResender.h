@@ -6,23 +6,48 @@
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <string>
 
 #include "LogItemPtr.h"
 
 namespace EndpointLog {
 
-template<typename T> class ConcurrentMap;
+class InflightRing;
 class SocketClient;
+class WorkerRuntime;
+class LogItem;
+class Counter;
+class Histogram;
+class TokenBucket;
+
+/// How the unacked items are replayed after a new connection is created.
+enum class ReplayPolicy {
+    Interleave,  // replay from the resender while new items are sent.
+    ReplayFirst  // new items wait until the replay is done.
+};
 
 /// This class will resend data in a shared cache to a socket server
 /// in a multi-thread system, while other threads keep on inserting data to
 /// the same shared cache.
 ///
-/// It will run in a resend-sleep loop until it is told to stop.
+/// It will either run in a resend-sleep loop in its own thread (Run()) until it
+/// is told to stop, or resend from a timer of the shared WorkerRuntime (Start()).
 ///
 /// It reads data and removes obsolete data from the shared cache. It doesn't
 /// add data to the cache.
 ///
+/// Cached data are resent in the order they were added to the cache. When a new
+/// connection is created, all the cached data are replayed oldest first at once,
+/// instead of waiting for the next resend interval (see ReplayIfReconnected()).
+///
+/// Resending can be paced to a share of the socket time (see SetResendShare()),
+/// so that new data sent by other threads are not blocked behind a big backlog.
+/// A paced turn doesn't wait for its share: it stops, and the next turn is
+/// scheduled to continue where it stopped.
+///
 class DataResender {
 public:
     /// Constructor.
@@ -34,7 +59,7 @@ public:
     /// <param name="resendIntervalMS">milliseconds to do resending</param>
     DataResender(
         const std::shared_ptr<SocketClient> & sockClient,
-        const std::shared_ptr<ConcurrentMap<LogItemPtr>> & dataCache,
+        const std::shared_ptr<InflightRing> & dataCache,
         unsigned int ackTimeoutMS,
         unsigned int resendIntervalMS
         );
@@ -54,18 +79,68 @@ public:
     /// </summary>
     size_t Run();
 
+    /// <summary>
+    /// Resend from a WorkerRuntime timer every resend interval, instead of
+    /// in a thread that calls Run(). It returns immediately.
+    /// </summary>
+    void Start();
+
     /// <summary>
     /// Told the resending loop to stop. Typically called in a thread different
-    /// from the one calls Run().
+    /// from the one calls Run(). If Start() was called, wait until the current
+    /// resending turn is done.
     /// </summary>
     void Stop();
 
+    /// <summary>
+    /// Start next resending turn now instead of waiting for the resend interval.
+    /// This is used to flush the cache before shutdown.
+    /// </summary>
+    void ResendNow();
+
     size_t GetTotalSendTimes() const { return m_totalSend; }
 
+    /// Set how the cached data are replayed after a new connection is created.
+    /// Default is ReplayPolicy::Interleave.
+    void SetReplayPolicy(ReplayPolicy policy) { m_replayPolicy = policy; }
+
+    ReplayPolicy GetReplayPolicy() const { return m_replayPolicy; }
+
+    /// Return the replay policy of a name: "interleave" or "replay_first".
+    /// Throw exception if the name is unknown.
+    static ReplayPolicy ParseReplayPolicy(const std::string & name);
+
+    /// <summary>
+    /// Limit resending to 'percent' of the time, measured by how long each resent
+    /// item holds the socket. Between resent items, the socket is left to new data.
+    /// 100 (default) means no limit. With ReplayPolicy::ReplayFirst, the replay
+    /// after a new connection is not limited, because new data wait for it anyway.
+    /// Throw exception if percent is 0 or more than 100.
+    /// </summary>
+    void SetResendShare(unsigned int percent);
+
+    unsigned int GetResendShare() const { return m_resendShare; }
+
+    /// <summary>
+    /// If a new connection was created since the last replay, resend all the
+    /// cached data that were cached before the connection and are not timed out,
+    /// oldest first, without waiting for their acks. If another thread is
+    /// replaying, wait until it is done. A paced replay (see SetResendShare())
+    /// sends only what its share allows now, and the next resending turns
+    /// send the rest.
+    /// With ReplayPolicy::ReplayFirst, the senders call this before sending
+    /// each new item.
+    /// Return number of items replayed.
+    /// </summary>
+    size_t ReplayIfReconnected();
+
 private:
-    /// <summary>Wait for m_resendIntervalMS before next resending turn.</summary>
+    /// <summary>Wait for m_resendIntervalMS, or for the pacing delay, before next resending turn.</summary>
     void WaitForNextResend();
 
+    /// Start the next resending turn after 'delay' instead of the resend interval.
+    void DelayNextResend(std::chrono::microseconds delay);
+
     /// <summary>Resend all valid data and handle exceptions.</summary>
     void ResendOnce();
 
@@ -75,20 +150,72 @@ private:
     /// </summary>
     void ResendData();
 
+    /// Remove the items not acked within m_ackTimeoutMS from the cache.
+    void DropExpiredItems();
+
+    /// Return true if resending is limited to a share of time.
+    bool IsPaced() const { return m_resendShare < 100; }
+
+    /// Resend items in order in batches (see SocketClient::SendBatch()), without
+    /// pacing. 'nsent' is the number of items sent, even if SocketException is thrown.
+    void ResendItems(const std::vector<LogItemPtr> & items, size_t & nsent);
+
+    /// Resend m_backlog with pacing, from where the last turn stopped. When the
+    /// share of time is used up, stop and delay the next turn until it isn't.
+    /// Return the number of items sent. The caller must hold m_replayMutex.
+    size_t ResendBacklogUnlocked();
+
+    /// Continue resending m_backlog. Return false if there is no backlog.
+    bool ContinueBacklog();
+
+    /// Clear m_backlog. If it is a replay, record the replay metrics.
+    /// The caller must hold m_replayMutex.
+    void FinishBacklogUnlocked();
+
 private:
     std::shared_ptr<SocketClient> m_socketClient;
-    std::shared_ptr<ConcurrentMap<LogItemPtr>> m_dataCache;
+    std::shared_ptr<InflightRing> m_dataCache;
 
     unsigned int m_ackTimeoutMS;       // if ack is not received in this time, item is removed from cache.
     unsigned int m_resendIntervalMS;   // cached items resending interval in milliseconds.
 
     std::atomic<bool> m_stopMe { false }; // A flag used to stop resending loop.
+    bool m_resendNow = false; // A flag to start next resending turn immediately. Protected by m_timerMutex.
+    std::atomic<bool> m_isReplayTurn{false}; // next resending turn is started by a new connection.
 
     /// m_timerMutex and m_timerCV are used to create an interruptible blocking wait.
     std::mutex m_timerMutex;
     std::condition_variable m_timerCV;
 
+    std::shared_ptr<WorkerRuntime> m_runtime; // set by Start(). Protected by m_timerMutex.
+    uint64_t m_timerId = 0;                   // resend timer id in m_runtime.
+
     std::atomic<size_t> m_totalSend {0}; // total Send() is called on socket. for testability
+
+    std::atomic<ReplayPolicy> m_replayPolicy{ReplayPolicy::Interleave};
+    std::mutex m_replayMutex;                 // only one thread replays at a time.
+    std::atomic<uint64_t> m_replayedConnId{0}; // id of the last connection replayed on.
+    std::shared_ptr<std::atomic<int64_t>> m_numReplaying; // 1 while replaying. Shared with the metrics gauge.
+    uint64_t m_connHandlerId = 0;             // connect handler id in m_socketClient.
+
+    std::atomic<unsigned int> m_resendShare{100}; // percent of time used by resending.
+    std::unique_ptr<TokenBucket> m_pacer;     // tokens are microseconds of socket time.
+    std::chrono::microseconds m_paceDelay{0}; // delay of the next turn in Run(). Protected by m_timerMutex.
+
+    // The items of a paced resending or replay, which can span several turns.
+    // Protected by m_replayMutex.
+    std::vector<LogItemPtr> m_backlog;
+    size_t m_backlogPos = 0;                  // next item in m_backlog to resend.
+    size_t m_backlogNumSent = 0;              // number of items in m_backlog sent.
+    bool m_backlogIsReplay = false;           // m_backlog is a replay on a new connection.
+    std::chrono::steady_clock::time_point m_backlogStartTime; // when the replay started.
+
+    Counter* m_resendCounter = nullptr;         // number of items resent.
+    Counter* m_ackTimeoutDropCounter = nullptr; // number of items dropped after ack timeout.
+    Counter* m_replayCounter = nullptr;         // number of replays after reconnect.
+    Counter* m_replayItemsCounter = nullptr;    // number of items replayed.
+    Histogram* m_replayHistogram = nullptr;     // microseconds of each replay.
+    Counter* m_paceWaitCounter = nullptr;       // microseconds waited by resend pacing.
 };
 
 } // namespace
@@ -1,28 +1,57 @@
 #include <cassert>
-#include "ConcurrentMap.h"
-#include "ConcurrentQueue.h"
+#include "InflightRing.h"
+#include "FairQueue.h"
 #include "DataSender.h"
 #include "SocketClient.h"
 #include "Exceptions.h"
 #include "Trace.h"
 #include "TraceMacros.h"
 #include "LogItem.h"
+#include "Metrics.h"
+#include "DataResender.h"
+#include "BatchController.h"
 
 using namespace EndpointLog;
 
 class InterruptException {};
 
+constexpr size_t DataSender::DefaultBatchItems;
+constexpr size_t DataSender::DefaultBatchBytes;
+constexpr int64_t DataSender::DefaultLingerMicroSeconds;
+constexpr std::chrono::milliseconds DataSender::AckLatencyUpdatePeriod;
+
 DataSender::DataSender(
     const std::shared_ptr<SocketClient> & sockClient,
-    const std::shared_ptr<ConcurrentMap<LogItemPtr>> & dataCache,
-    const std::shared_ptr<ConcurrentQueue<LogItemPtr>> & incomingQueue
+    const std::shared_ptr<InflightRing> & dataCache,
+    const std::shared_ptr<FairQueue> & incomingQueue
     ) :
     m_socketClient(sockClient),
     m_dataCache(dataCache),
-    m_incomingQueue(incomingQueue)
+    m_incomingQueue(incomingQueue),
+    m_batchController(std::make_shared<BatchController>(DefaultBatchItems, DefaultBatchBytes,
+                      std::chrono::microseconds(DefaultLingerMicroSeconds)))
 {
     assert(m_socketClient);
     assert(m_incomingQueue);
+
+    auto & metrics = m_socketClient->GetMetrics();
+    m_enqueueToSendHistogram = &metrics.GetHistogram(MetricNames::EnqueueToSendMicroSeconds);
+    m_sendErrorDropCounter = &metrics.GetCounter(std::string(MetricNames::DropCountPrefix) + "send_error");
+
+    m_batchItemsHistogram = &metrics.GetHistogram(MetricNames::SenderBatchItems);
+    m_batchSendHistogram = &metrics.GetHistogram(MetricNames::SenderBatchSendMicroSeconds);
+    m_sendToAckHistogram = &metrics.GetHistogram(MetricNames::SendToAckMicroSeconds);
+
+    auto controller = m_batchController;
+    metrics.SetGauge(MetricNames::SenderBatchItemsLimit, [controller] {
+        return static_cast<int64_t>(controller->GetBatchItems());
+    });
+    metrics.SetGauge(MetricNames::SenderBatchBytesLimit, [controller] {
+        return static_cast<int64_t>(controller->GetBatchBytes());
+    });
+    metrics.SetGauge(MetricNames::SenderLingerMicroSeconds, [controller] {
+        return static_cast<int64_t>(controller->GetLinger().count());
+    });
 }
 
 DataSender::~DataSender()
@@ -52,43 +81,66 @@ DataSender::InterruptPoint() const
     }
 }
 
+void
+DataSender::SetBatchLimits(
+    size_t maxItems,
+    size_t maxBytes,
+    std::chrono::microseconds maxLinger
+    )
+{
+    m_batchController->SetLimits(maxItems, maxBytes, maxLinger);
+}
+
 void
 DataSender::Run()
 {
     try {
         ADD_INFO_TRACE;
 
+        std::vector<LogItemPtr> items;
         while(!m_stopSender) {
-            LogItemPtr item;
-            m_incomingQueue->wait_and_pop(item);
+            items.clear();
+            auto nbytes = m_incomingQueue->WaitAndPopBatch(items, m_batchController->GetBatchItems(),
+                m_batchController->GetBatchBytes(), m_batchController->GetLinger());
 
-            // When ConcurrentQueue is empty and stopped, wait_and_pop() do nothing,
-            // so item is still pointing to nullptr
-            if (!item) {
-                assert(0 == m_incomingQueue->size());
+            // When FairQueue is empty and stopped, WaitAndPopBatch() returns no item.
+            if (items.empty()) {
+                assert(0 == m_incomingQueue->Size());
                 Log(TraceLevel::Info, "Abort Run() because data queue is aborted.");
                 break;
             }
 
             InterruptPoint();
-
-            if (!m_dataCache) {
-                // If no caching, send it out immediately
-                Send(item->GetData());
+            for (const auto & item : items) {
+                item->RecordStage(FlightStage::Dequeue);
+                // The item is not touched until now, so this is the time since it is created.
+                m_enqueueToSendHistogram->Record(item->GetLastTouchMicroSeconds());
             }
-            else {
-                // Move item to cache first before sending it out.
-                // This makes sure that the cache has the tag in the thread
+
+            if (m_dataCache) {
+                // Connect before the items are cached, so that they aren't replayed
+                // on a new connection.
+                ConnectAndReplay();
+
+                // Add items to cache first before sending them out.
+                // This makes sure that the cache has the tags in the thread
                 // where response is received and handled.
-                item->Touch();
-                auto tag = item->GetTag();
-                m_dataCache->Add(tag, std::move(item));
-
-                auto dataItem = m_dataCache->Get(tag);
-                if (dataItem) {
-                    InterruptPoint();
-                    Send(m_dataCache->Get(tag)->GetData());
+                for (const auto & item : items) {
+                    item->Touch();
+                    m_dataCache->Add(item);
                 }
+                InterruptPoint();
+            }
+            auto startTime = std::chrono::steady_clock::now();
+            Send(items);
+            auto sendTime = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - startTime);
+
+            m_batchItemsHistogram->Record(items.size());
+            m_batchSendHistogram->Record(sendTime.count());
+            m_batchController->OnBatchSent(items.size(), nbytes, m_incomingQueue->Size(), sendTime);
+            if (m_dataCache) {
+                UpdateAckLatency();
             }
 
             InterruptPoint();
@@ -106,16 +158,67 @@ DataSender::Run()
 // Because DataResender can keep on resending the failed data until timed out,
 // it shouldn't abort further DataSender::Run(), and also log this as an information.
 void
-DataSender::Send(const char* data)
+DataSender::Send(
+    const std::vector<LogItemPtr> & items
+    )
 {
     ADD_TRACE_TRACE;
     try {
-        m_numSend++;
-        m_socketClient->Send(data);
-        m_numSuccess++;
+        m_numSend += items.size();
+        // Cached items are sent on the connection made before they are cached.
+        // If there is none, they are replayed on the next one, so don't reconnect:
+        // the send fails at once, and the resender sends them once connected.
+        bool mayConnect = !m_dataCache;
+        if (1 == items.size()) {
+            m_socketClient->Send(items.front(), mayConnect);
+        }
+        else {
+            m_socketClient->SendBatch(items, mayConnect);
+        }
+        m_numSuccess += items.size();
         Log(TraceLevel::Trace, "m_numSend=" << m_numSend << "; m_numSuccess=" << m_numSuccess);
     }
     catch(const SocketException & ex) {
         Log(TraceLevel::Info, "DataSender Send() SocketException: " << ex.what());
+        if (!m_dataCache) {
+            // Without cache, the items are never resent.
+            m_sendErrorDropCounter->Add(items.size());
+        }
+    }
+}
+
+void
+DataSender::UpdateAckLatency()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_lastAckUpdate < AckLatencyUpdatePeriod) {
+        return;
+    }
+    m_lastAckUpdate = now;
+
+    // The histogram is cumulative, so the mean of the recent acks is the
+    // difference from the last snapshot.
+    auto snapshot = m_sendToAckHistogram->GetSnapshot();
+    if (snapshot.count > m_lastAckCount) {
+        auto meanUS = (snapshot.sum - m_lastAckSum) / (snapshot.count - m_lastAckCount);
+        m_batchController->OnAckLatency(std::chrono::microseconds(meanUS));
+    }
+    m_lastAckCount = snapshot.count;
+    m_lastAckSum = snapshot.sum;
+}
+
+void
+DataSender::ConnectAndReplay()
+{
+    m_socketClient->Connect();
+    if (!m_socketClient->IsConnected() || !m_resender ||
+        ReplayPolicy::ReplayFirst != m_resender->GetReplayPolicy()) {
+        return;
+    }
+    try {
+        m_resender->ReplayIfReconnected();
+    }
+    catch(const SocketException & ex) {
+        Log(TraceLevel::Info, "DataSender replay SocketException: " << ex.what());
     }
 }
@@ -4,22 +4,31 @@
 
 #include <memory>
 #include <atomic>
+#include <vector>
+#include <chrono>
 
 #include "LogItemPtr.h"
 
 namespace EndpointLog {
 
-template<typename T> class ConcurrentQueue;
-template<typename T> class ConcurrentMap;
+class InflightRing;
+class FairQueue;
 class SocketClient;
+class LogItem;
+class DataResender;
+class Counter;
+class Histogram;
+class BatchController;
 
 /// This class will keep on sending incoming data in a shared queue to a
 /// socket server in a multi-thread system. Other threads will keep on
 /// pushing new data to the same shared queue (see BufferedLogger class).
 ///
-/// DataSender will run in an infinite loop to pop and send each item
+/// DataSender will run in an infinite loop to pop and send items
 /// from the shared queue to socket server. If no item to pop, it will
-/// wait until there is item in the queue. 
+/// wait until there is item in the queue. Items are popped and sent in
+/// batches whose size adapts to the load (see BatchController class):
+/// a single item when traffic is light, more items under load.
 ///
 /// To avoid message loss, each item can be optionally saved to a cache for
 /// future resend (see DataResender class).
@@ -32,11 +41,12 @@ public:
     /// <param name="dataCache"> cache for data backup if not NULL. If NULL, no backup</param>
     /// <param name="incomingQueue"> data to be sent. DataSender will pop each item in the queue
     /// and send it to socket server. If no data to pop, it will wait until there is data to pop.
+    /// The queue decides which source's item is popped next (see FairQueue class).
     /// </param>
     DataSender(
         const std::shared_ptr<SocketClient> & sockClient,
-        const std::shared_ptr<ConcurrentMap<LogItemPtr>> & dataCache,
-        const std::shared_ptr<ConcurrentQueue<LogItemPtr>> & incomingQueue
+        const std::shared_ptr<InflightRing> & dataCache,
+        const std::shared_ptr<FairQueue> & incomingQueue
         );
 
     ~DataSender();
@@ -67,23 +77,61 @@ public:
     /// Return total number of successful send.
     size_t GetNumSuccess() const { return m_numSuccess; }
 
+    /// Set the resender of the cached data. If its policy is ReplayPolicy::ReplayFirst,
+    /// the cached data are replayed before any new item is sent on a new connection.
+    /// The resender must outlive the sender.
+    void SetResender(DataResender* resender) { m_resender = resender; }
+
+    /// Set the limits of the adaptive batches. See BatchController.
+    /// maxItems of 1 sends each item alone. Throw exception if any limit is 0.
+    void SetBatchLimits(size_t maxItems, size_t maxBytes, std::chrono::microseconds maxLinger);
+
+    /// Default batch limits.
+    constexpr static size_t DefaultBatchItems = 64;
+    constexpr static size_t DefaultBatchBytes = 256 * 1024;
+    constexpr static int64_t DefaultLingerMicroSeconds = 2000;
+
 private:
     /// Define interruption point for Run() loop.
     void InterruptPoint() const;
 
-    /// Send a data string. It will send all chars until it hits terminal NUL.
-    /// NUL is not sent.
-    void Send(const char* data);
+    /// Send log items in one batch. Socket errors are logged and ignored.
+    void Send(const std::vector<LogItemPtr> & items);
+
+    /// Pass the mean ack latency since last update to the batch controller,
+    /// at most once per AckLatencyUpdatePeriod.
+    void UpdateAckLatency();
+
+    /// Connect before the items are cached, so that they are sent on this
+    /// connection and are not replayed on it. If the resender's policy is
+    /// ReplayPolicy::ReplayFirst, replay the cached data on a new connection.
+    /// Replay errors are logged and ignored. If the connection fails, the
+    /// items are sent by the resender once connected.
+    void ConnectAndReplay();
 
 private:
     std::shared_ptr<SocketClient> m_socketClient;
-    std::shared_ptr<ConcurrentMap<LogItemPtr>> m_dataCache; // for data backup
-    std::shared_ptr<ConcurrentQueue<LogItemPtr>> m_incomingQueue;  // incoming data queue
+    std::shared_ptr<InflightRing> m_dataCache; // for data backup
+    std::shared_ptr<FairQueue> m_incomingQueue;  // incoming data queue
+    DataResender* m_resender = nullptr;          // resender of the cached data, if any.
 
     std::atomic<bool> m_stopSender{false}; // a flag to notify sender loop to stop.
 
-    size_t m_numSend = 0; // number of items trying to be sent. This includes fails and successes.
-    size_t m_numSuccess = 0; // number of success send.
+    std::atomic<size_t> m_numSend{0}; // number of items trying to be sent. This includes fails and successes.
+    std::atomic<size_t> m_numSuccess{0}; // number of success send.
+
+    Histogram* m_enqueueToSendHistogram = nullptr; // microseconds from item creation to send.
+    Counter* m_sendErrorDropCounter = nullptr;     // items lost because send failed and there is no cache.
+
+    std::shared_ptr<BatchController> m_batchController; // shared with the metrics gauges.
+    Histogram* m_batchItemsHistogram = nullptr;    // items in each batch.
+    Histogram* m_batchSendHistogram = nullptr;     // microseconds to send each batch.
+
+    constexpr static std::chrono::milliseconds AckLatencyUpdatePeriod{100};
+    Histogram* m_sendToAckHistogram = nullptr;
+    uint64_t m_lastAckCount = 0;
+    uint64_t m_lastAckSum = 0;
+    std::chrono::steady_clock::time_point m_lastAckUpdate;
 };
 
 } // namespace
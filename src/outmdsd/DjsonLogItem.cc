@@ -2,6 +2,7 @@
 
 #include "DjsonLogItem.h"
 #include "IdMgr.h"
+#include "DataFrame.h"
 
 using namespace EndpointLog;
 
@@ -18,6 +19,44 @@ DjsonLogItem::GetData()
     return m_djsonData.c_str();
 }
 
+uint64_t
+DjsonLogItem::GetSchemaId()
+{
+    if (!m_isSchemaParsed) {
+        if (m_schemaAndData.empty()) {
+            ComposeSchemaAndData();
+        }
+        else {
+            ParseSchemaAndData();
+        }
+    }
+    return m_schemaId;
+}
+
+const char*
+DjsonLogItem::GetDataNoSchema()
+{
+    if (0 == GetSchemaId()) {
+        return GetData();
+    }
+
+    if (m_djsonDataNoSchema.empty()) {
+        auto schemaIdStr = std::to_string(m_schemaId) + ",";
+        m_djsonDataNoSchema = ComposeDjson(schemaIdStr, m_schemaAndData.c_str() + m_dataPos,
+                                           m_schemaAndData.size() - m_dataPos);
+    }
+    return m_djsonDataNoSchema.c_str();
+}
+
+size_t
+DjsonLogItem::GetSizeHint()
+{
+    if (m_schemaAndData.empty()) {
+        ComposeSchemaAndData();
+    }
+    return m_source.size() + m_schemaAndData.size();
+}
+
 IdMgr&
 DjsonLogItem::GetIdMgr()
 {
@@ -31,6 +70,7 @@ DjsonLogItem::ComposeSchemaAndData()
     std::ostringstream strm;
 
     ComposeSchema(strm);
+    m_dataPos = static_cast<size_t>(strm.tellp());
     ComposeDataValue(strm);
 
     // free m_svlist capacity
@@ -38,6 +78,7 @@ DjsonLogItem::ComposeSchemaAndData()
     tmpv.swap(m_svlist);
 
     m_schemaAndData = strm.str();
+    m_isSchemaParsed = true;
 }
 
 void
@@ -51,12 +92,13 @@ DjsonLogItem::ComposeSchema(
     // but in different order will be treated different schemas.
     auto key = GetSchemaCacheKey();
     if (GetIdMgr().GetItem(key, cachedInfo)) {
+        m_schemaId = cachedInfo.first;
         strm << cachedInfo.first << "," << cachedInfo.second;
     }
     else {
         auto schemaArray = ComposeSchemaArray();
-        auto schemaId = GetIdMgr().FindOrInsert(key, schemaArray);
-        strm << schemaId << "," << schemaArray;
+        m_schemaId = GetIdMgr().FindOrInsert(key, schemaArray);
+        strm << m_schemaId << "," << schemaArray;
     }
 }
 
@@ -76,7 +118,7 @@ DjsonLogItem::ComposeSchemaArray() const
     std::ostringstream strm;
     strm << "[";
     for (size_t i = 0; i < m_svlist.size();  i++) {
-        strm << "[\"" << m_svlist[i].name << "\",\"" << m_svlist[i].type << "\"]";
+        strm << "[" << JsonString::Quote(m_svlist[i].name) << ",\"" << m_svlist[i].type << "\"]";
         if (i != (m_svlist.size()-1)) {
             strm << ",";
         }
@@ -102,12 +144,189 @@ DjsonLogItem::ComposeDataValue(
 
 void
 DjsonLogItem::ComposeFullData()
+{
+    m_djsonData = ComposeDjson(m_schemaAndData, nullptr, 0);
+}
+
+std::string
+DjsonLogItem::ComposeDjsonHeader(
+    size_t payloadLen
+    ) const
 {
     auto tag = GetTag();
-    size_t len = 2 + m_source.size() + 2 + tag.size() + 1 + m_schemaAndData.size() + 1;
+    size_t len = 2 + m_source.size() + 2 + tag.size() + 1 + payloadLen + 1;
     auto lenstr = std::to_string(len);
 
-    m_djsonData.reserve(len + lenstr.size() + 1);
-    m_djsonData = lenstr;
-    m_djsonData.append("\n[\"").append(m_source).append("\",").append(tag).append(",").append(m_schemaAndData).append("]");
+    std::string result;
+    result.reserve(lenstr.size() + 1 + len - payloadLen - 1);
+    result = lenstr;
+    result.append("\n[\"").append(m_source).append("\",").append(tag).append(",");
+    return result;
+}
+
+std::string
+DjsonLogItem::ComposeDjson(
+    const std::string & payload1,
+    const char* payload2,
+    size_t len2
+    ) const
+{
+    auto header = ComposeDjsonHeader(payload1.size() + len2);
+
+    std::string result;
+    result.reserve(header.size() + payload1.size() + len2 + 1);
+    result = std::move(header);
+    result.append(payload1);
+    if (len2) {
+        result.append(payload2, len2);
+    }
+    result.append("]");
+    return result;
+}
+
+void
+DjsonLogItem::GetFrame(
+    DataFrame & frame
+    )
+{
+    frame.Add(GetFrameHeader());
+    frame.Add(m_schemaAndData);
+    frame.Add("]", 1);
+}
+
+void
+DjsonLogItem::GetFrameNoSchema(
+    DataFrame & frame
+    )
+{
+    if (0 == GetSchemaId()) {
+        GetFrame(frame);
+        return;
+    }
+
+    frame.Add(GetFrameHeaderNoSchema());
+    frame.Add(m_schemaAndData.data() + m_dataPos, m_schemaAndData.size() - m_dataPos);
+    frame.Add("]", 1);
+}
+
+void
+DjsonLogItem::Encode()
+{
+    GetFrameHeader();
+    if (GetSchemaId()) {
+        GetFrameHeaderNoSchema();
+    }
+}
+
+const std::string &
+DjsonLogItem::GetFrameHeader()
+{
+    if (m_schemaAndData.empty()) {
+        ComposeSchemaAndData();
+    }
+    if (m_frameHeader.empty()) {
+        m_frameHeader = ComposeDjsonHeader(m_schemaAndData.size());
+    }
+    return m_frameHeader;
+}
+
+const std::string &
+DjsonLogItem::GetFrameHeaderNoSchema()
+{
+    if (m_frameHeaderNoSchema.empty()) {
+        auto schemaIdStr = std::to_string(m_schemaId) + ",";
+        auto dataLen = m_schemaAndData.size() - m_dataPos;
+        m_frameHeaderNoSchema = ComposeDjsonHeader(schemaIdStr.size() + dataLen) + schemaIdStr;
+    }
+    return m_frameHeaderNoSchema;
+}
+
+// Find the end of a JSON array starting at 'startPos'.
+// Return the position after the closing ']', or std::string::npos if not found.
+static size_t
+FindArrayEnd(
+    const std::string & str,
+    size_t startPos
+    )
+{
+    int depth = 0;
+    bool inString = false;
+
+    for (size_t i = startPos; i < str.size(); i++) {
+        auto c = str[i];
+        if (inString) {
+            if ('\\' == c) {
+                i++;
+            }
+            else if ('"' == c) {
+                inString = false;
+            }
+        }
+        else if ('"' == c) {
+            inString = true;
+        }
+        else if ('[' == c) {
+            depth++;
+        }
+        else if (']' == c) {
+            if (0 == --depth) {
+                return i+1;
+            }
+        }
+    }
+    return std::string::npos;
+}
+
+bool
+DjsonLogItem::SplitSchemaAndData(
+    const std::string & schemaAndData,
+    uint64_t & schemaId,
+    size_t & schemaPos,
+    size_t & dataPos
+    )
+{
+    auto commaPos = schemaAndData.find(',');
+    if (std::string::npos == commaPos || 0 == commaPos) {
+        return false;
+    }
+
+    uint64_t id = 0;
+    for (size_t i = 0; i < commaPos; i++) {
+        auto c = schemaAndData[i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        id = id * 10 + (c - '0');
+    }
+
+    auto arrayPos = commaPos + 1;
+    if (arrayPos >= schemaAndData.size() || '[' != schemaAndData[arrayPos]) {
+        return false;
+    }
+
+    auto schemaEnd = FindArrayEnd(schemaAndData, arrayPos);
+    if (std::string::npos == schemaEnd || (schemaEnd+1) >= schemaAndData.size() ||
+        ',' != schemaAndData[schemaEnd] || '[' != schemaAndData[schemaEnd+1]) {
+        return false;
+    }
+
+    schemaId = id;
+    schemaPos = arrayPos;
+    dataPos = schemaEnd + 1;
+    return true;
+}
+
+// If m_schemaAndData doesn't match the expected format, m_schemaId is left
+// to be 0 so that the item is always sent with its full data.
+void
+DjsonLogItem::ParseSchemaAndData()
+{
+    m_isSchemaParsed = true;
+
+    uint64_t schemaId = 0;
+    size_t schemaPos = 0, dataPos = 0;
+    if (SplitSchemaAndData(m_schemaAndData, schemaId, schemaPos, dataPos)) {
+        m_schemaId = schemaId;
+        m_dataPos = dataPos;
+    }
 }
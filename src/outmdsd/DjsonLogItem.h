@@ -7,6 +7,7 @@
 #include <sstream>
 #include <vector>
 #include "LogItem.h"
+#include "JsonString.h"
 
 namespace EndpointLog {
 
@@ -28,6 +29,11 @@ class IdMgr;
 // 110
 // ["syslog",53,3,[["timestamp","FT_TIME"],["message","FT_STRING"]],[[1475129808,541868180],"This is a message"]]
 //
+// Once a schema is sent on a connection, later items with the same schema
+// can omit the schema array and only refer to the schema id. Example:
+// 59
+// ["syslog",54,3,[[1475129810,128634270],"Another message"]]
+//
 class DjsonLogItem : public LogItem
 {
 private:
@@ -77,6 +83,44 @@ public:
     // Return full DJSON-formatted string
     const char* GetData() override;
 
+    // Return schema id, or 0 if the schema id cannot be found in the item.
+    uint64_t GetSchemaId() override;
+
+    // Return DJSON-formatted string without schema array
+    const char* GetDataNoSchema() override;
+
+    // Add the DJSON frame header, the schema and data, and the closing
+    // bracket as separate segments, without composing the full DJSON string.
+    void GetFrame(DataFrame & frame) override;
+
+    // Same as GetFrame() except that the schema array is not included.
+    void GetFrameNoSchema(DataFrame & frame) override;
+
+    // Compose the schema and data, find the schema id, and compose the frame
+    // headers, so that GetFrame() and GetFrameNoSchema() only add segments.
+    void Encode() override;
+
+    const std::string & GetSourceName() const override { return m_source; }
+
+    // Return the string of schema id, schema array and data array.
+    const std::string & GetSchemaAndData()
+    {
+        if (m_schemaAndData.empty()) {
+            ComposeSchemaAndData();
+        }
+        return m_schemaAndData;
+    }
+
+    // Return size of the source and the schema and data, without composing
+    // the full DJSON string.
+    size_t GetSizeHint() override;
+
+    // Find schema id, and where the schema array and data array start in a
+    // string of '<schemaId>,[<schema>],[<data>]'.
+    // Return false if the string doesn't match this format.
+    static bool SplitSchemaAndData(const std::string & schemaAndData, uint64_t & schemaId,
+                                   size_t & schemaPos, size_t & dataPos);
+
     void AddData(std::string name, bool value)
     {
         m_svlist.emplace_back(std::move(name), "FT_BOOL", value? "true" : "false");
@@ -120,17 +164,31 @@ public:
         AddData(name, std::string(value));
     }
 
+    // The value is escaped as a JSON string (see JsonString).
     void AddData(std::string name, std::string value)
     {
-        std::string tmpstr;
-        tmpstr.reserve(2 + value.size());
-        tmpstr.append(1, '"').append(value).append(1, '"');
-        m_svlist.emplace_back(std::move(name), "FT_STRING", std::move(tmpstr));
+        m_svlist.emplace_back(std::move(name), "FT_STRING", JsonString::Quote(value));
     }
 
-private:
+protected:
+    /// Construct a new object whose schema and data are already composed.
+    /// schemaId: schema id at the beginning of schemaAndData.
+    /// dataPos: position of the data array in schemaAndData.
+    DjsonLogItem(std::string source, std::string schemaAndData, uint64_t schemaId, size_t dataPos)
+        : LogItem(),
+        m_source(std::move(source)),
+        m_schemaAndData(std::move(schemaAndData)),
+        m_isSchemaParsed(true),
+        m_schemaId(schemaId),
+        m_dataPos(dataPos)
+    {
+    }
+
+    /// Return the schema cache shared by all DJSON items. Items with the same
+    /// field names and types use the same schema id.
     static IdMgr& GetIdMgr();
 
+private:
     void ComposeSchemaAndData();
 
     void ComposeSchema(std::ostringstream& strm);
@@ -140,11 +198,35 @@ private:
 
     void ComposeFullData();
 
+    // Find schema id and where data array starts in m_schemaAndData.
+    void ParseSchemaAndData();
+
+    // Return the DJSON header before m_schemaAndData. Compose it if needed.
+    const std::string & GetFrameHeader();
+
+    // Return the DJSON header and schema id before the data array. Compose it
+    // if needed. The schema id must be valid.
+    const std::string & GetFrameHeaderNoSchema();
+
+    // Compose DJSON string whose payload is 'payload1' followed by 'len2' bytes of 'payload2'.
+    std::string ComposeDjson(const std::string & payload1, const char* payload2, size_t len2) const;
+
+    // Compose the DJSON string before a payload of 'payloadLen' bytes,
+    // i.e. 'len\n["source",tag,'. The payload must be followed by ']'.
+    std::string ComposeDjsonHeader(size_t payloadLen) const;
+
 private:
     std::string m_source;
     std::string m_schemaAndData;
     std::vector<ItemInfo> m_svlist; // contain schema and value info
     std::string m_djsonData;
+    std::string m_djsonDataNoSchema;
+    std::string m_frameHeader;         // DJSON header before m_schemaAndData.
+    std::string m_frameHeaderNoSchema; // DJSON header and schema id before the data array.
+
+    bool m_isSchemaParsed = false; // true if m_schemaId and m_dataPos are set.
+    uint64_t m_schemaId = 0;       // 0 means no valid schema id is found.
+    size_t m_dataPos = 0;          // position of data array in m_schemaAndData.
 };
 
 } // namespace
@@ -0,0 +1,193 @@
+#pragma once
+#ifndef __ENDPOINTLOG_DJSONRECORD_H__
+#define __ENDPOINTLOG_DJSONRECORD_H__
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+#include "DjsonLogItem.h"
+#include "IdMgr.h"
+#include "JsonString.h"
+
+namespace EndpointLog {
+
+/// Value of a FT_TIME field.
+struct DjsonTime
+{
+    DjsonTime(uint64_t s = 0, uint32_t ns = 0) : seconds(s), nanoseconds(ns) {}
+
+    uint64_t seconds;
+    uint32_t nanoseconds;
+};
+
+/// DjsonFieldTraits<T> defines the DJSON type name of a C++ value type, and
+/// how to write a value of the type. The types and value formats are the same
+/// as DjsonLogItem::AddData().
+template<typename T> struct DjsonFieldTraits;
+
+template<> struct DjsonFieldTraits<bool>
+{
+    static const char* TypeName() { return "FT_BOOL"; }
+    static void Append(std::string & out, bool value) { out.append(value? "true" : "false"); }
+};
+
+template<> struct DjsonFieldTraits<int32_t>
+{
+    static const char* TypeName() { return "FT_INT32"; }
+    static void Append(std::string & out, int32_t value) { out.append(std::to_string(value)); }
+};
+
+template<> struct DjsonFieldTraits<uint32_t>
+{
+    static const char* TypeName() { return "FT_INT64"; }
+    static void Append(std::string & out, uint32_t value) { out.append(std::to_string(value)); }
+};
+
+template<> struct DjsonFieldTraits<int64_t>
+{
+    static const char* TypeName() { return "FT_INT64"; }
+    static void Append(std::string & out, int64_t value) { out.append(std::to_string(value)); }
+};
+
+template<> struct DjsonFieldTraits<double>
+{
+    static const char* TypeName() { return "FT_DOUBLE"; }
+    static void Append(std::string & out, double value)
+    {
+        // "%g" is the default format of std::ostream used by DjsonLogItem.
+        char buf[32];
+        auto len = snprintf(buf, sizeof(buf), "%g", value);
+        out.append(buf, len);
+    }
+};
+
+template<> struct DjsonFieldTraits<DjsonTime>
+{
+    static const char* TypeName() { return "FT_TIME"; }
+    static void Append(std::string & out, const DjsonTime & value)
+    {
+        out.append("[").append(std::to_string(value.seconds)).append(",");
+        out.append(std::to_string(value.nanoseconds)).append("]");
+    }
+};
+
+template<> struct DjsonFieldTraits<std::string>
+{
+    static const char* TypeName() { return "FT_STRING"; }
+    static void Append(std::string & out, const std::string & value)
+    {
+        JsonString::Append(out, value.data(), value.size());
+    }
+};
+
+/// Define a field type for DjsonRecord.
+/// For example, DJSON_FIELD(EventIdField, "EventId", int32_t) defines a field
+/// named "EventId" whose value type is int32_t.
+#define DJSON_FIELD(fieldType, fieldName, valueType) \
+    struct fieldType { \
+        using type = valueType; \
+        static const char* Name() { return fieldName; } \
+    }
+
+/// This class is a DJSON item whose fields are known at compile time.
+///
+/// Unlike DjsonLogItem, which composes the schema array and looks up its
+/// schema id for each item, the schema of a DjsonRecord type is composed
+/// once at first use. Each record only writes its values after the cached
+/// schema. The schema id is the same as a DjsonLogItem with the same fields.
+///
+/// Example:
+///   DJSON_FIELD(NameField, "name", std::string);
+///   DJSON_FIELD(CountField, "count", int64_t);
+///   using CountRecord = DjsonRecord<NameField, CountField>;
+///   auto item = MakeLogItem<CountRecord>("source", "eth0", 12);
+///
+template<typename... Fields>
+class DjsonRecord : public DjsonLogItem
+{
+public:
+    /// Construct a new object.
+    /// source: source of the DJSON item
+    /// values: value of each field, in the same order as Fields.
+    DjsonRecord(std::string source, const typename Fields::type &... values)
+        : DjsonLogItem(std::move(source), ComposeSchemaAndData(values...),
+                       GetSchema().id, GetSchema().prefix.size())
+    {
+    }
+
+    /// Return the string of schema id and schema array shared by all the
+    /// records of this type, e.g. '3,[["name","FT_STRING"]],'.
+    static const std::string & GetSchemaPrefix() { return GetSchema().prefix; }
+
+private:
+    struct Schema
+    {
+        uint64_t id;
+        std::string prefix; // schema id, schema array, and the commas after them.
+    };
+
+    static const Schema & GetSchema()
+    {
+        static const Schema schema = CreateSchema();
+        return schema;
+    }
+
+    static Schema CreateSchema()
+    {
+        std::string key;
+        std::string schemaArray = "[";
+        bool isFirst = true;
+        int expand[] = { 0, (AddField<Fields>(key, schemaArray, isFirst), 0)... };
+        (void)expand;
+        schemaArray.append("],");
+
+        Schema schema;
+        schema.id = GetIdMgr().FindOrInsert(key, schemaArray);
+        schema.prefix = std::to_string(schema.id) + "," + schemaArray;
+        return schema;
+    }
+
+    template<typename Field>
+    static void AddField(std::string & key, std::string & schemaArray, bool & isFirst)
+    {
+        using Traits = DjsonFieldTraits<typename Field::type>;
+        key.append(Field::Name()).append(Traits::TypeName());
+
+        if (!isFirst) {
+            schemaArray.append(",");
+        }
+        isFirst = false;
+        schemaArray.append("[").append(JsonString::Quote(Field::Name()));
+        schemaArray.append(",\"").append(Traits::TypeName()).append("\"]");
+    }
+
+    static std::string ComposeSchemaAndData(const typename Fields::type &... values)
+    {
+        const auto & prefix = GetSchema().prefix;
+        std::string result;
+        result.reserve(prefix.size() + 2 + 24 * sizeof...(Fields));
+        result.append(prefix).append("[");
+
+        bool isFirst = true;
+        int expand[] = { 0, (AddValue<typename Fields::type>(result, values, isFirst), 0)... };
+        (void)expand;
+
+        result.append("]");
+        return result;
+    }
+
+    template<typename T>
+    static void AddValue(std::string & out, const T & value, bool & isFirst)
+    {
+        if (!isFirst) {
+            out.append(",");
+        }
+        isFirst = false;
+        DjsonFieldTraits<T>::Append(out, value);
+    }
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_DJSONRECORD_H__
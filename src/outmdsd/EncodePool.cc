@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "EncodePool.h"
+#include "LogItem.h"
+#include "Trace.h"
+#include "TraceMacros.h"
+
+using namespace EndpointLog;
+
+constexpr size_t EncodePool::DefaultMaxPending;
+
+EncodePool::EncodePool(
+    size_t nthreads,
+    HandOffFunc handOff,
+    size_t maxPending
+    ) :
+    m_numThreads(nthreads),
+    m_handOff(std::move(handOff)),
+    m_maxPending(maxPending)
+{
+    if (0 == nthreads) {
+        throw std::invalid_argument("EncodePool: number of threads must be positive.");
+    }
+    if (0 == maxPending) {
+        throw std::invalid_argument("EncodePool: max pending items must be positive.");
+    }
+    if (!m_handOff) {
+        throw std::invalid_argument("EncodePool: unexpected empty hand-off function.");
+    }
+
+    for (size_t i = 0; i < nthreads; i++) {
+        m_workers.push_back(std::async(std::launch::async, [this] { RunWorker(); }));
+    }
+}
+
+EncodePool::~EncodePool()
+{
+    try {
+        Stop();
+    }
+    catch(const std::exception & ex) {
+        Log(TraceLevel::Error, "~EncodePool() exception: " << ex.what());
+    }
+    catch(...) {
+    } // no exception thrown from destructor
+}
+
+void
+EncodePool::Push(
+    LogItemPtr item
+    )
+{
+    if (!item) {
+        throw std::invalid_argument("EncodePool::Push(): unexpected NULL item.");
+    }
+    auto rawItem = item.get();
+
+    std::unique_lock<std::mutex> lk(m_mutex);
+    if (m_stopping) {
+        throw std::runtime_error("EncodePool::Push(): the pool is stopped.");
+    }
+    auto seq = m_headSeq + m_entries.size();
+    m_entries.emplace_back();
+    m_entries.back().item = std::move(item);
+
+    if (m_numUnclaimed < m_maxPending) {
+        m_numUnclaimed++;
+        lk.unlock();
+        m_workCV.notify_one();
+        return;
+    }
+
+    // The workers are behind. The caller encodes its own item.
+    m_entries.back().isClaimed = true;
+    lk.unlock();
+    EncodeEntry(seq, rawItem);
+}
+
+void
+EncodePool::RunWorker()
+{
+    while(true) {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_workCV.wait(lk, [this] { return m_numUnclaimed || m_stopping; });
+        if (0 == m_numUnclaimed) {
+            // Stopped, and all the entries are claimed.
+            return;
+        }
+
+        m_nextSeq = std::max(m_nextSeq, m_headSeq);
+        while (GetEntry(m_nextSeq).isClaimed) {
+            m_nextSeq++;
+        }
+        auto seq = m_nextSeq++;
+        auto & entry = GetEntry(seq);
+        entry.isClaimed = true;
+        m_numUnclaimed--;
+        auto item = entry.item.get();
+        lk.unlock();
+
+        EncodeEntry(seq, item);
+    }
+}
+
+void
+EncodePool::EncodeEntry(
+    uint64_t seq,
+    LogItem* item
+    )
+{
+    auto startTime = std::chrono::steady_clock::now();
+    try {
+        item->Encode();
+    }
+    catch(const std::exception & ex) {
+        // The sender composes the data again, and handles the error.
+        Log(TraceLevel::Error, "EncodePool: failed to encode item '" << item->GetTag() << "': " << ex.what());
+    }
+    m_busyMicroSeconds += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime).count();
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+    GetEntry(seq).isEncoded = true;
+    while (!m_entries.empty() && m_entries.front().isEncoded) {
+        try {
+            m_handOff(std::move(m_entries.front().item));
+        }
+        catch(const std::exception & ex) {
+            Log(TraceLevel::Error, "EncodePool: failed to hand off item: " << ex.what());
+        }
+        m_entries.pop_front();
+        m_headSeq++;
+    }
+    if (m_entries.empty()) {
+        m_emptyCV.notify_all();
+    }
+}
+
+size_t
+EncodePool::Size() const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_entries.size();
+}
+
+bool
+EncodePool::WaitUntilEmpty(
+    uint32_t timeoutMS
+    )
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    return m_emptyCV.wait_for(lk, std::chrono::milliseconds(timeoutMS),
+                              [this] { return m_entries.empty(); });
+}
+
+void
+EncodePool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stopping = true;
+    }
+    m_workCV.notify_all();
+
+    for (auto & worker : m_workers) {
+        if (worker.valid()) {
+            worker.get();
+        }
+    }
+}
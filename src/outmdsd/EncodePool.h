@@ -0,0 +1,110 @@
+#pragma once
+#ifndef __ENDPOINTLOG_ENCODEPOOL_H__
+#define __ENDPOINTLOG_ENCODEPOOL_H__
+
+#include <deque>
+#include <vector>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+#include "LogItemPtr.h"
+
+namespace EndpointLog {
+
+/// This class runs LogItem::Encode() on a small pool of threads, so that the
+/// data of many items can be composed in parallel before a single sender
+/// thread sends them.
+///
+/// The items are handed off in the order they are pushed, whatever order the
+/// workers finish them in: an item is handed off once it and all the items
+/// pushed before it are encoded. When more than maxPending items wait for a
+/// worker, Push() encodes the new item on the caller's thread, so the backlog
+/// stays bounded.
+class EncodePool
+{
+public:
+    /// Function to hand off an encoded item, e.g. to the send queue.
+    /// It is called by one thread at a time, in push order, while the pool
+    /// is locked, so it must be quick and must not call back into the pool.
+    using HandOffFunc = std::function<void(LogItemPtr)>;
+
+    /// Constructor. It starts the worker threads.
+    /// <param name="nthreads">number of worker threads.</param>
+    /// <param name="handOff">function to hand off an encoded item.</param>
+    /// <param name="maxPending">max items waiting for a worker.</param>
+    /// Throw exception if nthreads or maxPending is 0.
+    EncodePool(size_t nthreads, HandOffFunc handOff, size_t maxPending = DefaultMaxPending);
+
+    ~EncodePool();
+
+    // not copyable, not movable
+    EncodePool(const EncodePool& other) = delete;
+    EncodePool& operator=(const EncodePool& other) = delete;
+
+    EncodePool(EncodePool&& other) = delete;
+    EncodePool& operator=(EncodePool&& other) = delete;
+
+    /// Add an item to encode. Throw exception if item is NULL or the pool is stopped.
+    void Push(LogItemPtr item);
+
+    /// Return number of items pushed but not handed off yet.
+    size_t Size() const;
+
+    /// Wait until all the items pushed are handed off or timed out.
+    /// Return true if all are handed off, false if timed out.
+    bool WaitUntilEmpty(uint32_t timeoutMS);
+
+    /// Hand off all the items pushed, then stop the workers.
+    void Stop();
+
+    size_t GetNumThreads() const { return m_numThreads; }
+
+    /// Return total microseconds the workers and callers spent encoding.
+    /// The utilization of the pool is its growth over time, divided by the
+    /// number of threads.
+    uint64_t GetBusyMicroSeconds() const { return m_busyMicroSeconds; }
+
+    constexpr static size_t DefaultMaxPending = 4096;
+
+private:
+    struct Entry
+    {
+        LogItemPtr item;
+        bool isClaimed = false; // true once a worker or the caller encodes it.
+        bool isEncoded = false;
+    };
+
+    void RunWorker();
+
+    /// Encode the item of the entry with the given sequence number, then hand
+    /// off the encoded items at the head of the pool. The entry must be claimed.
+    void EncodeEntry(uint64_t seq, LogItem* item);
+
+    Entry & GetEntry(uint64_t seq) { return m_entries[seq - m_headSeq]; }
+
+private:
+    size_t m_numThreads;
+    HandOffFunc m_handOff;
+    size_t m_maxPending;
+
+    std::deque<Entry> m_entries; // items not handed off yet, in push order.
+    uint64_t m_headSeq = 0;      // sequence number of m_entries.front().
+    uint64_t m_nextSeq = 0;      // sequence number to look for an unclaimed entry from.
+    size_t m_numUnclaimed = 0;   // number of entries waiting for a worker.
+    bool m_stopping = false;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_workCV;  // notified when an entry is added, or when stopping.
+    std::condition_variable m_emptyCV; // notified when all the entries are handed off.
+
+    std::vector<std::future<void>> m_workers;
+    std::atomic<uint64_t> m_busyMicroSeconds{0};
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_ENCODEPOOL_H__
@@ -5,6 +5,7 @@
 #include <string>
 
 #include "DjsonLogItem.h"
+#include "DjsonRecord.h"
 
 namespace EndpointLog {
 
@@ -22,6 +23,17 @@ public:
     }
 };
 
+DJSON_FIELD(EtwGuidField, "GUID", std::string);
+DJSON_FIELD(EtwEventIdField, "EventId", int32_t);
+
+// An ETW record whose fields after "GUID" and "EventId" are known at compile
+// time. It has the same schema as an EtwLogItem with the same fields added,
+// without composing the schema for each record. Example:
+//   DJSON_FIELD(CounterField, "counter", int64_t);
+//   EtwRecord<CounterField> item("source", "guid", 10, 123);
+template<typename... Fields>
+using EtwRecord = DjsonRecord<EtwGuidField, EtwEventIdField, Fields...>;
+
 } // namespace
 
 #endif // __ENDPOINT_ETWLOGITEM_H__
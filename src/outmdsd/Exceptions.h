@@ -17,8 +17,6 @@ public:
         std::system_error(errnum, std::system_category(), msg) {}
 };
 
-class ReaderInterruptException {};
-
 }
 
 #endif // __ENDPOINT_EXCEPTIONS__H__
@@ -0,0 +1,291 @@
+#include <stdexcept>
+
+#include "FairQueue.h"
+#include "LogItem.h"
+#include "Trace.h"
+#include "TraceMacros.h"
+
+using namespace EndpointLog;
+
+struct FairQueue::SubQueue
+{
+    SubQueue(std::string s) : source(std::move(s)) {}
+
+    std::string source;
+    std::deque<std::pair<LogItemPtr, size_t>> items; // <item, size hint>
+    unsigned int weight = 1;
+    size_t byteLimit = 0;
+    bool hasByteLimit = false; // if false, use FairQueue default byte limit.
+
+    size_t deficit = 0;        // bytes that can be popped in current round.
+    bool isActive = false;     // true if in m_activeList.
+    bool hasQuantum = false;   // true if quantum was added in current round.
+
+    SourceStats stats;
+};
+
+FairQueue::FairQueue(
+    size_t maxItems,
+    size_t quantumBytes
+    ) :
+    m_maxItems(maxItems),
+    m_quantumBytes(quantumBytes)
+{
+    if (0 == quantumBytes) {
+        throw std::invalid_argument("FairQueue: quantum bytes must be non-zero.");
+    }
+}
+
+FairQueue::~FairQueue()
+{
+    StopOnceEmpty();
+}
+
+FairQueue::SubQueue&
+FairQueue::GetSubQueue(
+    const std::string & source
+    )
+{
+    auto & sq = m_subQueues[source];
+    if (!sq) {
+        sq.reset(new SubQueue(source));
+    }
+    return *sq;
+}
+
+void
+FairQueue::SetSourceWeight(
+    const std::string & source,
+    unsigned int weight
+    )
+{
+    if (0 == weight) {
+        throw std::invalid_argument("FairQueue::SetSourceWeight(): weight must be non-zero.");
+    }
+    std::lock_guard<std::mutex> lk(m_mutex);
+    GetSubQueue(source).weight = weight;
+}
+
+void
+FairQueue::SetSourceByteLimit(
+    const std::string & source,
+    size_t maxBytes
+    )
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto & sq = GetSubQueue(source);
+    sq.byteLimit = maxBytes;
+    sq.hasByteLimit = true;
+}
+
+void
+FairQueue::SetDefaultByteLimit(
+    size_t maxBytes
+    )
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_defaultByteLimit = maxBytes;
+}
+
+void
+FairQueue::DropOldest(
+    SubQueue & sq
+    )
+{
+    auto nbytes = sq.items.front().second;
+    sq.items.front().first->RecordStage(FlightStage::Drop);
+    sq.items.pop_front();
+    m_numItems--;
+    m_totalDropped++;
+
+    sq.stats.numItems--;
+    sq.stats.numBytes -= nbytes;
+    sq.stats.numDropped++;
+    sq.stats.numBytesDropped += nbytes;
+
+    LogEveryN(TraceLevel::Warning, 1000, "FairQueue overflow. Drop oldest item of source '"
+        << sq.source << "'. Total dropped from this source: " << sq.stats.numDropped);
+
+    if (sq.items.empty()) {
+        sq.deficit = 0;
+        sq.hasQuantum = false;
+        sq.isActive = false;
+        m_activeList.remove(&sq);
+    }
+}
+
+FairQueue::SubQueue*
+FairQueue::GetSubQueueToDrop()
+{
+    SubQueue* result = nullptr;
+    for (auto sq : m_activeList) {
+        if (!result || sq->stats.numBytes * result->weight > result->stats.numBytes * sq->weight) {
+            result = sq;
+        }
+    }
+    return result;
+}
+
+void
+FairQueue::Push(
+    LogItemPtr item
+    )
+{
+    if (!item) {
+        throw std::invalid_argument("FairQueue::Push(): unexpected NULL item.");
+    }
+    // Get size out of the lock because it may compose the item data.
+    auto nbytes = item->GetSizeHint();
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto & sq = GetSubQueue(item->GetSourceName());
+
+    auto byteLimit = sq.hasByteLimit? sq.byteLimit : m_defaultByteLimit;
+    if (byteLimit) {
+        // Always keep the new item, even if it alone is over the limit.
+        while(!sq.items.empty() && sq.stats.numBytes + nbytes > byteLimit) {
+            DropOldest(sq);
+        }
+    }
+
+    if (m_maxItems && m_numItems >= m_maxItems) {
+        auto dropSq = GetSubQueueToDrop();
+        if (dropSq) {
+            DropOldest(*dropSq);
+        }
+    }
+
+    sq.items.emplace_back(std::move(item), nbytes);
+    sq.stats.numItems++;
+    sq.stats.numBytes += nbytes;
+    m_numItems++;
+
+    if (!sq.isActive) {
+        sq.isActive = true;
+        m_activeList.push_back(&sq);
+    }
+    m_dataCond.notify_one();
+}
+
+LogItemPtr
+FairQueue::PopNext(
+    size_t* nbytesOut
+    )
+{
+    while(true) {
+        auto sq = m_activeList.front();
+        if (!sq->hasQuantum) {
+            sq->deficit += m_quantumBytes * sq->weight;
+            sq->hasQuantum = true;
+        }
+
+        auto nbytes = sq->items.front().second;
+        if (nbytes <= sq->deficit) {
+            auto item = std::move(sq->items.front().first);
+            sq->items.pop_front();
+            sq->deficit -= nbytes;
+            sq->stats.numItems--;
+            sq->stats.numBytes -= nbytes;
+            m_numItems--;
+            if (nbytesOut) {
+                *nbytesOut = nbytes;
+            }
+
+            if (sq->items.empty()) {
+                // An idle source doesn't keep its unused deficit.
+                sq->deficit = 0;
+                sq->hasQuantum = false;
+                sq->isActive = false;
+                m_activeList.pop_front();
+            }
+            return item;
+        }
+
+        // Not enough deficit for its next item. Move to next source.
+        sq->hasQuantum = false;
+        m_activeList.splice(m_activeList.end(), m_activeList, m_activeList.begin());
+    }
+}
+
+LogItemPtr
+FairQueue::WaitAndPop()
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_dataCond.wait(lk, [this] { return (m_numItems > 0 || m_stopOnceEmpty); });
+    if (0 == m_numItems) {
+        return nullptr;
+    }
+    return PopNext();
+}
+
+size_t
+FairQueue::WaitAndPopBatch(
+    std::vector<LogItemPtr> & items,
+    size_t maxItems,
+    size_t maxBytes,
+    std::chrono::microseconds linger
+    )
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_dataCond.wait(lk, [this] { return (m_numItems > 0 || m_stopOnceEmpty); });
+
+    auto deadline = std::chrono::steady_clock::now() + linger;
+    size_t totalBytes = 0;
+    size_t nitems = 0;
+    while(nitems < maxItems && (0 == nitems || totalBytes < maxBytes)) {
+        if (0 == m_numItems) {
+            if (0 == nitems || m_stopOnceEmpty || 0 == linger.count() ||
+                !m_dataCond.wait_until(lk, deadline, [this] { return (m_numItems > 0 || m_stopOnceEmpty); }) ||
+                0 == m_numItems) {
+                break;
+            }
+        }
+        size_t nbytes = 0;
+        items.push_back(PopNext(&nbytes));
+        totalBytes += nbytes;
+        nitems++;
+    }
+    return totalBytes;
+}
+
+void
+FairQueue::StopOnceEmpty()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_stopOnceEmpty = true;
+    m_dataCond.notify_all();
+}
+
+bool
+FairQueue::Empty() const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return (0 == m_numItems);
+}
+
+size_t
+FairQueue::Size() const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_numItems;
+}
+
+FairQueue::SourceStats
+FairQueue::GetSourceStats(
+    const std::string & source
+    ) const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto iter = m_subQueues.find(source);
+    if (m_subQueues.end() == iter) {
+        return SourceStats();
+    }
+    return iter->second->stats;
+}
+
+size_t
+FairQueue::GetTotalDropped() const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_totalDropped;
+}
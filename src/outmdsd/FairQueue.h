@@ -0,0 +1,138 @@
+#pragma once
+#ifndef __ENDPOINTLOG_FAIRQUEUE_H__
+#define __ENDPOINTLOG_FAIRQUEUE_H__
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "LogItemPtr.h"
+
+namespace EndpointLog {
+
+/// This class implements a thread-safe queue of log items that shares the
+/// output fairly among the item sources (see LogItem::GetSourceName()).
+///
+/// - Each source has its own sub-queue. Items are popped from the sub-queues
+///   using deficit round robin (DRR): in each round, a source can pop up to
+///   quantum * weight bytes. So a source with weight 2 gets about twice the
+///   bytes of a source with weight 1 when both have items, no matter how small
+///   or big their items are.
+/// - A source can have a byte limit. When it is reached, the oldest items of the
+///   same source are dropped.
+/// - When the total item limit is reached, the oldest item of the source that
+///   uses the most bytes per weight is dropped. So a chatty source can't evict
+///   the items of low-volume sources.
+///
+class FairQueue
+{
+public:
+    /// Counters of one source.
+    struct SourceStats
+    {
+        size_t numItems = 0;      // number of items in queue
+        size_t numBytes = 0;      // number of bytes in queue
+        size_t numDropped = 0;    // number of items dropped because of overflow
+        size_t numBytesDropped = 0; // number of bytes dropped because of overflow
+    };
+
+    /// <summary>
+    /// Construct a new queue.
+    /// <param name='maxItems'>max number of items of all sources. 0 means no limit.</param>
+    /// <param name='quantumBytes'>number of bytes a source with weight 1 can pop
+    /// in each round.</param>
+    /// </summary>
+    FairQueue(size_t maxItems = 0, size_t quantumBytes = 4096);
+
+    ~FairQueue();
+
+    FairQueue(const FairQueue&) = delete;
+    FairQueue& operator=(const FairQueue&) = delete;
+
+    FairQueue(FairQueue&&) = delete;
+    FairQueue& operator=(FairQueue&&) = delete;
+
+    /// Set the DRR weight of a source. Default weight is 1.
+    /// Throw exception if weight is 0.
+    void SetSourceWeight(const std::string & source, unsigned int weight);
+
+    /// Set the max number of bytes a source can have in queue. 0 means no limit.
+    void SetSourceByteLimit(const std::string & source, size_t maxBytes);
+
+    /// Set the byte limit of the sources that don't have their own limit.
+    /// 0 means no limit, which is the default.
+    void SetDefaultByteLimit(size_t maxBytes);
+
+    /// Add an item to its source's sub-queue. Drop old items if any limit is reached.
+    /// Throw exception if item is NULL.
+    void Push(LogItemPtr item);
+
+    /// Wait until any item is available, then pop it.
+    /// Return nullptr if the queue is empty and StopOnceEmpty() is called.
+    LogItemPtr WaitAndPop();
+
+    /// Wait until any item is available, then pop items until 'maxItems' items
+    /// or at least 'maxBytes' bytes (by item size hint) are popped. If the queue
+    /// runs out of items first, wait up to 'linger' after the first pop for more.
+    /// Append the items to 'items' and return the number of bytes popped.
+    /// Return 0 with no item if the queue is empty and StopOnceEmpty() is called.
+    size_t WaitAndPopBatch(std::vector<LogItemPtr> & items, size_t maxItems, size_t maxBytes,
+                           std::chrono::microseconds linger);
+
+    /// Notify queue to stop any further waiting once it is empty.
+    void StopOnceEmpty();
+
+    bool Empty() const;
+
+    /// Return total number of items of all sources.
+    size_t Size() const;
+
+    /// Return the counters of a source. Return all 0 for an unknown source.
+    SourceStats GetSourceStats(const std::string & source) const;
+
+    /// Return total number of items dropped from all sources.
+    size_t GetTotalDropped() const;
+
+private:
+    struct SubQueue;
+
+    /// Return the sub-queue of a source. Create it if it doesn't exist.
+    /// The caller must hold m_mutex.
+    SubQueue& GetSubQueue(const std::string & source);
+
+    /// Drop the oldest item of a sub-queue. The caller must hold m_mutex.
+    void DropOldest(SubQueue & sq);
+
+    /// Return the sub-queue to drop from when total item limit is reached.
+    /// The caller must hold m_mutex.
+    SubQueue* GetSubQueueToDrop();
+
+    /// Pop next item by DRR. The queue must not be empty. The caller must hold m_mutex.
+    /// If nbytes is not NULL, save the size hint of the item to it.
+    LogItemPtr PopNext(size_t* nbytes = nullptr);
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_dataCond;
+    bool m_stopOnceEmpty = false;
+
+    size_t m_maxItems;
+    size_t m_quantumBytes;
+    size_t m_defaultByteLimit = 0;
+
+    size_t m_numItems = 0;
+    size_t m_totalDropped = 0;
+
+    std::unordered_map<std::string, std::unique_ptr<SubQueue>> m_subQueues;
+    std::list<SubQueue*> m_activeList; // sub-queues that have items, in DRR order.
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_FAIRQUEUE_H__
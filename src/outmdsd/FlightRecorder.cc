@@ -0,0 +1,275 @@
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <unordered_map>
+#include <sstream>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+
+extern "C" {
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include "FlightRecorder.h"
+
+using namespace EndpointLog;
+
+constexpr size_t FlightRecorder::Capacity;
+std::atomic<uint32_t> FlightRecorder::s_sampleRate{0};
+
+namespace {
+
+// A ring slot is protected by a sequence lock: 'seq' is 2*position+1 while the
+// event of ring position 'position' is written, and is 2*(position+1) after it is
+// written. A writer claims the slot by changing 'seq' from an even value of an
+// older position, so writers a whole ring apart never write the slot together.
+// All fields are atomic, so that readers never race with writers.
+struct Slot
+{
+    std::atomic<uint64_t> seq{0};
+    std::atomic<uint64_t> itemId{0};
+    std::atomic<uint64_t> timeNs{0};
+    std::atomic<uint64_t> stageAndThread{0};
+};
+
+Slot s_ring[FlightRecorder::Capacity];
+std::atomic<uint64_t> s_nextPos{0};   // ring position of next event.
+std::atomic<uint64_t> s_startPos{0};  // events before this position are cleared.
+
+const char BinaryHeader[] = "OMDSDFR1";
+constexpr size_t BinaryHeaderSize = sizeof(BinaryHeader) - 1;
+
+// Binary dump files used by the signal handler. A new path is written to the
+// unused buffer before it is switched to, so the handler never reads a partial path.
+char s_dumpFiles[2][4096];
+std::atomic<int> s_dumpFileIndex{0};
+std::mutex s_dumpFileMutex;
+
+uint32_t
+GetThreadId()
+{
+    static thread_local uint32_t tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    return tid;
+}
+
+// Read the event of ring position 'pos'. Return false if it is overwritten
+// or is being written.
+bool
+ReadSlot(
+    uint64_t pos,
+    FlightEvent & event
+    )
+{
+    const auto & slot = s_ring[pos % FlightRecorder::Capacity];
+    auto seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != 2*(pos+1)) {
+        return false;
+    }
+    event.itemId = slot.itemId.load(std::memory_order_relaxed);
+    event.timeNs = slot.timeNs.load(std::memory_order_relaxed);
+    auto stageAndThread = slot.stageAndThread.load(std::memory_order_relaxed);
+    event.stage = static_cast<uint32_t>(stageAndThread >> 32);
+    event.threadId = static_cast<uint32_t>(stageAndThread);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq == slot.seq.load(std::memory_order_relaxed);
+}
+
+// Return the ring positions [first, last) of the events that can be read.
+void
+GetRange(
+    uint64_t & first,
+    uint64_t & last
+    )
+{
+    last = s_nextPos.load(std::memory_order_acquire);
+    first = (last > FlightRecorder::Capacity)? (last - FlightRecorder::Capacity) : 0;
+    auto startPos = s_startPos.load(std::memory_order_relaxed);
+    if (first < startPos) {
+        first = startPos;
+    }
+}
+
+// Write all of 'buf' to 'fd'. It is async-signal-safe.
+bool
+WriteAll(
+    int fd,
+    const void* buf,
+    size_t len
+    )
+{
+    auto p = static_cast<const char*>(buf);
+    while(len > 0) {
+        auto rtn = write(fd, p, len);
+        if (rtn < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return false;
+        }
+        p += rtn;
+        len -= rtn;
+    }
+    return true;
+}
+
+void
+DumpOnSignal(int)
+{
+    auto savedErrno = errno;
+    auto fd = open(s_dumpFiles[s_dumpFileIndex.load()], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        uint64_t first = 0, last = 0;
+        GetRange(first, last);
+
+        bool ok = WriteAll(fd, BinaryHeader, BinaryHeaderSize);
+        for (auto pos = first; ok && pos < last; pos++) {
+            FlightEvent event;
+            if (ReadSlot(pos, event)) {
+                ok = WriteAll(fd, &event, sizeof(event));
+            }
+        }
+        close(fd);
+    }
+    errno = savedErrno;
+}
+
+} // namespace
+
+void
+FlightRecorder::Record(
+    uint64_t itemId,
+    FlightStage stage
+    )
+{
+    auto timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    auto pos = s_nextPos.fetch_add(1, std::memory_order_relaxed);
+    auto & slot = s_ring[pos % Capacity];
+
+    // If the slot is being written by a writer of another position, or already
+    // has a newer event, the event is dropped rather than waiting for the slot.
+    auto seq = slot.seq.load(std::memory_order_relaxed);
+    do {
+        if ((seq & 1) || seq > 2*pos) {
+            return;
+        }
+    } while (!slot.seq.compare_exchange_weak(seq, 2*pos+1, std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.itemId.store(itemId, std::memory_order_relaxed);
+    slot.timeNs.store(static_cast<uint64_t>(timeNs), std::memory_order_relaxed);
+    slot.stageAndThread.store((static_cast<uint64_t>(stage) << 32) | GetThreadId(), std::memory_order_relaxed);
+    slot.seq.store(2*(pos+1), std::memory_order_release);
+}
+
+std::vector<FlightEvent>
+FlightRecorder::GetEvents()
+{
+    uint64_t first = 0, last = 0;
+    GetRange(first, last);
+
+    std::vector<FlightEvent> events;
+    events.reserve(last - first);
+    for (auto pos = first; pos < last; pos++) {
+        FlightEvent event;
+        if (ReadSlot(pos, event)) {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+const char*
+FlightRecorder::GetStageName(
+    uint32_t stage
+    )
+{
+    static const char* names[] = {
+        "enqueue", "dequeue", "encode", "lock", "send", "send_error", "ack", "resend", "drop"
+    };
+    static_assert(sizeof(names)/sizeof(names[0]) == static_cast<size_t>(FlightStage::NumStages),
+        "Each FlightStage must have a name.");
+
+    return (stage < static_cast<uint32_t>(FlightStage::NumStages))? names[stage] : "unknown";
+}
+
+std::string
+FlightRecorder::DumpJson()
+{
+    auto events = GetEvents();
+
+    // Group the events by item, in the order of each item's first event.
+    std::unordered_map<uint64_t, size_t> itemIndex;
+    std::vector<std::vector<const FlightEvent*>> items;
+    for (const auto & event : events) {
+        auto iter = itemIndex.find(event.itemId);
+        if (iter == itemIndex.end()) {
+            iter = itemIndex.emplace(event.itemId, items.size()).first;
+            items.emplace_back();
+        }
+        items[iter->second].push_back(&event);
+    }
+
+    std::ostringstream strm;
+    strm << "{\"sample_rate\":" << GetSampleRate() << ",\"items\":[";
+    for (size_t i = 0; i < items.size(); i++) {
+        auto startNs = items[i].front()->timeNs;
+        strm << (i? "," : "") << "{\"id\":" << items[i].front()->itemId
+             << ",\"start_ns\":" << startNs << ",\"events\":[";
+        for (size_t j = 0; j < items[i].size(); j++) {
+            auto e = items[i][j];
+            strm << (j? "," : "") << "[\"" << GetStageName(e->stage) << "\","
+                 << (e->timeNs - startNs) << "," << e->threadId << "]";
+        }
+        strm << "]}";
+    }
+    strm << "]}";
+    return strm.str();
+}
+
+std::string
+FlightRecorder::DumpBinary()
+{
+    auto events = GetEvents();
+
+    std::string dump(BinaryHeader, BinaryHeaderSize);
+    dump.append(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(FlightEvent));
+    return dump;
+}
+
+void
+FlightRecorder::SetDumpSignal(
+    int signo,
+    const std::string & filepath
+    )
+{
+    if (filepath.empty() || filepath.size() >= sizeof(s_dumpFiles[0])) {
+        throw std::invalid_argument("FlightRecorder::SetDumpSignal(): invalid dump file path '" + filepath + "'.");
+    }
+
+    std::lock_guard<std::mutex> lck(s_dumpFileMutex);
+    auto index = 1 - s_dumpFileIndex.load();
+    memcpy(s_dumpFiles[index], filepath.c_str(), filepath.size() + 1);
+    s_dumpFileIndex = index;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = DumpOnSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(signo, &action, nullptr)) {
+        throw std::system_error(errno, std::system_category(),
+            "FlightRecorder::SetDumpSignal(): sigaction() failed for signal " + std::to_string(signo));
+    }
+}
+
+void
+FlightRecorder::Clear()
+{
+    s_startPos.store(s_nextPos.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
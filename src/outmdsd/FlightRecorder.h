@@ -0,0 +1,100 @@
+#pragma once
+#ifndef __ENDPOINTLOG_FLIGHTRECORDER_H__
+#define __ENDPOINTLOG_FLIGHTRECORDER_H__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+namespace EndpointLog {
+
+/// The stages of a log item that are recorded by FlightRecorder.
+enum class FlightStage : uint32_t {
+    Enqueue = 0,    // item is added to the logger.
+    Dequeue,        // item is popped from the incoming queue by the sender thread.
+    Encode,         // item data is ready to be sent.
+    Lock,           // socket send lock is acquired.
+    Send,           // item data is written to the socket.
+    SendError,      // item data failed to be written to the socket.
+    Ack,            // ack of the item is received from the socket server.
+    Resend,         // item is resent because its ack is not received yet.
+    Drop,           // item is dropped, e.g. by queue overflow or ack timeout.
+    NumStages
+};
+
+/// One event of a sampled log item.
+struct FlightEvent
+{
+    uint64_t itemId;    // LogItem sequence number. It is the same as the item tag.
+    uint64_t timeNs;    // steady clock time in nanoseconds.
+    uint32_t stage;     // FlightStage value.
+    uint32_t threadId;  // Linux thread id that recorded the event.
+};
+
+/// This class records the stage times of 1 out of every N log items in a
+/// process-wide ring of fixed size, so that the timeline of recent items can
+/// be dumped when latency spikes.
+///
+/// - Whether an item is sampled is decided once when it is created (see LogItem).
+///   For items not sampled, each stage costs one boolean check.
+/// - Record() is lock-free. When the ring is full, the oldest events are overwritten.
+///   An event is dropped if its slot is still being written for an event a whole
+///   ring older.
+/// - The ring can be dumped as JSON or binary by API, or as binary to a file when
+///   a signal is received. The binary dump is an 8-byte "OMDSDFR1" header
+///   followed by FlightEvent records in native byte order.
+///
+/// Sampling is disabled by default.
+class FlightRecorder
+{
+public:
+    /// Max number of events kept in the ring.
+    constexpr static size_t Capacity = 1 << 16;
+
+    /// Sample 1 out of every 'n' log items. 0 disables sampling.
+    static void SetSampleRate(uint32_t n) { s_sampleRate.store(n, std::memory_order_relaxed); }
+
+    static uint32_t GetSampleRate() { return s_sampleRate.load(std::memory_order_relaxed); }
+
+    /// Return true if the log item of sequence number 'itemId' is sampled.
+    static bool IsSampled(uint64_t itemId)
+    {
+        auto n = s_sampleRate.load(std::memory_order_relaxed);
+        return n && (0 == itemId % n);
+    }
+
+    /// Add an event to the ring.
+    static void Record(uint64_t itemId, FlightStage stage);
+
+    /// Return the events in the ring, oldest first. The events being written
+    /// at the same time are skipped.
+    static std::vector<FlightEvent> GetEvents();
+
+    /// Return the events as a JSON object. The events are grouped by item in
+    /// the order of their first event. Each event is [stage, nanoseconds since the
+    /// item's first event, thread id]. e.g.
+    /// {"sample_rate":100,"items":[{"id":200,"start_ns":123456,"events":[["enqueue",0,31],...]},...]}
+    static std::string DumpJson();
+
+    /// Return the events in the binary dump format.
+    static std::string DumpBinary();
+
+    /// Write the binary dump to 'filepath' each time signal 'signo' is received.
+    /// The file is overwritten by each dump. The dump only uses async-signal-safe calls.
+    /// Throw exception for any error.
+    static void SetDumpSignal(int signo, const std::string & filepath);
+
+    /// Remove all the events. Events recorded at the same time may be kept.
+    static void Clear();
+
+    /// Return the name of a stage, e.g. "enqueue".
+    static const char* GetStageName(uint32_t stage);
+
+private:
+    static std::atomic<uint32_t> s_sampleRate;
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_FLIGHTRECORDER_H__
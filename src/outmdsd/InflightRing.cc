@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "InflightRing.h"
+#include "LogItem.h"
+
+using namespace EndpointLog;
+
+constexpr size_t InflightRing::DefaultCapacity;
+constexpr size_t InflightRing::DefaultMaxCapacity;
+
+// The bitmap has one word per 64 slots, so the capacity is at least 64.
+static constexpr size_t MinCapacity = 64;
+
+InflightRing::InflightRing(
+    size_t initialCapacity,
+    size_t maxCapacity
+    ) :
+    m_maxCapacity(RoundUpCapacity(maxCapacity))
+{
+    Resize(std::min(RoundUpCapacity(initialCapacity), m_maxCapacity));
+}
+
+size_t
+InflightRing::RoundUpCapacity(
+    size_t n
+    )
+{
+    size_t capacity = MinCapacity;
+    while (capacity < n) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+bool
+InflightRing::IsInUse(
+    uint64_t id
+    ) const
+{
+    auto slot = GetSlot(id);
+    return (m_inUse[slot / 64] >> (slot % 64)) & 1;
+}
+
+uint64_t
+InflightRing::FindNext(
+    uint64_t from
+    ) const
+{
+    auto id = from;
+    while (id < m_end) {
+        auto slot = GetSlot(id);
+        auto bits = m_inUse[slot / 64] >> (slot % 64);
+        if (bits) {
+            return std::min(m_end, id + __builtin_ctzll(bits));
+        }
+        id += 64 - (slot % 64);
+    }
+    return m_end;
+}
+
+void
+InflightRing::Place(
+    uint64_t id,
+    LogItemPtr item,
+    size_t nbytes
+    )
+{
+    auto slot = GetSlot(id);
+    if (IsInUse(id)) {
+        m_bytes -= m_slotBytes[slot];
+    }
+    else {
+        m_inUse[slot / 64] |= (uint64_t(1) << (slot % 64));
+        m_count++;
+    }
+    m_slots[slot] = std::move(item);
+    m_slotBytes[slot] = nbytes;
+    m_bytes += nbytes;
+}
+
+LogItemPtr
+InflightRing::Take(
+    uint64_t id
+    )
+{
+    auto slot = GetSlot(id);
+    m_inUse[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    m_count--;
+    m_bytes -= m_slotBytes[slot];
+    auto item = std::move(m_slots[slot]);
+
+    if (0 == m_count) {
+        m_base = m_end = 0;
+    }
+    else if (id == m_base) {
+        m_base = FindNext(id + 1);
+    }
+    return item;
+}
+
+void
+InflightRing::Resize(
+    size_t capacity
+    )
+{
+    std::vector<LogItemPtr> oldSlots(capacity);
+    std::vector<size_t> oldSlotBytes(capacity);
+    std::vector<uint64_t> oldInUse(capacity / 64, 0);
+    oldSlots.swap(m_slots);
+    oldSlotBytes.swap(m_slotBytes);
+    oldInUse.swap(m_inUse);
+
+    if (oldSlots.empty()) {
+        return;
+    }
+    auto oldMask = oldSlots.size() - 1;
+    for (auto id = m_base; id < m_end; id++) {
+        auto oldSlot = id & oldMask;
+        if ((oldInUse[oldSlot / 64] >> (oldSlot % 64)) & 1) {
+            auto slot = GetSlot(id);
+            m_inUse[slot / 64] |= (uint64_t(1) << (slot % 64));
+            m_slots[slot] = std::move(oldSlots[oldSlot]);
+            m_slotBytes[slot] = oldSlotBytes[oldSlot];
+        }
+    }
+}
+
+bool
+InflightRing::Reserve(
+    uint64_t id
+    )
+{
+    if (0 == m_count) {
+        m_base = m_end = id;
+    }
+    else if (id < m_base) {
+        if (m_end - id > m_maxCapacity) {
+            return false;
+        }
+    }
+    else if (id + 1 - m_base > m_maxCapacity) {
+        // Move the items older than the max window out of the ring.
+        auto minBase = id + 1 - m_maxCapacity;
+        while (m_count && m_base < minBase) {
+            auto oldId = m_base;
+            auto nbytes = m_slotBytes[GetSlot(oldId)];
+            m_stragglers[oldId] = Straggler{Take(oldId), nbytes};
+            m_bytes += nbytes;
+        }
+        if (0 == m_count) {
+            m_base = m_end = id;
+        }
+    }
+
+    auto base = std::min(m_base, id);
+    auto end = std::max(m_end, id + 1);
+    if (end - base > m_slots.size()) {
+        Resize(RoundUpCapacity(end - base));
+    }
+    m_base = base;
+    m_end = end;
+    return true;
+}
+
+void
+InflightRing::Add(
+    LogItemPtr item
+    )
+{
+    if (!item) {
+        throw std::invalid_argument("InflightRing::Add(): unexpected NULL item.");
+    }
+    auto id = item->GetId();
+    // The item may compose its data to tell its size, so it is not done under
+    // the lock, nor by other threads later.
+    auto nbytes = item->GetSizeHint();
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if (!InRing(id)) {
+        auto straggler = m_stragglers.find(id);
+        if (straggler != m_stragglers.end()) {
+            m_bytes = m_bytes - straggler->second.nbytes + nbytes;
+            straggler->second = Straggler{std::move(item), nbytes};
+            return;
+        }
+        if (!Reserve(id)) {
+            m_stragglers[id] = Straggler{std::move(item), nbytes};
+            m_bytes += nbytes;
+            return;
+        }
+    }
+    Place(id, std::move(item), nbytes);
+}
+
+size_t
+InflightRing::Erase(
+    uint64_t id
+    )
+{
+    LogItemPtr erasedItem;
+    return Erase(id, erasedItem);
+}
+
+size_t
+InflightRing::Erase(
+    uint64_t id,
+    LogItemPtr & erasedItem
+    )
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if (InRing(id) && IsInUse(id)) {
+        erasedItem = Take(id);
+    }
+    else {
+        auto straggler = m_stragglers.find(id);
+        if (straggler == m_stragglers.end()) {
+            return 0;
+        }
+        erasedItem = std::move(straggler->second.item);
+        m_bytes -= straggler->second.nbytes;
+        m_stragglers.erase(straggler);
+    }
+    NotifyIfEmpty();
+    return 1;
+}
+
+size_t
+InflightRing::Erase(
+    const std::vector<LogItemPtr> & items
+    )
+{
+    size_t nTotal = 0;
+    std::lock_guard<std::mutex> lk(m_mutex);
+    for (const auto & item : items) {
+        if (!item) {
+            continue;
+        }
+        auto id = item->GetId();
+        if (InRing(id) && IsInUse(id)) {
+            Take(id);
+            nTotal++;
+        }
+        else {
+            auto straggler = m_stragglers.find(id);
+            if (straggler != m_stragglers.end()) {
+                m_bytes -= straggler->second.nbytes;
+                m_stragglers.erase(straggler);
+                nTotal++;
+            }
+        }
+    }
+    NotifyIfEmpty();
+    return nTotal;
+}
+
+std::vector<LogItemPtr>
+InflightRing::EraseIf(
+    const std::function<bool(const LogItemPtr&)>& fn
+    )
+{
+    std::vector<LogItemPtr> erasedItems;
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    for (auto iter = m_stragglers.begin(); iter != m_stragglers.end(); ) {
+        if (fn(iter->second.item)) {
+            erasedItems.push_back(std::move(iter->second.item));
+            m_bytes -= iter->second.nbytes;
+            iter = m_stragglers.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+    for (auto id = FindNext(m_base); m_count && id < m_end; id = FindNext(id + 1)) {
+        if (fn(m_slots[GetSlot(id)])) {
+            erasedItems.push_back(Take(id));
+        }
+    }
+    NotifyIfEmpty();
+    return erasedItems;
+}
+
+LogItemPtr
+InflightRing::Get(
+    uint64_t id
+    ) const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if (InRing(id) && IsInUse(id)) {
+        return m_slots[GetSlot(id)];
+    }
+    auto straggler = m_stragglers.find(id);
+    return (straggler == m_stragglers.end())? nullptr : straggler->second.item;
+}
+
+void
+InflightRing::ForEach(
+    const std::function<void(const LogItemPtr&)>& fn
+    ) const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    for (const auto & straggler : m_stragglers) {
+        fn(straggler.second.item);
+    }
+    for (auto id = FindNext(m_base); m_count && id < m_end; id = FindNext(id + 1)) {
+        fn(m_slots[GetSlot(id)]);
+    }
+}
+
+std::vector<LogItemPtr>
+InflightRing::GetValues() const
+{
+    std::vector<LogItemPtr> values;
+    bool hasStragglers = false;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        values.reserve(m_count + m_stragglers.size());
+        for (const auto & straggler : m_stragglers) {
+            values.push_back(straggler.second.item);
+        }
+        for (auto id = FindNext(m_base); m_count && id < m_end; id = FindNext(id + 1)) {
+            values.push_back(m_slots[GetSlot(id)]);
+        }
+        hasStragglers = !m_stragglers.empty();
+    }
+
+    // A straggler can be newer than the ring base if it was added out of order.
+    if (hasStragglers) {
+        std::sort(values.begin(), values.end(),
+            [](const LogItemPtr & a, const LogItemPtr & b) { return a->GetId() < b->GetId(); });
+    }
+    return values;
+}
+
+size_t
+InflightRing::Size() const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_count + m_stragglers.size();
+}
+
+size_t
+InflightRing::GetBytes() const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_bytes;
+}
+
+size_t
+InflightRing::GetCapacity() const
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_slots.size();
+}
+
+bool
+InflightRing::WaitUntilEmpty(
+    uint32_t timeoutMS
+    )
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    return m_emptyCV.wait_for(lk, std::chrono::milliseconds(timeoutMS),
+                              [this] { return 0 == m_count && m_stragglers.empty(); });
+}
+
+void
+InflightRing::NotifyIfEmpty()
+{
+    if (0 == m_count && m_stragglers.empty()) {
+        m_emptyCV.notify_all();
+    }
+}
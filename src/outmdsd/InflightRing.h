@@ -0,0 +1,144 @@
+#pragma once
+#ifndef __ENDPOINTLOG_INFLIGHTRING_H__
+#define __ENDPOINTLOG_INFLIGHTRING_H__
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+#include "LogItemPtr.h"
+
+namespace EndpointLog {
+
+/// This class implements a thread-safe cache of the items that are sent but
+/// not acked yet.
+///
+/// Item ids come from one increasing counter (see LogItem::GetId()), so the
+/// cached items are a sliding window over a range of ids. The items are stored
+/// in a ring of slots indexed by (id mod capacity), and a bitmap marks the
+/// slots in use. An ack erases its slot and, if it is the oldest item, moves
+/// the window base to the next bit set. Lookups don't hash or allocate, and
+/// the items are always read oldest first.
+///
+/// The ring doubles when the window doesn't fit, up to a max capacity. An item
+/// that falls behind the max window, e.g. one that is never acked while new
+/// items keep coming, is moved to a small ordered map, so that one old item
+/// can't make the ring grow without bound.
+class InflightRing
+{
+public:
+    /// Constructor.
+    /// <param name="initialCapacity">number of slots to start with.</param>
+    /// <param name="maxCapacity">max number of slots.</param>
+    /// Capacities are rounded up to a power of 2, and at least 64.
+    InflightRing(size_t initialCapacity = DefaultCapacity, size_t maxCapacity = DefaultMaxCapacity);
+
+    ~InflightRing() = default;
+
+    // not copyable, not movable
+    InflightRing(const InflightRing& other) = delete;
+    InflightRing& operator=(const InflightRing& other) = delete;
+
+    InflightRing(InflightRing&& other) = delete;
+    InflightRing& operator=(InflightRing&& other) = delete;
+
+    /// Add an item keyed by its id. An item with the same id is replaced.
+    /// Its size is counted by GetSizeHint() here, in the caller's thread, so
+    /// the item must not be used by other threads yet.
+    /// Throw exception if item is NULL.
+    void Add(LogItemPtr item);
+
+    /// Erase the item with the given id.
+    /// Return 1 if erased, 0 if nothing is erased.
+    size_t Erase(uint64_t id);
+
+    /// Erase the item with the given id, and move it to 'erasedItem'.
+    /// Return 1 if erased, 0 if nothing is erased.
+    size_t Erase(uint64_t id, LogItemPtr & erasedItem);
+
+    /// Erase the given items. Return number of items erased.
+    size_t Erase(const std::vector<LogItemPtr> & items);
+
+    /// Erase all the items such that fn(item) == true. Return the erased items.
+    std::vector<LogItemPtr> EraseIf(const std::function<bool(const LogItemPtr&)>& fn);
+
+    /// Return the item with the given id, or NULL if it isn't found.
+    LogItemPtr Get(uint64_t id) const;
+
+    /// Apply fn on each item of the cache.
+    void ForEach(const std::function<void(const LogItemPtr&)>& fn) const;
+
+    /// Return a copy of all the items, oldest first.
+    std::vector<LogItemPtr> GetValues() const;
+
+    size_t Size() const;
+
+    /// Return the total size of the items, as counted when they were added.
+    size_t GetBytes() const;
+
+    /// Return number of slots of the ring.
+    size_t GetCapacity() const;
+
+    /// Wait until all the items are erased or timed out.
+    /// Return true if the cache is empty, false if timed out.
+    bool WaitUntilEmpty(uint32_t timeoutMS);
+
+    constexpr static size_t DefaultCapacity = 1024;
+    constexpr static size_t DefaultMaxCapacity = 256*1024;
+
+private:
+    static size_t RoundUpCapacity(size_t n);
+
+    size_t GetSlot(uint64_t id) const { return id & (m_slots.size() - 1); }
+    bool IsInUse(uint64_t id) const;
+    bool InRing(uint64_t id) const { return m_count && id >= m_base && id < m_end; }
+
+    /// Return the first id >= 'from' in use in the ring, or m_end if none.
+    uint64_t FindNext(uint64_t from) const;
+
+    /// Place an item of 'nbytes' bytes whose id is in [m_base, m_end) and fits the ring.
+    void Place(uint64_t id, LogItemPtr item, size_t nbytes);
+
+    /// Remove the item with the given id, which must be in use.
+    LogItemPtr Take(uint64_t id);
+
+    /// Make room in the ring for an id out of [m_base, m_end). If the window
+    /// gets larger than the max capacity, the oldest items are moved to
+    /// m_stragglers. Return false if the id itself is too old for the ring.
+    bool Reserve(uint64_t id);
+
+    /// Move the items to a ring of the given capacity.
+    void Resize(size_t capacity);
+
+    /// Wake up WaitUntilEmpty(). The caller must hold m_mutex.
+    void NotifyIfEmpty();
+
+private:
+    struct Straggler
+    {
+        LogItemPtr item;
+        size_t nbytes;
+    };
+
+    std::vector<LogItemPtr> m_slots;
+    std::vector<size_t> m_slotBytes; // size of the item in each slot.
+    std::vector<uint64_t> m_inUse;  // 1 bit per slot.
+    size_t m_maxCapacity;
+
+    uint64_t m_base = 0;  // id of the oldest item in the ring. Valid if m_count > 0.
+    uint64_t m_end = 0;   // 1 + id of the newest item in the ring. Valid if m_count > 0.
+    size_t m_count = 0;   // number of items in the ring.
+
+    std::map<uint64_t, Straggler> m_stragglers; // items older than the max window.
+    size_t m_bytes = 0;   // total size of the items in the ring and m_stragglers.
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_emptyCV; // notified when the cache becomes empty.
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_INFLIGHTRING_H__
@@ -0,0 +1,327 @@
+extern "C" {
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+}
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "IoUring.h"
+#include "Exceptions.h"
+
+using namespace EndpointLog;
+
+// The kernel features used by this class: completions are never dropped,
+// and io_uring_enter() can wait with a timeout.
+static constexpr uint32_t RequiredFeatures = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+
+template<typename T>
+static T*
+RingPtr(
+    void* base,
+    uint32_t offset
+    )
+{
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+IoUring::IoUring(
+    unsigned int entries
+    )
+{
+    memset(&m_params, 0, sizeof(m_params));
+    auto fd = syscall(__NR_io_uring_setup, entries, &m_params);
+    if (fd < 0) {
+        throw SocketException(errno, "io_uring_setup()");
+    }
+    m_ringFd = static_cast<int>(fd);
+
+    try {
+        if (RequiredFeatures != (m_params.features & RequiredFeatures)) {
+            throw SocketException(ENOTSUP, "io_uring: required features are not supported");
+        }
+
+        const auto & sqOff = m_params.sq_off;
+        const auto & cqOff = m_params.cq_off;
+        m_ringSize = std::max(sqOff.array + m_params.sq_entries * sizeof(unsigned int),
+                              cqOff.cqes + m_params.cq_entries * sizeof(struct io_uring_cqe));
+        m_ringPtr = mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_ringFd, IORING_OFF_SQ_RING);
+        if (MAP_FAILED == m_ringPtr) {
+            m_ringPtr = nullptr;
+            throw SocketException(errno, "io_uring mmap() of rings");
+        }
+
+        m_sqesSize = m_params.sq_entries * sizeof(struct io_uring_sqe);
+        auto sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         m_ringFd, IORING_OFF_SQES);
+        if (MAP_FAILED == sqes) {
+            throw SocketException(errno, "io_uring mmap() of entries");
+        }
+        m_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+        m_sqHead = RingPtr<unsigned int>(m_ringPtr, sqOff.head);
+        m_sqTail = RingPtr<unsigned int>(m_ringPtr, sqOff.tail);
+        m_sqArray = RingPtr<unsigned int>(m_ringPtr, sqOff.array);
+        m_sqMask = *RingPtr<unsigned int>(m_ringPtr, sqOff.ring_mask);
+        m_sqeTail = *m_sqTail;
+
+        m_cqHead = RingPtr<unsigned int>(m_ringPtr, cqOff.head);
+        m_cqTail = RingPtr<unsigned int>(m_ringPtr, cqOff.tail);
+        m_cqes = RingPtr<struct io_uring_cqe>(m_ringPtr, cqOff.cqes);
+        m_cqMask = *RingPtr<unsigned int>(m_ringPtr, cqOff.ring_mask);
+    }
+    catch(...) {
+        Destroy();
+        throw;
+    }
+}
+
+IoUring::~IoUring()
+{
+    Destroy();
+}
+
+void
+IoUring::Destroy()
+{
+    // Closing the fd cancels all the pending requests.
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+    if (m_ringPtr) {
+        munmap(m_ringPtr, m_ringSize);
+        m_ringPtr = nullptr;
+    }
+    if (m_ringFd >= 0) {
+        close(m_ringFd);
+        m_ringFd = -1;
+    }
+    if (m_bufRing) {
+        free(m_bufRing);
+        m_bufRing = nullptr;
+    }
+}
+
+bool
+IoUring::IsSupported()
+{
+    static const bool isSupported = [] {
+        try {
+            IoUring ring(2);
+            return ring.ProbeRecvMultishot();
+        }
+        catch(const std::exception &) {
+            return false;
+        }
+    }();
+    return isSupported;
+}
+
+bool
+IoUring::ProbeRecvMultishot()
+{
+    // Multishot receive (kernel 6.0+) isn't reported by the features, and an
+    // older kernel fails the request with EINVAL. So receive from a socket pair.
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds)) {
+        throw SocketException(errno, "io_uring probe socketpair()");
+    }
+
+    bool isSupported = false;
+    try {
+        RegisterBufRing(0, 2, 64);
+        auto sqe = GetSqe();
+        PrepRecvMultishot(sqe, fds[0], 0);
+        if (1 == write(fds[1], "x", 1) && Submit(1, 1000)) {
+            auto cqe = PeekCqe();
+            if (cqe) {
+                // IORING_CQE_F_MORE: the receive goes on after this completion.
+                isSupported = (1 == cqe->res && (cqe->flags & IORING_CQE_F_MORE));
+                SeenCqe();
+            }
+        }
+    }
+    catch(...) {
+        close(fds[0]);
+        close(fds[1]);
+        throw;
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return isSupported;
+}
+
+struct io_uring_sqe*
+IoUring::GetSqe()
+{
+    auto head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (m_sqeTail - head >= m_params.sq_entries) {
+        return nullptr;
+    }
+    auto index = m_sqeTail & m_sqMask;
+    auto sqe = &m_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+    m_sqeTail++;
+    return sqe;
+}
+
+bool
+IoUring::Submit(
+    unsigned int waitNr,
+    int timeoutMS
+    )
+{
+    // Publish the new entries. Entries of an interrupted call are still
+    // between head and tail, so they are submitted again.
+    __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+    auto toSubmit = m_sqeTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+
+    // GETEVENTS runs the pending completion work even if waitNr is 0.
+    unsigned int flags = IORING_ENTER_GETEVENTS;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void* argPtr = nullptr;
+    size_t argSize = 0;
+    if (waitNr && timeoutMS >= 0) {
+        ts.tv_sec = timeoutMS / 1000;
+        ts.tv_nsec = (timeoutMS % 1000) * 1000000LL;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        argPtr = &arg;
+        argSize = sizeof(arg);
+    }
+
+    if (syscall(__NR_io_uring_enter, m_ringFd, toSubmit, waitNr, flags, argPtr, argSize) < 0) {
+        if (EINTR == errno || ETIME == errno || EAGAIN == errno || EBUSY == errno) {
+            return false;
+        }
+        throw SocketException(errno, "io_uring_enter()");
+    }
+    return true;
+}
+
+struct io_uring_cqe*
+IoUring::PeekCqe()
+{
+    auto head = *m_cqHead;
+    if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+    return &m_cqes[head & m_cqMask];
+}
+
+void
+IoUring::SeenCqe()
+{
+    __atomic_store_n(m_cqHead, *m_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+void
+IoUring::RegisterBufRing(
+    uint16_t groupId,
+    uint16_t nbufs,
+    uint32_t bufSize
+    )
+{
+    if (0 == nbufs || (nbufs & (nbufs - 1))) {
+        throw std::invalid_argument("IoUring::RegisterBufRing(): number of buffers must be a power of 2.");
+    }
+    if (m_bufRing) {
+        throw std::logic_error("IoUring::RegisterBufRing(): buffers are already registered.");
+    }
+
+    void* ringMem = nullptr;
+    auto ringSize = nbufs * sizeof(struct io_uring_buf);
+    if (posix_memalign(&ringMem, sysconf(_SC_PAGESIZE), ringSize)) {
+        throw std::bad_alloc();
+    }
+    memset(ringMem, 0, ringSize);
+    m_bufRing = static_cast<struct io_uring_buf_ring*>(ringMem);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(m_bufRing);
+    reg.ring_entries = nbufs;
+    reg.bgid = groupId;
+    if (syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        auto errCopy = errno;
+        free(m_bufRing);
+        m_bufRing = nullptr;
+        throw SocketException(errCopy, "io_uring_register() of buffer ring");
+    }
+
+    m_bufs.resize(static_cast<size_t>(nbufs) * bufSize);
+    m_bufSize = bufSize;
+    m_bufMask = nbufs - 1;
+    for (uint16_t i = 0; i < nbufs; i++) {
+        RecycleBuf(i);
+    }
+}
+
+void
+IoUring::RecycleBuf(
+    uint16_t bufId
+    )
+{
+    // Don't use m_bufRing->bufs: in C++, __DECLARE_FLEX_ARRAY puts it at offset 8
+    // instead of 0. The ring is an array of io_uring_buf whose first entry
+    // overlays the tail.
+    auto & buf = reinterpret_cast<struct io_uring_buf*>(m_bufRing)[m_bufTail & m_bufMask];
+    buf.addr = reinterpret_cast<uint64_t>(GetBuf(bufId));
+    buf.len = m_bufSize;
+    buf.bid = bufId;
+    m_bufTail++;
+    __atomic_store_n(&m_bufRing->tail, m_bufTail, __ATOMIC_RELEASE);
+}
+
+void
+IoUring::PrepSendMsg(
+    struct io_uring_sqe* sqe,
+    int sockfd,
+    const struct msghdr* msg,
+    unsigned int flags
+    )
+{
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sockfd;
+    sqe->addr = reinterpret_cast<uint64_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = flags;
+}
+
+void
+IoUring::PrepLinkTimeout(
+    struct io_uring_sqe* sqe,
+    const struct __kernel_timespec* ts
+    )
+{
+    sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(ts);
+    sqe->len = 1;
+}
+
+void
+IoUring::PrepRecvMultishot(
+    struct io_uring_sqe* sqe,
+    int sockfd,
+    uint16_t groupId
+    )
+{
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sockfd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = groupId;
+}
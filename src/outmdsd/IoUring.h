@@ -0,0 +1,122 @@
+#pragma once
+#ifndef __ENDPOINTLOG_IOURING_H__
+#define __ENDPOINTLOG_IOURING_H__
+
+#include <vector>
+#include <cstdint>
+
+extern "C" {
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+}
+
+namespace EndpointLog {
+
+/// This class is a minimal io_uring instance using the raw system calls, so
+/// that no liburing is needed. It is not thread-safe: the caller must make sure
+/// only one thread uses it at a time.
+///
+/// Besides submission and completion, it supports one ring of provided buffers
+/// registered to the kernel, for multishot recv with IOSQE_BUFFER_SELECT.
+///
+class IoUring
+{
+public:
+    /// Create a ring with at least 'entries' submission queue entries.
+    /// Throw SocketException if io_uring is not available, e.g. the kernel is
+    /// too old, or io_uring is disabled or blocked by seccomp.
+    explicit IoUring(unsigned int entries);
+
+    ~IoUring();
+
+    // not copyable, not movable
+    IoUring(const IoUring& other) = delete;
+    IoUring& operator=(const IoUring& other) = delete;
+
+    IoUring(IoUring&& other) = delete;
+    IoUring& operator=(IoUring&& other) = delete;
+
+    /// Return true if io_uring with all the features used by this class can be
+    /// created in this process, including multishot receive (kernel 6.0+).
+    /// The result is probed once.
+    static bool IsSupported();
+
+    /// Return the ring fd. It is readable when there is any completion.
+    int GetFd() const { return m_ringFd; }
+
+    /// Return a zeroed submission queue entry to fill, or nullptr if the
+    /// submission queue is full. The entry is submitted by next Submit().
+    struct io_uring_sqe* GetSqe();
+
+    /// Submit the entries got by GetSqe(), and run the pending completion work.
+    /// If 'waitNr' is not 0, wait until there are at least 'waitNr' completions,
+    /// or until 'timeoutMS' if it is not negative.
+    /// Return false if the wait is interrupted or timed out.
+    /// Throw SocketException for other errors.
+    bool Submit(unsigned int waitNr = 0, int timeoutMS = -1);
+
+    /// Return the oldest completion, or nullptr if there is none.
+    /// Call SeenCqe() when done with it.
+    struct io_uring_cqe* PeekCqe();
+
+    /// Remove the completion returned by PeekCqe().
+    void SeenCqe();
+
+    /// Register 'nbufs' provided buffers of 'bufSize' bytes each as buffer
+    /// group 'groupId'. 'nbufs' must be a power of 2. Only one group is supported.
+    /// Throw exception for any error.
+    void RegisterBufRing(uint16_t groupId, uint16_t nbufs, uint32_t bufSize);
+
+    /// Return the provided buffer of id 'bufId'.
+    const char* GetBuf(uint16_t bufId) const { return m_bufs.data() + static_cast<size_t>(bufId) * m_bufSize; }
+
+    /// Give a provided buffer back to the kernel after its data are used.
+    void RecycleBuf(uint16_t bufId);
+
+    /// Prepare 'sqe' to send 'msg' on 'sockfd'.
+    static void PrepSendMsg(struct io_uring_sqe* sqe, int sockfd, const struct msghdr* msg, unsigned int flags);
+
+    /// Prepare 'sqe' as the timeout of the previous linked entry.
+    static void PrepLinkTimeout(struct io_uring_sqe* sqe, const struct __kernel_timespec* ts);
+
+    /// Prepare 'sqe' to receive from 'sockfd' into buffers of group 'groupId'
+    /// until it fails or runs out of buffers. Each receive is one completion.
+    static void PrepRecvMultishot(struct io_uring_sqe* sqe, int sockfd, uint16_t groupId);
+
+private:
+    void Destroy();
+
+    /// Return true if a multishot receive works on this ring. It registers
+    /// the ring's provided buffers, so it is only called on a probe ring.
+    bool ProbeRecvMultishot();
+
+private:
+    int m_ringFd = -1;
+    struct io_uring_params m_params;
+
+    void* m_ringPtr = nullptr;   // shared mapping of the submission and completion rings.
+    size_t m_ringSize = 0;
+    struct io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    unsigned int* m_sqHead = nullptr;
+    unsigned int* m_sqTail = nullptr;
+    unsigned int* m_sqArray = nullptr;
+    unsigned int m_sqMask = 0;
+    unsigned int m_sqeTail = 0;  // next free entry. Entries before it are not submitted yet.
+
+    unsigned int* m_cqHead = nullptr;
+    unsigned int* m_cqTail = nullptr;
+    struct io_uring_cqe* m_cqes = nullptr;
+    unsigned int m_cqMask = 0;
+
+    struct io_uring_buf_ring* m_bufRing = nullptr; // page aligned, as the kernel requires.
+    std::vector<char> m_bufs;
+    uint32_t m_bufSize = 0;
+    uint16_t m_bufMask = 0;
+    uint16_t m_bufTail = 0;
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_IOURING_H__
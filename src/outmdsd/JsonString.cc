@@ -0,0 +1,271 @@
+#include <atomic>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ENDPOINTLOG_X86_SCANNERS
+#include <immintrin.h>
+#endif
+
+#include "JsonString.h"
+
+using namespace EndpointLog;
+
+// Return true if 'c' can't be copied to a JSON string as is: quote,
+// backslash, control character, or part of a multi-byte UTF-8 sequence.
+static inline bool
+IsSpecialChar(
+    unsigned char c
+    )
+{
+    return (c < 0x20 || '"' == c || '\\' == c || c >= 0x80);
+}
+
+// Each scanner returns the number of bytes at the beginning of 'data'
+// that are not special chars.
+using ScanFunc = size_t (*)(const char* data, size_t len);
+
+static size_t
+ScanScalar(
+    const char* data,
+    size_t len
+    )
+{
+    size_t i = 0;
+    while(i < len && !IsSpecialChar(data[i])) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef ENDPOINTLOG_X86_SCANNERS
+__attribute__((target("sse4.2")))
+static size_t
+ScanSse42(
+    const char* data,
+    size_t len
+    )
+{
+    // byte ranges of special chars: [0x00,0x1f], '"', '\\', [0x80,0xff]
+    const __m128i ranges = _mm_setr_epi8(0x00, 0x1f, '"', '"', '\\', '\\',
+        static_cast<char>(0x80), static_cast<char>(0xff), 0, 0, 0, 0, 0, 0, 0, 0);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        auto pos = _mm_cmpestri(ranges, 8, chunk, 16,
+            _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (pos < 16) {
+            return i + pos;
+        }
+    }
+    return i + ScanScalar(data + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+ScanAvx2(
+    const char* data,
+    size_t len
+    )
+{
+    const auto quote = _mm256_set1_epi8('"');
+    const auto backslash = _mm256_set1_epi8('\\');
+    const auto maxCtrl = _mm256_set1_epi8(0x1f);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        // chunk <= 0x1f as unsigned bytes if min(chunk, 0x1f) == chunk.
+        auto special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, backslash)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, maxCtrl), chunk));
+        // bytes >= 0x80 have their top bit set, which movemask collects.
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(special)) |
+                    static_cast<uint32_t>(_mm256_movemask_epi8(chunk));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + ScanSse42(data + i, len - i);
+}
+#endif // ENDPOINTLOG_X86_SCANNERS
+
+static bool
+IsScannerSupported(
+    JsonString::Scanner scanner
+    )
+{
+#ifdef ENDPOINTLOG_X86_SCANNERS
+    __builtin_cpu_init();
+    switch(scanner) {
+        case JsonString::Scanner::Avx2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+        case JsonString::Scanner::Sse42:
+            return __builtin_cpu_supports("sse4.2");
+        default:
+            return true;
+    }
+#else
+    return (JsonString::Scanner::Scalar == scanner);
+#endif
+}
+
+static ScanFunc
+GetScanFunc(
+    JsonString::Scanner scanner
+    )
+{
+#ifdef ENDPOINTLOG_X86_SCANNERS
+    switch(scanner) {
+        case JsonString::Scanner::Avx2:
+            return ScanAvx2;
+        case JsonString::Scanner::Sse42:
+            return ScanSse42;
+        default:
+            break;
+    }
+#endif
+    return ScanScalar;
+}
+
+static JsonString::Scanner
+SelectScanner()
+{
+    if (IsScannerSupported(JsonString::Scanner::Avx2)) {
+        return JsonString::Scanner::Avx2;
+    }
+    if (IsScannerSupported(JsonString::Scanner::Sse42)) {
+        return JsonString::Scanner::Sse42;
+    }
+    return JsonString::Scanner::Scalar;
+}
+
+static std::atomic<JsonString::Scanner> &
+GetScannerInUse()
+{
+    static std::atomic<JsonString::Scanner> scanner { SelectScanner() };
+    return scanner;
+}
+
+// Return the length of the valid UTF-8 sequence at the beginning of 'data',
+// or 0 if it is not valid. Overlong forms, surrogates and code points above
+// U+10FFFF are not valid.
+static size_t
+GetUtf8SeqLen(
+    const unsigned char* data,
+    size_t len
+    )
+{
+    auto c = data[0];
+    size_t seqLen = 0;
+    if (c >= 0xC2 && c <= 0xDF) {
+        seqLen = 2;
+    }
+    else if (c >= 0xE0 && c <= 0xEF) {
+        seqLen = 3;
+    }
+    else if (c >= 0xF0 && c <= 0xF4) {
+        seqLen = 4;
+    }
+    else {
+        return 0;
+    }
+
+    if (len < seqLen) {
+        return 0;
+    }
+    for (size_t i = 1; i < seqLen; i++) {
+        if (0x80 != (data[i] & 0xC0)) {
+            return 0;
+        }
+    }
+    if ((0xE0 == c && data[1] < 0xA0) ||
+        (0xED == c && data[1] > 0x9F) ||
+        (0xF0 == c && data[1] < 0x90) ||
+        (0xF4 == c && data[1] > 0x8F)) {
+        return 0;
+    }
+    return seqLen;
+}
+
+static void
+AppendEscapedChar(
+    std::string & out,
+    unsigned char c
+    )
+{
+    switch(c) {
+        case '"':  out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\b': out.append("\\b"); break;
+        case '\f': out.append("\\f"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+        {
+            static const char hexDigits[] = "0123456789abcdef";
+            char buf[] = { '\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xF] };
+            out.append(buf, sizeof(buf));
+            break;
+        }
+    }
+}
+
+size_t
+JsonString::Append(
+    std::string & out,
+    const char* data,
+    size_t len
+    )
+{
+    auto scan = GetScanFunc(GetScannerInUse());
+    auto udata = reinterpret_cast<const unsigned char*>(data);
+    size_t nInvalid = 0;
+
+    out.push_back('"');
+    size_t i = 0;
+    while(i < len) {
+        auto nplain = scan(data + i, len - i);
+        out.append(data + i, nplain);
+        i += nplain;
+        if (i == len) {
+            break;
+        }
+
+        if (udata[i] < 0x80) {
+            AppendEscapedChar(out, udata[i]);
+            i++;
+        }
+        else if (auto seqLen = GetUtf8SeqLen(udata + i, len - i)) {
+            out.append(data + i, seqLen);
+            i += seqLen;
+        }
+        else {
+            out.append("\\ufffd");
+            nInvalid++;
+            i++;
+        }
+    }
+    out.push_back('"');
+
+    return nInvalid;
+}
+
+JsonString::Scanner
+JsonString::GetScanner()
+{
+    return GetScannerInUse();
+}
+
+bool
+JsonString::SetScanner(
+    Scanner scanner
+    )
+{
+    if (!IsScannerSupported(scanner)) {
+        return false;
+    }
+    GetScannerInUse() = scanner;
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#ifndef __ENDPOINTLOG_JSONSTRING_H__
+#define __ENDPOINTLOG_JSONSTRING_H__
+
+#include <string>
+
+namespace EndpointLog {
+
+/// This class converts raw strings to JSON string literals.
+///
+/// Quotes, backslashes and control characters are escaped. Invalid UTF-8
+/// sequences are replaced by \ufffd byte by byte, so that the result is
+/// always valid JSON that mdsd can decode.
+///
+/// Most log strings are plain ASCII that needs no escaping. To find the
+/// next byte that needs attention, the input is scanned 16 or 32 bytes at
+/// a time with SSE4.2 or AVX2 if the CPU supports it, or byte by byte
+/// otherwise. The scanner is chosen once at runtime.
+///
+class JsonString
+{
+public:
+    /// The scanners that can be used.
+    enum class Scanner
+    {
+        Scalar,
+        Sse42,
+        Avx2
+    };
+
+    /// Append 'len' bytes of 'data' to 'out' as a quoted JSON string.
+    /// Return number of invalid UTF-8 bytes replaced.
+    static size_t Append(std::string & out, const char* data, size_t len);
+
+    /// Return 'str' as a quoted JSON string.
+    static std::string Quote(const std::string & str)
+    {
+        std::string out;
+        out.reserve(str.size() + 2);
+        Append(out, str.data(), str.size());
+        return out;
+    }
+
+    /// Return the scanner in use.
+    static Scanner GetScanner();
+
+    /// Use a given scanner. Return false if the CPU doesn't support it.
+    /// It is for testability.
+    static bool SetScanner(Scanner scanner);
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_JSONSTRING_H__
@@ -1,5 +1,58 @@
+#include <cstdint>
+
 #include "LogItem.h"
+#include "DataFrame.h"
 
 using namespace EndpointLog;
 
 std::atomic<uint64_t> LogItem::s_counter{0};
+
+bool
+LogItem::ParseTag(
+    const std::string & tag,
+    uint64_t & id
+    )
+{
+    // A uint64_t has at most 20 digits.
+    if (tag.empty() || tag.size() > 20) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (auto c : tag) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        auto digit = static_cast<uint64_t>(c - '0');
+        if (value > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    id = value;
+    return true;
+}
+
+const std::string &
+LogItem::GetSourceName() const
+{
+    static const std::string emptyName;
+    return emptyName;
+}
+
+void
+LogItem::GetFrame(
+    DataFrame & frame
+    )
+{
+    auto data = GetData();
+    frame.Add(data, strlen(data));
+}
+
+void
+LogItem::GetFrameNoSchema(
+    DataFrame & frame
+    )
+{
+    auto data = GetDataNoSchema();
+    frame.Add(data, strlen(data));
+}
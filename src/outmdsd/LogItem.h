@@ -4,11 +4,16 @@
 #define __ENDPOINT_LOGITEM_H__
 
 #include <string>
+#include <cstring>
 #include <chrono>
 #include <atomic>
 
+#include "FlightRecorder.h"
+
 namespace EndpointLog {
 
+class DataFrame;
+
 /// This class contains all the data to send to mdsd socket.
 /// It has two parts: a tag and raw string data.
 ///
@@ -21,8 +26,10 @@ class LogItem
 {
 public:
     LogItem() :
-    m_tag(std::to_string(++LogItem::s_counter)),
-    m_touchTime(std::chrono::steady_clock::now())
+    m_id(++LogItem::s_counter),
+    m_tag(std::to_string(m_id)),
+    m_touchTime(std::chrono::steady_clock::now()),
+    m_isSampled(FlightRecorder::IsSampled(m_id))
     {
     }
 
@@ -36,8 +43,48 @@ public:
 
     virtual std::string GetTag() const { return m_tag; }
 
+    /// Return the sequence number of the item. Its tag is the decimal string of it.
+    uint64_t GetId() const { return m_id; }
+
+    /// Parse a tag created by GetTag() back to its item id.
+    /// Return true if success, false if the tag isn't a valid item id.
+    static bool ParseTag(const std::string & tag, uint64_t & id);
+
     virtual const char* GetData() = 0;
 
+    /// Return the id of the schema referenced by the item data, or 0 if
+    /// the item doesn't reference a schema by id.
+    virtual uint64_t GetSchemaId() { return 0; }
+
+    /// Return the item data without the schema definition. The socket server
+    /// must already know the schema id from an earlier item on the same connection.
+    /// If GetSchemaId() returns 0, this is the same as GetData().
+    virtual const char* GetDataNoSchema() { return GetData(); }
+
+    /// Add the item data to 'frame' as one or more segments. The segments
+    /// point into the item, so the item must stay alive and unchanged until
+    /// the frame is sent, or for a zero-copy send, until the kernel is done
+    /// with the pages (see SocketClient::SetZeroCopy()).
+    virtual void GetFrame(DataFrame & frame);
+
+    /// Same as GetFrame() except that the data has no schema definition.
+    /// See GetDataNoSchema().
+    virtual void GetFrameNoSchema(DataFrame & frame);
+
+    /// Do the work of composing the data ahead of time, so that GetFrame() and
+    /// GetFrameNoSchema() are cheap on the sender thread. It isn't thread-safe,
+    /// so it must be called before the item is shared, e.g. by an encode worker
+    /// before the item is queued (see EncodePool).
+    virtual void Encode() {}
+
+    /// Return the source name of the item, or an empty string if the item
+    /// doesn't have one.
+    virtual const std::string & GetSourceName() const;
+
+    /// Return about how many bytes the item data has. It is used to share the
+    /// send bandwidth among sources, so it doesn't need to be exact.
+    virtual size_t GetSizeHint() { return strlen(GetData()); }
+
     void Touch() {
         m_touchTime = std::chrono::steady_clock::now();
     }
@@ -50,9 +97,29 @@ public:
         return (now - m_touchTime) / std::chrono::milliseconds(1);
     }
 
+    /// Return the time the item is last touched, or its creation time.
+    std::chrono::steady_clock::time_point GetLastTouchTime() const { return m_touchTime; }
+
+    /// Same as GetLastTouchMilliSeconds() but in microseconds.
+    int64_t GetLastTouchMicroSeconds() const
+    {
+        auto now = std::chrono::steady_clock::now();
+        return (now - m_touchTime) / std::chrono::microseconds(1);
+    }
+
+    /// Record a stage of the item in the FlightRecorder if the item is sampled.
+    void RecordStage(FlightStage stage) const
+    {
+        if (m_isSampled) {
+            FlightRecorder::Record(m_id, stage);
+        }
+    }
+
 private:
+    uint64_t m_id;       // Sequence number of the log item.
     std::string m_tag;   // Tag to the log item.
     std::chrono::steady_clock::time_point m_touchTime; // last touch time
+    bool m_isSampled;    // true if the stages of the item are recorded by FlightRecorder.
 
     static std::atomic<uint64_t> s_counter; // counter of number of logItem created.
 };
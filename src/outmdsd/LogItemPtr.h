@@ -4,12 +4,21 @@
 #define __ENDPOINT_LOGITEMPTR_H__
 
 #include <memory>
+#include "PoolAllocator.h"
 
 namespace EndpointLog {
 
 class LogItem;
 using LogItemPtr = std::shared_ptr<LogItem>;
 
+/// Create a new log item of type T. The item and its shared_ptr control block
+/// are allocated together in one pooled memory block (see PoolAllocator).
+template<typename T, typename... Args>
+LogItemPtr MakeLogItem(Args&&... args)
+{
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
 }
 
 #endif // __ENDPOINT_LOGITEMPTR_H__
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "Metrics.h"
+#include "JsonString.h"
+
+using namespace EndpointLog;
+
+constexpr size_t Histogram::SubBuckets;
+constexpr size_t Histogram::NumBuckets;
+
+// Return the shard used by the calling thread. Threads are given shards
+// round robin at their first use of any metric.
+static size_t
+GetShardIndex()
+{
+    static std::atomic<size_t> nextIndex{0};
+    static thread_local size_t index = nextIndex++ % MetricShards;
+    return index;
+}
+
+void
+Counter::Add(
+    uint64_t n
+    )
+{
+    m_shards[GetShardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t
+Counter::Get() const
+{
+    uint64_t total = 0;
+    for (const auto & shard : m_shards) {
+        total += shard.value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+Histogram::Shard::Shard()
+{
+    for (auto & bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t
+Histogram::GetBucketIndex(
+    uint64_t value
+    )
+{
+    if (value < SubBuckets) {
+        return value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= MaxValueBits) {
+        return NumBuckets - 1;
+    }
+    int shift = msb - SubBucketBits;
+    size_t subIndex = (value >> shift) & (SubBuckets - 1);
+    return (shift + 1) * SubBuckets + subIndex;
+}
+
+uint64_t
+Histogram::GetBucketMaxValue(
+    size_t index
+    )
+{
+    if (index < SubBuckets) {
+        return index;
+    }
+    int shift = index / SubBuckets - 1;
+    uint64_t lower = static_cast<uint64_t>(SubBuckets + index % SubBuckets) << shift;
+    return lower + (static_cast<uint64_t>(1) << shift) - 1;
+}
+
+void
+Histogram::Record(
+    uint64_t value
+    )
+{
+    auto & shard = m_shards[GetShardIndex()];
+    shard.buckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+
+    auto oldMax = shard.max.load(std::memory_order_relaxed);
+    while(value > oldMax && !shard.max.compare_exchange_weak(oldMax, value, std::memory_order_relaxed)) {}
+}
+
+HistogramSnapshot
+Histogram::GetSnapshot() const
+{
+    HistogramSnapshot snapshot;
+    uint64_t buckets[NumBuckets] = {};
+
+    for (const auto & shard : m_shards) {
+        for (size_t i = 0; i < NumBuckets; i++) {
+            buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        }
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        snapshot.max = std::max(snapshot.max, shard.max.load(std::memory_order_relaxed));
+    }
+
+    // Use the bucket counts as the total, so that the percentiles are
+    // consistent even if values are recorded meanwhile.
+    for (auto n : buckets) {
+        snapshot.count += n;
+    }
+    if (0 == snapshot.count) {
+        return snapshot;
+    }
+
+    struct { double percentile; uint64_t* result; } targets[] = {
+        { 0.5, &snapshot.p50 }, { 0.9, &snapshot.p90 }, { 0.99, &snapshot.p99 }, { 0.999, &snapshot.p999 }
+    };
+
+    uint64_t seen = 0;
+    size_t t = 0;
+    for (size_t i = 0; i < NumBuckets && t < sizeof(targets)/sizeof(targets[0]); i++) {
+        seen += buckets[i];
+        while(t < sizeof(targets)/sizeof(targets[0]) &&
+              seen >= std::ceil(targets[t].percentile * snapshot.count)) {
+            *targets[t].result = std::min(GetBucketMaxValue(i), snapshot.max);
+            t++;
+        }
+    }
+    return snapshot;
+}
+
+Counter &
+MetricsRegistry::GetCounter(
+    const std::string & name
+    )
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto & counter = m_counters[name];
+    if (!counter) {
+        counter.reset(new Counter());
+    }
+    return *counter;
+}
+
+Histogram &
+MetricsRegistry::GetHistogram(
+    const std::string & name
+    )
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto & histogram = m_histograms[name];
+    if (!histogram) {
+        histogram.reset(new Histogram());
+    }
+    return *histogram;
+}
+
+void
+MetricsRegistry::SetGauge(
+    const std::string & name,
+    std::function<int64_t()> fn
+    )
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    m_gauges[name] = std::move(fn);
+}
+
+uint64_t
+MetricsRegistry::GetCounterValue(
+    const std::string & name
+    ) const
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto iter = m_counters.find(name);
+    return (iter == m_counters.end())? 0 : iter->second->Get();
+}
+
+std::string
+MetricsRegistry::GetStats() const
+{
+    std::map<std::string, std::string> values;
+
+    std::lock_guard<std::mutex> lck(m_mutex);
+    for (const auto & item : m_counters) {
+        values[item.first] = std::to_string(item.second->Get());
+    }
+    for (const auto & item : m_gauges) {
+        values[item.first] = std::to_string(item.second());
+    }
+    for (const auto & item : m_histograms) {
+        auto s = item.second->GetSnapshot();
+        std::ostringstream strm;
+        strm << "{\"count\":" << s.count << ",\"sum\":" << s.sum << ",\"max\":" << s.max
+             << ",\"p50\":" << s.p50 << ",\"p90\":" << s.p90 << ",\"p99\":" << s.p99
+             << ",\"p999\":" << s.p999 << "}";
+        values[item.first] = strm.str();
+    }
+
+    std::string stats = "{";
+    for (const auto & item : values) {
+        if (stats.size() > 1) {
+            stats.append(1, ',');
+        }
+        stats.append(JsonString::Quote(item.first)).append(1, ':').append(item.second);
+    }
+    stats.append(1, '}');
+    return stats;
+}
@@ -0,0 +1,171 @@
+#pragma once
+#ifndef __ENDPOINTLOG_METRICS_H__
+#define __ENDPOINTLOG_METRICS_H__
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+namespace EndpointLog {
+
+/// Number of shards of each metric. Each thread updates one shard, so that
+/// threads updating the same metric don't fight over one cache line.
+constexpr size_t MetricShards = 8;
+
+/// A monotonic counter. Add() is lock-free and wait-free.
+class Counter
+{
+public:
+    Counter() = default;
+
+    Counter(const Counter&) = delete;
+    Counter& operator=(const Counter&) = delete;
+
+    void Add(uint64_t n = 1);
+
+    /// Return the sum of all the shards.
+    uint64_t Get() const;
+
+private:
+    struct Shard
+    {
+        std::atomic<uint64_t> value{0};
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+    Shard m_shards[MetricShards];
+};
+
+/// Summary of a Histogram.
+struct HistogramSnapshot
+{
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+};
+
+/// A histogram of non-negative values, e.g. latencies in microseconds.
+///
+/// Like HdrHistogram, buckets are log-linear: each power of 2 is split into
+/// 8 linear sub-buckets, so a percentile is within 12.5% of the real value.
+/// Values up to 2^40 are recorded. Bigger values are counted in the last bucket.
+/// Record() is lock-free.
+class Histogram
+{
+public:
+    Histogram() = default;
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void Record(uint64_t value);
+
+    HistogramSnapshot GetSnapshot() const;
+
+    /// Return the index of the bucket of a value.
+    static size_t GetBucketIndex(uint64_t value);
+
+    /// Return the highest value that is counted in a bucket.
+    static uint64_t GetBucketMaxValue(size_t index);
+
+private:
+    constexpr static int SubBucketBits = 3;
+    constexpr static size_t SubBuckets = 1 << SubBucketBits;
+    constexpr static int MaxValueBits = 40;
+    constexpr static size_t NumBuckets = (MaxValueBits - SubBucketBits + 1) * SubBuckets;
+
+    struct Shard
+    {
+        std::atomic<uint64_t> buckets[NumBuckets];
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+
+        Shard();
+    };
+    Shard m_shards[MetricShards];
+};
+
+/// This class holds the metrics of one connection to mdsd by name. Metrics
+/// are created at first use and are never removed, so a component can look
+/// them up once and keep the reference. Updating a metric doesn't lock.
+///
+/// A gauge is a function called when the stats are created, e.g. the number
+/// of items in a queue.
+///
+/// Metric names use '.' to separate a metric from its label,
+/// e.g. "drop_count.ack_timeout".
+class MetricsRegistry
+{
+public:
+    MetricsRegistry() = default;
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    /// Return the counter of a name. Create it if it doesn't exist.
+    Counter & GetCounter(const std::string & name);
+
+    /// Return the histogram of a name. Create it if it doesn't exist.
+    Histogram & GetHistogram(const std::string & name);
+
+    /// Set the function of a gauge. Replace the old function if any.
+    void SetGauge(const std::string & name, std::function<int64_t()> fn);
+
+    /// Return the current value of a counter, or 0 if it doesn't exist.
+    uint64_t GetCounterValue(const std::string & name) const;
+
+    /// Return all the metrics as a JSON object, sorted by name. A counter or
+    /// a gauge is a number. A histogram is an object of count, sum, max and
+    /// percentiles.
+    std::string GetStats() const;
+
+private:
+    mutable std::mutex m_mutex; // protect the maps, not the metrics.
+    std::map<std::string, std::unique_ptr<Counter>> m_counters;
+    std::map<std::string, std::unique_ptr<Histogram>> m_histograms;
+    std::map<std::string, std::function<int64_t()>> m_gauges;
+};
+
+/// Names of the metrics shared by the components.
+namespace MetricNames {
+    constexpr const char* SendCount = "send_count";
+    constexpr const char* SendErrorCount = "send_error_count";
+    constexpr const char* SendBytes = "send_bytes";
+    constexpr const char* ResendCount = "resend_count";
+    constexpr const char* ReplayCount = "replay_count";
+    constexpr const char* ReplayItems = "replay_items";
+    constexpr const char* ReplayMicroSeconds = "replay_us";
+    constexpr const char* ReplayActive = "replay_active";
+    constexpr const char* ResendPaceWaitMicroSeconds = "resend_pace_wait_us";
+    constexpr const char* ZeroCopySends = "zerocopy_sends";
+    constexpr const char* ZeroCopyCopied = "zerocopy_copied";
+    constexpr const char* ZeroCopyPinned = "zerocopy_pinned";
+    constexpr const char* ConnectCount = "connect_count";
+    constexpr const char* ConnectMicroSeconds = "connect_us";
+    constexpr const char* EnqueueToSendMicroSeconds = "enqueue_to_send_us";
+    constexpr const char* SendToAckMicroSeconds = "send_to_ack_us";
+    constexpr const char* AckCountPrefix = "ack_count.";
+    constexpr const char* DropCountPrefix = "drop_count.";
+    constexpr const char* QueueDepth = "queue_depth";
+    constexpr const char* SenderBatchItems = "sender_batch_items";
+    constexpr const char* SenderBatchSendMicroSeconds = "sender_batch_send_us";
+    constexpr const char* SenderBatchItemsLimit = "sender_batch_limit_items";
+    constexpr const char* SenderBatchBytesLimit = "sender_batch_limit_bytes";
+    constexpr const char* SenderLingerMicroSeconds = "sender_linger_us";
+    constexpr const char* EncodeQueueDepth = "encode_queue_depth";
+    constexpr const char* EncodeThreads = "encode_threads";
+    constexpr const char* EncodeBusyMicroSeconds = "encode_busy_us";
+    constexpr const char* CacheItems = "cache_items";
+    constexpr const char* CacheBytes = "cache_bytes";
+}
+
+} // namespace
+
+#endif // __ENDPOINTLOG_METRICS_H__
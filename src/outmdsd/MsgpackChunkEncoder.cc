@@ -0,0 +1,690 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <stdexcept>
+#include <system_error>
+
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+#include "MsgpackChunkEncoder.h"
+#include "MsgpackReader.h"
+#include "JsonString.h"
+#include "SocketLogger.h"
+#include "RoutingLogger.h"
+#include "Trace.h"
+#include "TraceMacros.h"
+
+using namespace EndpointLog;
+
+using MsgType = MsgpackReader::Type;
+
+// max depth of nested arrays and maps in a record value.
+static const int MaxJsonDepth = 64;
+
+// fluentd EventTime MessagePack extension type.
+static const int8_t EventTimeExtType = 0;
+
+namespace {
+
+// Read-only memory map of a whole file.
+class MappedFile
+{
+public:
+    MappedFile(const std::string & filepath)
+    {
+        int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (-1 == fd) {
+            throw std::system_error(errno, std::system_category(), "open " + filepath + " failed");
+        }
+
+        struct stat st;
+        if (fstat(fd, &st)) {
+            auto errCopy = errno;
+            close(fd);
+            throw std::system_error(errCopy, std::system_category(), "fstat " + filepath + " failed");
+        }
+
+        m_size = static_cast<size_t>(st.st_size);
+        if (m_size) {
+            m_addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (MAP_FAILED == m_addr) {
+                auto errCopy = errno;
+                close(fd);
+                throw std::system_error(errCopy, std::system_category(), "mmap " + filepath + " failed");
+            }
+            // The chunk is read once from start to end.
+            madvise(m_addr, m_size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (m_size) {
+            munmap(m_addr, m_size);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* GetData() const { return static_cast<const char*>(m_addr); }
+    size_t GetSize() const { return m_size; }
+
+private:
+    void* m_addr = nullptr;
+    size_t m_size = 0;
+};
+
+} // namespace
+
+static std::string
+FormatTime(
+    uint64_t seconds,
+    uint64_t nanoseconds
+    )
+{
+    return "[" + std::to_string(seconds) + "," + std::to_string(nanoseconds) + "]";
+}
+
+static std::string
+GetTimeNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return FormatTime(ts.tv_sec, ts.tv_nsec);
+}
+
+static uint32_t
+GetBigEndianUInt32(
+    const char* data
+    )
+{
+    auto p = reinterpret_cast<const uint8_t*>(data);
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static bool
+IsEventTime(
+    const MsgpackReader::Object & obj
+    )
+{
+    return (MsgType::Ext == obj.type && EventTimeExtType == obj.extType && 8 == obj.size);
+}
+
+// Format the time of a chunk entry: EventTime, or seconds as integer or float.
+static std::string
+FormatEntryTime(
+    const MsgpackReader::Object & obj
+    )
+{
+    if (IsEventTime(obj)) {
+        return FormatTime(GetBigEndianUInt32(obj.data), GetBigEndianUInt32(obj.data + 4));
+    }
+    if (MsgType::UInt == obj.type) {
+        return FormatTime(obj.uintValue, 0);
+    }
+    if (MsgType::Float == obj.type && obj.floatValue >= 0) {
+        auto seconds = std::floor(obj.floatValue);
+        auto nanoseconds = std::floor((obj.floatValue - seconds) * 1e9);
+        return FormatTime(static_cast<uint64_t>(seconds), static_cast<uint64_t>(nanoseconds));
+    }
+    throw std::runtime_error("MsgpackChunkEncoder: unexpected time type in chunk entry.");
+}
+
+// Append a double in the same format as Ruby Float#to_s: the shortest digits
+// that round trip, in fixed notation for exponents in [-4, 16), or in
+// scientific notation otherwise, e.g. "1.0", "0.0001", "1.0e-05", "1.0e+16".
+static void
+AppendDouble(
+    std::string & out,
+    double value
+    )
+{
+    if (std::isnan(value)) {
+        out.append("NaN");
+        return;
+    }
+    if (std::isinf(value)) {
+        out.append(value < 0? "-Infinity" : "Infinity");
+        return;
+    }
+    if (0 == value) {
+        out.append(std::signbit(value)? "-0.0" : "0.0");
+        return;
+    }
+
+    char buf[40];
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(buf, sizeof(buf), "%.*e", precision-1, value);
+        if (strtod(buf, nullptr) == value) {
+            break;
+        }
+    }
+
+    // buf is like "-1.2345e+06"
+    const char* p = buf;
+    if ('-' == *p) {
+        out.append(1, '-');
+        p++;
+    }
+    std::string digits;
+    for (; *p != 'e'; p++) {
+        if ('.' != *p) {
+            digits.append(1, *p);
+        }
+    }
+    int exponent = atoi(p+1);
+
+    if (exponent >= -4 && exponent < 16) {
+        if (exponent >= 0) {
+            size_t nint = exponent + 1;
+            if (digits.size() < nint) {
+                digits.append(nint - digits.size(), '0');
+            }
+            out.append(digits, 0, nint).append(1, '.');
+            out.append(digits.size() > nint? digits.substr(nint) : "0");
+        }
+        else {
+            out.append("0.").append(-exponent-1, '0').append(digits);
+        }
+    }
+    else {
+        out.append(1, digits[0]).append(1, '.');
+        out.append(digits.size() > 1? digits.substr(1) : "0");
+        snprintf(buf, sizeof(buf), "e%+03d", exponent);
+        out.append(buf);
+    }
+}
+
+// Append a MessagePack object as JSON text. Elements of arrays and maps are
+// read from 'reader'.
+static void
+AppendJson(
+    MsgpackReader & reader,
+    const MsgpackReader::Object & obj,
+    std::string & out,
+    int depth
+    )
+{
+    if (depth > MaxJsonDepth) {
+        throw std::runtime_error("MsgpackChunkEncoder: too deeply nested record value.");
+    }
+
+    switch(obj.type) {
+        case MsgType::Nil:
+            out.append("null");
+            break;
+        case MsgType::Bool:
+            out.append(obj.boolValue? "true" : "false");
+            break;
+        case MsgType::Int:
+            out.append(std::to_string(obj.intValue));
+            break;
+        case MsgType::UInt:
+            out.append(std::to_string(obj.uintValue));
+            break;
+        case MsgType::Float:
+            if (std::isfinite(obj.floatValue)) {
+                AppendDouble(out, obj.floatValue);
+            }
+            else {
+                out.append("null");
+            }
+            break;
+        case MsgType::Str:
+        case MsgType::Bin:
+            JsonString::Append(out, obj.data, obj.size);
+            break;
+        case MsgType::Ext:
+            if (IsEventTime(obj)) {
+                out.append(std::to_string(GetBigEndianUInt32(obj.data)));
+            }
+            else {
+                JsonString::Append(out, obj.data, obj.size);
+            }
+            break;
+        case MsgType::Array:
+            out.append(1, '[');
+            for (size_t i = 0; i < obj.size; i++) {
+                if (i) {
+                    out.append(1, ',');
+                }
+                AppendJson(reader, reader.Next(), out, depth+1);
+            }
+            out.append(1, ']');
+            break;
+        case MsgType::Map:
+            out.append(1, '{');
+            for (size_t i = 0; i < obj.size; i++) {
+                if (i) {
+                    out.append(1, ',');
+                }
+                auto key = reader.Next();
+                if (MsgType::Str == key.type || MsgType::Bin == key.type) {
+                    JsonString::Append(out, key.data, key.size);
+                }
+                else {
+                    // JSON keys must be strings.
+                    std::string keyJson;
+                    AppendJson(reader, key, keyJson, depth+1);
+                    JsonString::Append(out, keyJson.data(), keyJson.size());
+                }
+                out.append(1, ':');
+                AppendJson(reader, reader.Next(), out, depth+1);
+            }
+            out.append(1, '}');
+            break;
+    }
+}
+
+// Append a record value the same way as MdsdMsgMaker.get_value_by_type().
+// Return the mdsd type of the value.
+static const char*
+AppendValue(
+    MsgpackReader & reader,
+    const MsgpackReader::Object & obj,
+    std::string & out
+    )
+{
+    switch(obj.type) {
+        case MsgType::Nil:
+            out.append("\"null\"");
+            return "FT_STRING";
+        case MsgType::Bool:
+            out.append(obj.boolValue? "true" : "false");
+            return "FT_BOOL";
+        case MsgType::Int:
+            out.append(std::to_string(obj.intValue));
+            return "FT_INT64";
+        case MsgType::UInt:
+            out.append(std::to_string(obj.uintValue));
+            return "FT_INT64";
+        case MsgType::Float:
+            AppendDouble(out, obj.floatValue);
+            return "FT_DOUBLE";
+        case MsgType::Str:
+        case MsgType::Bin:
+            JsonString::Append(out, obj.data, obj.size);
+            return "FT_STRING";
+        default:
+        {
+            std::string json;
+            AppendJson(reader, obj, json, 0);
+            if (MsgType::Ext == obj.type) {
+                // json is already a quoted string or a number.
+                if ('"' != json[0]) {
+                    json = JsonString::Quote(json);
+                }
+                out.append(json);
+            }
+            else {
+                JsonString::Append(out, json.data(), json.size());
+            }
+            return "FT_STRING";
+        }
+    }
+}
+
+MsgpackChunkEncoder::MsgpackChunkEncoder(
+    const std::vector<std::string> & tagPatterns,
+    const std::string & timestampName,
+    bool useSourceTimestamp,
+    size_t maxRecordSize
+    ) :
+    m_sourceResolver(tagPatterns),
+    m_timestampName(timestampName),
+    m_useSourceTimestamp(useSourceTimestamp),
+    m_maxRecordSize(maxRecordSize)
+{
+}
+
+size_t
+MsgpackChunkEncoder::GetNumSchemas() const
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    return m_schemas.size();
+}
+
+SendResult
+MsgpackChunkEncoder::RunEncode(
+    size_t startIndex,
+    const std::function<void(SendResult&)> & encodeFunc
+    )
+{
+    SendResult result;
+    result.failedIndex = startIndex;
+    try {
+        encodeFunc(result);
+        return result;
+    }
+    catch(const std::exception & ex) {
+        Log(TraceLevel::Error, "MsgpackChunkEncoder exception: " << ex.what());
+    }
+    catch(...) {
+        Log(TraceLevel::Error, "MsgpackChunkEncoder hit unknown exception");
+    }
+    // The chunk fails the same way if it is sent again.
+    result.success = false;
+    result.retryable = false;
+    return result;
+}
+
+bool
+MsgpackChunkEncoder::SendChunkFile(
+    SocketLogger & logger,
+    const std::string & filepath
+    )
+{
+    return SendChunkFileFrom(logger, filepath, 0).success;
+}
+
+bool
+MsgpackChunkEncoder::SendChunkFile(
+    RoutingLogger & logger,
+    const std::string & filepath
+    )
+{
+    return SendChunkFileFrom(logger, filepath, 0).success;
+}
+
+bool
+MsgpackChunkEncoder::SendChunkData(
+    SocketLogger & logger,
+    const std::string & chunkData
+    )
+{
+    return SendChunkDataFrom(logger, chunkData, 0).success;
+}
+
+bool
+MsgpackChunkEncoder::SendChunkData(
+    RoutingLogger & logger,
+    const std::string & chunkData
+    )
+{
+    return SendChunkDataFrom(logger, chunkData, 0).success;
+}
+
+SendResult
+MsgpackChunkEncoder::SendChunkFileFrom(
+    SocketLogger & logger,
+    const std::string & filepath,
+    size_t startIndex
+    )
+{
+    return RunEncode(startIndex, [this, &logger, &filepath, startIndex](SendResult & result) {
+        EncodeChunkFile(filepath, startIndex, [&logger](const std::string & source, const std::string & data) {
+            return logger.SendDjson(source, data);
+        }, result);
+    });
+}
+
+SendResult
+MsgpackChunkEncoder::SendChunkFileFrom(
+    RoutingLogger & logger,
+    const std::string & filepath,
+    size_t startIndex
+    )
+{
+    return RunEncode(startIndex, [this, &logger, &filepath, startIndex](SendResult & result) {
+        EncodeChunkFile(filepath, startIndex, [&logger](const std::string & source, const std::string & data) {
+            return logger.SendDjson(source, data);
+        }, result);
+    });
+}
+
+SendResult
+MsgpackChunkEncoder::SendChunkDataFrom(
+    SocketLogger & logger,
+    const std::string & chunkData,
+    size_t startIndex
+    )
+{
+    return RunEncode(startIndex, [this, &logger, &chunkData, startIndex](SendResult & result) {
+        EncodeChunk(chunkData.data(), chunkData.size(), startIndex,
+            [&logger](const std::string & source, const std::string & data) {
+                return logger.SendDjson(source, data);
+            }, result);
+    });
+}
+
+SendResult
+MsgpackChunkEncoder::SendChunkDataFrom(
+    RoutingLogger & logger,
+    const std::string & chunkData,
+    size_t startIndex
+    )
+{
+    return RunEncode(startIndex, [this, &logger, &chunkData, startIndex](SendResult & result) {
+        EncodeChunk(chunkData.data(), chunkData.size(), startIndex,
+            [&logger](const std::string & source, const std::string & data) {
+                return logger.SendDjson(source, data);
+            }, result);
+    });
+}
+
+bool
+MsgpackChunkEncoder::EncodeChunkFile(
+    const std::string & filepath,
+    const SendFunc & sendFunc
+    )
+{
+    SendResult result;
+    EncodeChunkFile(filepath, 0, sendFunc, result);
+    return result.success;
+}
+
+void
+MsgpackChunkEncoder::EncodeChunkFile(
+    const std::string & filepath,
+    size_t startIndex,
+    const SendFunc & sendFunc,
+    SendResult & result
+    )
+{
+    ADD_DEBUG_TRACE;
+
+    MappedFile chunk(filepath);
+    EncodeChunk(chunk.GetData(), chunk.GetSize(), startIndex, sendFunc, result);
+}
+
+bool
+MsgpackChunkEncoder::EncodeChunk(
+    const char* data,
+    size_t len,
+    const SendFunc & sendFunc
+    )
+{
+    SendResult result;
+    EncodeChunk(data, len, 0, sendFunc, result);
+    return result.success;
+}
+
+void
+MsgpackChunkEncoder::EncodeChunk(
+    const char* data,
+    size_t len,
+    size_t startIndex,
+    const SendFunc & sendFunc,
+    SendResult & result
+    )
+{
+    ADD_DEBUG_TRACE;
+
+    MsgpackReader reader(data, len);
+    std::string schemaAndData;
+    // Records of a chunk usually have the same tag.
+    std::string lastTag;
+    std::string source;
+
+    for (size_t index = 0; !reader.AtEnd(); index++) {
+        // If decoding throws, this is where the send stops.
+        result.failedIndex = index;
+
+        auto entryPos = reader.GetPosition();
+        auto entry = reader.Next();
+        if (MsgType::Array != entry.type || entry.size < 2) {
+            throw std::runtime_error("MsgpackChunkEncoder: unexpected chunk entry at offset " +
+                std::to_string(entryPos));
+        }
+        if (index < startIndex) {
+            for (size_t i = 0; i < entry.size; i++) {
+                reader.Skip();
+            }
+            continue;
+        }
+
+        auto tag = reader.Next();
+        if (MsgType::Str != tag.type && MsgType::Bin != tag.type) {
+            throw std::runtime_error("MsgpackChunkEncoder: unexpected tag type at offset " +
+                std::to_string(entryPos));
+        }
+
+        std::string timeValue;
+        if (entry.size >= 3) {
+            if (m_useSourceTimestamp) {
+                timeValue = FormatEntryTime(reader.Next());
+            }
+            else {
+                reader.Skip();
+            }
+        }
+        if (timeValue.empty()) {
+            timeValue = GetTimeNow();
+        }
+
+        EncodeRecord(reader, timeValue, schemaAndData);
+        for (size_t i = 3; i < entry.size; i++) {
+            reader.Skip();
+        }
+
+        if (source.empty() || lastTag.compare(0, std::string::npos, tag.data, tag.size)) {
+            lastTag = tag.ToString();
+            source = m_sourceResolver.Resolve(lastTag);
+        }
+        if (schemaAndData.size() > m_maxRecordSize) {
+            m_numDropped++;
+            result.numAccepted++;
+            LogEveryN(TraceLevel::Warning, 100, "Dropping too large record to mdsd with size="
+                << schemaAndData.size() << ", source='" << source << "'");
+            continue;
+        }
+
+        if (!sendFunc(source, schemaAndData)) {
+            result.success = false;
+            result.retryable = IsValidDjson(source, schemaAndData);
+            return;
+        }
+        m_numSent++;
+        result.numAccepted++;
+    }
+}
+
+void
+MsgpackChunkEncoder::EncodeRecord(
+    MsgpackReader & reader,
+    const std::string & timeValue,
+    std::string & schemaAndData
+    )
+{
+    auto record = reader.Next();
+    if (MsgType::Map != record.type) {
+        throw std::runtime_error("MsgpackChunkEncoder: record is not a map.");
+    }
+
+    // Like the Ruby hash, if the record already has the timestamp field, its
+    // value is replaced in place. Otherwise, the field is added at the end.
+    std::vector<std::pair<std::string, const char*>> fields;
+    // The map size comes from the chunk. Each key and value takes at least
+    // 1 byte, so don't reserve more than the data left can hold.
+    fields.reserve(std::min<size_t>(record.size, reader.GetRemaining() / 2) + 1);
+    std::string values = "[";
+    bool hasTimestamp = false;
+
+    for (size_t i = 0; i < record.size; i++) {
+        auto key = reader.Next();
+        std::string name;
+        if (MsgType::Str == key.type || MsgType::Bin == key.type) {
+            name = key.ToString();
+        }
+        else if (MsgType::UInt == key.type) {
+            name = std::to_string(key.uintValue);
+        }
+        else if (MsgType::Int == key.type) {
+            name = std::to_string(key.intValue);
+        }
+        else {
+            throw std::runtime_error("MsgpackChunkEncoder: unsupported record key type.");
+        }
+
+        if (i) {
+            values.append(1, ',');
+        }
+        if (name == m_timestampName) {
+            reader.Skip();
+            values.append(timeValue);
+            fields.emplace_back(std::move(name), "FT_TIME");
+            hasTimestamp = true;
+        }
+        else {
+            auto type = AppendValue(reader, reader.Next(), values);
+            fields.emplace_back(std::move(name), type);
+        }
+    }
+
+    if (!hasTimestamp) {
+        if (!fields.empty()) {
+            values.append(1, ',');
+        }
+        values.append(timeValue);
+        fields.emplace_back(m_timestampName, "FT_TIME");
+    }
+    values.append(1, ']');
+
+    const auto & schema = GetSchema(fields);
+    auto schemaId = std::to_string(schema.first);
+
+    schemaAndData.clear();
+    schemaAndData.reserve(schemaId.size() + schema.second.size() + values.size() + 2);
+    schemaAndData.append(schemaId).append(1, ',').append(schema.second).append(1, ',').append(values);
+}
+
+const std::pair<uint64_t, std::string> &
+MsgpackChunkEncoder::GetSchema(
+    const std::vector<std::pair<std::string, const char*>> & fields
+    )
+{
+    std::string key;
+    for (const auto & field : fields) {
+        key.append(field.first).append(1, '\0').append(field.second).append(1, '\0');
+    }
+
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto iter = m_schemas.find(key);
+    if (iter != m_schemas.end()) {
+        return iter->second;
+    }
+
+    // Same format as SchemaManager: the index of the timestamp field, then
+    // the name and type of each field.
+    std::string schema = "[" + std::to_string(fields.size()-1);
+    for (const auto & field : fields) {
+        schema.append(",[");
+        JsonString::Append(schema, field.first.data(), field.first.size());
+        schema.append(",\"").append(field.second).append("\"]");
+    }
+    schema.append(1, ']');
+
+    auto & value = m_schemas[key];
+    value = std::make_pair(++m_lastSchemaId, std::move(schema));
+    return value;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#ifndef __ENDPOINTLOG_MSGPACKCHUNKENCODER_H__
+#define __ENDPOINTLOG_MSGPACKCHUNKENCODER_H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <atomic>
+
+#include "SourceResolver.h"
+#include "SendResult.h"
+
+namespace EndpointLog {
+
+class SocketLogger;
+class RoutingLogger;
+class MsgpackReader;
+
+/// This class sends the records of a fluentd buffer chunk to mdsd without
+/// creating any Ruby object for them.
+///
+/// A chunk is the output of out_mdsd's format(): a series of MessagePack
+/// arrays [tag, time, record] or [tag, record]. The chunk is decoded in place
+/// (a file chunk is memory mapped), and each record is encoded to the same
+/// DJSON schema and data string that the Ruby MdsdMsgMaker class creates:
+/// - the source name is the first match of the tag regex patterns, or the tag.
+/// - the emit timestamp field is added as the last field.
+/// - the schema array starts with the index of the timestamp field.
+/// - types not supported by mdsd are sent as FT_STRING. Nested arrays and maps
+///   are sent as JSON text.
+///
+/// Schema ids are allocated by each encoder, like the Ruby SchemaManager,
+/// so a logger should get all its records from one encoder.
+///
+class MsgpackChunkEncoder
+{
+public:
+    /// <summary>
+    /// Construct a new encoder.
+    /// <param name='tagPatterns'> regex patterns to map fluentd tags to mdsd
+    /// source names. Invalid patterns are logged and ignored. </param>
+    /// <param name='timestampName'> name of the emit timestamp field. </param>
+    /// <param name='useSourceTimestamp'> if true, use the time in the chunk as
+    /// the emit timestamp. Otherwise, use current time. </param>
+    /// <param name='maxRecordSize'> records whose schema and data are bigger
+    /// than this are dropped. </param>
+    /// </summary>
+    MsgpackChunkEncoder(
+        const std::vector<std::string> & tagPatterns,
+        const std::string & timestampName,
+        bool useSourceTimestamp,
+        size_t maxRecordSize
+        );
+
+    ~MsgpackChunkEncoder() = default;
+
+    // not copyable, not movable
+    MsgpackChunkEncoder(const MsgpackChunkEncoder&) = delete;
+    MsgpackChunkEncoder& operator=(const MsgpackChunkEncoder &) = delete;
+
+    MsgpackChunkEncoder(MsgpackChunkEncoder&& h) = delete;
+    MsgpackChunkEncoder& operator=(MsgpackChunkEncoder&& h) = delete;
+
+    /// Send all the records of a chunk file to the logger.
+    /// Return true if all the records are sent or dropped because they are too
+    /// large. Return false if any send fails, or if the chunk can't be decoded.
+    bool SendChunkFile(SocketLogger & logger, const std::string & filepath);
+    bool SendChunkFile(RoutingLogger & logger, const std::string & filepath);
+
+    /// Same as SendChunkFile() except that the chunk is in memory.
+    bool SendChunkData(SocketLogger & logger, const std::string & chunkData);
+    bool SendChunkData(RoutingLogger & logger, const std::string & chunkData);
+
+    /// Same as SendChunkFile() except that the records before 'startIndex' are
+    /// skipped, and the result tells where the send stops, so that a chunk can
+    /// be resumed after a failure (see SendResult). Records are counted from 0,
+    /// including the ones dropped because they are too large. A chunk that
+    /// can't be read or decoded fails permanently at the record where decoding
+    /// fails, which is before 'startIndex' if a skipped record is bad.
+    SendResult SendChunkFileFrom(SocketLogger & logger, const std::string & filepath, size_t startIndex);
+    SendResult SendChunkFileFrom(RoutingLogger & logger, const std::string & filepath, size_t startIndex);
+
+    /// Same as SendChunkFileFrom() except that the chunk is in memory.
+    SendResult SendChunkDataFrom(SocketLogger & logger, const std::string & chunkData, size_t startIndex);
+    SendResult SendChunkDataFrom(RoutingLogger & logger, const std::string & chunkData, size_t startIndex);
+
+    /// Return total number of records sent.
+    size_t GetNumRecordsSent() const { return m_numSent; }
+
+    /// Return total number of records dropped because they are too large.
+    size_t GetNumRecordsDropped() const { return m_numDropped; }
+
+    /// Return number of schemas created.
+    size_t GetNumSchemas() const;
+
+#ifndef SWIG
+    /// Function to send a record. Return true if success, false otherwise.
+    using SendFunc = DjsonSendFunc;
+
+    /// Encode the records of a chunk and call sendFunc on each of them
+    /// until it returns false. Return false if sendFunc returns false.
+    /// Throw exception if the chunk can't be decoded.
+    bool EncodeChunk(const char* data, size_t len, const SendFunc & sendFunc);
+
+    /// Same as EncodeChunk() above except that the records before 'startIndex'
+    /// are skipped. 'result' is updated as the records are sent, so it tells
+    /// where the send stops even if an exception is thrown. A record that
+    /// sendFunc fails is retryable unless it is invalid (see IsValidDjson()).
+    void EncodeChunk(const char* data, size_t len, size_t startIndex, const SendFunc & sendFunc,
+                     SendResult & result);
+
+    /// Memory map a chunk file and call EncodeChunk() on it.
+    /// Throw exception for any file error.
+    bool EncodeChunkFile(const std::string & filepath, const SendFunc & sendFunc);
+    void EncodeChunkFile(const std::string & filepath, size_t startIndex, const SendFunc & sendFunc,
+                         SendResult & result);
+#endif // SWIG
+
+private:
+    /// Encode one record map to DJSON schema and data.
+    void EncodeRecord(MsgpackReader & reader, const std::string & timeValue, std::string & schemaAndData);
+
+    /// Return schema id and schema string of the given field names and types.
+    const std::pair<uint64_t, std::string> & GetSchema(const std::vector<std::pair<std::string, const char*>> & fields);
+
+    /// Call encodeFunc on a new result starting at 'startIndex' and return the
+    /// result. Log any exception and return it as a permanent failure.
+    static SendResult RunEncode(size_t startIndex, const std::function<void(SendResult&)> & encodeFunc);
+
+private:
+    SourceResolver m_sourceResolver;
+    std::string m_timestampName;
+    bool m_useSourceTimestamp;
+    size_t m_maxRecordSize;
+
+    mutable std::mutex m_mutex; // protect m_schemas and m_lastSchemaId.
+    std::unordered_map<std::string, std::pair<uint64_t, std::string>> m_schemas; // key -> <id, schema>
+    uint64_t m_lastSchemaId = 0;
+
+    std::atomic<size_t> m_numSent{0};
+    std::atomic<size_t> m_numDropped{0};
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_MSGPACKCHUNKENCODER_H__
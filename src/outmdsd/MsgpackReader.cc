@@ -0,0 +1,171 @@
+#include <stdexcept>
+#include <cstring>
+
+#include "MsgpackReader.h"
+
+using namespace EndpointLog;
+
+const char*
+MsgpackReader::Consume(
+    size_t n
+    )
+{
+    if (n > m_len - m_pos) {
+        throw std::runtime_error("MsgpackReader: truncated data at offset " + std::to_string(m_pos));
+    }
+    auto p = m_data + m_pos;
+    m_pos += n;
+    return p;
+}
+
+uint8_t
+MsgpackReader::ReadUInt8()
+{
+    return static_cast<uint8_t>(*Consume(1));
+}
+
+uint16_t
+MsgpackReader::ReadUInt16()
+{
+    auto p = reinterpret_cast<const uint8_t*>(Consume(2));
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t
+MsgpackReader::ReadUInt32()
+{
+    auto p = reinterpret_cast<const uint8_t*>(Consume(4));
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+uint64_t
+MsgpackReader::ReadUInt64()
+{
+    uint64_t high = ReadUInt32();
+    return (high << 32) | ReadUInt32();
+}
+
+void
+MsgpackReader::SetPayload(
+    Object & obj,
+    Type type,
+    size_t size
+    )
+{
+    obj.type = type;
+    obj.size = size;
+    obj.data = Consume(size);
+}
+
+void
+MsgpackReader::SetExt(
+    Object & obj,
+    size_t size
+    )
+{
+    obj.extType = static_cast<int8_t>(ReadUInt8());
+    SetPayload(obj, Type::Ext, size);
+}
+
+MsgpackReader::Object
+MsgpackReader::Next()
+{
+    Object obj;
+    auto b = ReadUInt8();
+
+    if (b <= 0x7f) {
+        obj.type = Type::UInt;
+        obj.uintValue = b;
+    }
+    else if (b >= 0xe0) {
+        obj.type = Type::Int;
+        obj.intValue = static_cast<int8_t>(b);
+    }
+    else if (b <= 0x8f) {
+        obj.type = Type::Map;
+        obj.size = b & 0x0f;
+    }
+    else if (b <= 0x9f) {
+        obj.type = Type::Array;
+        obj.size = b & 0x0f;
+    }
+    else if (b <= 0xbf) {
+        SetPayload(obj, Type::Str, b & 0x1f);
+    }
+    else {
+        switch(b) {
+            case 0xc0: obj.type = Type::Nil; break;
+            case 0xc2: obj.type = Type::Bool; obj.boolValue = false; break;
+            case 0xc3: obj.type = Type::Bool; obj.boolValue = true; break;
+            case 0xc4: SetPayload(obj, Type::Bin, ReadUInt8()); break;
+            case 0xc5: SetPayload(obj, Type::Bin, ReadUInt16()); break;
+            case 0xc6: SetPayload(obj, Type::Bin, ReadUInt32()); break;
+            case 0xc7: SetExt(obj, ReadUInt8()); break;
+            case 0xc8: SetExt(obj, ReadUInt16()); break;
+            case 0xc9: SetExt(obj, ReadUInt32()); break;
+            case 0xca:
+            {
+                auto bits = ReadUInt32();
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                obj.type = Type::Float;
+                obj.floatValue = f;
+                break;
+            }
+            case 0xcb:
+            {
+                auto bits = ReadUInt64();
+                memcpy(&obj.floatValue, &bits, sizeof(obj.floatValue));
+                obj.type = Type::Float;
+                break;
+            }
+            case 0xcc: obj.type = Type::UInt; obj.uintValue = ReadUInt8(); break;
+            case 0xcd: obj.type = Type::UInt; obj.uintValue = ReadUInt16(); break;
+            case 0xce: obj.type = Type::UInt; obj.uintValue = ReadUInt32(); break;
+            case 0xcf: obj.type = Type::UInt; obj.uintValue = ReadUInt64(); break;
+            case 0xd0: obj.intValue = static_cast<int8_t>(ReadUInt8()); break;
+            case 0xd1: obj.intValue = static_cast<int16_t>(ReadUInt16()); break;
+            case 0xd2: obj.intValue = static_cast<int32_t>(ReadUInt32()); break;
+            case 0xd3: obj.intValue = static_cast<int64_t>(ReadUInt64()); break;
+            case 0xd4: SetExt(obj, 1); break;
+            case 0xd5: SetExt(obj, 2); break;
+            case 0xd6: SetExt(obj, 4); break;
+            case 0xd7: SetExt(obj, 8); break;
+            case 0xd8: SetExt(obj, 16); break;
+            case 0xd9: SetPayload(obj, Type::Str, ReadUInt8()); break;
+            case 0xda: SetPayload(obj, Type::Str, ReadUInt16()); break;
+            case 0xdb: SetPayload(obj, Type::Str, ReadUInt32()); break;
+            case 0xdc: obj.type = Type::Array; obj.size = ReadUInt16(); break;
+            case 0xdd: obj.type = Type::Array; obj.size = ReadUInt32(); break;
+            case 0xde: obj.type = Type::Map; obj.size = ReadUInt16(); break;
+            case 0xdf: obj.type = Type::Map; obj.size = ReadUInt32(); break;
+            default:
+                throw std::runtime_error("MsgpackReader: invalid type byte at offset " + std::to_string(m_pos-1));
+        }
+
+        if (b >= 0xd0 && b <= 0xd3) {
+            obj.type = (obj.intValue < 0)? Type::Int : Type::UInt;
+            obj.uintValue = static_cast<uint64_t>(obj.intValue);
+        }
+    }
+    return obj;
+}
+
+void
+MsgpackReader::Skip()
+{
+    // number of objects left to skip. Nested elements are added to it,
+    // so that deeply nested data doesn't use the stack.
+    uint64_t nleft = 1;
+    while(nleft) {
+        auto obj = Next();
+        nleft--;
+        if (Type::Array == obj.type) {
+            nleft += obj.size;
+        }
+        else if (Type::Map == obj.type) {
+            nleft += 2 * static_cast<uint64_t>(obj.size);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef __ENDPOINTLOG_MSGPACKREADER_H__
+#define __ENDPOINTLOG_MSGPACKREADER_H__
+
+#include <string>
+#include <cstdint>
+
+namespace EndpointLog {
+
+/// This class decodes MessagePack data in place, one object at a time,
+/// without copying strings or building any object tree.
+///
+/// For arrays and maps, Next() only reads the header. The caller then reads
+/// the elements (or calls Skip() for each of them).
+///
+class MsgpackReader
+{
+public:
+    enum class Type
+    {
+        Nil,
+        Bool,
+        Int,    // negative integer
+        UInt,   // non-negative integer
+        Float,
+        Str,
+        Bin,
+        Array,
+        Map,
+        Ext
+    };
+
+    struct Object
+    {
+        Type type = Type::Nil;
+        bool boolValue = false;
+        int64_t intValue = 0;
+        uint64_t uintValue = 0;
+        double floatValue = 0;
+        const char* data = nullptr; // payload of Str, Bin and Ext.
+        size_t size = 0;            // payload size of Str, Bin and Ext, or number of elements of Array and Map.
+        int8_t extType = 0;
+
+        std::string ToString() const { return std::string(data, size); }
+    };
+
+    /// The caller must keep 'data' valid while using the reader.
+    MsgpackReader(const char* data, size_t len) : m_data(data), m_len(len) {}
+
+    /// Return true if all the data are read.
+    bool AtEnd() const { return m_pos >= m_len; }
+
+    /// Return number of bytes read so far.
+    size_t GetPosition() const { return m_pos; }
+
+    /// Return number of bytes not read yet.
+    size_t GetRemaining() const { return (m_pos < m_len)? (m_len - m_pos) : 0; }
+
+    /// Read the next object. Throw std::runtime_error if the data are
+    /// truncated or invalid.
+    Object Next();
+
+    /// Skip the next object, including all the elements if it is an
+    /// array or a map. Throw std::runtime_error if the data are truncated
+    /// or invalid.
+    void Skip();
+
+private:
+    const char* Consume(size_t n);
+    uint8_t ReadUInt8();
+    uint16_t ReadUInt16();
+    uint32_t ReadUInt32();
+    uint64_t ReadUInt64();
+
+    void SetPayload(Object & obj, Type type, size_t size);
+    void SetExt(Object & obj, size_t size);
+
+private:
+    const char* m_data;
+    size_t m_len;
+    size_t m_pos = 0;
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_MSGPACKREADER_H__
@@ -0,0 +1,179 @@
+#pragma once
+#ifndef __ENDPOINTLOG_POOLALLOCATOR_H__
+#define __ENDPOINTLOG_POOLALLOCATOR_H__
+
+#include <cstddef>
+#include <new>
+#include <mutex>
+
+namespace EndpointLog {
+
+/// This class implements a process-wide pool of memory blocks of the same size.
+///
+/// Each thread keeps freed blocks in its own cache, so that most Allocate() and
+/// Deallocate() calls take no lock. Because log items are usually created in one
+/// thread and freed in another thread (e.g. DataReader thread after ack), a thread
+/// cache that grows over a limit moves a batch of blocks to a shared free list,
+/// where other threads can take them from.
+///
+/// Blocks are never returned to the system. So the memory held by the pool is
+/// bounded by the max number of blocks in use at the same time.
+template<size_t BlockSize>
+class FixedBlockPool
+{
+public:
+    static void* Allocate()
+    {
+        auto & cache = GetThreadCache();
+        if (!cache.head) {
+            GetSharedList().Take(cache);
+        }
+        if (!cache.head) {
+            return ::operator new(BlockSize);
+        }
+
+        auto block = cache.head;
+        cache.head = block->next;
+        cache.count--;
+        return block;
+    }
+
+    static void Deallocate(void* p)
+    {
+        if (!p) {
+            return;
+        }
+        auto & cache = GetThreadCache();
+        auto block = static_cast<Block*>(p);
+        block->next = cache.head;
+        cache.head = block;
+        cache.count++;
+
+        if (cache.count > MaxCacheSize) {
+            GetSharedList().Give(cache, BatchSize);
+        }
+    }
+
+private:
+    static_assert(BlockSize >= sizeof(void*), "FixedBlockPool: block size is too small.");
+
+    constexpr static size_t BatchSize = 64;            // blocks moved between thread cache and shared list
+    constexpr static size_t MaxCacheSize = 2 * BatchSize; // max blocks in a thread cache
+
+    struct Block
+    {
+        Block* next;
+    };
+
+    struct ThreadCache;
+
+    struct SharedList
+    {
+        std::mutex mutex;
+        Block* head = nullptr;
+
+        // Move up to BatchSize blocks to the thread cache.
+        void Take(ThreadCache & cache)
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            for (size_t i = 0; i < BatchSize && head; i++) {
+                auto block = head;
+                head = block->next;
+                block->next = cache.head;
+                cache.head = block;
+                cache.count++;
+            }
+        }
+
+        // Move up to n blocks from the thread cache to the shared list.
+        void Give(ThreadCache & cache, size_t n)
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            for (size_t i = 0; i < n && cache.head; i++) {
+                auto block = cache.head;
+                cache.head = block->next;
+                cache.count--;
+                block->next = head;
+                head = block;
+            }
+        }
+    };
+
+    struct ThreadCache
+    {
+        Block* head = nullptr;
+        size_t count = 0;
+
+        // When a thread exits, let other threads use its blocks.
+        ~ThreadCache()
+        {
+            if (head) {
+                GetSharedList().Give(*this, count);
+            }
+        }
+    };
+
+    // Use a static pointer to avoid static object deinitialization order issue
+    // with the thread caches.
+    static SharedList& GetSharedList()
+    {
+        static SharedList* s = new SharedList();
+        return *s;
+    }
+
+    static ThreadCache& GetThreadCache()
+    {
+        static thread_local ThreadCache c;
+        return c;
+    }
+};
+
+/// A standard allocator that gets single objects from FixedBlockPool.
+/// Arrays are allocated by operator new.
+///
+/// It is designed to be used with std::allocate_shared, so that an object and
+/// its shared_ptr control block share one pooled memory block.
+template<typename T>
+class PoolAllocator
+{
+public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (1 != n) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(Pool::Allocate());
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (1 != n) {
+            ::operator delete(p);
+        }
+        else {
+            Pool::Deallocate(p);
+        }
+    }
+
+private:
+    // Round the block size so that types of similar sizes share the same pool.
+    constexpr static size_t Alignment = alignof(std::max_align_t);
+    using Pool = FixedBlockPool<(sizeof(T) + Alignment - 1) / Alignment * Alignment>;
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true; }
+
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false; }
+
+} // namespace
+
+#endif // __ENDPOINTLOG_POOLALLOCATOR_H__
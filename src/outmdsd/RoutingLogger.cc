@@ -0,0 +1,399 @@
+#include <stdexcept>
+#include <algorithm>
+
+#include "RoutingLogger.h"
+#include "SocketLogger.h"
+#include "SpillFile.h"
+#include "JsonString.h"
+#include "Trace.h"
+#include "TraceMacros.h"
+
+using namespace EndpointLog;
+
+// Number of points each endpoint has on the hash ring. More points give more
+// even distribution of sources among endpoints.
+static constexpr int VirtualNodesPerEndpoint = 160;
+
+struct RoutingLogger::Endpoint
+{
+    Endpoint(
+        const std::string & sockFile,
+        unsigned int ackTimeoutMS,
+        unsigned int resendIntervalMS,
+        unsigned int connRetryTimeoutMS,
+        const std::string & ioEngine
+        ) :
+        socketFile(sockFile),
+        logger(new SocketLogger(sockFile, ackTimeoutMS, resendIntervalMS, connRetryTimeoutMS, ioEngine))
+    {
+    }
+
+    std::string socketFile;
+    std::unique_ptr<SocketLogger> logger;
+    std::atomic<bool> isUp{true};
+
+    std::mutex reconnectMutex; // protect reconnectTask
+    std::future<void> reconnectTask;
+};
+
+// 64-bit FNV-1a hash followed by a finalizer to spread similar strings
+// (e.g. "/var/run/mdsd/default_djson.socket#1" and "#2") over the ring.
+// std::hash is not used so that the ring is the same across builds.
+static uint64_t
+GetHashValue(
+    const std::string & str
+    )
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto c : str) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+RoutingLogger::RoutingLogger(
+    const std::vector<std::string>& socketFiles,
+    unsigned int ackTimeoutMS,
+    unsigned int resendIntervalMS,
+    unsigned int connRetryTimeoutMS,
+    const std::string& ioEngine
+    )
+{
+    if (socketFiles.empty()) {
+        throw std::invalid_argument("RoutingLogger: unexpected empty socket file list.");
+    }
+
+    for (size_t i = 0; i < socketFiles.size(); i++) {
+        const auto & sockFile = socketFiles[i];
+        for (size_t j = 0; j < i; j++) {
+            if (sockFile == socketFiles[j]) {
+                throw std::invalid_argument("RoutingLogger: duplicate socket file '" + sockFile + "'.");
+            }
+        }
+
+        m_endpoints.emplace_back(new Endpoint(sockFile, ackTimeoutMS, resendIntervalMS, connRetryTimeoutMS, ioEngine));
+        for (int k = 0; k < VirtualNodesPerEndpoint; k++) {
+            // On the rare hash collision, the first endpoint keeps the point.
+            m_hashRing.emplace(GetHashValue(sockFile + "#" + std::to_string(k)), i);
+        }
+    }
+}
+
+RoutingLogger::~RoutingLogger()
+{
+    try {
+        ADD_INFO_TRACE;
+
+        // Stop all the loggers first, so that reconnect tasks finish immediately.
+        for (auto & endpoint : m_endpoints) {
+            endpoint->logger->Stop();
+        }
+        for (auto & endpoint : m_endpoints) {
+            std::lock_guard<std::mutex> lck(endpoint->reconnectMutex);
+            if (endpoint->reconnectTask.valid()) {
+                endpoint->reconnectTask.get();
+            }
+        }
+    }
+    catch(const std::exception& ex)
+    {
+        Log(TraceLevel::Error, "unexpected exception: " << ex.what());
+    }
+    catch(...)
+    {} // no exception thrown from destructor
+}
+
+void
+RoutingLogger::AddMirrorSource(
+    const std::string & sourceName
+    )
+{
+    std::lock_guard<std::mutex> lck(m_mirrorMutex);
+    m_mirrorSources.insert(sourceName);
+}
+
+bool
+RoutingLogger::SetReplayPolicy(
+    const std::string & policy
+    )
+{
+    for (auto & endpoint : m_endpoints) {
+        if (!endpoint->logger->SetReplayPolicy(policy)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+RoutingLogger::SetResendShare(
+    unsigned int percent
+    )
+{
+    for (auto & endpoint : m_endpoints) {
+        if (!endpoint->logger->SetResendShare(percent)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<size_t>
+RoutingLogger::GetEndpointOrder(
+    const std::string & sourceName
+    ) const
+{
+    std::vector<size_t> order;
+    order.reserve(m_endpoints.size());
+
+    auto iter = m_hashRing.upper_bound(GetHashValue(sourceName));
+    for (size_t n = 0; n < m_hashRing.size() && order.size() < m_endpoints.size(); n++, iter++) {
+        if (m_hashRing.end() == iter) {
+            iter = m_hashRing.begin();
+        }
+        auto index = iter->second;
+        if (order.end() == std::find(order.begin(), order.end(), index)) {
+            order.push_back(index);
+        }
+    }
+    return order;
+}
+
+size_t
+RoutingLogger::GetEndpointIndex(
+    const std::string & sourceName
+    ) const
+{
+    return GetEndpointOrder(sourceName)[0];
+}
+
+bool
+RoutingLogger::IsEndpointUp(
+    size_t index
+    ) const
+{
+    return m_endpoints.at(index)->isUp;
+}
+
+void
+RoutingLogger::StartReconnect(
+    Endpoint & endpoint
+    )
+{
+    std::lock_guard<std::mutex> lck(endpoint.reconnectMutex);
+    if (endpoint.reconnectTask.valid()) {
+        if (std::future_status::ready != endpoint.reconnectTask.wait_for(std::chrono::seconds(0))) {
+            return;
+        }
+        endpoint.reconnectTask.get();
+    }
+
+    Log(TraceLevel::Info, "Start to reconnect to '" << endpoint.socketFile << "'.");
+    auto ep = &endpoint;
+    endpoint.reconnectTask = std::async(std::launch::async, [ep] () {
+        try {
+            if (ep->logger->Connect()) {
+                ep->isUp = true;
+                Log(TraceLevel::Info, "Reconnected to '" << ep->socketFile << "'.");
+            }
+        }
+        catch(const std::exception & ex) {
+            Log(TraceLevel::Error, "Reconnect to '" << ep->socketFile << "' failed: " << ex.what());
+        }
+    });
+}
+
+bool
+RoutingLogger::SendToEndpoint(
+    Endpoint & endpoint,
+    const std::string & sourceName,
+    const std::string & schemaAndData
+    )
+{
+    if (endpoint.logger->SendDjson(sourceName, schemaAndData)) {
+        return true;
+    }
+    if (endpoint.isUp.exchange(false)) {
+        Log(TraceLevel::Warning, "Send to '" << endpoint.socketFile << "' failed. Mark it down.");
+    }
+    StartReconnect(endpoint);
+    return false;
+}
+
+bool
+RoutingLogger::SendDjson(
+    const std::string & sourceName,
+    const std::string & schemaAndData
+    )
+{
+    ADD_DEBUG_TRACE;
+
+    if (sourceName.empty()) {
+        Log(TraceLevel::Error, "SendDjson: unexpected empty source name.");
+        return false;
+    }
+    if (schemaAndData.empty()) {
+        Log(TraceLevel::Error, "SendDjson: unexpected empty schemaAndData string.");
+        return false;
+    }
+
+    bool isMirror = false;
+    {
+        std::lock_guard<std::mutex> lck(m_mirrorMutex);
+        isMirror = (m_mirrorSources.count(sourceName) > 0);
+    }
+
+    if (isMirror) {
+        size_t nsent = 0;
+        for (auto & endpoint : m_endpoints) {
+            if (!endpoint->isUp) {
+                StartReconnect(*endpoint);
+                continue;
+            }
+            if (SendToEndpoint(*endpoint, sourceName, schemaAndData)) {
+                nsent++;
+            }
+        }
+        if (0 == nsent) {
+            Log(TraceLevel::Error, "SendDjson: failed to send mirrored source '" << sourceName << "' to any socket.");
+        }
+        return (nsent > 0);
+    }
+
+    auto order = GetEndpointOrder(sourceName);
+    for (size_t i = 0; i < order.size(); i++) {
+        auto & endpoint = *m_endpoints[order[i]];
+        if (!endpoint.isUp) {
+            StartReconnect(endpoint);
+            continue;
+        }
+        if (SendToEndpoint(endpoint, sourceName, schemaAndData)) {
+            if (i > 0) {
+                m_totalFailover++;
+            }
+            return true;
+        }
+    }
+
+    Log(TraceLevel::Error, "SendDjson: all sockets are down for source '" << sourceName << "'.");
+    return false;
+}
+
+SendResult
+RoutingLogger::SendDjsonBatch(
+    const std::vector<std::string> & sourceNames,
+    const std::vector<std::string> & schemaAndData
+    )
+{
+    ADD_DEBUG_TRACE;
+    return SendDjsonEach(sourceNames, schemaAndData, [this](const std::string & source, const std::string & data) {
+        return SendDjson(source, data);
+    });
+}
+
+size_t
+RoutingLogger::GetNumTagsRead() const
+{
+    size_t n = 0;
+    for (const auto & endpoint : m_endpoints) {
+        n += endpoint->logger->GetNumTagsRead();
+    }
+    return n;
+}
+
+size_t
+RoutingLogger::GetTotalSend() const
+{
+    size_t n = 0;
+    for (const auto & endpoint : m_endpoints) {
+        n += endpoint->logger->GetTotalSend();
+    }
+    return n;
+}
+
+size_t
+RoutingLogger::GetNumItemsInCache() const
+{
+    size_t n = 0;
+    for (const auto & endpoint : m_endpoints) {
+        n += endpoint->logger->GetNumItemsInCache();
+    }
+    return n;
+}
+
+std::string
+RoutingLogger::GetStats() const
+{
+    std::string stats = "{\"failover_count\":" + std::to_string(m_totalFailover) + ",\"endpoints\":{";
+    for (size_t i = 0; i < m_endpoints.size(); i++) {
+        if (i) {
+            stats.append(1, ',');
+        }
+        const auto & endpoint = m_endpoints[i];
+        stats.append(JsonString::Quote(endpoint->socketFile)).append(1, ':');
+        stats.append(endpoint->logger->GetStats());
+    }
+    stats.append("}}");
+    return stats;
+}
+
+bool
+RoutingLogger::WaitUntilAllAcked(
+    unsigned int timeoutMS
+    )
+{
+    ADD_INFO_TRACE;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+    bool allAcked = true;
+    for (auto & endpoint : m_endpoints) {
+        auto leftMS = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (!endpoint->logger->WaitUntilAllAcked(leftMS > 0? leftMS : 0)) {
+            allAcked = false;
+        }
+    }
+    return allAcked;
+}
+
+size_t
+RoutingLogger::SpillUnacked(
+    const std::string & filepath
+    )
+{
+    ADD_INFO_TRACE;
+
+    size_t n = 0;
+    for (auto & endpoint : m_endpoints) {
+        n += endpoint->logger->SpillUnacked(filepath);
+    }
+    return n;
+}
+
+size_t
+RoutingLogger::ReplaySpillFile(
+    const std::string & filepath
+    )
+{
+    ADD_INFO_TRACE;
+
+    try {
+        auto nsent = SpillFile::Replay(filepath, [this](const std::string & source, const std::string & data) {
+            return SendDjson(source, data);
+        });
+        if (nsent) {
+            Log(TraceLevel::Info, "Replayed " << nsent << " records from " << filepath);
+        }
+        return nsent;
+    }
+    catch(const std::exception& ex) {
+        Log(TraceLevel::Error, "ReplaySpillFile exception: " << ex.what());
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#ifndef __ROUTINGLOGGER_H__
+#define __ROUTINGLOGGER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <atomic>
+
+#include "SendResult.h"
+
+namespace EndpointLog {
+
+class SocketLogger;
+
+/// This class sends data to several mdsd sockets. Each socket has its own
+/// SocketLogger, so each of them has its own cache, reader and resender.
+///
+/// - Records are sharded by source name using consistent hashing, so that
+///   all the records of a source go to the same socket, and adding or removing
+///   a socket only moves about 1/N of the sources.
+/// - Records of mirrored sources are sent to every socket that is up.
+/// - When a send to a socket fails, the socket is marked down and reconnected
+///   in the background. Until it is up again, its records fail over to the next
+///   socket on the hash ring.
+///
+class RoutingLogger
+{
+public:
+    /// <summary>
+    /// Construct a logger that'll send data to several Unix domain sockets.
+    ///
+    /// <param name='socketFiles'> full paths to socket files. Must not be empty. </param>
+    /// <param name='ackTimeoutMS'> max milliseconds to wait for ack from socket server.
+    /// After timeout, record will be dropped from cache. If this parameter's value
+    /// is 0, do no caching. </param>
+    /// <param name='resendIntervalMS'>message resend interval in milliseconds.</param>
+    /// <param name='connRetryTimeoutMS'>number of milliseconds to timeout socket
+    /// connect() retry. This is also the max time a send to a socket that is not
+    /// known to be down can block before failing over.</param>
+    /// <param name='ioEngine'>socket I/O engine of every socket. See SocketLogger.</param>
+    RoutingLogger(
+        const std::vector<std::string>& socketFiles,
+        unsigned int ackTimeoutMS,
+        unsigned int resendIntervalMS,
+        unsigned int connRetryTimeoutMS = 60*1000,
+        const std::string& ioEngine = "poll"
+        );
+
+    ~RoutingLogger();
+
+    // not copyable, not movable
+    RoutingLogger(const RoutingLogger&) = delete;
+    RoutingLogger& operator=(const RoutingLogger &) = delete;
+
+    RoutingLogger(RoutingLogger&& h) = delete;
+    RoutingLogger& operator=(RoutingLogger&& h) = delete;
+
+    /// Send all the records of a source to every socket instead of one.
+    void AddMirrorSource(const std::string & sourceName);
+
+    /// Set the replay policy of every socket. See SocketLogger::SetReplayPolicy().
+    /// Return true if success, false if the policy is unknown.
+    bool SetReplayPolicy(const std::string & policy);
+
+    /// Set the resend share of every socket. See SocketLogger::SetResendShare().
+    /// Return true if success, false if percent is not in [1, 100].
+    bool SetResendShare(unsigned int percent);
+
+    /// Send a dynamic json data to mdsd socket(s).
+    /// sourceName: source name of the event.
+    /// schemaAndData: a string containing schema info and actual data values.
+    /// Return true if the data is sent to at least one socket, false otherwise.
+    bool SendDjson(const std::string & sourceName, const std::string & schemaAndData);
+
+    /// Send dynamic json data in order, and stop at the first failure.
+    /// See SocketLogger::SendDjsonBatch().
+    SendResult SendDjsonBatch(const std::vector<std::string> & sourceNames,
+                              const std::vector<std::string> & schemaAndData);
+
+    /// Return number of sockets.
+    size_t GetNumEndpoints() const { return m_endpoints.size(); }
+
+    /// Return the index of the socket that a source is sharded to when
+    /// all the sockets are up.
+    size_t GetEndpointIndex(const std::string & sourceName) const;
+
+    /// Return false if the socket at 'index' is marked down, true otherwise.
+    bool IsEndpointUp(size_t index) const;
+
+    /// Return total number of ack tags processed by all reader threads.
+    size_t GetNumTagsRead() const;
+
+    /// Return total Send() called on all the sockets, including resends.
+    size_t GetTotalSend() const;
+
+    /// Return total number of records sent to a socket other than the one
+    /// they are sharded to.
+    size_t GetTotalFailover() const { return m_totalFailover; }
+
+    /// Return number of items in all the backup caches.
+    size_t GetNumItemsInCache() const;
+
+    /// Return a snapshot of the metrics as a JSON object: the failover count,
+    /// and the stats of each socket (see SocketLogger::GetStats()) by socket file.
+    std::string GetStats() const;
+
+    /// Wait until the backup caches of all the sockets are empty, or until
+    /// timeoutMS in total. See SocketLogger::WaitUntilAllAcked().
+    /// Return true if all the caches are empty, false if timed out.
+    bool WaitUntilAllAcked(unsigned int timeoutMS);
+
+    /// Append the data in all the backup caches to a file and remove them from
+    /// the caches. Return number of records saved.
+    size_t SpillUnacked(const std::string & filepath);
+
+    /// Send the records saved by SpillUnacked(), routed the same way as
+    /// SendDjson(). Stop at the first failure and keep the records not sent in
+    /// the file. Return number of records sent.
+    size_t ReplaySpillFile(const std::string & filepath);
+
+private:
+    struct Endpoint;
+
+    /// Return the endpoint indexes in the order a source should try them:
+    /// the sharded one first, then the next ones on the hash ring.
+    std::vector<size_t> GetEndpointOrder(const std::string & sourceName) const;
+
+    /// Send data to one endpoint. If it fails, mark the endpoint down and
+    /// start to reconnect it. Return true if success, false otherwise.
+    bool SendToEndpoint(Endpoint & endpoint, const std::string & sourceName,
+                        const std::string & schemaAndData);
+
+    /// Start to reconnect a down endpoint if it is not reconnecting yet.
+    void StartReconnect(Endpoint & endpoint);
+
+private:
+    std::vector<std::unique_ptr<Endpoint>> m_endpoints;
+    std::map<uint64_t, size_t> m_hashRing; // <hash of virtual node, endpoint index>
+
+    std::unordered_set<std::string> m_mirrorSources;
+    std::mutex m_mirrorMutex; // protect m_mirrorSources
+
+    std::atomic<size_t> m_totalFailover{0};
+};
+
+} // namespace
+
+#endif // __ROUTINGLOGGER_H__
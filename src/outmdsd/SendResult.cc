@@ -0,0 +1,38 @@
+#include "SendResult.h"
+#include "Trace.h"
+#include "TraceMacros.h"
+
+using namespace EndpointLog;
+
+SendResult
+EndpointLog::SendDjsonEach(
+    const std::vector<std::string> & sourceNames,
+    const std::vector<std::string> & schemaAndData,
+    const DjsonSendFunc & sendFunc
+    )
+{
+    SendResult result;
+    if (sourceNames.size() != schemaAndData.size()) {
+        Log(TraceLevel::Error, "SendDjsonBatch: " << sourceNames.size() << " source names don't match "
+            << schemaAndData.size() << " data strings.");
+        result.success = false;
+        return result;
+    }
+
+    for (size_t i = 0; i < sourceNames.size(); i++) {
+        if (!IsValidDjson(sourceNames[i], schemaAndData[i])) {
+            Log(TraceLevel::Error, "SendDjsonBatch: unexpected empty source name or data at index " << i);
+            result.success = false;
+            result.failedIndex = i;
+            return result;
+        }
+        if (!sendFunc(sourceNames[i], schemaAndData[i])) {
+            result.success = false;
+            result.failedIndex = i;
+            result.retryable = true;
+            return result;
+        }
+        result.numAccepted++;
+    }
+    return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef __ENDPOINTLOG_SENDRESULT_H__
+#define __ENDPOINTLOG_SENDRESULT_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace EndpointLog {
+
+/// Result of sending a sequence of records in order, e.g. the records of a
+/// fluentd buffer chunk. The send stops at the first failure, so the records
+/// before failedIndex are all accepted, and the caller can resume from
+/// failedIndex instead of sending the whole sequence again.
+///
+struct SendResult
+{
+    /// Number of records accepted. SendDjsonEach() counts the records sent.
+    /// MsgpackChunkEncoder also counts the records it drops because they are
+    /// larger than its max record size.
+    size_t numAccepted = 0;
+
+    /// true if all the records are accepted.
+    bool success = true;
+
+    /// Index of the failed record in the whole sequence. Valid if success is false.
+    size_t failedIndex = 0;
+
+    /// Valid if success is false. true if the failed record may be sent later,
+    /// e.g. after mdsd is back. false if it fails the same way every time,
+    /// e.g. an invalid record or a chunk that can't be decoded.
+    bool retryable = false;
+};
+
+#ifndef SWIG
+/// Function to send a DJSON record. Return true if success, false otherwise.
+using DjsonSendFunc = std::function<bool(const std::string & source, const std::string & schemaAndData)>;
+
+/// Return true if a DJSON record can be sent, i.e. neither its source name
+/// nor its schema and data is empty.
+inline bool
+IsValidDjson(
+    const std::string & sourceName,
+    const std::string & schemaAndData
+    )
+{
+    return !sourceName.empty() && !schemaAndData.empty();
+}
+
+/// Send record i of (sourceNames[i], schemaAndData[i]) by sendFunc in order,
+/// and stop at the first failure. An invalid record fails permanently.
+/// A failed sendFunc is retryable. If the two vectors have different sizes,
+/// nothing is sent and it fails permanently at index 0.
+SendResult SendDjsonEach(
+    const std::vector<std::string> & sourceNames,
+    const std::vector<std::string> & schemaAndData,
+    const DjsonSendFunc & sendFunc
+    );
+#endif // SWIG
+
+} // namespace
+
+#endif // __ENDPOINTLOG_SENDRESULT_H__
@@ -7,6 +7,7 @@ extern "C" {
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#include <string.h>
 }
 #include <string>
 
@@ -25,6 +26,10 @@ public:
 
     /// Return size of a socket address used in connect().
     virtual int GetAddrLen() const = 0;
+
+    /// Return the file path of the socket, or empty string if the socket
+    /// has no file path.
+    virtual std::string GetFilePath() const { return std::string(); }
 };
 
 class UnixSockAddr : public SockAddr {
@@ -39,6 +44,10 @@ public:
 
     int GetAddrLen() const { return sizeof(addr); }
 
+    std::string GetFilePath() const {
+        return std::string(addr.sun_path, strnlen(addr.sun_path, sizeof(addr.sun_path)));
+    }
+
 private:
     struct sockaddr_un addr;
 };
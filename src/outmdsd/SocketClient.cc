@@ -3,44 +3,78 @@ extern "C" {
 #include <fcntl.h>
 #include <poll.h>
 #include <assert.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
 }
 
 
 #include <algorithm>
+#include <cstring>
+#include <set>
 #include "SocketClient.h"
 #include "SockAddr.h"
+#include "LogItem.h"
+#include "DataFrame.h"
+#include "IoUring.h"
+#include "Metrics.h"
 #include "Exceptions.h"
 #include "Trace.h"
 #include "TraceMacros.h"
 
 using namespace EndpointLog;
 
+// Max milliseconds Close() waits for the zero-copy sends to be done.
+static constexpr unsigned int ZeroCopyCloseTimeoutMS = 100;
+
 SocketClient::SocketClient(
     const std::string & socketfile,
-    unsigned int connRetryTimeoutMS
+    unsigned int connRetryTimeoutMS,
+    IoEngine ioEngine
     ) :
     m_sockaddr(std::make_shared<UnixSockAddr>(socketfile)),
     m_connRetryTimeoutMS(connRetryTimeoutMS),
-    m_randDist(0.75, 1.25)
+    m_randDist(0.75, 1.25),
+    m_metrics(new MetricsRegistry())
 {
+    InitMetrics();
     if (0 == m_connRetryTimeoutMS) {
         throw std::invalid_argument("SocketClient: connect retry timeout must be non-zero.");
     }
+    m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == m_stopFd) {
+        throw SocketException(errno, "SocketClient eventfd()");
+    }
+    InitIoEngine(ioEngine);
 }
 
 SocketClient::SocketClient(
     int port,
-    unsigned int connRetryTimeoutMS
+    unsigned int connRetryTimeoutMS,
+    IoEngine ioEngine
     ) :
     m_sockaddr(std::make_shared<TcpSockAddr>(port)),
-    m_connRetryTimeoutMS(connRetryTimeoutMS)
+    m_connRetryTimeoutMS(connRetryTimeoutMS),
+    m_randDist(0.75, 1.25),
+    m_metrics(new MetricsRegistry())
 {
+    InitMetrics();
+    m_stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == m_stopFd) {
+        throw SocketException(errno, "SocketClient eventfd()");
+    }
+    InitIoEngine(ioEngine);
 }
 
 SocketClient::~SocketClient()
 {
     try {
         Stop();
+        CloseFd(m_inotifyFd);
+        CloseFd(m_stopFd);
     }
     catch(const std::exception & ex) {
         Log(TraceLevel::Error, "~SocketClient() exception: " << ex.what());
@@ -49,6 +83,73 @@ SocketClient::~SocketClient()
     } // no exception thrown from destructor
 }
 
+void
+SocketClient::InitIoEngine(
+    IoEngine ioEngine
+    )
+{
+    if (IoEngine::IoUring != ioEngine) {
+        return;
+    }
+    try {
+        if (!IoUring::IsSupported()) {
+            throw SocketException(ENOTSUP, "io_uring multishot recv is not supported");
+        }
+        // Each frame takes one entry for sendmsg() and one for its timeout.
+        m_sendRing.reset(new IoUring(2 * RingBatchFrames));
+        m_recvRing.reset(new IoUring(4));
+        m_recvRing->RegisterBufRing(RecvBufGroup, RecvBufCount, RecvBufSize);
+        m_ioEngine = IoEngine::IoUring;
+    }
+    catch(const std::exception & ex) {
+        Log(TraceLevel::Warning, "io_uring is not available. Use poll() instead: " << ex.what());
+        m_sendRing.reset();
+        m_recvRing.reset();
+    }
+}
+
+IoEngine
+SocketClient::ParseIoEngine(
+    const std::string & name
+    )
+{
+    if ("poll" == name) {
+        return IoEngine::Poll;
+    }
+    if ("io_uring" == name) {
+        return IoEngine::IoUring;
+    }
+    throw std::invalid_argument("SocketClient: unknown I/O engine '" + name + "'.");
+}
+
+const char*
+SocketClient::GetIoEngineName(
+    IoEngine ioEngine
+    )
+{
+    return (IoEngine::IoUring == ioEngine)? "io_uring" : "poll";
+}
+
+int
+SocketClient::GetReadEventFd() const
+{
+    return m_recvRing? m_recvRing->GetFd() : -1;
+}
+
+void
+SocketClient::InitMetrics()
+{
+    m_sendCounter = &m_metrics->GetCounter(MetricNames::SendCount);
+    m_sendErrorCounter = &m_metrics->GetCounter(MetricNames::SendErrorCount);
+    m_sendBytesCounter = &m_metrics->GetCounter(MetricNames::SendBytes);
+    m_connectCounter = &m_metrics->GetCounter(MetricNames::ConnectCount);
+    m_connectHistogram = &m_metrics->GetHistogram(MetricNames::ConnectMicroSeconds);
+    m_zcSendCounter = &m_metrics->GetCounter(MetricNames::ZeroCopySends);
+    m_zcCopiedCounter = &m_metrics->GetCounter(MetricNames::ZeroCopyCopied);
+    m_zcDropCounter = &m_metrics->GetCounter(std::string(MetricNames::DropCountPrefix) + "zerocopy_close");
+    m_metrics->SetGauge(MetricNames::ZeroCopyPinned, [this] { return static_cast<int64_t>(GetNumZeroCopyPinned()); });
+}
+
 void
 SocketClient::Stop()
 {
@@ -59,8 +160,12 @@ SocketClient::Stop()
 
         // Because m_stopClient is used to break retry loop in SetupSocketConnect(),
         // which is called under m_fdMutex lock, it should be called here
-        // before m_fdMutex is locked.
+        // before m_fdMutex is locked. m_stopFd wakes up WaitBeforeReConnect().
         m_stopClient = true;
+        uint64_t v = 1;
+        if (-1 == write(m_stopFd, &v, sizeof(v))) {
+            Log(TraceLevel::Warning, "SocketClient::Stop(): write() to eventfd failed. errno=" << errno);
+        }
         std::lock_guard<std::mutex> connlk(m_fdMutex);
         m_connCV.notify_all();
     }
@@ -68,7 +173,9 @@ SocketClient::Stop()
 }
 
 void
-SocketClient::SetupSocketConnect()
+SocketClient::SetupSocketConnect(
+    unsigned int timeoutMS
+    )
 {
     ADD_DEBUG_TRACE;
 
@@ -82,15 +189,54 @@ SocketClient::SetupSocketConnect()
     if (-1 == sockRtn) {
         throw SocketException(errno, "SocketClient socket()");
     }
-    m_sockfd = sockRtn;
 
-    if (-1 == connect(m_sockfd, m_sockaddr->GetAddress(), m_sockaddr->GetAddrLen())) {
-        close(m_sockfd);
-        m_sockfd = INVALID_SOCKET;
-        throw SocketException(errno, "SocketClient connect()");
+    // Only publish the fd after connect() succeeds. Other threads use m_sockfd
+    // without m_fdMutex, and must not poll() or Close() a socket that is not
+    // connected yet.
+    if (-1 == connect(sockRtn, m_sockaddr->GetAddress(), m_sockaddr->GetAddrLen())) {
+        auto errCopy = errno;
+        // A TCP connect() on a non-blocking socket finishes in the background.
+        if (EINPROGRESS == errCopy) {
+            errCopy = WaitForConnect(sockRtn, timeoutMS);
+        }
+        if (errCopy) {
+            close(sockRtn);
+            throw SocketException(errCopy, "SocketClient connect()");
+        }
     }
 
+    bool isZeroCopy = false;
+    if (m_zeroCopyMinBytes && AF_INET == m_sockaddr->GetDomain()) {
+        int enable = 1;
+        if (setsockopt(sockRtn, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable))) {
+            Log(TraceLevel::Warning, "setsockopt(SO_ZEROCOPY) failed. Send with copy. errno=" << errno);
+        }
+        else {
+            isZeroCopy = true;
+        }
+    }
+    {
+        // The kernel numbers the zero-copy sends of each socket from 0.
+        std::lock_guard<std::mutex> lck(m_zcMutex);
+        m_zcNextSeq = 0;
+        m_isZeroCopySocket = isZeroCopy;
+    }
+
+    m_connTime = std::chrono::steady_clock::now().time_since_epoch().count();
+    m_connId++;
+    m_sockfd = sockRtn;
+
     Log(TraceLevel::Debug, "Successfully connect() to sockfd=" << m_sockfd);
+
+    std::lock_guard<std::mutex> lck(m_connHandlerMutex);
+    for (const auto & handler : m_connHandlers) {
+        try {
+            handler.second(sockRtn);
+        }
+        catch(const std::exception & ex) {
+            Log(TraceLevel::Error, "SocketClient connect handler exception: " << ex.what());
+        }
+    }
 }
 
 static unsigned int
@@ -126,11 +272,21 @@ SocketClient::Connect()
     std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
     std::lock_guard<std::mutex> lock(m_fdMutex);
+    if (INVALID_SOCKET != m_sockfd) {
+        // connected by another thread meanwhile.
+        return;
+    }
+
+    // backoff starts from the min delay for each Connect() call, and after
+    // each time the socket file is created.
+    unsigned int nretries = 0;
 
     while(!m_stopClient) {
         try {
-            SetupSocketConnect();
+            SetupSocketConnect(m_connRetryTimeoutMS);
             m_connCV.notify_all();
+            m_connectCounter->Add();
+            m_connectHistogram->Record((std::chrono::steady_clock::now() - startTime) / std::chrono::microseconds(1));
             break;
         }
         catch(const SocketException & ex) {
@@ -143,7 +299,12 @@ SocketClient::Connect()
                 break;
             }
 
-            WaitBeforeReConnect(m_connRetryTimeoutMS-runtimeMS);
+            if (WaitBeforeReConnect(m_connRetryTimeoutMS-runtimeMS, nretries)) {
+                nretries = 0;
+            }
+            else {
+                nretries++;
+            }
 
             if (IsRetryTimeout(startTime)) {
                 break;
@@ -152,6 +313,36 @@ SocketClient::Connect()
     }
 }
 
+constexpr unsigned int SocketClient::DefaultTryConnectTimeoutMS;
+
+bool
+SocketClient::TryConnect(
+    unsigned int timeoutMS
+    )
+{
+    ADD_TRACE_TRACE;
+    if (INVALID_SOCKET != m_sockfd) {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(m_fdMutex, std::try_to_lock);
+    if (!lock.owns_lock() || m_stopClient) {
+        return IsConnected();
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    try {
+        SetupSocketConnect(timeoutMS);
+        m_connCV.notify_all();
+        m_connectCounter->Add();
+        m_connectHistogram->Record((std::chrono::steady_clock::now() - startTime) / std::chrono::microseconds(1));
+    }
+    catch(const SocketException & ex) {
+        Log(TraceLevel::Debug, "TryConnect() SocketException: " << ex.what());
+    }
+    return IsConnected();
+}
+
 void
 SocketClient::Close()
 {
@@ -160,14 +351,186 @@ SocketClient::Close()
 
     if (INVALID_SOCKET != m_sockfd) {
         Log(TraceLevel::Debug, "shutdown and close sockfd=" << m_sockfd);
+        if (m_isZeroCopySocket) {
+            // Give the queued data a chance to be sent before the reset below.
+            WaitForZeroCopyUnlocked(ZeroCopyCloseTimeoutMS);
+        }
         // In multi-threads, poll() can get shutdown() event, but poll()
         // may not get close() event. see man 2 select.
         // shutdown should use SHUT_RDWR mode because PollSocket() can do
         // either POLLIN or POLLOUT.
         shutdown(m_sockfd, SHUT_RDWR);
+
+        bool isZeroCopy = m_isZeroCopySocket.exchange(false);
+        if (isZeroCopy) {
+            // The pinned items may be freed once they are unpinned. So reset the
+            // connection to drop the unsent data, instead of sending them later
+            // from freed buffers.
+            struct linger lingerOpt = { 1, 0 };
+            setsockopt(m_sockfd, SOL_SOCKET, SO_LINGER, &lingerOpt, sizeof(lingerOpt));
+        }
         close(m_sockfd);
         m_sockfd = INVALID_SOCKET;
+
+        if (isZeroCopy) {
+            std::lock_guard<std::mutex> lck(m_zcMutex);
+            if (!m_zcPinned.empty()) {
+                // An item can be pinned by more than one sendmsg().
+                std::set<const LogItem*> droppedItems;
+                for (const auto & pinned : m_zcPinned) {
+                    droppedItems.insert(pinned.second.get());
+                }
+                m_zcDropCounter->Add(droppedItems.size());
+                Log(TraceLevel::Warning, "Close(): drop the unsent data of " << droppedItems.size()
+                    << " items pinned by zero-copy sends.");
+            }
+            m_zcPinned.clear();
+        }
+    }
+}
+
+int
+SocketClient::WaitForConnect(
+    int sockfd,
+    unsigned int timeoutMS
+    )
+{
+    struct pollfd pfds[2];
+    pfds[0].fd = sockfd;
+    pfds[0].events = POLLOUT;
+    pfds[1].fd = m_stopFd;
+    pfds[1].events = POLLIN;
+
+    int pollRtn = 0;
+    while(-1 == (pollRtn = poll(pfds, 2, static_cast<int>(timeoutMS))) && EINTR == errno) {}
+    if (pollRtn < 0) {
+        return errno;
+    }
+    if (0 == pollRtn) {
+        return ETIMEDOUT;
+    }
+    if (pfds[1].revents) {
+        return ECANCELED;
+    }
+
+    int sockErr = 0;
+    socklen_t errLen = sizeof(sockErr);
+    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &sockErr, &errLen)) {
+        return errno;
+    }
+    return sockErr;
+}
+
+size_t
+SocketClient::GetNumZeroCopyPinned() const
+{
+    std::lock_guard<std::mutex> lck(m_zcMutex);
+    return m_zcPinned.size();
+}
+
+void
+SocketClient::WaitForZeroCopyUnlocked(
+    unsigned int timeoutMS
+    )
+{
+    auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+    ReapZeroCopy();
+    while(GetNumZeroCopyPinned()) {
+        auto waitMS = std::chrono::duration_cast<std::chrono::milliseconds>(
+            endTime - std::chrono::steady_clock::now()).count();
+        if (waitMS <= 0) {
+            return;
+        }
+        // The completions in the error queue are reported as POLLERR.
+        struct pollfd pfd = { m_sockfd, 0, 0 };
+        int pollRtn = poll(&pfd, 1, static_cast<int>(waitMS));
+        if (-1 == pollRtn && EINTR == errno) {
+            continue;
+        }
+        if (pollRtn <= 0 || !ReapZeroCopy()) {
+            // Timed out, or a socket error or hangup instead of completions.
+            return;
+        }
+    }
+}
+
+ssize_t
+SocketClient::SendMsgZeroCopy(
+    int sockfd,
+    const struct msghdr* msg,
+    const LogItemPtr & pinItem
+    )
+{
+    // Send and pin under one lock, so that the completion of this send is
+    // never reaped before the item is pinned.
+    std::lock_guard<std::mutex> lck(m_zcMutex);
+    ssize_t rtn = 0;
+    while(-1 == (rtn = sendmsg(sockfd, msg, MSG_NOSIGNAL | MSG_ZEROCOPY)) && EINTR == errno) {}
+    if (-1 == rtn && ENOBUFS == errno) {
+        // The socket can't pin more pages (see optmem_max).
+        while(-1 == (rtn = sendmsg(sockfd, msg, MSG_NOSIGNAL)) && EINTR == errno) {}
+        return rtn;
+    }
+    if (rtn > 0) {
+        m_zcPinned[m_zcNextSeq++] = pinItem;
+        m_zcSendCounter->Add();
+    }
+    return rtn;
+}
+
+bool
+SocketClient::ReapZeroCopy()
+{
+    std::lock_guard<std::mutex> lck(m_zcMutex);
+    int sockfd = m_sockfd;
+    if (INVALID_SOCKET == sockfd || !m_isZeroCopySocket) {
+        return false;
+    }
+
+    bool isReaped = false;
+    while(true) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (-1 == recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT)) {
+            if (EINTR == errno) {
+                continue;
+            }
+            break; // EAGAIN when the error queue is empty.
+        }
+
+        for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!(SOL_IP == cmsg->cmsg_level && IP_RECVERR == cmsg->cmsg_type)) {
+                continue;
+            }
+            struct sock_extended_err serr;
+            memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+            if (serr.ee_errno || SO_EE_ORIGIN_ZEROCOPY != serr.ee_origin) {
+                continue;
+            }
+
+            // The sends of sequence numbers [ee_info, ee_data] are done.
+            // The range can wrap around.
+            auto lo = serr.ee_info;
+            auto hi = serr.ee_data;
+            auto first = m_zcPinned.lower_bound(lo);
+            if (lo <= hi) {
+                m_zcPinned.erase(first, m_zcPinned.upper_bound(hi));
+            }
+            else {
+                m_zcPinned.erase(first, m_zcPinned.end());
+                m_zcPinned.erase(m_zcPinned.begin(), m_zcPinned.upper_bound(hi));
+            }
+            if (serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                m_zcCopiedCounter->Add(hi - lo + 1);
+            }
+            isReaped = true;
+        }
     }
+    return isReaped;
 }
 
 ssize_t
@@ -193,6 +556,11 @@ SocketClient::Read(void* buf, size_t count, int timeoutMS)
         return -1;
     }
 
+    if (m_recvRing) {
+        auto readRet = RingRead(buf, count, true);
+        return (readRet < 0 && !m_stopClient)? 0 : readRet;
+    }
+
     ssize_t readRet = 0;
 
     try {
@@ -223,6 +591,192 @@ SocketClient::Read(void* buf, size_t count, int timeoutMS)
     return static_cast<size_t>(readRet);
 }
 
+ssize_t
+SocketClient::ReadNoWait(
+    void* buf,
+    size_t count
+    )
+{
+    ADD_TRACE_TRACE;
+
+    if (!buf) {
+        throw std::invalid_argument("SocketClient::ReadNoWait(): NULL pointer for buffer");
+    }
+    if (0 == count) {
+        throw std::invalid_argument("SocketClient::ReadNoWait(): read count cannot be 0.");
+    }
+
+    if (m_recvRing) {
+        return RingRead(buf, count, false);
+    }
+
+    int sockfd = m_sockfd;
+    if (m_stopClient || INVALID_SOCKET == sockfd) {
+        return -1;
+    }
+
+    // The zero-copy completions also wake up the reader.
+    if (m_isZeroCopySocket) {
+        ReapZeroCopy();
+    }
+
+    ssize_t readRet = 0;
+    while (-1 == (readRet = recv(sockfd, buf, count, MSG_DONTWAIT)) && EINTR == errno) {}
+    if (readRet < 0) {
+        if (EAGAIN == errno || EWOULDBLOCK == errno) {
+            return 0;
+        }
+        auto errCopy = errno;
+        Close();
+        throw SocketException(errCopy, "SocketClient recv()");
+    }
+    if (0 == readRet) {
+        // the other side closed the connection.
+        Close();
+        return -1;
+    }
+
+    Log(TraceLevel::Trace, "recv() returned nbytes=" << readRet);
+    return readRet;
+}
+
+bool
+SocketClient::ArmRecvUnlocked()
+{
+    int sockfd = m_sockfd;
+    if (INVALID_SOCKET == sockfd) {
+        return false;
+    }
+    uint64_t connId = m_connId;
+    if (connId != m_recvConnId && m_recvBufId >= 0) {
+        // data left from the old connection.
+        m_recvRing->RecycleBuf(m_recvBufId);
+        m_recvBufId = -1;
+    }
+
+    auto sqe = m_recvRing->GetSqe();
+    if (!sqe) {
+        throw SocketException(EBUSY, "io_uring recv: submission queue is full");
+    }
+    IoUring::PrepRecvMultishot(sqe, sockfd, RecvBufGroup);
+    // The connection id tells the completions of an old connection from the current one.
+    sqe->user_data = connId;
+    m_recvRing->Submit();
+
+    m_recvConnId = connId;
+    m_isRecvArmed = true;
+    return true;
+}
+
+ssize_t
+SocketClient::RingRead(
+    void* buf,
+    size_t count,
+    bool wait
+    )
+{
+    std::lock_guard<std::mutex> lck(m_recvMutex);
+
+    while(!m_stopClient) {
+        if (m_recvBufId >= 0) {
+            auto nbytes = std::min(count, m_recvBufLen - m_recvBufOffset);
+            memcpy(buf, m_recvRing->GetBuf(m_recvBufId) + m_recvBufOffset, nbytes);
+            m_recvBufOffset += nbytes;
+            if (m_recvBufOffset == m_recvBufLen) {
+                m_recvRing->RecycleBuf(m_recvBufId);
+                m_recvBufId = -1;
+            }
+            Log(TraceLevel::Trace, "io_uring recv returned nbytes=" << nbytes);
+            return nbytes;
+        }
+
+        if ((!m_isRecvArmed || m_recvConnId != m_connId) && !ArmRecvUnlocked()) {
+            return -1;
+        }
+
+        auto cqe = m_recvRing->PeekCqe();
+        if (!cqe) {
+            m_recvRing->Submit(wait? 1 : 0, PollTimeoutMS);
+            cqe = m_recvRing->PeekCqe();
+            if (!cqe) {
+                if (!wait) {
+                    return 0;
+                }
+                continue;
+            }
+        }
+
+        auto res = cqe->res;
+        auto flags = cqe->flags;
+        auto connId = cqe->user_data;
+        m_recvRing->SeenCqe();
+
+        bool hasBuf = (flags & IORING_CQE_F_BUFFER);
+        uint16_t bufId = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (connId != m_recvConnId || connId != m_connId) {
+            // from an old connection.
+            if (hasBuf) {
+                m_recvRing->RecycleBuf(bufId);
+            }
+            continue;
+        }
+        if (!(flags & IORING_CQE_F_MORE)) {
+            // The multishot recv is done. It is started again if needed.
+            m_isRecvArmed = false;
+        }
+
+        if (res > 0) {
+            m_recvBufId = bufId;
+            m_recvBufOffset = 0;
+            m_recvBufLen = res;
+            continue;
+        }
+        if (hasBuf) {
+            m_recvRing->RecycleBuf(bufId);
+        }
+        if (0 == res) {
+            // the other side closed the connection.
+            Close();
+            return -1;
+        }
+        if (-ENOBUFS == res || -ECANCELED == res || -EINTR == res) {
+            continue;
+        }
+        Close();
+        throw SocketException(-res, "SocketClient io_uring recv");
+    }
+    return -1;
+}
+
+uint64_t
+SocketClient::AddConnectHandler(
+    std::function<void(int)> handler
+    )
+{
+    if (!handler) {
+        throw std::invalid_argument("AddConnectHandler(): unexpected empty handler.");
+    }
+
+    std::lock_guard<std::mutex> fdlck(m_fdMutex);
+    std::lock_guard<std::mutex> lck(m_connHandlerMutex);
+    auto handlerId = ++m_lastConnHandlerId;
+    auto & newHandler = m_connHandlers[handlerId];
+    newHandler = std::move(handler);
+    if (INVALID_SOCKET != m_sockfd) {
+        newHandler(m_sockfd);
+    }
+    return handlerId;
+}
+
+void
+SocketClient::RemoveConnectHandler(
+    uint64_t handlerId
+    )
+{
+    std::lock_guard<std::mutex> lck(m_connHandlerMutex);
+    m_connHandlers.erase(handlerId);
+}
+
 // Send a buffer through socket. It handles partial send().
 void
 SocketClient::SendData(
@@ -232,10 +786,6 @@ SocketClient::SendData(
 {
     ADD_TRACE_TRACE;
 
-    size_t total = 0;        // how many bytes we've sent
-    size_t bytesleft = len;
-    ssize_t rtn = 0;
-
     if (m_sockfd < 0) {
         throw SocketException(0, "SocketClient SendData(): invalid sockfd " + std::to_string(m_sockfd));
     }
@@ -247,6 +797,26 @@ SocketClient::SendData(
     }
 
     std::lock_guard<std::mutex> lck(m_sendMutex);
+    SendDataUnlocked(buf, len);
+}
+
+void
+SocketClient::SendDataUnlocked(
+    const void *buf,
+    size_t len
+    )
+{
+    if (m_sendRing) {
+        DataFrame frame;
+        frame.Add(static_cast<const char*>(buf), len);
+        SendFrameUnlocked(frame);
+        return;
+    }
+
+    size_t total = 0;        // how many bytes we've sent
+    size_t bytesleft = len;
+    ssize_t rtn = 0;
+
     while(!m_stopClient && bytesleft) {
         PollSocket(POLLOUT);
         // Because the default behavior for SIGPIPE signal is to terminate the process,
@@ -264,6 +834,7 @@ SocketClient::SendData(
         }
 
         Log(TraceLevel::Trace, "sent (" << m_sockfd << ") nbytes=" << rtn);
+        m_sendBytesCounter->Add(rtn);
 
         total += rtn;
         bytesleft -= rtn;
@@ -314,6 +885,483 @@ SocketClient::Send(
     }
 }
 
+void
+SocketClient::SendFrameUnlocked(
+    const DataFrame & frame,
+    const LogItemPtr & pinItem
+    )
+{
+    if (m_sendRing) {
+        const DataFrame* frames[] = { &frame };
+        RingSendFramesUnlocked(frames, 1);
+    }
+    else {
+        PollSendFrameUnlocked(frame, pinItem);
+    }
+}
+
+void
+SocketClient::SendFramesUnlocked(
+    const DataFrame* const* frames,
+    size_t nframes,
+    const LogItemPtr* pinItems
+    )
+{
+    if (m_sendRing) {
+        RingSendFramesUnlocked(frames, nframes);
+        return;
+    }
+    for (size_t i = 0; i < nframes && !m_stopClient; i++) {
+        PollSendFrameUnlocked(*frames[i], pinItems? pinItems[i] : nullptr);
+    }
+}
+
+namespace {
+
+// A frame being sent by io_uring. The msghdr points to the segments not sent yet.
+struct RingFrame
+{
+    struct iovec iov[DataFrame::MaxSegments];
+    struct msghdr msg;
+    size_t bytesleft = 0;
+
+    void Init(const DataFrame & frame)
+    {
+        std::copy(frame.GetSegments(), frame.GetSegments() + frame.GetCount(), iov);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = frame.GetCount();
+        bytesleft = frame.GetTotalSize();
+    }
+
+    // Move forward over 'nsent' bytes.
+    void Advance(size_t nsent)
+    {
+        bytesleft -= nsent;
+        while(nsent && msg.msg_iovlen) {
+            if (nsent >= msg.msg_iov->iov_len) {
+                nsent -= msg.msg_iov->iov_len;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+            else {
+                msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + nsent;
+                msg.msg_iov->iov_len -= nsent;
+                nsent = 0;
+            }
+        }
+    }
+};
+
+} // namespace
+
+void
+SocketClient::RingSendFramesUnlocked(
+    const DataFrame* const* frames,
+    size_t nframes
+    )
+{
+    std::vector<RingFrame> ringFrames(nframes);
+    for (size_t i = 0; i < nframes; i++) {
+        ringFrames[i].Init(*frames[i]);
+    }
+
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = PollTimeoutMS * 1000000LL;
+
+    size_t first = 0;  // first frame not fully sent
+    while(!m_stopClient) {
+        while(first < nframes && 0 == ringFrames[first].bytesleft) {
+            first++;
+        }
+        if (first == nframes) {
+            break;
+        }
+        int sockfd = m_sockfd;
+        if (INVALID_SOCKET == sockfd) {
+            throw SocketException(0, "SocketClient io_uring send: invalid sockfd");
+        }
+
+        // Link all the sendmsg() of this round, so that a frame starts only after
+        // the previous one is fully sent. MSG_WAITALL makes a partial send an
+        // error that breaks the link.
+        struct io_uring_sqe* lastSqe = nullptr;
+        unsigned int nsqes = 0;
+        for (size_t i = first; i < nframes && nsqes < 2 * RingBatchFrames; i++) {
+            if (0 == ringFrames[i].bytesleft) {
+                continue;
+            }
+            auto sqe = m_sendRing->GetSqe();
+            IoUring::PrepSendMsg(sqe, sockfd, &ringFrames[i].msg, MSG_NOSIGNAL | MSG_WAITALL);
+            sqe->flags |= IOSQE_IO_LINK;
+            sqe->user_data = i;
+
+            lastSqe = m_sendRing->GetSqe();
+            IoUring::PrepLinkTimeout(lastSqe, &timeout);
+            lastSqe->flags |= IOSQE_IO_LINK;
+            lastSqe->user_data = UINT64_MAX;
+            nsqes += 2;
+        }
+        lastSqe->flags &= ~IOSQE_IO_LINK;
+
+        // Every entry has a completion, even when it is cancelled.
+        int sendError = 0;
+        size_t errorIndex = nframes;
+        bool isProgressed = false;
+        while(nsqes) {
+            auto cqe = m_sendRing->PeekCqe();
+            if (!cqe) {
+                m_sendRing->Submit(nsqes);
+                continue;
+            }
+            auto index = cqe->user_data;
+            auto res = cqe->res;
+            m_sendRing->SeenCqe();
+            nsqes--;
+
+            if (UINT64_MAX == index) {
+                continue;
+            }
+            if (res > 0) {
+                ringFrames[index].Advance(res);
+                m_sendBytesCounter->Add(res);
+                isProgressed = true;
+                Log(TraceLevel::Trace, "io_uring sent (" << sockfd << ") nbytes=" << res);
+            }
+            else if (res < 0 && -ECANCELED != res && -EINTR != res && -EAGAIN != res && index < errorIndex) {
+                sendError = -res;
+                errorIndex = index;
+            }
+        }
+        if (sendError) {
+            throw SocketException(sendError, "socket io_uring sendmsg()");
+        }
+        if (!isProgressed) {
+            // Timed out without any progress. Wait as the poll() engine does,
+            // so that Stop() and socket errors are checked.
+            PollSocket(POLLOUT);
+        }
+    }
+}
+
+void
+SocketClient::PollSendFrameUnlocked(
+    const DataFrame & frame,
+    const LogItemPtr & pinItem
+    )
+{
+    // sendmsg() may send only part of the frame. So keep a copy of the
+    // segments to move forward over the bytes sent.
+    struct iovec iov[DataFrame::MaxSegments];
+    std::copy(frame.GetSegments(), frame.GetSegments() + frame.GetCount(), iov);
+
+    size_t zeroCopyMinBytes = m_zeroCopyMinBytes;
+    bool isZeroCopy = pinItem && zeroCopyMinBytes && m_isZeroCopySocket &&
+                      frame.GetTotalSize() >= zeroCopyMinBytes;
+
+    size_t index = 0;  // first segment not fully sent
+    size_t bytesleft = frame.GetTotalSize();
+    ssize_t rtn = 0;
+
+    while(!m_stopClient && bytesleft) {
+        PollSocket(POLLOUT);
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov + index;
+        msg.msg_iovlen = frame.GetCount() - index;
+
+        // Use MSG_NOSIGNAL so that no SIGPIPE signal is created on errors.
+        if (isZeroCopy) {
+            rtn = SendMsgZeroCopy(m_sockfd, &msg, pinItem);
+        }
+        else {
+            while (-1 == (rtn = sendmsg(m_sockfd, &msg, MSG_NOSIGNAL)) && EINTR == errno) {}
+        }
+        if (-1 == rtn) {
+            if (EAGAIN == errno || EWOULDBLOCK == errno) {
+                continue;
+            }
+            else {
+                throw SocketException(errno, "socket sendmsg()");
+            }
+        }
+
+        Log(TraceLevel::Trace, "sent (" << m_sockfd << ") nbytes=" << rtn);
+        m_sendBytesCounter->Add(rtn);
+
+        bytesleft -= rtn;
+        size_t nsent = rtn;
+        while(nsent && index < frame.GetCount()) {
+            if (nsent >= iov[index].iov_len) {
+                nsent -= iov[index].iov_len;
+                index++;
+            }
+            else {
+                iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + nsent;
+                iov[index].iov_len -= nsent;
+                nsent = 0;
+            }
+        }
+    }
+
+    if (isZeroCopy) {
+        // Unpin the items sent before as soon as possible.
+        ReapZeroCopy();
+    }
+}
+
+void
+SocketClient::Send(
+    const DataFrame & frame
+    )
+{
+    ADD_TRACE_TRACE;
+
+    if (0 == frame.GetTotalSize()) {
+        return;
+    }
+
+    try {
+        Connect();
+        if (m_sockfd < 0) {
+            throw SocketException(0, "SocketClient Send(): invalid sockfd " + std::to_string(m_sockfd));
+        }
+
+        std::lock_guard<std::mutex> lck(m_sendMutex);
+        SendFrameUnlocked(frame);
+    }
+    catch(const SocketException & ex) {
+        Close();
+        throw;
+    }
+}
+
+void
+SocketClient::Send(
+    LogItem& item
+    )
+{
+    ADD_TRACE_TRACE;
+    SendAndRecord(item, nullptr, true);
+}
+
+void
+SocketClient::Send(
+    const LogItemPtr& item,
+    bool mayConnect
+    )
+{
+    ADD_TRACE_TRACE;
+    if (!item) {
+        throw std::invalid_argument("SocketClient::Send(): unexpected NULL item.");
+    }
+    SendAndRecord(*item, item, mayConnect);
+}
+
+void
+SocketClient::SendAndRecord(
+    LogItem& item,
+    const LogItemPtr& pinItem,
+    bool mayConnect
+    )
+{
+    m_sendCounter->Add();
+    try {
+        SendItem(item, pinItem, mayConnect);
+        item.RecordStage(FlightStage::Send);
+    }
+    catch(const SocketException &) {
+        m_sendErrorCounter->Add();
+        item.RecordStage(FlightStage::SendError);
+        throw;
+    }
+}
+
+void
+SocketClient::ConnectForSend(
+    bool mayConnect,
+    const char* caller
+    )
+{
+    if (mayConnect) {
+        Connect();
+    }
+    if (m_sockfd < 0) {
+        throw SocketException(mayConnect? 0 : ENOTCONN,
+            std::string("SocketClient ") + caller + ": invalid sockfd " + std::to_string(m_sockfd));
+    }
+}
+
+void
+SocketClient::SendItem(
+    LogItem& item,
+    const LogItemPtr& pinItem,
+    bool mayConnect
+    )
+{
+    auto schemaId = item.GetSchemaId();
+    if (0 == schemaId) {
+        DataFrame frame;
+        item.GetFrame(frame);
+        item.RecordStage(FlightStage::Encode);
+        if (0 == frame.GetTotalSize()) {
+            return;
+        }
+        try {
+            ConnectForSend(mayConnect, "Send()");
+            std::lock_guard<std::mutex> lck(m_sendMutex);
+            item.RecordStage(FlightStage::Lock);
+            SendFrameUnlocked(frame, pinItem);
+        }
+        catch(const SocketException & ex) {
+            Close();
+            throw;
+        }
+        return;
+    }
+
+    try {
+        ConnectForSend(mayConnect, "Send()");
+
+        // Items must be sent in the same order as they are checked against
+        // the sent schema ids. So lock m_sendMutex for all of them.
+        std::lock_guard<std::mutex> lck(m_sendMutex);
+        item.RecordStage(FlightStage::Lock);
+        uint64_t connId = m_connId;
+        bool isSchemaSent = IsSchemaIdSent(schemaId, connId);
+
+        DataFrame frame;
+        if (isSchemaSent) {
+            item.GetFrameNoSchema(frame);
+        }
+        else {
+            item.GetFrame(frame);
+        }
+        item.RecordStage(FlightStage::Encode);
+        if (0 == frame.GetTotalSize()) {
+            return;
+        }
+        SendFrameUnlocked(frame, pinItem);
+
+        if (!isSchemaSent) {
+            AddSentSchemaId(schemaId, connId);
+        }
+    }
+    catch(const SocketException & ex) {
+        Close();
+        throw;
+    }
+}
+
+void
+SocketClient::SendBatch(
+    const std::vector<LogItemPtr> & items,
+    bool mayConnect
+    )
+{
+    ADD_TRACE_TRACE;
+
+    if (items.empty()) {
+        return;
+    }
+
+    m_sendCounter->Add(items.size());
+    try {
+        ConnectForSend(mayConnect, "SendBatch()");
+
+        std::lock_guard<std::mutex> lck(m_sendMutex);
+        uint64_t connId = m_connId;
+
+        // A schema is sent only with its first item in the batch.
+        std::vector<DataFrame> frames(items.size());
+        std::vector<const DataFrame*> framePtrs;
+        std::vector<LogItemPtr> pins;
+        framePtrs.reserve(items.size());
+        pins.reserve(items.size());
+        for (size_t i = 0; i < items.size(); i++) {
+            auto & item = *items[i];
+            item.RecordStage(FlightStage::Lock);
+            auto schemaId = item.GetSchemaId();
+            if (schemaId && IsSchemaIdSent(schemaId, connId)) {
+                item.GetFrameNoSchema(frames[i]);
+            }
+            else {
+                item.GetFrame(frames[i]);
+                if (schemaId) {
+                    AddSentSchemaId(schemaId, connId);
+                }
+            }
+            item.RecordStage(FlightStage::Encode);
+            if (frames[i].GetTotalSize()) {
+                framePtrs.push_back(&frames[i]);
+                pins.push_back(items[i]);
+            }
+        }
+
+        SendFramesUnlocked(framePtrs.data(), framePtrs.size(), pins.data());
+        for (const auto & item : items) {
+            item->RecordStage(FlightStage::Send);
+        }
+    }
+    catch(const SocketException & ex) {
+        m_sendErrorCounter->Add(items.size());
+        for (const auto & item : items) {
+            item->RecordStage(FlightStage::SendError);
+        }
+        // The schema ids of this batch may be marked as sent. A new
+        // connection resets them.
+        Close();
+        throw;
+    }
+}
+
+bool
+SocketClient::IsSchemaIdSent(
+    uint64_t schemaId,
+    uint64_t connId
+    )
+{
+    std::lock_guard<std::mutex> lck(m_schemaMutex);
+    if (connId != m_sentSchemaConnId) {
+        m_sentSchemaIds.clear();
+        m_sentSchemaConnId = connId;
+        return false;
+    }
+    return (m_sentSchemaIds.count(schemaId) > 0);
+}
+
+void
+SocketClient::AddSentSchemaId(
+    uint64_t schemaId,
+    uint64_t connId
+    )
+{
+    std::lock_guard<std::mutex> lck(m_schemaMutex);
+    // If a new connection is created while sending, the schema id
+    // is not known to the new connection.
+    if (connId == m_sentSchemaConnId && connId == m_connId) {
+        m_sentSchemaIds.insert(schemaId);
+    }
+}
+
+void
+SocketClient::ResetSchemaId(
+    uint64_t schemaId
+    )
+{
+    std::lock_guard<std::mutex> lck(m_schemaMutex);
+    m_sentSchemaIds.erase(schemaId);
+}
+
+void
+SocketClient::ResetAllSchemaIds()
+{
+    std::lock_guard<std::mutex> lck(m_schemaMutex);
+    m_sentSchemaIds.clear();
+}
+
 void
 SocketClient::PollSocket(short pollMode)
 {
@@ -327,16 +1375,40 @@ SocketClient::PollSocket(short pollMode)
         throw SocketException(0, "PollSocket(): invalid sockfd=" + std::to_string(m_sockfd));
     }
 
+    // Read m_connId before m_sockfd, because a new connection changes them in
+    // the reverse order.
+    uint64_t connId = m_connId;
     struct pollfd pfds[1];
     pfds[0].fd = m_sockfd;
     pfds[0].events = pollMode;
 
-    Log(TraceLevel::Info, "start poll() ...");
+    LogEveryN(TraceLevel::Info, 10000, "start poll() ...");
     int pollRtn = 0;
-    while( (-1 == (pollRtn = poll(pfds, 1, -1))) && (EINTR == errno));
     auto errCopy = errno;
 
     try {
+        // If another thread closes the socket and creates a new connection right
+        // before poll() is called, poll() may wait on a socket that no one will
+        // ever shut down. So poll with a timeout, and check the connection is
+        // still the same one after each timeout.
+        while(true) {
+            pollRtn = poll(pfds, 1, PollTimeoutMS);
+            errCopy = errno;
+            if (-1 == pollRtn && EINTR == errCopy) {
+                continue;
+            }
+            if (pollRtn > 0 && POLLERR == (pfds[0].revents & (POLLERR | POLLHUP | pollMode)) &&
+                ReapZeroCopy()) {
+                // only zero-copy completions in the error queue.
+                continue;
+            }
+            if (0 != pollRtn) {
+                break;
+            }
+            if (m_stopClient || connId != m_connId || pfds[0].fd != m_sockfd) {
+                throw SocketException(0, "poll(): socket was closed by another thread.");
+            }
+        }
         if (pollRtn < 0) {
             throw SocketException(errCopy, "poll()");
         }
@@ -353,9 +1425,10 @@ SocketClient::PollSocket(short pollMode)
     }
 }
 
-void
+bool
 SocketClient::WaitBeforeReConnect(
-    int maxWaitMS
+    int maxWaitMS,
+    unsigned int nretries
     )
 {
     ADD_DEBUG_TRACE;
@@ -363,20 +1436,119 @@ SocketClient::WaitBeforeReConnect(
     const int minDelay = 100; // ms
     auto maxDelay = std::min(60000, maxWaitMS);
 
-    auto k = 1 << (m_numConnect % 10);
+    auto k = 1 << std::min(nretries, 9u);
     auto delayMS = std::min(minDelay * k, maxDelay);
     // Add random factor to delay
     delayMS = static_cast<int>(delayMS * m_randDist(m_randGen));
 
     Log(TraceLevel::Trace, "WaitBeforeReConnect (ms): " << delayMS);
 
-    int ntimes = delayMS/minDelay;
-    for (int i = 0; i < ntimes && !m_stopClient; i++) {
-        usleep(minDelay*1000);
+    WatchSocketFile();
+
+    struct pollfd pfds[2];
+    pfds[0].fd = m_stopFd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = m_inotifyFd;
+    pfds[1].events = POLLIN;
+    nfds_t nfds = (-1 == m_watchDesc)? 1 : 2;
+
+    auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMS);
+    while(!m_stopClient) {
+        auto leftMS = (endTime - std::chrono::steady_clock::now()) / std::chrono::milliseconds(1);
+        if (leftMS <= 0) {
+            break;
+        }
+        auto rtn = poll(pfds, nfds, leftMS);
+        if (-1 == rtn) {
+            if (EINTR == errno) {
+                continue;
+            }
+            Log(TraceLevel::Error, "WaitBeforeReConnect: poll() failed. errno=" << errno);
+            usleep(leftMS*1000);
+            break;
+        }
+        if (0 == rtn) {
+            break;
+        }
+        if ((pfds[1].revents & POLLIN) && IsSocketFileChanged()) {
+            Log(TraceLevel::Info, "Socket file '" << m_sockaddr->GetFilePath() << "' is created. Reconnect now.");
+            return true;
+        }
     }
-    auto leftMS = delayMS % minDelay;
-    if (!m_stopClient && leftMS > 0) {
-        usleep(leftMS*1000);
+    return false;
+}
+
+void
+SocketClient::WatchSocketFile()
+{
+    if (-1 != m_watchDesc) {
+        return;
+    }
+    auto filepath = m_sockaddr->GetFilePath();
+    if (filepath.empty()) {
+        return;
+    }
+
+    if (-1 == m_inotifyFd) {
+        m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (-1 == m_inotifyFd) {
+            Log(TraceLevel::Warning, "inotify_init1() failed. errno=" << errno);
+            return;
+        }
+    }
+
+    auto p = filepath.find_last_of('/');
+    auto dirpath = (std::string::npos == p)? "." : (0 == p? "/" : filepath.substr(0, p));
+
+    // The socket file is created by bind(), or renamed to its path. IN_ATTRIB
+    // covers servers that change file permissions after bind().
+    m_watchDesc = inotify_add_watch(m_inotifyFd, dirpath.c_str(), IN_CREATE | IN_MOVED_TO | IN_ATTRIB);
+    if (-1 == m_watchDesc) {
+        // The directory may not exist yet. Try again at next wait.
+        Log(TraceLevel::Debug, "inotify_add_watch('" << dirpath << "') failed. errno=" << errno);
+    }
+}
+
+bool
+SocketClient::IsSocketFileChanged()
+{
+    auto filepath = m_sockaddr->GetFilePath();
+    auto p = filepath.find_last_of('/');
+    auto filename = (std::string::npos == p)? filepath : filepath.substr(p+1);
+
+    bool isChanged = false;
+    alignas(struct inotify_event) char buf[4096];
+    while(true) {
+        auto len = read(m_inotifyFd, buf, sizeof(buf));
+        if (len <= 0) {
+            break;
+        }
+        for (char* ptr = buf; ptr < buf + len; ) {
+            auto event = reinterpret_cast<const struct inotify_event*>(ptr);
+            if (event->mask & IN_Q_OVERFLOW) {
+                isChanged = true;
+            }
+            else if (event->len && filename == event->name) {
+                isChanged = true;
+            }
+            if (event->mask & IN_IGNORED) {
+                // The watched directory is removed. Add the watch again at next wait.
+                m_watchDesc = -1;
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return isChanged;
+}
+
+void
+SocketClient::CloseFd(
+    int & fd
+    )
+{
+    if (-1 != fd) {
+        close(fd);
+        fd = -1;
     }
 }
 
@@ -9,10 +9,32 @@
 #include <condition_variable>
 #include <random>
 #include <chrono>
+#include <unordered_set>
+#include <map>
+#include <vector>
+#include <functional>
+
+extern "C" {
+#include <sys/socket.h>
+}
+
+#include "LogItemPtr.h"
 
 namespace EndpointLog {
 
 class SockAddr;
+class LogItem;
+class DataFrame;
+class MetricsRegistry;
+class Counter;
+class Histogram;
+class IoUring;
+
+/// How SocketClient does socket I/O.
+enum class IoEngine {
+    Poll,    // poll() then send()/recv() for each operation.
+    IoUring  // batched sendmsg() with linked timeouts, and multishot recv, in io_uring.
+};
 
 /// This is a specialized class to do socket send/read for the following scenario:
 /// - The socket server side may lose connection at any time (e.g. server process reboots).
@@ -24,6 +46,15 @@ class SockAddr;
 /// between retries. The read() operation will block until timed out if there is
 /// connection failure before actual read() is performed.
 ///
+/// For Unix domain sockets, the directory of the socket file is watched with
+/// inotify while waiting between connect() retries, so that a new connection
+/// is tried as soon as the socket server (re)creates the socket file.
+///
+/// The I/O engine is chosen at construction. With IoEngine::IoUring, all the
+/// frames of a batch are submitted at once as a chain of linked sendmsg(), each
+/// with a linked timeout, and acks are received by a multishot recv into
+/// registered buffers. If io_uring is not available, it falls back to IoEngine::Poll.
+///
 class SocketClient {
 public:
     /// <summary>
@@ -32,7 +63,9 @@ public:
     /// <param name="socketfile">unix domain socket file</param>
     /// <param name="connRetryTimeoutMS">number of milliseconds to timeout socket
     /// connect() retry </param>
-    SocketClient(const std::string & socketfile, unsigned int connRetryTimeoutMS=60*1000);
+    /// <param name="ioEngine">I/O engine to use if available</param>
+    SocketClient(const std::string & socketfile, unsigned int connRetryTimeoutMS=60*1000,
+                 IoEngine ioEngine=IoEngine::Poll);
 
     /// <summary>
     /// Construct a new object using TCP/IP port.
@@ -40,7 +73,8 @@ public:
     /// <param name="port">port number</param>
     /// <param name="connRetryTimeoutMS">number of milliseconds to timeout socket
     /// connect() retry </param>
-    SocketClient(int port, unsigned int connRetryTimeoutMS=60*1000);
+    /// <param name="ioEngine">I/O engine to use if available</param>
+    SocketClient(int port, unsigned int connRetryTimeoutMS=60*1000, IoEngine ioEngine=IoEngine::Poll);
 
     ~SocketClient();
 
@@ -61,9 +95,70 @@ public:
     /// </summary>
     void Connect();
 
+    /// <summary>
+    /// Make one connect() attempt if the socket is not connected, without the
+    /// retries of Connect(). A TCP connect() waits for at most 'timeoutMS'.
+    /// If another thread is connecting, return at once instead of waiting for it.
+    /// Return true if the socket is connected, false otherwise.
+    /// </summary>
+    bool TryConnect(unsigned int timeoutMS = DefaultTryConnectTimeoutMS);
+
+    /// Default milliseconds TryConnect() waits for a TCP connect().
+    constexpr static unsigned int DefaultTryConnectTimeoutMS = 100;
+
+    /// <summary>Return true if the socket is connected, false otherwise.</summary>
+    bool IsConnected() const { return INVALID_SOCKET != m_sockfd; }
+
+    /// <summary>
+    /// Return the I/O engine in use. It is IoEngine::Poll if io_uring was
+    /// asked for but is not available.
+    /// </summary>
+    IoEngine GetIoEngine() const { return m_ioEngine; }
+
+    /// <summary>
+    /// Return the I/O engine of a name: "poll" or "io_uring".
+    /// Throw exception if the name is unknown.
+    /// </summary>
+    static IoEngine ParseIoEngine(const std::string & name);
+
+    /// <summary>Return the name of an I/O engine. See ParseIoEngine().</summary>
+    static const char* GetIoEngineName(IoEngine ioEngine);
+
+    /// <summary>
+    /// Return a fd to watch for readability besides the socket fd, because data
+    /// received by the I/O engine don't make the socket readable. Return -1 if
+    /// the socket fd is enough. The fd is valid until the object is destroyed.
+    /// </summary>
+    int GetReadEventFd() const;
+
+    /// <summary>
+    /// Send frames of at least 'minFrameBytes' bytes with MSG_ZEROCOPY on TCP
+    /// connections, so that the kernel sends from the item buffers instead of
+    /// copying them. An item sent by Send(const LogItemPtr&) or SendBatch() is
+    /// pinned until the kernel reports its zero-copy sends are done, so it stays
+    /// alive even after it is acked and removed from the ack cache. Other sends
+    /// are copied as before. 0 disables it, which is the default.
+    /// It takes effect from the next connection. It is not used for Unix domain
+    /// sockets, which don't support it, nor with IoEngine::IoUring.
+    /// Use it only if the items are cached until acked, so that they are resent:
+    /// Close() waits a little for the pinned items, then resets the connection,
+    /// which drops the data not sent yet. The items still pinned are counted in
+    /// drop_count.zerocopy_close.
+    /// </summary>
+    void SetZeroCopy(size_t minFrameBytes) { m_zeroCopyMinBytes = minFrameBytes; }
+
+    /// <summary>Return number of items pinned by zero-copy sends not done yet.</summary>
+    size_t GetNumZeroCopyPinned() const;
+
     /// <summary>Get number of connect() is called. It is for testing only</summary>
     size_t GetNumReConnect() const { return m_numConnect; }
 
+    /// <summary>
+    /// Return the metrics of this connection. The components sharing the
+    /// connection (sender, reader, resender) add their metrics to it.
+    /// </summary>
+    MetricsRegistry & GetMetrics() const { return *m_metrics; }
+
     /// <summary>
     /// Read up to bufsize from the socket fd and save data to given buffer.
     /// If the socket fd is not valid, wait until timeout.
@@ -78,6 +173,46 @@ public:
     /// is invalid.</param>
     ssize_t Read(void* buf, size_t count, int timeoutMS = 60*1000);
 
+    /// <summary>
+    /// Read up to 'count' bytes that are already available in the socket,
+    /// without waiting. This is used when the socket is known to be readable.
+    /// Socket will be closed if any socket error is found, or EOF is reached.
+    /// Throw exception for any error.
+    /// Return number of bytes read, 0 if no data is available,
+    /// or -1 if the socket is not connected or is closed by the server.
+    /// </summary>
+    ssize_t ReadNoWait(void* buf, size_t count);
+
+    /// <summary>
+    /// Add a function to be called with the new socket fd each time a new
+    /// connection is created. If the socket is already connected, the function
+    /// is called immediately with the current fd. The fd is not closed
+    /// while the function runs. The function must not send or connect.
+    /// Return the handler id.
+    /// </summary>
+    uint64_t AddConnectHandler(std::function<void(int)> handler);
+
+    /// <summary>
+    /// Stop calling a connect handler. After this returns, the handler is
+    /// no longer running.
+    /// </summary>
+    void RemoveConnectHandler(uint64_t handlerId);
+
+    /// <summary>
+    /// Return the id of the current or the last connection. It is changed
+    /// every time a new connection is created, before the connection can be used.
+    /// </summary>
+    uint64_t GetConnectionId() const { return m_connId; }
+
+    /// <summary>
+    /// Return the time the connection of GetConnectionId() was created, or a
+    /// later one if another connection is created meanwhile.
+    /// </summary>
+    std::chrono::steady_clock::time_point GetConnectionTime() const
+    {
+        return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(m_connTime.load()));
+    }
+
     /// <summary>
     /// Send a data buffer to the socket. If 'len' is 0, do nothing.
     /// The caller must make sure 'buf' is valid.
@@ -98,19 +233,75 @@ public:
     /// </summary>
     void Send(const char* data);
 
+    /// <summary>
+    /// Send all the segments of a frame to the socket in order, using sendmsg()
+    /// so that the segments are not copied into one buffer first.
+    /// If the frame is empty, do nothing.
+    /// Throw exception for any error.
+    /// </summary>
+    void Send(const DataFrame & frame);
+
+    /// <summary>
+    /// Send a log item to the socket as a frame (see LogItem::GetFrame()).
+    /// If the item's schema id was already sent
+    /// on the current connection, the item is sent without its schema array.
+    /// The set of sent schema ids is reset whenever a new connection is created.
+    /// Throw exception for any error.
+    /// </summary>
+    void Send(LogItem& item);
+
+    /// <summary>
+    /// Same as Send(LogItem&), except that the item can be sent with zero copy
+    /// (see SetZeroCopy()). If 'mayConnect' is false and the socket is not
+    /// connected, it fails at once instead of connecting.
+    /// Throw exception for any error.
+    /// </summary>
+    void Send(const LogItemPtr& item, bool mayConnect = true);
+
+    /// <summary>
+    /// Send log items in order, like Send(const LogItemPtr&) for each item, but as one
+    /// batch under one lock. With IoEngine::IoUring the whole batch is submitted
+    /// at once. If any item fails, the rest of the batch are not sent.
+    /// If 'mayConnect' is false and the socket is not connected, it fails at
+    /// once instead of connecting.
+    /// Throw exception for any error.
+    /// </summary>
+    void SendBatch(const std::vector<LogItemPtr> & items, bool mayConnect = true);
+
+    /// <summary>
+    /// Forget that a schema id was sent on the current connection, so that
+    /// the next item using it will be sent with its full schema. This is used
+    /// when the socket server reports an unknown schema id.
+    /// </summary>
+    void ResetSchemaId(uint64_t schemaId);
+
+    /// Forget all the schema ids sent on the current connection.
+    void ResetAllSchemaIds();
+
     /// close socket fd.
     void Close();
 
 private:
-    void SetupSocketConnect();
+    /// Create the socket and connect() it. A TCP connect() waits for at most
+    /// 'timeoutMS'. Throw SocketException if it fails.
+    void SetupSocketConnect(unsigned int timeoutMS);
 
     /// Return true if the time from 'startTime' to 'now' is bigger or equal to
     /// m_connRetryTimeoutMS. Return false otherwise.
     bool IsRetryTimeout(const std::chrono::steady_clock::time_point & startTime) const;
 
     /// Wait some time using exponential delay policy before next connect() retry.
+    /// The wait ends early if Stop() is called, or if the socket file is created.
+    /// Return true if the socket file is created, false otherwise.
     /// <param name="maxWaitMS"> max milliseconds to wait</param>
-    void WaitBeforeReConnect(int maxWaitMS);
+    /// <param name="nretries"> number of connect() retries so far</param>
+    bool WaitBeforeReConnect(int maxWaitMS, unsigned int nretries);
+
+    /// Start to watch the socket file directory if it is not watched yet.
+    void WatchSocketFile();
+
+    /// Read all inotify events. Return true if any of them is for the socket file.
+    bool IsSocketFileChanged();
 
     /// Wait until socket fd is a valid number, or until timed out.
     /// <param name="timeoutMS"> max milliseconds to wait</param>
@@ -122,6 +313,77 @@ private:
     /// <param name='dataLen'> number of bytes to send </param>
     void SendData(const void* data, size_t dataLen);
 
+    /// Same as SendData() except that the caller must hold m_sendMutex.
+    void SendDataUnlocked(const void* data, size_t dataLen);
+
+    /// Send all the segments of a frame. It handles partial sendmsg().
+    /// If 'pinItem' is not null, the frame is the item's and may be sent with zero copy.
+    /// The caller must hold m_sendMutex.
+    void SendFrameUnlocked(const DataFrame & frame, const LogItemPtr & pinItem = nullptr);
+
+    /// Send frames in order. 'pinItems' is null, or the item of each frame.
+    /// The caller must hold m_sendMutex.
+    void SendFramesUnlocked(const DataFrame* const* frames, size_t nframes,
+                            const LogItemPtr* pinItems = nullptr);
+
+    /// Send a frame with poll() and sendmsg(). See SendFrameUnlocked().
+    /// The caller must hold m_sendMutex.
+    void PollSendFrameUnlocked(const DataFrame & frame, const LogItemPtr & pinItem);
+
+    /// Call sendmsg() once with MSG_ZEROCOPY, and pin 'pinItem' if any data is
+    /// sent. Fall back to copying if the kernel can't pin more pages.
+    ssize_t SendMsgZeroCopy(int sockfd, const struct msghdr* msg, const LogItemPtr & pinItem);
+
+    /// Read the zero-copy completions from the socket's error queue, and unpin
+    /// the items whose sends are done. Return true if any completion is read.
+    bool ReapZeroCopy();
+
+    /// Wait for at most 'timeoutMS' until no item is pinned by zero-copy sends.
+    /// The caller must hold m_fdMutex.
+    void WaitForZeroCopyUnlocked(unsigned int timeoutMS);
+
+    /// Wait for at most 'timeoutMS' until a non-blocking connect() in progress
+    /// finishes. Return 0 if connected, or the errno of the failure.
+    int WaitForConnect(int sockfd, unsigned int timeoutMS);
+
+    /// Send frames with io_uring. The frames of each round are linked, so they
+    /// are sent in order, and a frame not fully sent cancels the rest. Each frame
+    /// has a linked timeout, after which Stop() is checked and the rest is
+    /// submitted again. The caller must hold m_sendMutex.
+    void RingSendFramesUnlocked(const DataFrame* const* frames, size_t nframes);
+
+    /// Create the io_uring instances if asked for. Fall back to poll() if
+    /// io_uring is not available.
+    void InitIoEngine(IoEngine ioEngine);
+
+    /// Read from the multishot recv completions. If 'wait' is true, wait until
+    /// any data is read, or until the socket is closed or Stop() is called.
+    /// See ReadNoWait() for the return value.
+    ssize_t RingRead(void* buf, size_t count, bool wait);
+
+    /// Start a multishot recv on the current connection. The caller must hold m_recvMutex.
+    /// Return false if not connected.
+    bool ArmRecvUnlocked();
+
+    /// Send a log item and record its stage. See Send(const LogItemPtr&, bool).
+    void SendAndRecord(LogItem& item, const LogItemPtr & pinItem, bool mayConnect);
+
+    /// Send a log item. See Send(const LogItemPtr&, bool).
+    void SendItem(LogItem& item, const LogItemPtr & pinItem, bool mayConnect);
+
+    /// Connect if 'mayConnect' is true. Throw SocketException if the socket
+    /// is not connected then. 'caller' is used in the error message.
+    void ConnectForSend(bool mayConnect, const char* caller);
+
+    /// Look up the metrics updated by this class.
+    void InitMetrics();
+
+    /// Return true if 'schemaId' was sent on connection 'connId'.
+    bool IsSchemaIdSent(uint64_t schemaId, uint64_t connId);
+
+    /// Mark 'schemaId' as sent on connection 'connId'.
+    void AddSentSchemaId(uint64_t schemaId, uint64_t connId);
+
     /// <summary>
     /// poll() on the sock fd for I/O.
     /// Use a abortPollFd to abort waiting poll() when needed.
@@ -130,8 +392,15 @@ private:
     /// <param name="pollMode"> poll() events value. e.g. POLLIN, POLLOUT, etc</param>
     void PollSocket(short pollMode);
 
+    void CloseFd(int & fd);
+
 private:
     constexpr static int INVALID_SOCKET = -1;
+    constexpr static int PollTimeoutMS = 100; // max milliseconds for each poll() on sock fd.
+    constexpr static size_t RingBatchFrames = 64;   // max frames submitted in each io_uring round.
+    constexpr static uint16_t RecvBufGroup = 0;     // io_uring buffer group of received data.
+    constexpr static uint16_t RecvBufCount = 16;    // number of registered buffers of received data.
+    constexpr static uint32_t RecvBufSize = 4096;   // bytes of each registered buffer.
     std::shared_ptr<SockAddr> m_sockaddr;
     unsigned int m_connRetryTimeoutMS = 0;  // milliseconds to timeout connect() retry.
 
@@ -148,10 +417,59 @@ private:
     // for the sock fd to be ready (e.g. Read() API).
     std::condition_variable m_connCV;
 
+    // called with each new socket fd under m_fdMutex. Protected by m_connHandlerMutex.
+    std::map<uint64_t, std::function<void(int)>> m_connHandlers;
+    uint64_t m_lastConnHandlerId = 0;
+    std::mutex m_connHandlerMutex;
+
     size_t m_numConnect = 0; // number of times to create a new socket.
 
+    // id of current connection. It is changed every time a new connection is created.
+    std::atomic<uint64_t> m_connId{0};
+    // time of current connection in steady_clock ticks. It is set before m_connId is changed.
+    std::atomic<std::chrono::steady_clock::rep> m_connTime{0};
+
+    // schema ids that were sent on connection m_sentSchemaConnId. They are
+    // protected by m_schemaMutex instead of m_sendMutex, so that the reader
+    // thread never waits for a blocking send to reset them.
+    std::unordered_set<uint64_t> m_sentSchemaIds;
+    uint64_t m_sentSchemaConnId = 0;
+    std::mutex m_schemaMutex;
+
     std::default_random_engine m_randGen;
     std::uniform_real_distribution<float> m_randDist;
+
+    std::unique_ptr<MetricsRegistry> m_metrics;
+    Counter* m_sendCounter = nullptr;       // number of items sent, including failures.
+    Counter* m_sendErrorCounter = nullptr;  // number of items failed to be sent.
+    Counter* m_sendBytesCounter = nullptr;  // number of bytes sent.
+    Counter* m_connectCounter = nullptr;    // number of new connections.
+    Histogram* m_connectHistogram = nullptr; // microseconds from Connect() to new connection.
+
+    IoEngine m_ioEngine = IoEngine::Poll;
+    std::unique_ptr<IoUring> m_sendRing;  // used under m_sendMutex.
+    std::unique_ptr<IoUring> m_recvRing;  // used under m_recvMutex.
+    std::mutex m_recvMutex;
+    bool m_isRecvArmed = false;           // a multishot recv is running on connection m_recvConnId.
+    uint64_t m_recvConnId = 0;
+    int m_recvBufId = -1;                 // registered buffer of the data not read yet, or -1.
+    size_t m_recvBufOffset = 0;
+    size_t m_recvBufLen = 0;
+
+    // Zero-copy sends. m_zcPinned maps the kernel's sequence number of each
+    // zero-copy sendmsg() on the current socket to the item it sends from.
+    std::atomic<size_t> m_zeroCopyMinBytes{0};
+    std::atomic<bool> m_isZeroCopySocket{false}; // SO_ZEROCOPY is set on the current socket.
+    mutable std::mutex m_zcMutex;  // protect the items below.
+    std::map<uint32_t, LogItemPtr> m_zcPinned;
+    uint32_t m_zcNextSeq = 0;      // sequence number of next zero-copy sendmsg().
+    Counter* m_zcSendCounter = nullptr;    // number of zero-copy sendmsg().
+    Counter* m_zcCopiedCounter = nullptr;  // number of zero-copy sendmsg() the kernel copied anyway.
+    Counter* m_zcDropCounter = nullptr;    // number of items still pinned when the connection is reset.
+
+    int m_stopFd = -1;     // eventfd that becomes readable when Stop() is called.
+    int m_inotifyFd = -1;  // inotify fd to watch the socket file directory.
+    int m_watchDesc = -1;  // inotify watch descriptor of the socket file directory.
 };
 
 } // namespace
@@ -1,6 +1,6 @@
-#include <cassert>
+#include <cerrno>
 
-#include "ConcurrentMap.h"
+#include "InflightRing.h"
 #include "SocketLogger.h"
 #include "Trace.h"
 #include "TraceMacros.h"
@@ -9,6 +9,8 @@
 #include "DataResender.h"
 #include "DjsonLogItem.h"
 #include "Exceptions.h"
+#include "SpillFile.h"
+#include "Metrics.h"
 
 using namespace EndpointLog;
 
@@ -16,13 +18,16 @@ SocketLogger::SocketLogger(
     const std::string& socketFile,
     unsigned int ackTimeoutMS,
     unsigned int resendIntervalMS,
-    unsigned int connRetryTimeoutMS
+    unsigned int connRetryTimeoutMS,
+    const std::string& ioEngine
     ):
-    m_socketClient(std::make_shared<SocketClient>(socketFile, connRetryTimeoutMS)),
-    m_dataCache(ackTimeoutMS? std::make_shared<ConcurrentMap<LogItemPtr>>() : nullptr),
+    m_socketClient(std::make_shared<SocketClient>(socketFile, connRetryTimeoutMS,
+                   SocketClient::ParseIoEngine(ioEngine))),
+    m_dataCache(ackTimeoutMS? std::make_shared<InflightRing>() : nullptr),
     m_sockReader(new DataReader(m_socketClient, m_dataCache)),
     m_dataResender(ackTimeoutMS?
-        new DataResender(m_socketClient, m_dataCache, ackTimeoutMS, resendIntervalMS) : nullptr)
+        new DataResender(m_socketClient, m_dataCache, ackTimeoutMS, resendIntervalMS) : nullptr),
+    m_enqueueToSendHistogram(&m_socketClient->GetMetrics().GetHistogram(MetricNames::EnqueueToSendMicroSeconds))
 {
 }
 
@@ -37,12 +42,6 @@ SocketLogger::~SocketLogger()
             m_dataResender->Stop();
         }
         m_sockReader->Stop();
-
-        for(auto & task : m_workerTasks) {
-            if (task.valid()) {
-                task.get();
-            }
-        }
     }
     catch(const std::exception& ex)
     {
@@ -55,9 +54,10 @@ SocketLogger::~SocketLogger()
 void
 SocketLogger::StartWorkers()
 {
-    m_workerTasks.push_back(std::async(std::launch::async, [this] { m_sockReader->Run(); }));
+    // The reader and resender run in the threads shared by all the loggers.
+    m_sockReader->Start();
     if (m_dataResender) {
-        m_workerTasks.push_back(std::async(std::launch::async, [this] {  m_dataResender->Run(); }));
+        m_dataResender->Start();
     }
 }
 
@@ -73,36 +73,64 @@ SocketLogger::SendData(
     }
 
     std::call_once(m_initOnceFlag, &SocketLogger::StartWorkers, this);
+    item->RecordStage(FlightStage::Enqueue);
+    m_enqueueToSendHistogram->Record(item->GetLastTouchMicroSeconds());
 
     if (!m_dataCache) {
         // If no caching, send it out immediately
-        m_socketClient->Send(item->GetData());
+        m_socketClient->Send(item);
         m_totalSend++;
     }
     else {
+        // Connect before the item is cached, so that it isn't replayed on a new
+        // connection. If the connection fails, fail now instead of waiting for
+        // the connect timeout again in Send(). With ReplayFirst, the cached
+        // items are replayed first.
+        m_socketClient->Connect();
+        if (!m_socketClient->IsConnected()) {
+            throw SocketException(ENOTCONN, "SocketLogger SendData(): failed to connect");
+        }
+        if (m_dataResender && ReplayPolicy::ReplayFirst == m_dataResender->GetReplayPolicy()) {
+            m_dataResender->ReplayIfReconnected();
+        }
+
         // Move item to cache first before sending it out.
         // This makes sure that the cache has the tag in the thread
         // where response is received and handled.
         item->Touch();
-        auto tag = item->GetTag();
-        m_dataCache->Add(tag, std::move(item));
+        m_dataCache->Add(item);
 
-        auto dataItem = m_dataCache->Get(tag);
-        assert(dataItem);
         try {
-            m_socketClient->Send(m_dataCache->Get(tag)->GetData());
+            // Don't reconnect once the item is cached: the resender would
+            // replay it on the new connection too.
+            m_socketClient->Send(item, false);
             m_totalSend++;
         }
         catch(...) {
             // if Send() fails, the caller of SocketLogger is expected to
             // retry, so remove it from cache.
-            auto nErased = m_dataCache->Erase(tag);
-            Log(TraceLevel::Trace, "Send() failed on msgid='" << tag << "'; Try to erase. nErased=" << nErased);
+            auto nErased = m_dataCache->Erase(item->GetId());
+            Log(TraceLevel::Trace, "Send() failed on msgid='" << item->GetTag() << "'; Try to erase. nErased=" << nErased);
             throw;
         }
     }
 }
 
+bool
+SocketLogger::Connect()
+{
+    ADD_DEBUG_TRACE;
+    m_socketClient->Connect();
+    return m_socketClient->IsConnected();
+}
+
+void
+SocketLogger::Stop()
+{
+    ADD_DEBUG_TRACE;
+    m_socketClient->Stop();
+}
+
 bool
 SocketLogger::SendDjson(
     const std::string & sourceName,
@@ -120,7 +148,7 @@ SocketLogger::SendDjson(
         return false;
     }
     try {
-        LogItemPtr item(new DjsonLogItem(sourceName, schemaAndData));
+        auto item = MakeLogItem<DjsonLogItem>(sourceName, schemaAndData);
         SendData(std::move(item));
         return true;
     }
@@ -136,6 +164,18 @@ SocketLogger::SendDjson(
     return false;
 }
 
+SendResult
+SocketLogger::SendDjsonBatch(
+    const std::vector<std::string> & sourceNames,
+    const std::vector<std::string> & schemaAndData
+    )
+{
+    ADD_DEBUG_TRACE;
+    return SendDjsonEach(sourceNames, schemaAndData, [this](const std::string & source, const std::string & data) {
+        return SendDjson(source, data);
+    });
+}
+
 size_t
 SocketLogger::GetNumTagsRead() const
 {
@@ -154,3 +194,126 @@ SocketLogger::GetNumItemsInCache() const
     return (m_dataCache? m_dataCache->Size() : 0);
 }
 
+bool
+SocketLogger::SetReplayPolicy(
+    const std::string & policy
+    )
+{
+    try {
+        auto replayPolicy = DataResender::ParseReplayPolicy(policy);
+        if (m_dataResender) {
+            m_dataResender->SetReplayPolicy(replayPolicy);
+        }
+        return true;
+    }
+    catch(const std::exception& ex) {
+        Log(TraceLevel::Error, "SetReplayPolicy exception: " << ex.what());
+    }
+    return false;
+}
+
+bool
+SocketLogger::SetResendShare(
+    unsigned int percent
+    )
+{
+    try {
+        if (0 == percent || percent > 100) {
+            throw std::invalid_argument("invalid resend share " + std::to_string(percent));
+        }
+        if (m_dataResender) {
+            m_dataResender->SetResendShare(percent);
+        }
+        return true;
+    }
+    catch(const std::exception& ex) {
+        Log(TraceLevel::Error, "SetResendShare exception: " << ex.what());
+    }
+    return false;
+}
+
+std::string
+SocketLogger::GetIoEngine() const
+{
+    return SocketClient::GetIoEngineName(m_socketClient->GetIoEngine());
+}
+
+std::string
+SocketLogger::GetStats() const
+{
+    try {
+        return m_socketClient->GetMetrics().GetStats();
+    }
+    catch(const std::exception& ex) {
+        Log(TraceLevel::Error, "GetStats exception: " << ex.what());
+    }
+    return "{}";
+}
+
+bool
+SocketLogger::WaitUntilAllAcked(
+    unsigned int timeoutMS
+    )
+{
+    ADD_INFO_TRACE;
+
+    if (!m_dataCache) {
+        return true;
+    }
+    if (m_dataResender) {
+        m_dataResender->ResendNow();
+    }
+    if (m_dataCache->WaitUntilEmpty(timeoutMS)) {
+        return true;
+    }
+    Log(TraceLevel::Warning, "WaitUntilAllAcked timed out after " << timeoutMS << " ms. Items left in cache: "
+        << m_dataCache->Size());
+    return false;
+}
+
+size_t
+SocketLogger::SpillUnacked(
+    const std::string & filepath
+    )
+{
+    ADD_INFO_TRACE;
+
+    if (!m_dataCache) {
+        return 0;
+    }
+    try {
+        auto items = m_dataCache->GetValues();
+        auto nsaved = SpillFile::Append(filepath, items);
+
+        m_dataCache->Erase(items);
+
+        Log(TraceLevel::Info, "Saved " << nsaved << " unacknowledged records to " << filepath);
+        return nsaved;
+    }
+    catch(const std::exception& ex) {
+        Log(TraceLevel::Error, "SpillUnacked exception: " << ex.what());
+    }
+    return 0;
+}
+
+size_t
+SocketLogger::ReplaySpillFile(
+    const std::string & filepath
+    )
+{
+    ADD_INFO_TRACE;
+
+    try {
+        auto nsent = SpillFile::Replay(filepath, [this](const std::string & source, const std::string & data) {
+            return SendDjson(source, data);
+        });
+        if (nsent) {
+            Log(TraceLevel::Info, "Replayed " << nsent << " records from " << filepath);
+        }
+        return nsent;
+    }
+    catch(const std::exception& ex) {
+        Log(TraceLevel::Error, "ReplaySpillFile exception: " << ex.what());
+    }
+    return 0;
+}
@@ -3,18 +3,19 @@
 #ifndef __SOCKETLOGGER_H__
 #define __SOCKETLOGGER_H__
 
-#include <future>
+#include <mutex>
 #include <memory>
-#include <vector>
 #include <atomic>
 #include "LogItemPtr.h"
+#include "SendResult.h"
 
 namespace EndpointLog {
 
-template<typename T> class ConcurrentMap;
+class InflightRing;
 class SocketClient;
 class DataReader;
 class DataResender;
+class Histogram;
 
 class SocketLogger
 {
@@ -29,11 +30,14 @@ public:
     /// <param name='resendIntervalMS'>message resend interval in milliseconds
     /// from this logger to the targeted endpoint.
     /// </param>
+    /// <param name='ioEngine'>socket I/O engine: "poll" or "io_uring". If io_uring
+    /// is not available, poll is used. Throw exception if it is unknown.</param>
     SocketLogger(
         const std::string& socketFile,
         unsigned int ackTimeoutMS,
         unsigned int resendIntervalMS,
-        unsigned int connRetryTimeoutMS = 60*1000
+        unsigned int connRetryTimeoutMS = 60*1000,
+        const std::string& ioEngine = "poll"
         );
 
     ~SocketLogger();
@@ -51,6 +55,12 @@ public:
     /// Return true if success, false if any error.
     bool SendDjson(const std::string & sourceName, const std::string & schemaAndData);
 
+    /// Send dynamic json data in order, and stop at the first failure.
+    /// Record i is sourceNames[i] and schemaAndData[i]. See SendResult for
+    /// how to resume from the failed record.
+    SendResult SendDjsonBatch(const std::vector<std::string> & sourceNames,
+                              const std::vector<std::string> & schemaAndData);
+
     /// Return total number of ack tags processed by reader thread.
     size_t GetNumTagsRead() const;
 
@@ -66,9 +76,45 @@ public:
     /// or not acknowledged yet
     size_t GetNumItemsInCache() const;
 
-private:
-    void StartWorkers();
-
+    /// Set how the unacked data are replayed after a new connection is created:
+    /// "interleave" (default) replays them oldest first while new data are sent;
+    /// "replay_first" replays them oldest first before any new data is sent.
+    /// Return true if success, false if the policy is unknown.
+    bool SetReplayPolicy(const std::string & policy);
+
+    /// Limit resending of the unacked data to 'percent' of the socket time, so
+    /// that new data keep low latency while a backlog is resent after an outage.
+    /// e.g. 30 leaves at least 70% of the time to new data. 100 (default) means no limit.
+    /// Return true if success, false if percent is not in [1, 100].
+    bool SetResendShare(unsigned int percent);
+
+    /// Return the socket I/O engine in use: "poll" or "io_uring".
+    std::string GetIoEngine() const;
+
+    /// Return a snapshot of all the metrics of the logger as a JSON object:
+    /// send and ack counters, drops by reason, acks by status, cache size,
+    /// and latency histograms in microseconds. Return "{}" if any error.
+    std::string GetStats() const;
+
+    /// Wait until the backup cache is empty, i.e. all the data are acknowledged
+    /// or dropped after ackTimeoutMS, or until timeoutMS. The reader and resender
+    /// keep on running while waiting, and the cached data are resent once
+    /// immediately. Call this before destroying the logger to avoid losing data.
+    /// Return true if the cache is empty, false if timed out. After timeout,
+    /// GetNumItemsInCache() returns the number of data left.
+    bool WaitUntilAllAcked(unsigned int timeoutMS);
+
+    /// Append the data in the backup cache to a file and remove them from the
+    /// cache, so that they can be sent by ReplaySpillFile() at next start.
+    /// Return number of records saved.
+    size_t SpillUnacked(const std::string & filepath);
+
+    /// Send the records saved by SpillUnacked(). Stop at the first failure and
+    /// keep the records not sent in the file. The file is removed once all the
+    /// records are sent. Return number of records sent.
+    size_t ReplaySpillFile(const std::string & filepath);
+
+#ifndef SWIG
     /// <summary>
     /// Send new data item to socket.
     /// Throw exception for any error.
@@ -76,11 +122,22 @@ private:
     /// <param name='item'>A new logger item.</param>
     void SendData(LogItemPtr item);
 
+    /// Connect to the socket server if not connected yet. Retry until
+    /// connRetryTimeoutMS or until Stop() is called.
+    /// Return true if the socket is connected, false otherwise.
+    bool Connect();
+
+    /// Stop all the socket operations. Any blocking Connect() or SendData()
+    /// returns immediately.
+    void Stop();
+#endif
+
 private:
-    std::shared_ptr<SocketClient> m_socketClient;
-    std::shared_ptr<ConcurrentMap<LogItemPtr>> m_dataCache; // to store <TAG, Item>
+    void StartWorkers();
 
-    std::vector<std::future<void>> m_workerTasks; // store all the worker tasks (reader, resender)
+private:
+    std::shared_ptr<SocketClient> m_socketClient;
+    std::shared_ptr<InflightRing> m_dataCache; // items sent but not acked yet
 
     std::unique_ptr<DataReader> m_sockReader;
     std::unique_ptr<DataResender> m_dataResender;
@@ -88,6 +145,7 @@ private:
     std::once_flag m_initOnceFlag;
 
     std::atomic<size_t> m_totalSend{0}; // a counter. it includes main thread Send() to socket only
+    Histogram* m_enqueueToSendHistogram = nullptr; // microseconds from item creation to send.
 };
 
 } // namespace
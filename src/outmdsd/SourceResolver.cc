@@ -0,0 +1,140 @@
+#include "SourceResolver.h"
+#include "Trace.h"
+#include "TraceMacros.h"
+
+using namespace EndpointLog;
+
+SourceResolver::SourceResolver(
+    const std::vector<std::string> & tagPatterns,
+    size_t maxCachedTags
+    ) :
+    m_maxCachedTags(maxCachedTags)
+{
+    for (const auto & pattern : tagPatterns) {
+        auto rubySyntax = FindRubyOnlySyntax(pattern);
+        if (!rubySyntax.empty()) {
+            Log(TraceLevel::Error, "SourceResolver: ignore tag pattern '" << pattern
+                << "' with Ruby-only syntax: " << rubySyntax);
+            continue;
+        }
+        try {
+            m_tagPatterns.emplace_back(pattern, std::regex::ECMAScript | std::regex::optimize);
+        }
+        catch(const std::regex_error & ex) {
+            Log(TraceLevel::Error, "SourceResolver: ignore invalid tag pattern '" << pattern
+                << "': " << ex.what());
+        }
+    }
+}
+
+std::string
+SourceResolver::FindRubyOnlySyntax(
+    const std::string & pattern
+    )
+{
+    // Anchors and escapes that ECMAScript reads as the plain letter.
+    static const std::string rubyEscapes = "AzZhHGKRX";
+    // Ruby groups after '(?': options, named groups, atomic groups, absence operator.
+    static const std::string rubyGroups = "imx-<>'~";
+
+    bool inClass = false;
+    bool afterQuantifier = false;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        auto c = pattern[i];
+        if ('\\' == c) {
+            if (i+1 < pattern.size() && std::string::npos != rubyEscapes.find(pattern[i+1])) {
+                return std::string("'\\") + pattern[i+1] + "'";
+            }
+            i++;
+            afterQuantifier = false;
+            continue;
+        }
+        if (inClass) {
+            inClass = (']' != c);
+            continue;
+        }
+
+        if ('(' == c && i+2 < pattern.size() && '?' == pattern[i+1] &&
+            std::string::npos != rubyGroups.find(pattern[i+2])) {
+            return "'" + pattern.substr(i, 3) + "' group";
+        }
+        if ('+' == c && afterQuantifier) {
+            return "possessive quantifier";
+        }
+        afterQuantifier = ('*' == c || '+' == c || '?' == c || '}' == c);
+        if ('?' == c && i > 0 && '(' == pattern[i-1]) {
+            afterQuantifier = false;
+        }
+        inClass = ('[' == c);
+    }
+    return std::string();
+}
+
+size_t
+SourceResolver::GetNumCachedTags() const
+{
+    std::lock_guard<std::mutex> lck(m_cacheMutex);
+    return m_cache.size();
+}
+
+std::string
+SourceResolver::Match(
+    const std::string & tag
+    ) const
+{
+    for (const auto & pattern : m_tagPatterns) {
+        std::smatch match;
+        if (std::regex_search(tag, match, pattern)) {
+            return match[0];
+        }
+    }
+    return tag;
+}
+
+std::string
+SourceResolver::Resolve(
+    const std::string & tag
+    )
+{
+    if (m_tagPatterns.empty()) {
+        return tag;
+    }
+
+    {
+        std::lock_guard<std::mutex> lck(m_cacheMutex);
+        auto iter = m_cache.find(tag);
+        if (iter != m_cache.end()) {
+            return iter->second;
+        }
+    }
+
+    // Match without holding the lock. If two threads resolve the same new
+    // tag, they get the same result.
+    auto source = Match(tag);
+
+    std::lock_guard<std::mutex> lck(m_cacheMutex);
+    if (m_cache.size() >= m_maxCachedTags) {
+        m_cache.clear();
+    }
+    m_cache[tag] = source;
+    return source;
+}
+
+std::vector<std::string>
+SourceResolver::ResolveBatch(
+    const std::vector<std::string> & tags
+    )
+{
+    std::vector<std::string> sources;
+    sources.reserve(tags.size());
+
+    for (size_t i = 0; i < tags.size(); i++) {
+        if (i > 0 && tags[i] == tags[i-1]) {
+            sources.push_back(sources.back());
+        }
+        else {
+            sources.push_back(Resolve(tags[i]));
+        }
+    }
+    return sources;
+}
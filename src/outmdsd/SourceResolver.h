@@ -0,0 +1,81 @@
+#pragma once
+#ifndef __ENDPOINTLOG_SOURCERESOLVER_H__
+#define __ENDPOINTLOG_SOURCERESOLVER_H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <regex>
+
+namespace EndpointLog {
+
+/// This class maps fluentd tags to mdsd source names. The source name of a
+/// tag is the match of the first tag regex pattern that matches the tag, or
+/// the tag itself if no pattern matches.
+///
+/// The patterns are compiled once. Because the number of distinct tags is
+/// small, the source name of each tag is cached, so that regex matching is
+/// done once per tag instead of once per record. The cache is bounded: it is
+/// cleared when it reaches the max number of tags.
+///
+/// This class is thread-safe.
+///
+class SourceResolver
+{
+public:
+    /// <summary>
+    /// Construct a new resolver.
+    /// <param name='tagPatterns'> regex patterns (ECMAScript syntax) to map
+    /// tags to source names. Invalid patterns are logged and ignored. Ruby
+    /// regex syntax that ECMAScript reads differently, e.g. '\A', '\z' or
+    /// possessive quantifiers, is invalid too. </param>
+    /// <param name='maxCachedTags'> max number of tags in the cache. </param>
+    /// </summary>
+    SourceResolver(
+        const std::vector<std::string> & tagPatterns,
+        size_t maxCachedTags = 10000
+        );
+
+    ~SourceResolver() = default;
+
+    // not copyable, not movable
+    SourceResolver(const SourceResolver&) = delete;
+    SourceResolver& operator=(const SourceResolver &) = delete;
+
+    SourceResolver(SourceResolver&& h) = delete;
+    SourceResolver& operator=(SourceResolver&& h) = delete;
+
+    /// Return the source name of a tag.
+    std::string Resolve(const std::string & tag);
+
+    /// Return the source name of each tag. Consecutive records of a chunk
+    /// usually have the same tag, so a run of the same tag is resolved once.
+    std::vector<std::string> ResolveBatch(const std::vector<std::string> & tags);
+
+    /// Return number of valid patterns.
+    size_t GetNumPatterns() const { return m_tagPatterns.size(); }
+
+    /// Return a description of the first construct in the pattern that is Ruby
+    /// regex syntax and is read differently or rejected by ECMAScript, or an
+    /// empty string if there is none.
+    static std::string FindRubyOnlySyntax(const std::string & pattern);
+
+    /// Return number of tags in the cache.
+    size_t GetNumCachedTags() const;
+
+private:
+    /// Match the tag against the patterns without using the cache.
+    std::string Match(const std::string & tag) const;
+
+private:
+    std::vector<std::regex> m_tagPatterns;
+    size_t m_maxCachedTags;
+
+    mutable std::mutex m_cacheMutex;
+    std::unordered_map<std::string, std::string> m_cache; // tag -> source name
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_SOURCERESOLVER_H__
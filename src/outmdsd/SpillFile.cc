@@ -0,0 +1,237 @@
+#include <stdexcept>
+#include <system_error>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <unordered_map>
+
+extern "C" {
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <stdio.h>
+}
+
+#include "SpillFile.h"
+#include "DjsonLogItem.h"
+#include "Trace.h"
+#include "TraceMacros.h"
+
+using namespace EndpointLog;
+
+constexpr uint64_t SpillFile::ReplaySchemaIdBase;
+
+static const std::string SpillFileVersion = "outmdsd-spill 1";
+
+static void
+AppendRecord(
+    std::string & buf,
+    const std::string & source,
+    const std::string & schemaAndData
+    )
+{
+    buf.append(std::to_string(source.size())).append(" ").append(std::to_string(schemaAndData.size()));
+    buf.append("\n").append(source).append(schemaAndData).append("\n");
+}
+
+// Write buf to the end of the file, adding the version line if the file is
+// empty, then flush it to disk. The file is locked, so that concurrent writers,
+// even in other processes, don't both see an empty file and both add the
+// version line.
+static void
+WriteToFile(
+    const std::string & filepath,
+    const std::string & buf,
+    int openFlags
+    )
+{
+    int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | openFlags, 0600);
+    if (-1 == fd) {
+        throw std::system_error(errno, std::system_category(), "open " + filepath + " failed");
+    }
+
+    try {
+        int rtn = 0;
+        while(-1 == (rtn = flock(fd, LOCK_EX)) && EINTR == errno) {}
+        if (-1 == rtn) {
+            throw std::system_error(errno, std::system_category(), "flock " + filepath + " failed");
+        }
+
+        struct stat st;
+        if (fstat(fd, &st)) {
+            throw std::system_error(errno, std::system_category(), "fstat " + filepath + " failed");
+        }
+        auto data = (0 == st.st_size)? (SpillFileVersion + "\n" + buf) : buf;
+
+        auto bytesleft = data.size();
+        while(bytesleft) {
+            auto rtn = write(fd, data.c_str()+data.size()-bytesleft, bytesleft);
+            if (-1 == rtn) {
+                if (EINTR != errno) {
+                    throw std::system_error(errno, std::system_category(), "write() " + filepath + " failed");
+                }
+            }
+            else {
+                bytesleft -= rtn;
+            }
+        }
+        if (fsync(fd)) {
+            throw std::system_error(errno, std::system_category(), "fsync() " + filepath + " failed");
+        }
+    }
+    catch(...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+size_t
+SpillFile::Append(
+    const std::string & filepath,
+    const std::vector<LogItemPtr> & items
+    )
+{
+    ADD_DEBUG_TRACE;
+
+    std::string buf;
+    size_t nsaved = 0;
+    for (const auto & item : items) {
+        auto djsonItem = dynamic_cast<DjsonLogItem*>(item.get());
+        if (!djsonItem) {
+            continue;
+        }
+        AppendRecord(buf, djsonItem->GetSourceName(), djsonItem->GetSchemaAndData());
+        nsaved++;
+    }
+
+    if (nsaved < items.size()) {
+        Log(TraceLevel::Warning, "SpillFile: skipped " << (items.size()-nsaved) << " non-DJSON items.");
+    }
+    if (nsaved) {
+        WriteToFile(filepath, buf, O_APPEND);
+    }
+    return nsaved;
+}
+
+void
+SpillFile::Append(
+    const std::string & filepath,
+    const std::vector<Record> & records
+    )
+{
+    std::string buf;
+    for (const auto & record : records) {
+        AppendRecord(buf, record.source, record.schemaAndData);
+    }
+    WriteToFile(filepath, buf, O_APPEND);
+}
+
+std::vector<SpillFile::Record>
+SpillFile::Read(
+    const std::string & filepath
+    )
+{
+    ADD_DEBUG_TRACE;
+
+    std::vector<Record> records;
+
+    struct stat st;
+    if (stat(filepath.c_str(), &st)) {
+        if (ENOENT == errno) {
+            return records;
+        }
+        throw std::system_error(errno, std::system_category(), "stat " + filepath + " failed");
+    }
+
+    std::ifstream fin(filepath, std::ios::binary);
+    if (!fin) {
+        throw std::runtime_error("SpillFile: failed to open " + filepath);
+    }
+
+    std::string line;
+    if (!std::getline(fin, line)) {
+        return records;
+    }
+    if (SpillFileVersion != line) {
+        throw std::runtime_error("SpillFile: unknown format in file " + filepath);
+    }
+
+    while(std::getline(fin, line)) {
+        std::istringstream sizes(line);
+        size_t sourceLen = 0, dataLen = 0;
+        if (!(sizes >> sourceLen >> dataLen)) {
+            Log(TraceLevel::Warning, "SpillFile: invalid record header in " << filepath << ". Ignore the rest.");
+            break;
+        }
+
+        if (sourceLen + dataLen >= static_cast<size_t>(st.st_size)) {
+            Log(TraceLevel::Warning, "SpillFile: invalid record size in " << filepath << ". Ignore the rest.");
+            break;
+        }
+        std::string buf(sourceLen + dataLen + 1, '\0');
+        if (!fin.read(&buf[0], buf.size()) || '\n' != buf.back()) {
+            Log(TraceLevel::Warning, "SpillFile: truncated record in " << filepath << ". Ignore the rest.");
+            break;
+        }
+        records.emplace_back(buf.substr(0, sourceLen), buf.substr(sourceLen, dataLen));
+    }
+    return records;
+}
+
+void
+SpillFile::Rewrite(
+    const std::string & filepath,
+    const std::vector<Record> & records
+    )
+{
+    std::string buf;
+    for (const auto & record : records) {
+        AppendRecord(buf, record.source, record.schemaAndData);
+    }
+
+    auto tmpfile = filepath + ".tmp";
+    WriteToFile(tmpfile, buf, O_TRUNC);
+    if (rename(tmpfile.c_str(), filepath.c_str())) {
+        throw std::system_error(errno, std::system_category(), "rename " + tmpfile + " failed");
+    }
+}
+
+void
+SpillFile::Remove(
+    const std::string & filepath
+    )
+{
+    if (unlink(filepath.c_str()) && ENOENT != errno) {
+        throw std::system_error(errno, std::system_category(), "unlink " + filepath + " failed");
+    }
+}
+
+std::string
+SpillFile::RenumberSchema(
+    const std::string & schemaAndData
+    )
+{
+    uint64_t schemaId = 0;
+    size_t schemaPos = 0, dataPos = 0;
+    if (!DjsonLogItem::SplitSchemaAndData(schemaAndData, schemaId, schemaPos, dataPos)) {
+        return schemaAndData;
+    }
+    // schema array, without the comma before the data array.
+    auto schema = schemaAndData.substr(schemaPos, dataPos - 1 - schemaPos);
+
+    static std::mutex replayIdMutex;
+    static std::unordered_map<std::string, uint64_t> replayIds;
+    uint64_t newId = 0;
+    {
+        std::lock_guard<std::mutex> lk(replayIdMutex);
+        auto iter = replayIds.find(schema);
+        if (iter == replayIds.end()) {
+            iter = replayIds.emplace(std::move(schema), ReplaySchemaIdBase + replayIds.size()).first;
+        }
+        newId = iter->second;
+    }
+    return std::to_string(newId) + schemaAndData.substr(schemaPos - 1);
+}
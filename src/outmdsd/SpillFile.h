@@ -0,0 +1,105 @@
+#pragma once
+#ifndef __ENDPOINTLOG_SPILLFILE_H__
+#define __ENDPOINTLOG_SPILLFILE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "LogItemPtr.h"
+
+namespace EndpointLog {
+
+/// This class saves DJSON records that are not acknowledged by mdsd at
+/// shutdown to a file, so that they can be sent again at next start.
+///
+/// The file starts with a version line. Each record is saved as
+/// "<source length> <schemaAndData length>\n<source><schemaAndData>\n".
+/// Records are always appended, so several loggers can spill to the same file.
+///
+/// Spilled records keep the schema ids of the process that saved them, while
+/// the schema ids of a new process start from 1 again, so the same id can
+/// name different schemas. Because mdsd caches schemas by id per connection,
+/// Replay() renumbers the records into a separate range of ids before they
+/// are sent (see RenumberSchema()).
+///
+class SpillFile
+{
+public:
+    struct Record
+    {
+        Record(std::string s, std::string d) :
+            source(std::move(s)), schemaAndData(std::move(d)) {}
+
+        std::string source;
+        std::string schemaAndData;
+    };
+
+    /// Append DJSON items to the file. Create the file if it doesn't exist.
+    /// Items that are not DjsonLogItem are skipped because they can't be replayed.
+    /// Throw exception for any file error.
+    /// Return number of items saved.
+    static size_t Append(const std::string & filepath, const std::vector<LogItemPtr> & items);
+
+    /// Append records to the file. Create the file if it doesn't exist.
+    /// Throw exception for any file error.
+    static void Append(const std::string & filepath, const std::vector<Record> & records);
+
+    /// Read all the records from the file. A truncated record at the end of
+    /// the file, e.g. from a crash during Append(), is ignored.
+    /// Return an empty list if the file doesn't exist.
+    /// Throw exception if the file can't be read or has an unknown format.
+    static std::vector<Record> Read(const std::string & filepath);
+
+    /// Replace the file content with the records. The file is replaced atomically,
+    /// so a crash leaves either the old or the new content.
+    /// Throw exception for any file error.
+    static void Rewrite(const std::string & filepath, const std::vector<Record> & records);
+
+    /// Remove the file if it exists. Throw exception for any other error.
+    static void Remove(const std::string & filepath);
+
+    /// Return schemaAndData with its schema id replaced by an id of the replay
+    /// range, which starts at ReplaySchemaIdBase. Records with the same schema
+    /// get the same id for the life of the process, whatever id they were
+    /// saved with. Data not in '<schemaId>,[<schema>],[<data>]' format is
+    /// returned unchanged.
+    static std::string RenumberSchema(const std::string & schemaAndData);
+
+    /// Read all the records from the file, then call sendFunc on each of them
+    /// until it returns false. The records are renumbered by RenumberSchema()
+    /// before they are sent. The records not sent are written back to the
+    /// file as they were read; the file is removed if all the records are sent.
+    /// Return number of records sent.
+    template<typename SendFunc>
+    static size_t Replay(const std::string & filepath, SendFunc sendFunc)
+    {
+        auto records = Read(filepath);
+        if (records.empty()) {
+            Remove(filepath);
+            return 0;
+        }
+
+        size_t nsent = 0;
+        while(nsent < records.size() && sendFunc(records[nsent].source, RenumberSchema(records[nsent].schemaAndData))) {
+            nsent++;
+        }
+
+        if (nsent < records.size()) {
+            records.erase(records.begin(), records.begin()+nsent);
+            Rewrite(filepath, records);
+        }
+        else {
+            Remove(filepath);
+        }
+        return nsent;
+    }
+
+    /// First schema id of replayed records. Live schema ids are counted from 1
+    /// and never get this far.
+    constexpr static uint64_t ReplaySchemaIdBase = 1ULL << 40;
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_SPILLFILE_H__
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "TokenBucket.h"
+
+using namespace EndpointLog;
+
+TokenBucket::TokenBucket(
+    double rate,
+    double burst
+    ) :
+    m_rate(rate),
+    m_burst(burst),
+    m_tokens(burst),
+    m_lastRefill(Clock::now())
+{
+    ValidateRate(rate, burst);
+}
+
+void
+TokenBucket::ValidateRate(
+    double rate,
+    double burst
+    )
+{
+    if (!(rate > 0)) {
+        throw std::invalid_argument("TokenBucket: rate must be a positive number.");
+    }
+    if (!(burst > 0)) {
+        throw std::invalid_argument("TokenBucket: burst must be a positive number.");
+    }
+}
+
+void
+TokenBucket::SetRate(
+    double rate,
+    double burst
+    )
+{
+    ValidateRate(rate, burst);
+
+    std::lock_guard<std::mutex> lck(m_mutex);
+    RefillUnlocked();
+    m_rate = rate;
+    m_burst = burst;
+    m_tokens = std::min(m_tokens, m_burst);
+}
+
+void
+TokenBucket::RefillUnlocked()
+{
+    auto now = Clock::now();
+    std::chrono::duration<double> elapsed = now - m_lastRefill;
+    m_lastRefill = now;
+    m_tokens = std::min(m_burst, m_tokens + elapsed.count() * m_rate);
+}
+
+void
+TokenBucket::Consume(
+    double n
+    )
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    RefillUnlocked();
+    m_tokens -= n;
+}
+
+std::chrono::microseconds
+TokenBucket::GetWaitTime()
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    RefillUnlocked();
+    if (m_tokens >= 0) {
+        return std::chrono::microseconds(0);
+    }
+    return std::chrono::microseconds(static_cast<int64_t>(std::ceil(-m_tokens / m_rate * 1000000)));
+}
+
+double
+TokenBucket::GetTokens()
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    RefillUnlocked();
+    return m_tokens;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef __ENDPOINTLOG_TOKENBUCKET_H__
+#define __ENDPOINTLOG_TOKENBUCKET_H__
+
+#include <mutex>
+#include <chrono>
+
+namespace EndpointLog {
+
+/// This class implements a thread-safe token bucket. Tokens are added at a
+/// fixed rate up to the burst size.
+///
+/// Unlike a classic token bucket, Consume() always succeeds and can leave the
+/// bucket in debt, because the cost of an operation (e.g. how long a send
+/// takes) is often known only after it is done. The caller waits GetWaitTime()
+/// before its next operation, until the debt is paid back.
+class TokenBucket
+{
+public:
+    /// Constructor. The bucket starts full.
+    /// <param name="rate">tokens added per second. Must be positive.</param>
+    /// <param name="burst">max tokens in the bucket. Must be positive.</param>
+    /// Throw exception for invalid parameters.
+    TokenBucket(double rate, double burst);
+
+    ~TokenBucket() = default;
+
+    // not copyable, not movable
+    TokenBucket(const TokenBucket& other) = delete;
+    TokenBucket& operator=(const TokenBucket& other) = delete;
+
+    TokenBucket(TokenBucket&& other) = delete;
+    TokenBucket& operator=(TokenBucket&& other) = delete;
+
+    /// Change the rate and burst size. The tokens in the bucket are kept, up to
+    /// the new burst size. Throw exception for invalid parameters.
+    void SetRate(double rate, double burst);
+
+    /// Take 'n' tokens from the bucket.
+    void Consume(double n);
+
+    /// Return how long to wait until the bucket is not in debt. Return 0 if it isn't.
+    std::chrono::microseconds GetWaitTime();
+
+    /// Return the number of tokens in the bucket. It is negative when in debt.
+    double GetTokens();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /// Add the tokens since last refill. The caller must hold m_mutex.
+    void RefillUnlocked();
+
+    static void ValidateRate(double rate, double burst);
+
+private:
+    std::mutex m_mutex;
+    double m_rate;
+    double m_burst;
+    double m_tokens;
+    Clock::time_point m_lastRefill;
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_TOKENBUCKET_H__
@@ -72,7 +72,7 @@ Trace::WriteLog(
     int lineNumber
     )
 {
-    if (traceLevel < s_minLevel) {
+    if (!IsEnabled(traceLevel)) {
         return;
     }
     
@@ -103,7 +103,7 @@ Trace::WriteLog(
 std::string
 Trace::TraceLevel2Str(TraceLevel level) noexcept
 {
-    auto levelTable = GetLevelStrTable();
+    auto & levelTable = GetLevelStrTable();
     auto iter = levelTable.find(level);
     if (iter != levelTable.end()) {
         return iter->second;
@@ -114,7 +114,7 @@ Trace::TraceLevel2Str(TraceLevel level) noexcept
 TraceLevel
 Trace::TraceLevelFromStr(const std::string & level) noexcept
 {
-    auto t = GetStr2LevelTable();
+    auto & t = GetStr2LevelTable();
     auto iter = t.find(level);
     if (iter != t.end()) {
         return iter->second;
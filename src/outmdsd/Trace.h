@@ -7,16 +7,22 @@
 #include <sstream>
 #include <unordered_map>
 
+// Trace levels lower than this value are removed at compile time.
+// 0: Trace, 1: Debug, 2: Info, 3: Warning, 4: Error, 5: Fatal.
+#ifndef ENDPOINTLOG_MIN_TRACE_LEVEL
+#define ENDPOINTLOG_MIN_TRACE_LEVEL 0
+#endif
+
 namespace EndpointLog {
     class ITracer;
 
     enum class TraceLevel {
-        Trace,
-        Debug,
-        Info,
-        Warning,
-        Error,
-        Fatal
+        Trace = 0,
+        Debug = 1,
+        Info = 2,
+        Warning = 3,
+        Error = 4,
+        Fatal = 5
     };
 
     struct EnumClassHash {
@@ -30,45 +36,41 @@ namespace EndpointLog {
     public:
         Trace(
             TraceLevel level,
-            const std::string & func,
+            const char* func,
             const char* srcFilename,
             int lineNumber) :
+            m_enabled(IsEnabled(level)),
             m_level(level),
             m_func(func),
             m_srcFilename(srcFilename),
             m_lineNumber(lineNumber)
         {
-            if (level >= s_minLevel) {
-                std::ostringstream ss;
-                ss << "Entering " << m_func;
-                WriteLog(level, ss.str(), srcFilename, lineNumber);
+            if (m_enabled) {
+                WriteLog(level, std::string("Entering ") + m_func, srcFilename, lineNumber);
             }
         }
 
-        Trace(
-            TraceLevel level,
-            std::string && func,
-            const char* srcFilename,
-            int lineNumber) :
-            m_level(level),
-            m_func(std::move(func)),
-            m_srcFilename(srcFilename),
-            m_lineNumber(lineNumber)
+        ~Trace()
         {
-            if (level >= s_minLevel) {
-                std::ostringstream ss;
-                ss << "Entering " << m_func;
-                WriteLog(level, ss.str(), srcFilename, lineNumber);
+            if (m_enabled) {
+                WriteLog(m_level, std::string("Leaving ") + m_func, m_srcFilename, m_lineNumber);
             }
         }
 
-        ~Trace()
+        Trace(const Trace&) = delete;
+        Trace& operator=(const Trace&) = delete;
+
+        /// Return true if the level is compiled in, i.e. not lower than
+        /// ENDPOINTLOG_MIN_TRACE_LEVEL.
+        static constexpr bool IsCompiledIn(TraceLevel level)
         {
-            if (m_level >= s_minLevel) {
-                std::ostringstream ss;
-                ss << "Leaving " << m_func;
-                WriteLog(m_level, ss.str(), m_srcFilename, m_lineNumber);
-            }
+            return static_cast<int>(level) >= ENDPOINTLOG_MIN_TRACE_LEVEL;
+        }
+
+        /// Return true if logs at given level should be written.
+        static bool IsEnabled(TraceLevel level)
+        {
+            return IsCompiledIn(level) && level >= s_minLevel;
         }
 
         /// Set tracer object which implements the real logging.
@@ -94,8 +96,9 @@ namespace EndpointLog {
                              const char* filename, int lineNumber);
 
     private:
+        bool m_enabled;     // if true, write entering and leaving logs
         TraceLevel m_level;
-        std::string m_func;
+        const char* m_func;
         const char* m_srcFilename;
         int m_lineNumber;
 
@@ -2,21 +2,52 @@
 #ifndef __TRACEMACROS_H__
 #define __TRACEMACROS_H__
 
+#include <atomic>
+
+// The ADD_*_TRACE scopes only store const char* pointers. They write nothing when
+// the level is disabled at runtime, and are removed when the level is lower than
+// ENDPOINTLOG_MIN_TRACE_LEVEL (see Trace.h).
+
+#if ENDPOINTLOG_MIN_TRACE_LEVEL <= 2
 #define ADD_INFO_TRACE \
     Trace _trace(TraceLevel::Info, __func__, __FILE__, __LINE__)
+#else
+#define ADD_INFO_TRACE do {} while(0)
+#endif
 /**/
+#if ENDPOINTLOG_MIN_TRACE_LEVEL <= 1
 #define ADD_DEBUG_TRACE \
     Trace _trace(TraceLevel::Debug, __func__, __FILE__, __LINE__)
+#else
+#define ADD_DEBUG_TRACE do {} while(0)
+#endif
 /**/
+#if ENDPOINTLOG_MIN_TRACE_LEVEL <= 0
 #define ADD_TRACE_TRACE \
     Trace _trace(TraceLevel::Trace, __func__, __FILE__, __LINE__)
+#else
+#define ADD_TRACE_TRACE do {} while(0)
+#endif
 /**/
 #define Log(level, message) \
-    if (level >= Trace::GetTraceLevel()) { \
+    if (Trace::IsEnabled(level)) { \
         std::ostringstream _ss; \
         _ss << message; \
         Trace::WriteLog(level, _ss.str(), __FILE__, __LINE__); \
     }
 /**/
+// Same as Log(), but only write the 1st of every n messages from the same
+// code location. Use it for logs on per-record code paths.
+#define LogEveryN(level, n, message) \
+    if (Trace::IsEnabled(level)) { \
+        static std::atomic<uint64_t> _logCount{0}; \
+        auto _count = _logCount++; \
+        if (0 == (_count % (n))) { \
+            std::ostringstream _ss; \
+            _ss << message << " (count=" << (_count+1) << ", logged every " << (n) << ")"; \
+            Trace::WriteLog(level, _ss.str(), __FILE__, __LINE__); \
+        } \
+    }
+/**/
 
 #endif
@@ -0,0 +1,445 @@
+#include <system_error>
+#include <algorithm>
+
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+}
+
+#include "WorkerRuntime.h"
+#include "Trace.h"
+#include "TraceMacros.h"
+
+using namespace EndpointLog;
+
+std::shared_ptr<WorkerRuntime>
+WorkerRuntime::Get()
+{
+    static std::mutex instanceMutex;
+    static std::weak_ptr<WorkerRuntime> instance;
+
+    std::lock_guard<std::mutex> lck(instanceMutex);
+    auto runtime = instance.lock();
+    if (!runtime) {
+        runtime.reset(new WorkerRuntime());
+        instance = runtime;
+    }
+    return runtime;
+}
+
+WorkerRuntime::WorkerRuntime()
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == m_epollFd) {
+        throw std::system_error(errno, std::system_category(), "WorkerRuntime epoll_create1()");
+    }
+
+    m_wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == m_wakeupFd) {
+        auto errCopy = errno;
+        close(m_epollFd);
+        throw std::system_error(errCopy, std::system_category(), "WorkerRuntime eventfd()");
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = WakeupWatchId;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeupFd, &ev)) {
+        auto errCopy = errno;
+        close(m_wakeupFd);
+        close(m_epollFd);
+        throw std::system_error(errCopy, std::system_category(), "WorkerRuntime epoll_ctl()");
+    }
+
+    // Timer callbacks mostly wait for socket I/O, so a few threads are enough
+    // even on big machines.
+    auto nworkers = std::min(std::max(std::thread::hardware_concurrency(), 2u), 8u);
+
+    m_reactor = std::thread([this] { RunReactor(); });
+    for (unsigned int i = 0; i < nworkers; i++) {
+        m_workers.emplace_back([this] { RunWorker(); });
+    }
+    Log(TraceLevel::Info, "WorkerRuntime started with " << GetNumThreads() << " threads.");
+}
+
+WorkerRuntime::~WorkerRuntime()
+{
+    try {
+        ADD_INFO_TRACE;
+        {
+            std::lock_guard<std::mutex> lck(m_mutex);
+            m_stopMe = true;
+            m_workCV.notify_all();
+        }
+        WakeupReactor();
+
+        m_reactor.join();
+        for (auto & worker : m_workers) {
+            worker.join();
+        }
+
+        for (const auto & watch : m_watches) {
+            close(watch.second.fd);
+        }
+        close(m_wakeupFd);
+        close(m_epollFd);
+    }
+    catch(const std::exception & ex) {
+        Log(TraceLevel::Error, "~WorkerRuntime() exception: " << ex.what());
+    }
+    catch(...) {
+    } // no exception thrown from destructor
+}
+
+uint64_t
+WorkerRuntime::AddReadHandler(
+    std::function<void()> handler
+    )
+{
+    if (!handler) {
+        throw std::invalid_argument("WorkerRuntime::AddReadHandler(): unexpected empty handler.");
+    }
+
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto handlerId = ++m_lastId;
+    m_readHandlers[handlerId] = std::make_shared<std::function<void()>>(std::move(handler));
+    return handlerId;
+}
+
+void
+WorkerRuntime::WatchSocket(
+    uint64_t handlerId,
+    int sockfd
+    )
+{
+    ADD_DEBUG_TRACE;
+
+    std::lock_guard<std::mutex> lck(m_mutex);
+    if (!m_readHandlers.count(handlerId)) {
+        return;
+    }
+
+    auto fd = fcntl(sockfd, F_DUPFD_CLOEXEC, 0);
+    if (-1 == fd) {
+        throw std::system_error(errno, std::system_category(), "WorkerRuntime fcntl(F_DUPFD_CLOEXEC)");
+    }
+
+    auto watchId = ++m_lastId;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u64 = watchId;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &ev)) {
+        auto errCopy = errno;
+        close(fd);
+        throw std::system_error(errCopy, std::system_category(), "WorkerRuntime epoll_ctl(EPOLL_CTL_ADD)");
+    }
+    m_watches[watchId] = Watch{fd, handlerId};
+    Log(TraceLevel::Debug, "WorkerRuntime watches sockfd=" << sockfd << " for handler " << handlerId);
+}
+
+void
+WorkerRuntime::RemoveReadHandler(
+    uint64_t handlerId
+    )
+{
+    ADD_DEBUG_TRACE;
+
+    std::unique_lock<std::mutex> lck(m_mutex);
+    m_readHandlers.erase(handlerId);
+
+    std::vector<uint64_t> watchIds;
+    for (const auto & watch : m_watches) {
+        if (handlerId == watch.second.handlerId) {
+            watchIds.push_back(watch.first);
+        }
+    }
+    for (auto watchId : watchIds) {
+        UnwatchUnlocked(watchId);
+    }
+
+    m_doneCV.wait(lck, [this, handlerId] { return handlerId != m_runningHandlerId; });
+}
+
+void
+WorkerRuntime::UnwatchUnlocked(
+    uint64_t watchId
+    )
+{
+    auto iter = m_watches.find(watchId);
+    if (iter == m_watches.end()) {
+        return;
+    }
+    // close() removes the fd from epoll, because the fd is a duplicate
+    // that is only used here.
+    close(iter->second.fd);
+    m_watches.erase(iter);
+}
+
+uint64_t
+WorkerRuntime::AddTimer(
+    unsigned int intervalMS,
+    std::function<void()> callback
+    )
+{
+    if (0 == intervalMS) {
+        throw std::invalid_argument("WorkerRuntime::AddTimer(): timer interval must be a positive integer.");
+    }
+    if (!callback) {
+        throw std::invalid_argument("WorkerRuntime::AddTimer(): unexpected empty callback.");
+    }
+
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto timerId = ++m_lastId;
+    auto & timer = m_timers[timerId];
+    timer.callback = std::move(callback);
+    timer.interval = std::chrono::milliseconds(intervalMS);
+    ScheduleTimerUnlocked(timerId, std::chrono::steady_clock::now() + timer.interval);
+    return timerId;
+}
+
+void
+WorkerRuntime::TriggerTimer(
+    uint64_t timerId
+    )
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto iter = m_timers.find(timerId);
+    if (iter == m_timers.end()) {
+        return;
+    }
+    if (iter->second.isRunning) {
+        iter->second.isTriggered = true;
+    }
+    else {
+        ScheduleTimerUnlocked(timerId, std::chrono::steady_clock::now());
+    }
+}
+
+void
+WorkerRuntime::DelayTimer(
+    uint64_t timerId,
+    std::chrono::microseconds delay
+    )
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto iter = m_timers.find(timerId);
+    if (iter == m_timers.end()) {
+        return;
+    }
+    if (iter->second.isRunning) {
+        iter->second.isDelayed = true;
+        iter->second.delay = delay;
+    }
+    else {
+        // The entry of the old due time is ignored by DispatchDueTimers().
+        ScheduleTimerUnlocked(timerId, std::chrono::steady_clock::now() + delay);
+    }
+}
+
+void
+WorkerRuntime::RemoveTimer(
+    uint64_t timerId
+    )
+{
+    ADD_DEBUG_TRACE;
+
+    std::unique_lock<std::mutex> lck(m_mutex);
+    m_doneCV.wait(lck, [this, timerId] {
+        auto iter = m_timers.find(timerId);
+        return (iter == m_timers.end() || !iter->second.isRunning);
+    });
+    // Any entry left in m_timerQueue or m_workQueue is ignored once the timer is gone.
+    m_timers.erase(timerId);
+}
+
+void
+WorkerRuntime::ScheduleTimerUnlocked(
+    uint64_t timerId,
+    const TimePoint & due
+    )
+{
+    auto & timer = m_timers[timerId];
+    timer.due = due;
+    m_timerQueue.emplace(due, timerId);
+    if (m_timerQueue.begin()->second == timerId) {
+        WakeupReactor();
+    }
+}
+
+void
+WorkerRuntime::WakeupReactor()
+{
+    uint64_t v = 1;
+    if (-1 == write(m_wakeupFd, &v, sizeof(v)) && EAGAIN != errno) {
+        Log(TraceLevel::Warning, "WorkerRuntime: write() to eventfd failed. errno=" << errno);
+    }
+}
+
+void
+WorkerRuntime::RunReactor()
+{
+    ADD_INFO_TRACE;
+
+    struct epoll_event events[MaxEvents];
+
+    while(!m_stopMe) {
+        auto timeoutMS = DispatchDueTimers();
+
+        auto nevents = epoll_wait(m_epollFd, events, MaxEvents, timeoutMS);
+        if (-1 == nevents) {
+            if (EINTR != errno) {
+                Log(TraceLevel::Error, "WorkerRuntime epoll_wait() failed. errno=" << errno);
+            }
+            continue;
+        }
+
+        for (int i = 0; i < nevents && !m_stopMe; i++) {
+            if (WakeupWatchId == events[i].data.u64) {
+                uint64_t v = 0;
+                if (-1 == read(m_wakeupFd, &v, sizeof(v)) && EAGAIN != errno) {
+                    Log(TraceLevel::Warning, "WorkerRuntime: read() from eventfd failed. errno=" << errno);
+                }
+            }
+            else {
+                HandleReadEvent(events[i].data.u64, events[i].events);
+            }
+        }
+    }
+}
+
+void
+WorkerRuntime::HandleReadEvent(
+    uint64_t watchId,
+    uint32_t events
+    )
+{
+    std::shared_ptr<std::function<void()>> handler;
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        auto watchIter = m_watches.find(watchId);
+        if (watchIter == m_watches.end()) {
+            // The socket was unwatched after epoll_wait() returned.
+            return;
+        }
+        auto handlerIter = m_readHandlers.find(watchIter->second.handlerId);
+        if (handlerIter == m_readHandlers.end()) {
+            UnwatchUnlocked(watchId);
+            return;
+        }
+        handler = handlerIter->second;
+        m_runningHandlerId = handlerIter->first;
+    }
+
+    try {
+        (*handler)();
+    }
+    catch(const std::exception & ex) {
+        Log(TraceLevel::Error, "WorkerRuntime read handler exception: " << ex.what());
+    }
+
+    std::lock_guard<std::mutex> lck(m_mutex);
+    m_runningHandlerId = 0;
+    // Once the socket is shut down, it stays readable, so it must not be
+    // watched any more. A new connection is watched with a new fd.
+    // EPOLLERR alone is not a shutdown: it can be the zero-copy completions
+    // in the socket error queue, which the handler reads.
+    if (events & (EPOLLHUP | EPOLLRDHUP)) {
+        UnwatchUnlocked(watchId);
+    }
+    m_doneCV.notify_all();
+}
+
+int
+WorkerRuntime::DispatchDueTimers()
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+
+    auto now = std::chrono::steady_clock::now();
+    while(!m_timerQueue.empty()) {
+        auto first = m_timerQueue.begin();
+        if (first->first > now) {
+            // round up, so that the timer is due when epoll_wait() returns.
+            auto waitMS = std::chrono::duration_cast<std::chrono::milliseconds>(first->first - now).count() + 1;
+            return static_cast<int>(waitMS);
+        }
+
+        auto timerId = first->second;
+        auto due = first->first;
+        m_timerQueue.erase(first);
+
+        auto iter = m_timers.find(timerId);
+        if (iter == m_timers.end() || iter->second.isRunning || iter->second.due != due) {
+            // removed, running, or rescheduled.
+            continue;
+        }
+        iter->second.isRunning = true;
+        m_workQueue.push_back(timerId);
+        m_workCV.notify_one();
+    }
+    return -1;
+}
+
+void
+WorkerRuntime::RunWorker()
+{
+    ADD_INFO_TRACE;
+
+    while(true) {
+        uint64_t timerId = 0;
+        {
+            std::unique_lock<std::mutex> lck(m_mutex);
+            m_workCV.wait(lck, [this] { return m_stopMe || !m_workQueue.empty(); });
+            if (m_stopMe) {
+                break;
+            }
+            timerId = m_workQueue.front();
+            m_workQueue.pop_front();
+        }
+        RunTimer(timerId);
+    }
+}
+
+void
+WorkerRuntime::RunTimer(
+    uint64_t timerId
+    )
+{
+    std::function<void()> callback;
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        auto iter = m_timers.find(timerId);
+        if (iter == m_timers.end()) {
+            return;
+        }
+        callback = iter->second.callback;
+    }
+
+    try {
+        callback();
+    }
+    catch(const std::exception & ex) {
+        Log(TraceLevel::Error, "WorkerRuntime timer callback exception: " << ex.what());
+    }
+
+    std::lock_guard<std::mutex> lck(m_mutex);
+    auto iter = m_timers.find(timerId);
+    if (iter != m_timers.end()) {
+        auto & timer = iter->second;
+        timer.isRunning = false;
+        auto now = std::chrono::steady_clock::now();
+        if (timer.isTriggered) {
+            ScheduleTimerUnlocked(timerId, now);
+        }
+        else if (timer.isDelayed) {
+            ScheduleTimerUnlocked(timerId, now + timer.delay);
+        }
+        else {
+            ScheduleTimerUnlocked(timerId, now + timer.interval);
+        }
+        timer.isTriggered = false;
+        timer.isDelayed = false;
+    }
+    m_doneCV.notify_all();
+}
@@ -0,0 +1,161 @@
+#pragma once
+#ifndef __ENDPOINTLOG_WORKERRUNTIME_H__
+#define __ENDPOINTLOG_WORKERRUNTIME_H__
+
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <map>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+namespace EndpointLog {
+
+/// This class implements the threads shared by all the loggers in one process,
+/// so that the number of threads doesn't grow with the number of loggers.
+///
+/// - One reactor thread waits with epoll() for all the watched sockets, and
+///   calls their read handlers when they are readable. Read handlers must not block.
+/// - The same reactor thread keeps all the timers ordered by due time, so it
+///   wakes up only when the earliest timer is due.
+/// - Timer callbacks can block (e.g. to reconnect a socket), so they run in a
+///   small pool of worker threads whose size is based on the number of cores.
+///   A timer callback never runs in two threads at the same time.
+///
+/// The runtime is created by the first Get() call, and is destroyed when the
+/// last object that uses it releases it.
+///
+class WorkerRuntime
+{
+public:
+    /// Return the runtime of this process. Create it if it doesn't exist.
+    static std::shared_ptr<WorkerRuntime> Get();
+
+    ~WorkerRuntime();
+
+    // not copyable, not movable
+    WorkerRuntime(const WorkerRuntime& other) = delete;
+    WorkerRuntime& operator=(const WorkerRuntime& other) = delete;
+
+    WorkerRuntime(WorkerRuntime&& other) = delete;
+    WorkerRuntime& operator=(WorkerRuntime&& other) = delete;
+
+    /// Add a read handler. It is called in the reactor thread whenever any of
+    /// the sockets watched for it (see WatchSocket()) is readable or closed.
+    /// Return the handler id.
+    uint64_t AddReadHandler(std::function<void()> handler);
+
+    /// Watch a socket for the read handler until the socket is shut down or
+    /// closed, or until the handler is removed. The socket is watched through
+    /// a duplicated fd, so the caller can close 'sockfd' at any time.
+    /// Throw exception for any error.
+    void WatchSocket(uint64_t handlerId, int sockfd);
+
+    /// Remove a read handler and stop watching its sockets. If the handler is
+    /// running, wait until it returns. It must not be called from the handler.
+    void RemoveReadHandler(uint64_t handlerId);
+
+    /// Add a timer that calls 'callback' every 'intervalMS' milliseconds.
+    /// The interval starts after each callback returns.
+    /// Return the timer id.
+    uint64_t AddTimer(unsigned int intervalMS, std::function<void()> callback);
+
+    /// Call the timer callback as soon as possible instead of waiting for
+    /// its interval. If the callback is running, it is called again right
+    /// after it returns.
+    void TriggerTimer(uint64_t timerId);
+
+    /// Call the timer callback once after 'delay' instead of its interval. If
+    /// the callback is running (e.g. this is called from the callback), the
+    /// delay starts after it returns. Unlike sleeping in the callback, this
+    /// doesn't hold a worker thread while waiting.
+    void DelayTimer(uint64_t timerId, std::chrono::microseconds delay);
+
+    /// Remove a timer. If its callback is running, wait until it returns.
+    /// It must not be called from the timer callback.
+    void RemoveTimer(uint64_t timerId);
+
+    /// Return the number of threads used by the runtime.
+    size_t GetNumThreads() const { return m_workers.size() + 1; }
+
+private:
+    WorkerRuntime();
+
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    struct Timer
+    {
+        std::function<void()> callback;
+        std::chrono::milliseconds interval;
+        TimePoint due;
+        bool isRunning = false;
+        bool isTriggered = false; // TriggerTimer() is called while running.
+        bool isDelayed = false;   // DelayTimer() is called while running.
+        std::chrono::microseconds delay{0}; // delay of the next call if isDelayed.
+    };
+
+    /// A socket watched for a read handler.
+    struct Watch
+    {
+        int fd;             // duplicated socket fd.
+        uint64_t handlerId;
+    };
+
+    void RunReactor();
+    void RunWorker();
+
+    /// Call the read handler of a watched socket. Stop watching the socket if it
+    /// is shut down or closed.
+    void HandleReadEvent(uint64_t watchId, uint32_t events);
+
+    /// Move all the due timers to the worker queue. Return milliseconds until the
+    /// next timer is due, or -1 if there is no timer.
+    int DispatchDueTimers();
+
+    /// Run one timer callback, then schedule its next call.
+    void RunTimer(uint64_t timerId);
+
+    /// Put a timer in m_timerQueue. The caller must hold m_mutex.
+    void ScheduleTimerUnlocked(uint64_t timerId, const TimePoint & due);
+
+    /// Stop watching a socket. The caller must hold m_mutex.
+    void UnwatchUnlocked(uint64_t watchId);
+
+    /// Wake up the reactor thread from epoll_wait().
+    void WakeupReactor();
+
+private:
+    constexpr static uint64_t WakeupWatchId = 0; // epoll data of m_wakeupFd.
+    constexpr static int MaxEvents = 64;         // max events returned by each epoll_wait().
+
+    int m_epollFd = -1;
+    int m_wakeupFd = -1;   // eventfd to wake up the reactor thread.
+    std::atomic<bool> m_stopMe{false};
+
+    std::mutex m_mutex;    // protect all the members below.
+    std::condition_variable m_doneCV;   // notified when a handler or timer callback returns.
+    std::condition_variable m_workCV;   // notified when m_workQueue is not empty.
+
+    uint64_t m_lastId = WakeupWatchId;  // last id of handlers, watches and timers.
+
+    std::unordered_map<uint64_t, std::shared_ptr<std::function<void()>>> m_readHandlers;
+    std::unordered_map<uint64_t, Watch> m_watches;
+    uint64_t m_runningHandlerId = 0;    // id of the read handler being called.
+
+    std::unordered_map<uint64_t, Timer> m_timers;
+    std::multimap<TimePoint, uint64_t> m_timerQueue; // due time -> timer id
+    std::deque<uint64_t> m_workQueue;   // ids of the timers to run.
+
+    std::thread m_reactor;
+    std::vector<std::thread> m_workers;
+};
+
+} // namespace
+
+#endif // __ENDPOINTLOG_WORKERRUNTIME_H__
@@ -1,6 +1,10 @@
 #include "outmdsd_log.h"
 #include "Trace.h"
+#include "TraceMacros.h"
 #include "FileTracer.h"
+#include "FlightRecorder.h"
+
+using namespace EndpointLog;
 
 void
 InitLogger(
@@ -19,3 +23,38 @@ SetLogLevel(
     EndpointLog::Trace::SetTraceLevel(level);
 }
 
+void
+SetFlightRecorderSampleRate(
+    unsigned int n
+)
+{
+    EndpointLog::FlightRecorder::SetSampleRate(n);
+}
+
+std::string
+DumpFlightRecorder()
+{
+    try {
+        return EndpointLog::FlightRecorder::DumpJson();
+    }
+    catch(const std::exception & ex) {
+        Log(TraceLevel::Error, "DumpFlightRecorder() failed: " << ex.what());
+    }
+    return "{}";
+}
+
+bool
+SetFlightRecorderDumpSignal(
+    int signo,
+    const std::string & filepath
+)
+{
+    try {
+        EndpointLog::FlightRecorder::SetDumpSignal(signo, filepath);
+        return true;
+    }
+    catch(const std::exception & ex) {
+        Log(TraceLevel::Error, "SetFlightRecorderDumpSignal() failed: " << ex.what());
+    }
+    return false;
+}
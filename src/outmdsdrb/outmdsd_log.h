@@ -8,5 +8,15 @@ void InitLogger(const std::string& logFilePath, bool createIfNotExist);
 
 void SetLogLevel(const std::string & level);
 
+// Record the stage times of 1 out of every n log items. 0 disables it.
+void SetFlightRecorderSampleRate(unsigned int n);
+
+// Return the recorded stage times as JSON.
+std::string DumpFlightRecorder();
+
+// Dump the recorded stage times in binary to 'filepath' each time signal
+// 'signo' is received. Return true if success, false if any error.
+bool SetFlightRecorderDumpSignal(int signo, const std::string & filepath);
+
 
 #endif // __OUTMDSD_LOG_H__
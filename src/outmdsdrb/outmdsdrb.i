@@ -1,10 +1,20 @@
 %module Liboutmdsdrb
 
 %{
+#include "../outmdsd/SendResult.h"
 #include "../outmdsd/SocketLogger.h"
+#include "../outmdsd/RoutingLogger.h"
+#include "../outmdsd/SourceResolver.h"
+#include "../outmdsd/MsgpackChunkEncoder.h"
 #include "outmdsd_log.h"
 %}
 %include "stdint.i"
 %include "std_string.i"
+%include "std_vector.i"
+%template(StringVector) std::vector<std::string>;
+%include "../outmdsd/SendResult.h"
 %include "../outmdsd/SocketLogger.h"
+%include "../outmdsd/RoutingLogger.h"
+%include "../outmdsd/SourceResolver.h"
+%include "../outmdsd/MsgpackChunkEncoder.h"
 %include "outmdsd_log.h"
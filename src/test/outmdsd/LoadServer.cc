@@ -0,0 +1,609 @@
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+#include <algorithm>
+
+extern "C" {
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <string.h>
+}
+
+#include "LoadServer.h"
+#include "testutil.h"
+
+using namespace TestUtil;
+
+void
+LoadServerConfig::ParseLatency(
+    const std::string & str
+    )
+{
+    auto p1 = str.find(':');
+    if (std::string::npos == p1) {
+        throw std::invalid_argument("invalid ack latency '" + str + "'");
+    }
+    auto type = str.substr(0, p1);
+    auto p2 = str.find(':', p1+1);
+    auto value1 = std::stoul(str.substr(p1+1, p2-p1-1));
+
+    if ("fixed" == type) {
+        latencyType = LatencyType::Fixed;
+        ackLatencyUS = value1;
+    }
+    else if ("exp" == type) {
+        latencyType = LatencyType::Exponential;
+        ackLatencyUS = value1;
+    }
+    else if ("uniform" == type && std::string::npos != p2) {
+        latencyType = LatencyType::Uniform;
+        ackLatencyMinUS = value1;
+        ackLatencyUS = std::stoul(str.substr(p2+1));
+        if (ackLatencyMinUS > ackLatencyUS) {
+            throw std::invalid_argument("invalid ack latency range '" + str + "'");
+        }
+    }
+    else {
+        throw std::invalid_argument("invalid ack latency '" + str + "'");
+    }
+}
+
+void
+LoadServerConfig::ParseAckStatus(
+    const std::string & str
+    )
+{
+    auto p = str.find(':');
+    if (std::string::npos == p) {
+        throw std::invalid_argument("invalid ack status '" + str + "'");
+    }
+    auto code = std::stoi(str.substr(0, p));
+    auto percent = std::stod(str.substr(p+1));
+    if (code <= 0 || percent < 0 || percent > 100) {
+        throw std::invalid_argument("invalid ack status '" + str + "'");
+    }
+    ackStatusPercent[code] = percent;
+}
+
+LoadServer::LoadServer(
+    const std::string & socketFile,
+    const LoadServerConfig & config
+    ) :
+    m_socketFile(socketFile),
+    m_config(config),
+    m_randEngine(std::random_device{}())
+{
+    if (0 == m_config.ackBatchSize) {
+        m_config.ackBatchSize = 1;
+    }
+
+    // ack status codes known by the client: ACK_SUCCESS(0) to ACK_DUPLICATE_SCHEMA_ID(5)
+    for (int code = 0; code <= 5; code++) {
+        m_statusCounts[code] = 0;
+    }
+
+    double total = 0;
+    for (const auto & kv : m_config.ackStatusPercent) {
+        total += kv.second;
+        m_statusTable.emplace_back(total, kv.first);
+        m_statusCounts[kv.first] = 0;
+    }
+    if (total > 100) {
+        throw std::invalid_argument("LoadServer: total ack status percentage is over 100");
+    }
+}
+
+LoadServer::~LoadServer()
+{
+    for (const auto & kv : m_connections) {
+        close(kv.second.fd);
+    }
+    for (auto fd : { m_listenfd, m_epollfd, m_stopfd, m_timerfd }) {
+        if (-1 != fd) {
+            close(fd);
+        }
+    }
+}
+
+void
+LoadServer::Init()
+{
+    RemoveFileIfExists(m_socketFile);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, m_socketFile.c_str(), sizeof(addr.sun_path)-1);
+
+    m_listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (-1 == m_listenfd) {
+        throw std::system_error(errno, std::system_category(), "socket() at " + m_socketFile);
+    }
+    if (-1 == bind(m_listenfd, (struct sockaddr*) &addr, sizeof(addr))) {
+        throw std::system_error(errno, std::system_category(), "bind(" + m_socketFile + ")");
+    }
+    if (-1 == listen(m_listenfd, SOMAXCONN)) {
+        throw std::system_error(errno, std::system_category(), "listen(" + m_socketFile + ")");
+    }
+
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == m_epollfd) {
+        throw std::system_error(errno, std::system_category(), "epoll_create1()");
+    }
+    m_stopfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == m_stopfd) {
+        throw std::system_error(errno, std::system_category(), "eventfd()");
+    }
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (-1 == m_timerfd) {
+        throw std::system_error(errno, std::system_category(), "timerfd_create()");
+    }
+
+    AddToEpoll(m_listenfd, EPOLLIN);
+    AddToEpoll(m_stopfd, EPOLLIN);
+    AddToEpoll(m_timerfd, EPOLLIN);
+}
+
+void
+LoadServer::AddToEpoll(
+    int fd,
+    uint32_t events
+    )
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (-1 == epoll_ctl(m_epollfd, EPOLL_CTL_ADD, fd, &ev)) {
+        throw std::system_error(errno, std::system_category(), "epoll_ctl(ADD) fd=" + std::to_string(fd));
+    }
+}
+
+void
+LoadServer::ModifyEpoll(
+    int fd,
+    uint32_t events
+    )
+{
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (-1 == epoll_ctl(m_epollfd, EPOLL_CTL_MOD, fd, &ev)) {
+        throw std::system_error(errno, std::system_category(), "epoll_ctl(MOD) fd=" + std::to_string(fd));
+    }
+}
+
+void
+LoadServer::Stop()
+{
+    m_stopFlag = true;
+    if (-1 != m_stopfd) {
+        uint64_t v = 1;
+        (void) write(m_stopfd, &v, sizeof(v));
+    }
+}
+
+void
+LoadServer::Run()
+{
+    const int maxEvents = 64;
+    struct epoll_event events[maxEvents];
+
+    while(!m_stopFlag) {
+        auto nfds = epoll_wait(m_epollfd, events, maxEvents, -1);
+        if (-1 == nfds) {
+            if (EINTR == errno) {
+                continue;
+            }
+            throw std::system_error(errno, std::system_category(), "epoll_wait()");
+        }
+
+        for (int i = 0; i < nfds; i++) {
+            auto fd = events[i].data.fd;
+            if (fd == m_listenfd) {
+                AcceptConnections();
+            }
+            else if (fd == m_stopfd) {
+                break;
+            }
+            else if (fd == m_timerfd) {
+                uint64_t nexp = 0;
+                (void) read(m_timerfd, &nexp, sizeof(nexp));
+            }
+            else {
+                auto iter = m_fdToConnId.find(fd);
+                if (iter == m_fdToConnId.end()) {
+                    continue;
+                }
+                auto connId = iter->second;
+                if (events[i].events & EPOLLOUT) {
+                    HandleWrite(connId);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    HandleRead(connId);
+                }
+            }
+        }
+
+        ArmTimer(ProcessTimers());
+    }
+}
+
+void
+LoadServer::AcceptConnections()
+{
+    while(true) {
+        auto connfd = accept4(m_listenfd, NULL, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (-1 == connfd) {
+            if (EINTR == errno) {
+                continue;
+            }
+            if (EWOULDBLOCK != errno && EAGAIN != errno) {
+                std::cout << "LoadServer: accept() failed: " << GetErrnoStr(errno) << std::endl;
+            }
+            return;
+        }
+
+        auto connId = m_nextConnId++;
+        m_connections[connId].fd = connfd;
+        m_fdToConnId[connfd] = connId;
+        m_totalConnections++;
+        AddToEpoll(connfd, EPOLLIN);
+    }
+}
+
+void
+LoadServer::CloseConnection(
+    uint64_t connId
+    )
+{
+    auto iter = m_connections.find(connId);
+    if (iter == m_connections.end()) {
+        return;
+    }
+    auto fd = iter->second.fd;
+    epoll_ctl(m_epollfd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    m_fdToConnId.erase(fd);
+    m_connections.erase(iter);
+}
+
+void
+LoadServer::HandleRead(
+    uint64_t connId
+    )
+{
+    auto iter = m_connections.find(connId);
+    if (iter == m_connections.end()) {
+        return;
+    }
+    auto & conn = iter->second;
+
+    char buf[65536];
+    while(true) {
+        auto rtn = read(conn.fd, buf, sizeof(buf));
+        if (rtn > 0) {
+            m_totalBytesRead += rtn;
+            conn.readBuf.append(buf, rtn);
+            continue;
+        }
+        if (-1 == rtn && EINTR == errno) {
+            continue;
+        }
+        if (-1 == rtn && (EWOULDBLOCK == errno || EAGAIN == errno)) {
+            break;
+        }
+        // EOF or connection error. Acks not sent yet are lost.
+        ProcessFrames(connId, conn);
+        CloseConnection(connId);
+        return;
+    }
+
+    if (!ProcessFrames(connId, conn)) {
+        CloseConnection(connId);
+        return;
+    }
+    FlushConnection(connId, conn);
+}
+
+void
+LoadServer::HandleWrite(
+    uint64_t connId
+    )
+{
+    auto iter = m_connections.find(connId);
+    if (iter != m_connections.end()) {
+        FlushConnection(connId, iter->second);
+    }
+}
+
+bool
+LoadServer::ProcessFrames(
+    uint64_t connId,
+    Connection & conn
+    )
+{
+    auto & buf = conn.readBuf;
+    size_t pos = 0;
+    while(pos < buf.size()) {
+        auto nlPos = buf.find('\n', pos);
+        if (std::string::npos == nlPos) {
+            break;
+        }
+        size_t len = 0;
+        for (auto i = pos; i < nlPos; i++) {
+            if (buf[i] < '0' || buf[i] > '9') {
+                std::cout << "LoadServer: invalid frame length. Close connection." << std::endl;
+                buf.clear();
+                return false;
+            }
+            len = len * 10 + (buf[i] - '0');
+        }
+        if (buf.size() - (nlPos+1) < len) {
+            break;
+        }
+        ProcessRecord(connId, conn, buf.data() + nlPos + 1, len);
+        pos = nlPos + 1 + len;
+    }
+    buf.erase(0, pos);
+    return true;
+}
+
+void
+LoadServer::ProcessRecord(
+    uint64_t connId,
+    Connection & conn,
+    const char* payload,
+    size_t len
+    )
+{
+    m_totalRecords++;
+    if (m_config.retainData) {
+        std::lock_guard<std::mutex> lck(m_dataMutex);
+        m_dataRead.emplace_back(payload, len);
+    }
+
+    // payload: ["source",tag,...
+    auto end = payload + len;
+    auto comma1 = std::find(payload, end, ',');
+    if (comma1 == end) {
+        return;
+    }
+    auto comma2 = std::find(comma1+1, end, ',');
+    if (comma2 == end) {
+        return;
+    }
+
+    auto ack = CreateAck(std::string(comma1+1, comma2));
+    if (ack.empty()) {
+        return;
+    }
+
+    auto latency = GetAckLatency();
+    if (Clock::duration::zero() == latency) {
+        AddReadyAck(conn, std::move(ack));
+    }
+    else {
+        m_pendingAcks.push(PendingAck{ Clock::now() + latency, connId, std::move(ack) });
+    }
+}
+
+bool
+LoadServer::IsPercentHit(
+    double percent
+    )
+{
+    if (percent <= 0) {
+        return false;
+    }
+    std::uniform_real_distribution<double> dist(0, 100);
+    return dist(m_randEngine) < percent;
+}
+
+std::string
+LoadServer::CreateAck(
+    const std::string & tag
+    )
+{
+    if (IsPercentHit(m_config.ackDropPercent)) {
+        m_totalAcksDropped++;
+        return std::string();
+    }
+
+    int status = 0;
+    if (!m_statusTable.empty()) {
+        std::uniform_real_distribution<double> dist(0, 100);
+        auto r = dist(m_randEngine);
+        for (const auto & entry : m_statusTable) {
+            if (r < entry.first) {
+                status = entry.second;
+                break;
+            }
+        }
+    }
+    m_statusCounts[status]++;
+
+    return tag + ":" + std::to_string(status) + "\n";
+}
+
+LoadServer::Clock::duration
+LoadServer::GetAckLatency()
+{
+    uint64_t us = 0;
+    switch(m_config.latencyType) {
+        case LoadServerConfig::LatencyType::Fixed:
+            us = m_config.ackLatencyUS;
+            break;
+        case LoadServerConfig::LatencyType::Uniform:
+        {
+            std::uniform_int_distribution<uint32_t> dist(m_config.ackLatencyMinUS, m_config.ackLatencyUS);
+            us = dist(m_randEngine);
+            break;
+        }
+        case LoadServerConfig::LatencyType::Exponential:
+            if (m_config.ackLatencyUS) {
+                std::exponential_distribution<double> dist(1.0 / m_config.ackLatencyUS);
+                us = static_cast<uint64_t>(dist(m_randEngine));
+            }
+            break;
+    }
+    return std::chrono::microseconds(us);
+}
+
+void
+LoadServer::AddReadyAck(
+    Connection & conn,
+    std::string && ack
+    )
+{
+    if (conn.batch.empty()) {
+        conn.batchStartTime = Clock::now();
+    }
+    conn.batch.push_back(std::move(ack));
+    if (conn.batch.size() >= m_config.ackBatchSize) {
+        FlushBatch(conn);
+    }
+}
+
+void
+LoadServer::FlushBatch(
+    Connection & conn
+    )
+{
+    auto & batch = conn.batch;
+    if (batch.size() > 1 && m_config.ackReorderPercent > 0) {
+        std::uniform_int_distribution<size_t> dist(0, batch.size()-1);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (IsPercentHit(m_config.ackReorderPercent)) {
+                std::swap(batch[i], batch[dist(m_randEngine)]);
+            }
+        }
+    }
+    for (const auto & ack : batch) {
+        conn.writeBuf.append(ack);
+    }
+    m_totalAcksSent += batch.size();
+    batch.clear();
+}
+
+void
+LoadServer::FlushConnection(
+    uint64_t connId,
+    Connection & conn
+    )
+{
+    size_t nwritten = 0;
+    while(nwritten < conn.writeBuf.size()) {
+        auto rtn = send(conn.fd, conn.writeBuf.data() + nwritten, conn.writeBuf.size() - nwritten, MSG_NOSIGNAL);
+        if (rtn >= 0) {
+            nwritten += rtn;
+            continue;
+        }
+        if (EINTR == errno) {
+            continue;
+        }
+        if (EWOULDBLOCK == errno || EAGAIN == errno) {
+            break;
+        }
+        CloseConnection(connId);
+        return;
+    }
+    conn.writeBuf.erase(0, nwritten);
+
+    bool waitForWrite = !conn.writeBuf.empty();
+    if (waitForWrite != conn.waitForWrite) {
+        conn.waitForWrite = waitForWrite;
+        ModifyEpoll(conn.fd, waitForWrite? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+    }
+}
+
+LoadServer::Clock::time_point
+LoadServer::ProcessTimers()
+{
+    auto now = Clock::now();
+    std::vector<uint64_t> connsToFlush;
+
+    while(!m_pendingAcks.empty() && m_pendingAcks.top().dueTime <= now) {
+        auto & pending = m_pendingAcks.top();
+        auto iter = m_connections.find(pending.connId);
+        if (iter != m_connections.end()) {
+            // priority_queue::top() is const. The ack string is copied.
+            AddReadyAck(iter->second, std::string(pending.ack));
+            connsToFlush.push_back(pending.connId);
+        }
+        m_pendingAcks.pop();
+    }
+
+    auto nextTime = Clock::time_point::max();
+    auto batchTimeout = std::chrono::microseconds(m_config.ackBatchTimeoutUS);
+    for (auto & kv : m_connections) {
+        auto & conn = kv.second;
+        if (conn.batch.empty()) {
+            continue;
+        }
+        if (now - conn.batchStartTime >= batchTimeout) {
+            FlushBatch(conn);
+            connsToFlush.push_back(kv.first);
+        }
+        else {
+            nextTime = std::min(nextTime, conn.batchStartTime + batchTimeout);
+        }
+    }
+
+    std::sort(connsToFlush.begin(), connsToFlush.end());
+    connsToFlush.erase(std::unique(connsToFlush.begin(), connsToFlush.end()), connsToFlush.end());
+    for (auto connId : connsToFlush) {
+        auto iter = m_connections.find(connId);
+        if (iter != m_connections.end()) {
+            FlushConnection(connId, iter->second);
+        }
+    }
+
+    if (!m_pendingAcks.empty()) {
+        nextTime = std::min(nextTime, m_pendingAcks.top().dueTime);
+    }
+    return nextTime;
+}
+
+void
+LoadServer::ArmTimer(
+    Clock::time_point t
+    )
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+
+    if (t != Clock::time_point::max()) {
+        auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(t - Clock::now()).count();
+        // A zero it_value disarms the timer. So use minimum 1ns.
+        delay = std::max(delay, static_cast<decltype(delay)>(1));
+        spec.it_value.tv_sec = delay / 1000000000;
+        spec.it_value.tv_nsec = delay % 1000000000;
+    }
+    if (-1 == timerfd_settime(m_timerfd, 0, &spec, NULL)) {
+        throw std::system_error(errno, std::system_category(), "timerfd_settime()");
+    }
+}
+
+size_t
+LoadServer::GetTotalAcksByStatus(
+    int statusCode
+    ) const
+{
+    auto iter = m_statusCounts.find(statusCode);
+    return (iter == m_statusCounts.end())? 0 : iter->second.load();
+}
+
+std::vector<std::string>
+LoadServer::GetDataRead() const
+{
+    std::lock_guard<std::mutex> lck(m_dataMutex);
+    return m_dataRead;
+}
@@ -0,0 +1,174 @@
+#pragma once
+#ifndef __LOADSERVER_H__
+#define __LOADSERVER_H__
+
+#include <string>
+#include <atomic>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <queue>
+#include <random>
+#include <mutex>
+#include <chrono>
+
+namespace TestUtil
+{
+
+/// Configuration of LoadServer ack behaviors.
+struct LoadServerConfig
+{
+    enum class LatencyType {
+        Fixed,      // every ack is delayed by ackLatencyUS
+        Uniform,    // delay is uniformly distributed in [ackLatencyMinUS, ackLatencyUS]
+        Exponential // delay is exponentially distributed with mean ackLatencyUS
+    };
+
+    LatencyType latencyType = LatencyType::Fixed;
+    uint32_t ackLatencyUS = 0;
+    uint32_t ackLatencyMinUS = 0;
+
+    size_t ackBatchSize = 1;            // max number of acks sent in one write
+    uint32_t ackBatchTimeoutUS = 1000;  // max time a ready ack waits for its batch to fill
+
+    // Percentage of acks to return each non-success status code, e.g. {2, 1.5} means
+    // 1.5% of acks will be 'tag:2' (ACK_UNKNOWN_SCHEMA_ID). The rest are 'tag:0'.
+    std::map<int, double> ackStatusPercent;
+
+    double ackDropPercent = 0;    // percentage of records never acked
+    double ackReorderPercent = 0; // percentage of acks swapped with another ack in its batch
+
+    bool retainData = false; // if true, save all record payloads read.
+
+    // Parse latency string like 'fixed:<us>', 'uniform:<minUS>:<maxUS>' or 'exp:<meanUS>'.
+    // Throw std::invalid_argument if the string is invalid.
+    void ParseLatency(const std::string & str);
+
+    // Parse status string like '<code>:<percent>'.
+    // Throw std::invalid_argument if the string is invalid.
+    void ParseAckStatus(const std::string & str);
+};
+
+/// This is a socket server for load tests. It is a stand-in for mdsd that can
+/// handle many connections in one epoll loop without parsing or saving the
+/// record data, so that it won't be the bottleneck of the client under test.
+///
+/// Each record is a DJSON frame 'len\n[source,tag,...]'. For each record, the server
+/// sends back 'tag:status\n' ack, where the ack latency, batching, status, drops
+/// and reorders are controlled by LoadServerConfig.
+class LoadServer
+{
+public:
+    LoadServer(const std::string & socketFile, const LoadServerConfig & config);
+
+    ~LoadServer();
+
+    LoadServer(const LoadServer&) = delete;
+    LoadServer& operator=(const LoadServer&) = delete;
+
+    // Create the listening socket.
+    // Throw exception for any error.
+    void Init();
+
+    // Run the event loop until Stop() is called.
+    void Run();
+
+    // notify LoadServer to stop. It can be called from any thread.
+    void Stop();
+
+    size_t GetTotalBytesRead() const { return m_totalBytesRead; }
+    size_t GetTotalRecords() const { return m_totalRecords; }
+    size_t GetTotalAcksSent() const { return m_totalAcksSent; }
+    size_t GetTotalAcksDropped() const { return m_totalAcksDropped; }
+    size_t GetTotalConnections() const { return m_totalConnections; }
+
+    // Return number of acks created with given status code.
+    size_t GetTotalAcksByStatus(int statusCode) const;
+
+    // Return all the record payloads read, if retainData is true.
+    std::vector<std::string> GetDataRead() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingAck
+    {
+        Clock::time_point dueTime;
+        uint64_t connId;
+        std::string ack;
+
+        bool operator>(const PendingAck & other) const { return dueTime > other.dueTime; }
+    };
+
+    struct Connection
+    {
+        int fd = -1;
+        std::string readBuf;            // data read but not processed yet
+        std::string writeBuf;           // acks to write
+        std::vector<std::string> batch; // acks ready to send, waiting for batching
+        Clock::time_point batchStartTime;
+        bool waitForWrite = false;      // if true, EPOLLOUT is registered
+    };
+
+    void AddToEpoll(int fd, uint32_t events);
+    void ModifyEpoll(int fd, uint32_t events);
+
+    void AcceptConnections();
+    void HandleRead(uint64_t connId);
+    void HandleWrite(uint64_t connId);
+    void CloseConnection(uint64_t connId);
+
+    // Parse full frames in conn readBuf. Create an ack for each record.
+    // Return false if a frame is invalid, and the connection must be closed.
+    bool ProcessFrames(uint64_t connId, Connection & conn);
+    void ProcessRecord(uint64_t connId, Connection & conn, const char* payload, size_t len);
+
+    // Create ack string for a tag, or empty string if the ack is dropped.
+    std::string CreateAck(const std::string & tag);
+    Clock::duration GetAckLatency();
+
+    void AddReadyAck(Connection & conn, std::string && ack);
+    void FlushBatch(Connection & conn);
+    void FlushConnection(uint64_t connId, Connection & conn);
+
+    // Move due acks to their connection batch. Flush timed out batches.
+    // Return time when the next timer should fire.
+    Clock::time_point ProcessTimers();
+    void ArmTimer(Clock::time_point t);
+
+    bool IsPercentHit(double percent);
+
+private:
+    std::string m_socketFile;
+    LoadServerConfig m_config;
+
+    int m_listenfd = -1;
+    int m_epollfd = -1;
+    int m_stopfd = -1;  // eventfd to wake up the event loop for stop
+    int m_timerfd = -1; // timerfd for ack latency and batch timeout
+
+    std::atomic<bool> m_stopFlag{false};
+
+    uint64_t m_nextConnId = 1;
+    std::unordered_map<uint64_t, Connection> m_connections; // <connId, connection>
+    std::unordered_map<int, uint64_t> m_fdToConnId;
+
+    std::priority_queue<PendingAck, std::vector<PendingAck>, std::greater<PendingAck>> m_pendingAcks;
+
+    std::mt19937_64 m_randEngine;
+    std::vector<std::pair<double, int>> m_statusTable; // <cumulative percent, status code>
+
+    std::atomic<size_t> m_totalBytesRead{0};
+    std::atomic<size_t> m_totalRecords{0};
+    std::atomic<size_t> m_totalAcksSent{0};
+    std::atomic<size_t> m_totalAcksDropped{0};
+    std::atomic<size_t> m_totalConnections{0};
+    std::map<int, std::atomic<size_t>> m_statusCounts;
+
+    mutable std::mutex m_dataMutex;
+    std::vector<std::string> m_dataRead;
+};
+
+} // namespace
+
+#endif // __LOADSERVER_H__
@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <future>
+#include <random>
 
 extern "C" {
 #include <unistd.h>
@@ -157,12 +158,23 @@ MockServer::PollConnection() const
 {
     Log("Start PollConnection() ...");
     struct pollfd pfds[1];
-    pfds[0].fd = m_listenfd;
     pfds[0].events = POLLIN;
 
+    // Poll with a timeout, so that Stop() is noticed even if m_listenfd
+    // is closed (and set to -1) right before poll() is called.
     int rtn = 0;
-    while( (-1 == (rtn == poll(pfds, 1, -1))) && (EINTR == errno));
+    while(!m_stopAccept) {
+        pfds[0].fd = m_listenfd;
+        rtn = poll(pfds, 1, 100);
+        if (rtn > 0 || (-1 == rtn && EINTR != errno)) {
+            break;
+        }
+    }
     auto errCopy = errno;
+    if (m_stopAccept) {
+        Log("PollConnection(): server is stopped.");
+        return false;
+    }
     if (rtn < 0) {
         std::error_code ec(errCopy, std::system_category());
         Log(std::string("poll() failed: ") + ec.message());
@@ -229,8 +241,11 @@ MockServer::StartReadLoop(
 
     std::string lastStrForMsgId;
     std::string lastStrForData;
+    PendingAcks pendingAcks;
 
     while(!m_stopFlag) {
+        FlushPendingAcks(connfd, pendingAcks);
+
         char buf[4096];
         auto rtn = read(connfd, buf, sizeof(buf));
         auto errCopy = errno;
@@ -256,7 +271,7 @@ MockServer::StartReadLoop(
         m_totalBytesRead += rtn;
         auto bufstr = std::string(buf, rtn);
 
-        if (ProcessReadData(connfd, bufstr, lastStrForMsgId, lastStrForData)) {
+        if (ProcessReadData(connfd, bufstr, lastStrForMsgId, lastStrForData, pendingAcks)) {
             break;
         }
     }
@@ -270,11 +285,12 @@ MockServer::ProcessReadData(
     int connfd,
     const std::string & bufstr,
     std::string & lastStrForMsgId,
-    std::string & lastStrForData
+    std::string & lastStrForData,
+    PendingAcks & pendingAcks
     )
 {
     if (m_parseReadData) {
-        GetMsgIdInfo(connfd, bufstr, lastStrForMsgId);
+        GetMsgIdInfo(connfd, bufstr, lastStrForMsgId, pendingAcks);
 
         if (GetMsgDataInfo(bufstr, lastStrForData)) {
             MarkTestDone();
@@ -301,7 +317,8 @@ void
 MockServer::GetMsgIdInfo(
     int connfd,
     const std::string & bufstr,
-    std::string & lastStrForMsgId
+    std::string & lastStrForMsgId,
+    PendingAcks & pendingAcks
     )
 {
     lastStrForMsgId += bufstr;
@@ -310,7 +327,29 @@ MockServer::GetMsgIdInfo(
     lastStrForMsgId = std::move(leftOverForMsgId);
 
     if (!msgIds.empty()) {
-        WriteBack(connfd, msgIds);
+        if (m_ackDelayMS) {
+            auto sendTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_ackDelayMS);
+            pendingAcks.emplace_back(sendTime, std::move(msgIds));
+        }
+        else {
+            WriteBack(connfd, msgIds);
+        }
+    }
+}
+
+void
+MockServer::FlushPendingAcks(
+    int connfd,
+    PendingAcks & pendingAcks
+    )
+{
+    if (pendingAcks.empty()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    while(!pendingAcks.empty() && pendingAcks.front().first <= now) {
+        WriteBack(connfd, pendingAcks.front().second);
+        pendingAcks.pop_front();
     }
 }
 
@@ -424,6 +463,9 @@ MockServer::Log(
     const std::string & msg
     ) const
 {
+    if (!m_verbose) {
+        return;
+    }
     auto now = TestUtil::GetTimeNow();
     auto tid = std::this_thread::get_id();
     std::cout << now << " Mock: Th: " << tid << " " << msg << std::endl;
@@ -435,6 +477,13 @@ MockServer::ProcessMsgId(const std::string & msgId)
     Log("Get new msgid: " + msgId);
     if (!msgId.empty()) {
         m_totalTags++;
+        if (m_ackDropPercent) {
+            static thread_local std::minstd_rand randEngine(std::random_device{}());
+            if (randEngine() % 100 < m_ackDropPercent) {
+                m_totalAcksDropped++;
+                return std::string();
+            }
+        }
         return msgId + ":0\n";
     }
     return std::string();
@@ -524,7 +573,7 @@ MockServer::GetMsgData(
 
     auto msgData = msg.substr(comma2+1, closeBracketPos-comma2-1);
     Log("Get msgdata '" + msgData + "'");
-    if (!msgData.empty()) {
+    if (m_retainData && !msgData.empty()) {
         m_dataSet.insert(msgData);
     }
 
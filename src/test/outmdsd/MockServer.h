@@ -7,6 +7,8 @@
 #include <unordered_set>
 #include <mutex>
 #include <condition_variable>
+#include <deque>
+#include <chrono>
 
 namespace TestUtil
 {
@@ -49,7 +51,23 @@ public:
 
     std::unordered_set<std::string> GetUniqDataRead() const { return m_dataSet; }
 
+    // Delay each ack by given milliseconds before it is sent back.
+    void SetAckDelay(uint32_t delayMS) { m_ackDelayMS = delayMS; }
+
+    // Drop given percentage (0-100) of acks, i.e. never send them back.
+    void SetAckDropRate(uint32_t percent) { m_ackDropPercent = percent; }
+
+    // If false, data values are not saved in GetUniqDataRead() set.
+    void SetRetainData(bool retainData) { m_retainData = retainData; }
+
+    // If false, don't write any MockServer log to stdout.
+    void SetVerbose(bool verbose) { m_verbose = verbose; }
+
+    size_t GetTotalAcksDropped() const { return m_totalAcksDropped; }
+
 private:
+    using PendingAcks = std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>>;
+
     // poll socket server for new socket connection.
     // Return true if poll() returns successfully, return false if any error.
     bool PollConnection() const;
@@ -66,9 +84,14 @@ private:
     // Process the data read from socket.
     // Return true if end of test is received, return false otherwise.
     bool ProcessReadData(int connfd, const std::string & bufstr,
-        std::string & lastStrForMsgId, std::string & lastStrForData);
+        std::string & lastStrForMsgId, std::string & lastStrForData,
+        PendingAcks & pendingAcks);
+
+    void GetMsgIdInfo(int connfd, const std::string & bufstr, std::string & lastStrForMsgId,
+        PendingAcks & pendingAcks);
 
-    void GetMsgIdInfo(int connfd, const std::string & bufstr, std::string & lastStrForMsgId);
+    // Send back the delayed acks whose delay time has passed.
+    void FlushPendingAcks(int connfd, PendingAcks & pendingAcks);
 
     // Process the data read from socket and get data value info.
     // Return true if end of test is received, return false otherwise.
@@ -90,6 +113,11 @@ private:
 private:
     std::string m_socketFile;
     bool m_parseReadData = true; // if true, parse details from read data; if false, don't parse.
+    bool m_retainData = true; // if true, save data values in m_dataSet.
+    bool m_verbose = true;    // if true, write logs to stdout.
+
+    uint32_t m_ackDelayMS = 0;      // milliseconds to delay each ack
+    uint32_t m_ackDropPercent = 0;  // percentage of acks to drop
 
     std::atomic<bool> m_stopFlag{false}; // a flag to tell server to stop
     std::atomic<bool> m_stopAccept{false}; // stop accept any new connection
@@ -107,6 +135,9 @@ private:
     // total number of tags read by the server. can have duplicates.
     std::atomic<size_t> m_totalTags{0};
 
+    // total number of acks dropped on purpose.
+    std::atomic<size_t> m_totalAcksDropped{0};
+
     std::unordered_set<int> m_connfdSet; // To save all connect FDs.
     std::mutex m_connMutex; // to lock m_connfdSet
 
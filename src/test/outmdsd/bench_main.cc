@@ -0,0 +1,737 @@
+// A benchmark tool for SocketLogger and BufferedLogger. It sends records to a
+// MockServer or LoadServer (or to an external socket server), waits for all of them to be
+// acknowledged, then reports throughput, latency, CPU and memory in JSON.
+//
+// Record latency is measured from the time a record is created until the logger
+// releases it: after the ack is received if acks are enabled (-a), or after
+// it is sent if not. Records dropped by ack timeout are counted as released too.
+//
+// The MockServer or LoadServer runs in a child process, so that the CPU time
+// and memory reported are the logger's only.
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <future>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <system_error>
+
+extern "C" {
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+}
+
+#include "MockServer.h"
+#include "LoadServer.h"
+#include "testutil.h"
+#include "SocketLogger.h"
+#include "BufferedLogger.h"
+#include "DjsonLogItem.h"
+#include "Trace.h"
+#include "FileTracer.h"
+
+using namespace EndpointLog;
+
+struct CmdArgs {
+    std::string loggerType = "socket"; // socket or buffered
+    size_t nrecords = 100000;    // records per producer thread
+    size_t recordSize = 256;     // bytes of data values per record
+    size_t nfields = 4;          // number of fields per record
+    size_t nthreads = 1;         // number of producer threads
+    uint32_t ackTimeoutMS = 60000;
+    uint32_t resendIntervalMS = 1000;
+    size_t bufferLimit = 0;      // BufferedLogger queue limit
+    uint32_t ackDelayMS = 0;     // MockServer ack delay
+    uint32_t ackDropPercent = 0; // MockServer ack drop rate
+    uint32_t timeBeforeDisconnect = 0; // milliseconds
+    uint32_t timeToDisconnect = 0;     // milliseconds
+    uint32_t maxWaitMS = 120000; // max time to wait for all records to finish
+    std::string socketFile = "/tmp/bench_outmdsd.socket";
+    std::string logFile = "/tmp/bench_outmdsd.log";
+    bool useExternalServer = false;
+    std::string serverType = "mock"; // mock or load
+    std::string ioEngine = "poll";   // poll, io_uring, or both
+};
+
+// Save latency of each record in microseconds.
+class LatencyRecorder
+{
+public:
+    LatencyRecorder(size_t nrecords) : m_latencyList(nrecords) {}
+
+    void Add(std::chrono::steady_clock::duration d)
+    {
+        auto n = m_count++;
+        if (n < m_latencyList.size()) {
+            m_latencyList[n] = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+        }
+    }
+
+    size_t GetCount() const { return m_count; }
+
+    // Sort and return latency list. Call it after all records are done.
+    std::vector<uint64_t> GetSortedList()
+    {
+        auto n = std::min(m_count.load(), m_latencyList.size());
+        std::vector<uint64_t> v(m_latencyList.begin(), m_latencyList.begin() + n);
+        std::sort(v.begin(), v.end());
+        return v;
+    }
+
+private:
+    std::vector<uint64_t> m_latencyList;
+    std::atomic<size_t> m_count{0};
+};
+
+// A DjsonLogItem that records its life time when it is destroyed.
+class BenchLogItem : public DjsonLogItem
+{
+public:
+    BenchLogItem(
+        const std::string & source,
+        const std::string & schemaAndData,
+        LatencyRecorder & recorder
+        ) :
+        DjsonLogItem(source, schemaAndData),
+        m_recorder(recorder),
+        m_startTime(std::chrono::steady_clock::now())
+    {}
+
+    ~BenchLogItem()
+    {
+        m_recorder.Add(std::chrono::steady_clock::now() - m_startTime);
+    }
+
+private:
+    LatencyRecorder & m_recorder;
+    std::chrono::steady_clock::time_point m_startTime;
+};
+
+void Usage(const std::string & progname)
+{
+    std::cout << "Usage:" << std::endl;
+    std::cout << std::string("  ") + progname + " [options]" << std::endl;
+    std::cout << "    -l <socket|buffered> : Logger type. Default: socket." << std::endl;
+    std::cout << "    -n <count>       : Number of records per producer thread. Default: 100000." << std::endl;
+    std::cout << "    -s <bytes>       : Bytes of data values per record. Default: 256." << std::endl;
+    std::cout << "    -f <count>       : Number of fields per record. Default: 4." << std::endl;
+    std::cout << "    -t <count>       : Number of producer threads. Default: 1." << std::endl;
+    std::cout << "    -a <ms>          : Ack timeout. 0 means no ack. Default: 60000." << std::endl;
+    std::cout << "    -r <ms>          : Resend interval. Default: 1000." << std::endl;
+    std::cout << "    -q <count>       : BufferedLogger buffer limit. 0 means no limit. Default: 0." << std::endl;
+    std::cout << "    -D <ms>          : Delay each ack in the mock server." << std::endl;
+    std::cout << "    -L <percent>     : Percentage of acks dropped by the mock server." << std::endl;
+    std::cout << "    -b <ms>          : Wait for <ms> milliseconds before disconnect socket." << std::endl;
+    std::cout << "    -d <ms>          : Disconnect socket for <ms> milliseconds." << std::endl;
+    std::cout << "    -w <ms>          : Max time to wait for all records to finish. Default: 120000." << std::endl;
+    std::cout << "    -u <socketFile>  : Unix socket file. Default: /tmp/bench_outmdsd.socket." << std::endl;
+    std::cout << "    -e               : Use an external server listening on <socketFile>." << std::endl;
+    std::cout << "    -m <mock|load>   : Server type. load is LoadServer, which doesn't support -b/-d. Default: mock." << std::endl;
+    std::cout << "    -o <logFile>     : outmdsd log file. Default: /tmp/bench_outmdsd.log." << std::endl;
+    std::cout << "    -i <poll|io_uring|both> : Socket I/O engine. both runs the benchmark once with each. Default: poll." << std::endl;
+}
+
+CmdArgs
+ParseCmdLine(int argc, char** argv)
+{
+    CmdArgs cmdargs;
+    int opt = 0;
+    while((opt = getopt(argc, argv, "l:n:s:f:t:a:r:q:D:L:b:d:w:u:eo:m:i:h")) != -1) {
+        switch(opt) {
+        case 'l':
+            cmdargs.loggerType = optarg;
+            break;
+        case 'n':
+            cmdargs.nrecords = std::stoul(optarg);
+            break;
+        case 's':
+            cmdargs.recordSize = std::stoul(optarg);
+            break;
+        case 'f':
+            cmdargs.nfields = std::max(1UL, std::stoul(optarg));
+            break;
+        case 't':
+            cmdargs.nthreads = std::max(1UL, std::stoul(optarg));
+            break;
+        case 'a':
+            cmdargs.ackTimeoutMS = std::stoul(optarg);
+            break;
+        case 'r':
+            cmdargs.resendIntervalMS = std::stoul(optarg);
+            break;
+        case 'q':
+            cmdargs.bufferLimit = std::stoul(optarg);
+            break;
+        case 'D':
+            cmdargs.ackDelayMS = std::stoul(optarg);
+            break;
+        case 'L':
+            cmdargs.ackDropPercent = std::min(100UL, std::stoul(optarg));
+            break;
+        case 'b':
+            cmdargs.timeBeforeDisconnect = std::stoul(optarg);
+            break;
+        case 'd':
+            cmdargs.timeToDisconnect = std::stoul(optarg);
+            break;
+        case 'w':
+            cmdargs.maxWaitMS = std::stoul(optarg);
+            break;
+        case 'u':
+            cmdargs.socketFile = optarg;
+            break;
+        case 'e':
+            cmdargs.useExternalServer = true;
+            break;
+        case 'o':
+            cmdargs.logFile = optarg;
+            break;
+        case 'm':
+            cmdargs.serverType = optarg;
+            break;
+        case 'i':
+            cmdargs.ioEngine = optarg;
+            break;
+        default:
+            Usage(argv[0]);
+            exit(1);
+        }
+    }
+    if (cmdargs.loggerType != "socket" && cmdargs.loggerType != "buffered") {
+        std::cout << "Error: unexpected logger type: " << cmdargs.loggerType << std::endl;
+        Usage(argv[0]);
+        exit(1);
+    }
+    if (cmdargs.serverType != "mock" && cmdargs.serverType != "load") {
+        std::cout << "Error: unexpected server type: " << cmdargs.serverType << std::endl;
+        Usage(argv[0]);
+        exit(1);
+    }
+    if (cmdargs.ioEngine != "poll" && cmdargs.ioEngine != "io_uring" && cmdargs.ioEngine != "both") {
+        std::cout << "Error: unexpected I/O engine: " << cmdargs.ioEngine << std::endl;
+        Usage(argv[0]);
+        exit(1);
+    }
+    return cmdargs;
+}
+
+// Create a schema and data string with given number of fields,
+// and about given number of bytes for all the data values.
+static std::string
+CreateSchemaAndData(
+    size_t nfields,
+    size_t recordSize
+    )
+{
+    std::ostringstream schema;
+    std::ostringstream data;
+    auto fieldSize = std::max(static_cast<size_t>(1), recordSize / nfields);
+
+    for (size_t i = 0; i < nfields; i++) {
+        if (i) {
+            schema << ",";
+            data << ",";
+        }
+        schema << "[\"field" << i << "\",\"FT_STRING\"]";
+        data << "\"" << std::string(fieldSize, 'a' + (i % 26)) << "\"";
+    }
+    return "1,[" + schema.str() + "],[" + data.str() + "]";
+}
+
+// Run the producer threads. Each thread calls sendFunc for each item.
+// Return number of items failed to send.
+template<typename F>
+static size_t
+RunProducers(
+    const CmdArgs & cmdargs,
+    LatencyRecorder & recorder,
+    F sendFunc
+    )
+{
+    const std::string source = "benchsource";
+    const auto schemaAndData = CreateSchemaAndData(cmdargs.nfields, cmdargs.recordSize);
+
+    std::atomic<size_t> nfailures{0};
+    std::vector<std::future<void>> taskList;
+    for (size_t i = 0; i < cmdargs.nthreads; i++) {
+        taskList.push_back(std::async(std::launch::async, [&]() {
+            for (size_t k = 0; k < cmdargs.nrecords; k++) {
+                auto item = MakeLogItem<BenchLogItem>(source, schemaAndData, recorder);
+                try {
+                    sendFunc(std::move(item));
+                }
+                catch(const std::exception & ex) {
+                    nfailures++;
+                }
+            }
+        }));
+    }
+    for (auto & task : taskList) {
+        task.get();
+    }
+    return nfailures;
+}
+
+// Wait until all the items are released by the logger, or timeout.
+static bool
+WaitForAllDone(
+    const LatencyRecorder & recorder,
+    size_t nrecords,
+    uint32_t timeoutMS
+    )
+{
+    auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+    while(recorder.GetCount() < nrecords) {
+        if (std::chrono::steady_clock::now() > endTime) {
+            return false;
+        }
+        usleep(1000);
+    }
+    return true;
+}
+
+struct LoggerStats {
+    size_t nfailures = 0;
+    size_t totalSend = 0;
+    size_t totalResend = 0;
+    size_t numTagsRead = 0;
+    size_t numItemsInCache = 0;
+    size_t numCompleted = 0; // number of items released before the logger is destroyed
+    bool isAllDone = false;
+    std::string ioEngine;    // the I/O engine in use, after any fallback.
+};
+
+static LoggerStats
+RunSocketLogger(
+    const CmdArgs & cmdargs,
+    LatencyRecorder & recorder,
+    size_t nrecords
+    )
+{
+    LoggerStats stats;
+    SocketLogger logger(cmdargs.socketFile, cmdargs.ackTimeoutMS, cmdargs.resendIntervalMS,
+        60*1000, cmdargs.ioEngine);
+    stats.ioEngine = logger.GetIoEngine();
+
+    stats.nfailures = RunProducers(cmdargs, recorder, [&logger](LogItemPtr item) {
+        logger.SendData(std::move(item));
+    });
+    stats.isAllDone = WaitForAllDone(recorder, nrecords, cmdargs.maxWaitMS);
+
+    stats.totalSend = logger.GetTotalSend();
+    stats.totalResend = logger.GetTotalResend();
+    stats.numTagsRead = logger.GetNumTagsRead();
+    stats.numItemsInCache = logger.GetNumItemsInCache();
+    stats.numCompleted = recorder.GetCount();
+    return stats;
+}
+
+static LoggerStats
+RunBufferedLogger(
+    const CmdArgs & cmdargs,
+    LatencyRecorder & recorder,
+    size_t nrecords
+    )
+{
+    LoggerStats stats;
+    BufferedLogger logger(cmdargs.socketFile, cmdargs.ackTimeoutMS, cmdargs.resendIntervalMS,
+        60*1000, cmdargs.bufferLimit, cmdargs.ioEngine);
+    stats.ioEngine = logger.GetIoEngine();
+
+    stats.nfailures = RunProducers(cmdargs, recorder, [&logger](LogItemPtr item) {
+        logger.AddData(std::move(item));
+    });
+    stats.isAllDone = WaitForAllDone(recorder, nrecords, cmdargs.maxWaitMS);
+
+    stats.totalSend = logger.GetTotalSend();
+    stats.totalResend = logger.GetTotalResend();
+    stats.numTagsRead = logger.GetNumTagsRead();
+    stats.numItemsInCache = logger.GetNumItemsInCache();
+    stats.numCompleted = recorder.GetCount();
+    return stats;
+}
+
+static double
+GetCpuTimeUS()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    auto toUS = [](const struct timeval & tv) { return tv.tv_sec * 1000000.0 + tv.tv_usec; };
+    return toUS(usage.ru_utime) + toUS(usage.ru_stime);
+}
+
+static long
+GetPeakRssKB()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static uint64_t
+GetPercentile(
+    const std::vector<uint64_t> & sortedList,
+    double percentile
+    )
+{
+    if (sortedList.empty()) {
+        return 0;
+    }
+    auto index = static_cast<size_t>(percentile * (sortedList.size() - 1));
+    return sortedList[index];
+}
+
+// Disconnect the mock server once after a given time. The disconnect is
+// skipped if the benchmark finishes before it starts.
+class Disconnector
+{
+public:
+    Disconnector(TestUtil::MockServer & server, uint32_t timeBeforeMS, uint32_t disconnectMS) :
+        m_server(server),
+        m_timeBeforeMS(timeBeforeMS),
+        m_disconnectMS(disconnectMS)
+    {
+        if (disconnectMS) {
+            m_task = std::async(std::launch::async, [this]() { Run(); });
+        }
+    }
+
+    // Cancel a pending disconnect, or wait until the server is restarted.
+    void Finish()
+    {
+        if (!m_task.valid()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lck(m_mutex);
+        m_isCancelled = true;
+        m_cv.notify_all();
+        if (m_isStarted) {
+            lck.unlock();
+            auto restartTime = m_startTime + std::chrono::milliseconds(m_disconnectMS + 100);
+            std::this_thread::sleep_until(restartTime);
+        }
+    }
+
+    void Wait()
+    {
+        if (m_task.valid()) {
+            m_task.get();
+        }
+    }
+
+    bool IsStarted() const { return m_isStarted; }
+
+private:
+    void Run()
+    {
+        std::unique_lock<std::mutex> lck(m_mutex);
+        if (m_cv.wait_for(lck, std::chrono::milliseconds(m_timeBeforeMS), [this]() { return m_isCancelled; })) {
+            return;
+        }
+        m_isStarted = true;
+        m_startTime = std::chrono::steady_clock::now();
+        lck.unlock();
+
+        // This includes restart and run the server again until it is stopped.
+        m_server.DisconnectAndRun(m_disconnectMS);
+    }
+
+    TestUtil::MockServer & m_server;
+    uint32_t m_timeBeforeMS;
+    uint32_t m_disconnectMS;
+    std::future<void> m_task;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_isCancelled = false;
+    std::atomic<bool> m_isStarted{false};
+    std::chrono::steady_clock::time_point m_startTime;
+};
+
+// Run the MockServer or LoadServer in a child process until Stop() is called.
+class ServerProcess
+{
+public:
+    // Fork the server process and wait until it listens. Only the calling thread
+    // is forked, so the caller must not have started any other thread.
+    // Throw exception for any error.
+    ServerProcess(const CmdArgs & cmdargs)
+    {
+        int stopPipe[2];
+        int resultPipe[2];
+        if (pipe2(stopPipe, O_CLOEXEC)) {
+            throw std::system_error(errno, std::system_category(), "pipe2() failed");
+        }
+        if (pipe2(resultPipe, O_CLOEXEC)) {
+            auto errCopy = errno;
+            close(stopPipe[0]);
+            close(stopPipe[1]);
+            throw std::system_error(errCopy, std::system_category(), "pipe2() failed");
+        }
+
+        m_pid = fork();
+        if (0 == m_pid) {
+            close(stopPipe[1]);
+            close(resultPipe[0]);
+            RunChild(cmdargs, stopPipe[0], resultPipe[1]);
+        }
+        auto errCopy = errno;
+        close(stopPipe[0]);
+        close(resultPipe[1]);
+        m_stopFd = stopPipe[1];
+        m_resultFd = resultPipe[0];
+        if (-1 == m_pid) {
+            Close();
+            throw std::system_error(errCopy, std::system_category(), "fork() failed");
+        }
+
+        // The child writes one byte once the server listens, or exits.
+        char ready = 0;
+        ssize_t rtn = 0;
+        while(-1 == (rtn = read(m_resultFd, &ready, 1)) && EINTR == errno) {}
+        if (1 != rtn) {
+            Stop();
+            throw std::runtime_error("server process failed to start");
+        }
+    }
+
+    ~ServerProcess()
+    {
+        Stop();
+    }
+
+    ServerProcess(const ServerProcess&) = delete;
+    ServerProcess& operator=(const ServerProcess&) = delete;
+
+    // Stop the server process and read its results.
+    void Stop()
+    {
+        if (-1 == m_pid) {
+            return;
+        }
+        // The child stops when the pipe is closed.
+        close(m_stopFd);
+        m_stopFd = -1;
+
+        std::string result;
+        char buf[256];
+        ssize_t rtn = 0;
+        while((rtn = read(m_resultFd, buf, sizeof(buf))) != 0) {
+            if (rtn > 0) {
+                result.append(buf, rtn);
+            }
+            else if (EINTR != errno) {
+                break;
+            }
+        }
+        std::istringstream strm(result);
+        strm >> m_totalBytesRead >> m_totalAcksDropped >> m_isDisconnected;
+
+        while(-1 == waitpid(m_pid, nullptr, 0) && EINTR == errno) {}
+        m_pid = -1;
+        Close();
+    }
+
+    size_t GetTotalBytesRead() const { return m_totalBytesRead; }
+    size_t GetTotalAcksDropped() const { return m_totalAcksDropped; }
+
+    // Return true if the server was disconnected (see -b and -d).
+    bool IsDisconnected() const { return m_isDisconnected; }
+
+private:
+    [[noreturn]] static void RunChild(const CmdArgs & cmdargs, int stopFd, int resultFd)
+    {
+        try {
+            std::unique_ptr<TestUtil::MockServer> mockServer;
+            std::unique_ptr<TestUtil::LoadServer> loadServer;
+            std::future<void> serverTask;
+            if ("load" == cmdargs.serverType) {
+                TestUtil::LoadServerConfig config;
+                config.ackLatencyUS = cmdargs.ackDelayMS * 1000;
+                config.ackDropPercent = cmdargs.ackDropPercent;
+                loadServer.reset(new TestUtil::LoadServer(cmdargs.socketFile, config));
+                loadServer->Init();
+                serverTask = std::async(std::launch::async, [&loadServer]() { loadServer->Run(); });
+            }
+            else {
+                mockServer.reset(new TestUtil::MockServer(cmdargs.socketFile));
+                mockServer->SetVerbose(false);
+                mockServer->SetRetainData(false);
+                mockServer->SetAckDelay(cmdargs.ackDelayMS);
+                mockServer->SetAckDropRate(cmdargs.ackDropPercent);
+                mockServer->Init();
+                serverTask = std::async(std::launch::async, [&mockServer]() { mockServer->Run(); });
+            }
+            std::unique_ptr<Disconnector> disconnector;
+            if (mockServer) {
+                disconnector.reset(new Disconnector(*mockServer, cmdargs.timeBeforeDisconnect, cmdargs.timeToDisconnect));
+            }
+
+            if (1 != write(resultFd, "r", 1)) {
+                _exit(1);
+            }
+            // Run until the parent closes the pipe, including when it exits.
+            char c;
+            while(-1 == read(stopFd, &c, 1) && EINTR == errno) {}
+
+            std::ostringstream strm;
+            if (mockServer) {
+                disconnector->Finish();
+                strm << mockServer->GetTotalBytesRead() << " " << mockServer->GetTotalAcksDropped() << " "
+                     << disconnector->IsStarted();
+                mockServer->Stop();
+                disconnector->Wait();
+                serverTask.get();
+            }
+            else {
+                loadServer->Stop();
+                serverTask.get();
+                strm << loadServer->GetTotalBytesRead() << " " << loadServer->GetTotalAcksDropped() << " 0";
+            }
+            auto result = strm.str();
+            if (static_cast<ssize_t>(result.size()) != write(resultFd, result.c_str(), result.size())) {
+                _exit(1);
+            }
+        }
+        catch(const std::exception & ex) {
+            std::cout << "Error: server process exception: " << ex.what() << std::endl;
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    void Close()
+    {
+        if (-1 != m_stopFd) {
+            close(m_stopFd);
+            m_stopFd = -1;
+        }
+        if (-1 != m_resultFd) {
+            close(m_resultFd);
+            m_resultFd = -1;
+        }
+    }
+
+    pid_t m_pid = -1;
+    int m_stopFd = -1;   // the child stops when it is closed.
+    int m_resultFd = -1; // the child writes its ready byte, then its results.
+    size_t m_totalBytesRead = 0;
+    size_t m_totalAcksDropped = 0;
+    bool m_isDisconnected = false;
+};
+
+int
+RunBenchmark(
+    const CmdArgs & cmdargs
+    )
+{
+    const size_t nrecords = cmdargs.nrecords * cmdargs.nthreads;
+    LatencyRecorder recorder(nrecords);
+
+    // No logger thread is running yet, so the server process can be forked.
+    std::unique_ptr<ServerProcess> server;
+    if (!cmdargs.useExternalServer) {
+        server.reset(new ServerProcess(cmdargs));
+    }
+
+    auto startCpuUS = GetCpuTimeUS();
+    auto startTime = std::chrono::steady_clock::now();
+
+    LoggerStats stats;
+    if ("buffered" == cmdargs.loggerType) {
+        stats = RunBufferedLogger(cmdargs, recorder, nrecords);
+    }
+    else {
+        stats = RunSocketLogger(cmdargs, recorder, nrecords);
+    }
+
+    auto elapsedSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    auto cpuUS = GetCpuTimeUS() - startCpuUS;
+
+    size_t serverBytesRead = 0;
+    size_t serverAcksDropped = 0;
+    bool isDisconnected = false;
+    if (server) {
+        server->Stop();
+        serverBytesRead = server->GetTotalBytesRead();
+        serverAcksDropped = server->GetTotalAcksDropped();
+        isDisconnected = server->IsDisconnected();
+    }
+
+    auto latencyList = recorder.GetSortedList();
+    auto ncompleted = stats.numCompleted;
+    auto recordBytes = CreateSchemaAndData(cmdargs.nfields, cmdargs.recordSize).size();
+
+    std::ostringstream strm;
+    strm << std::fixed << std::setprecision(3);
+    strm << "{"
+         << "\"logger\":\"" << cmdargs.loggerType << "\","
+         << "\"threads\":" << cmdargs.nthreads << ","
+         << "\"records\":" << nrecords << ","
+         << "\"record_bytes\":" << recordBytes << ","
+         << "\"fields\":" << cmdargs.nfields << ","
+         << "\"ack_timeout_ms\":" << cmdargs.ackTimeoutMS << ","
+         << "\"resend_interval_ms\":" << cmdargs.resendIntervalMS << ","
+         << "\"ack_delay_ms\":" << cmdargs.ackDelayMS << ","
+         << "\"ack_drop_percent\":" << cmdargs.ackDropPercent << ","
+         << "\"disconnect_ms\":" << (isDisconnected? cmdargs.timeToDisconnect : 0) << ","
+         << "\"server\":\"" << (cmdargs.useExternalServer? "external" : cmdargs.serverType) << "\","
+         << "\"io_engine\":\"" << stats.ioEngine << "\","
+         << "\"all_done\":" << (stats.isAllDone? "true" : "false") << ","
+         << "\"completed\":" << ncompleted << ","
+         << "\"send_failures\":" << stats.nfailures << ","
+         << "\"total_send\":" << stats.totalSend << ","
+         << "\"total_resend\":" << stats.totalResend << ","
+         << "\"acks_read\":" << stats.numTagsRead << ","
+         << "\"items_in_cache\":" << stats.numItemsInCache << ","
+         << "\"server_bytes_read\":" << serverBytesRead << ","
+         << "\"server_acks_dropped\":" << serverAcksDropped << ","
+         << "\"elapsed_sec\":" << elapsedSec << ","
+         << "\"records_per_sec\":" << (elapsedSec > 0? ncompleted / elapsedSec : 0) << ","
+         << "\"bytes_per_sec\":" << (elapsedSec > 0? ncompleted * recordBytes / elapsedSec : 0) << ","
+         << "\"latency_us\":{"
+         << "\"p50\":" << GetPercentile(latencyList, 0.5) << ","
+         << "\"p99\":" << GetPercentile(latencyList, 0.99) << ","
+         << "\"p999\":" << GetPercentile(latencyList, 0.999) << ","
+         << "\"max\":" << (latencyList.empty()? 0 : latencyList.back())
+         << "},"
+         << "\"cpu_us_per_record\":" << (ncompleted? cpuUS / ncompleted : 0) << ","
+         << "\"peak_rss_kb\":" << GetPeakRssKB()
+         << "}";
+    std::cout << strm.str() << std::endl;
+
+    return stats.isAllDone? 0 : 2;
+}
+
+int main(int argc, char** argv)
+{
+    auto cmdargs = ParseCmdLine(argc, argv);
+
+    try {
+        Trace::SetTracer(new FileTracer(cmdargs.logFile, true));
+        Trace::SetTraceLevel(TraceLevel::Warning);
+
+        if ("both" != cmdargs.ioEngine) {
+            return RunBenchmark(cmdargs);
+        }
+        // Same load with each engine, one JSON line each.
+        int rtn = 0;
+        for (auto ioEngine : { "poll", "io_uring" }) {
+            auto engineArgs = cmdargs;
+            engineArgs.ioEngine = ioEngine;
+            rtn = std::max(rtn, RunBenchmark(engineArgs));
+        }
+        return rtn;
+    }
+    catch(const std::exception & ex) {
+        std::cout << "Error: RunBenchmark exception: " << ex.what() << std::endl;
+    }
+    return 1;
+}
@@ -3,14 +3,19 @@
 
 extern "C" {
 #include <unistd.h>
+#include <signal.h>
 }
 
 #include "MockServer.h"
+#include "LoadServer.h"
 
 struct CmdArgs {
-    uint32_t timeBeforeDisconnect; // milliseconds
-    uint32_t timeToDisconnect; // milliseconds
+    uint32_t timeBeforeDisconnect = 0; // milliseconds
+    uint32_t timeToDisconnect = 0; // milliseconds
     std::string socketFile;
+    bool useLoadServer = false;
+    uint32_t statsIntervalSec = 0; // seconds
+    TestUtil::LoadServerConfig loadConfig;
 };
 
 void Usage(const std::string & progname)
@@ -20,6 +25,16 @@ void Usage(const std::string & progname)
     std::cout << "    -b <ms>          : Wait for <ms> milliseconds before disconnect socket." << std::endl;
     std::cout << "    -d <ms>          : Disconnect socket after <ms> milliseconds." << std::endl;
     std::cout << "    -u <socketFile>  : Listen to a Unix socket file. Create it if not exists." << std::endl;
+    std::cout << "  Load test mode options:" << std::endl;
+    std::cout << "    -L               : Run as a load test server. -b and -d are not used." << std::endl;
+    std::cout << "    -l <latency>     : Ack latency: fixed:<us>, uniform:<minUS>:<maxUS> or exp:<meanUS>." << std::endl;
+    std::cout << "    -B <count>       : Max number of acks sent in one batch. Default: 1." << std::endl;
+    std::cout << "    -T <us>          : Max time to wait for an ack batch to fill. Default: 1000." << std::endl;
+    std::cout << "    -S <code:pct>    : Send ack status <code> for <pct> percent of records. Can be repeated." << std::endl;
+    std::cout << "    -x <pct>         : Drop <pct> percent of acks." << std::endl;
+    std::cout << "    -r <pct>         : Reorder <pct> percent of acks within their batch." << std::endl;
+    std::cout << "    -k               : Keep all the data read in memory." << std::endl;
+    std::cout << "    -i <sec>         : Print stats every <sec> seconds." << std::endl;
 }
 
 CmdArgs
@@ -32,23 +47,57 @@ ParseCmdLine(int argc, char** argv)
 
     CmdArgs cmdargs;
     int opt = 0;
-    while((opt = getopt(argc, argv, "b:d:u:")) != -1) {
-        switch(opt) {
-        case 'b':
-            cmdargs.timeBeforeDisconnect = atoi(optarg);
-            break;
-        case 'd':
-            cmdargs.timeToDisconnect = atoi(optarg);
-            break;
-        case 'u':
-            cmdargs.socketFile = optarg;
-            break;
-        default:
-            std::cout << "Error: unexpected cmd option: " << opt << std::endl;
-            Usage(argv[0]);
-            exit(1);
+    try {
+        while((opt = getopt(argc, argv, "b:d:u:Ll:B:T:S:x:r:ki:")) != -1) {
+            switch(opt) {
+            case 'b':
+                cmdargs.timeBeforeDisconnect = atoi(optarg);
+                break;
+            case 'd':
+                cmdargs.timeToDisconnect = atoi(optarg);
+                break;
+            case 'u':
+                cmdargs.socketFile = optarg;
+                break;
+            case 'L':
+                cmdargs.useLoadServer = true;
+                break;
+            case 'l':
+                cmdargs.loadConfig.ParseLatency(optarg);
+                break;
+            case 'B':
+                cmdargs.loadConfig.ackBatchSize = std::stoul(optarg);
+                break;
+            case 'T':
+                cmdargs.loadConfig.ackBatchTimeoutUS = std::stoul(optarg);
+                break;
+            case 'S':
+                cmdargs.loadConfig.ParseAckStatus(optarg);
+                break;
+            case 'x':
+                cmdargs.loadConfig.ackDropPercent = std::stod(optarg);
+                break;
+            case 'r':
+                cmdargs.loadConfig.ackReorderPercent = std::stod(optarg);
+                break;
+            case 'k':
+                cmdargs.loadConfig.retainData = true;
+                break;
+            case 'i':
+                cmdargs.statsIntervalSec = atoi(optarg);
+                break;
+            default:
+                std::cout << "Error: unexpected cmd option: " << opt << std::endl;
+                Usage(argv[0]);
+                exit(1);
+            }
         }
     }
+    catch(const std::exception & ex) {
+        std::cout << "Error: invalid value for option '" << static_cast<char>(opt) << "': " << ex.what() << std::endl;
+        Usage(argv[0]);
+        exit(1);
+    }
     return cmdargs;
 }
 
@@ -77,11 +126,71 @@ RunMockServer(
     return false;
 }
 
+static TestUtil::LoadServer* s_loadServer = nullptr;
+
+static void
+StopLoadServer(int)
+{
+    if (s_loadServer) {
+        s_loadServer->Stop();
+    }
+}
+
+static void
+PrintLoadServerStats(
+    const TestUtil::LoadServer & server
+    )
+{
+    std::cout << "records=" << server.GetTotalRecords()
+              << " bytes=" << server.GetTotalBytesRead()
+              << " acksSent=" << server.GetTotalAcksSent()
+              << " acksDropped=" << server.GetTotalAcksDropped()
+              << " connections=" << server.GetTotalConnections();
+    for (int code = 0; code <= 5; code++) {
+        std::cout << " status" << code << "=" << server.GetTotalAcksByStatus(code);
+    }
+    std::cout << std::endl;
+}
+
+bool
+RunLoadServer(
+    const CmdArgs& cmdargs
+    )
+{
+    try {
+        TestUtil::LoadServer loadServer(cmdargs.socketFile, cmdargs.loadConfig);
+        loadServer.Init();
+
+        s_loadServer = &loadServer;
+        signal(SIGINT, StopLoadServer);
+        signal(SIGTERM, StopLoadServer);
+
+        auto serverTask = std::async(std::launch::async, [&loadServer] () { loadServer.Run(); });
+
+        while(std::future_status::ready != serverTask.wait_for(std::chrono::seconds(1))) {
+            static uint32_t nsec = 0;
+            if (cmdargs.statsIntervalSec && 0 == (++nsec % cmdargs.statsIntervalSec)) {
+                PrintLoadServerStats(loadServer);
+            }
+        }
+        serverTask.get();
+        s_loadServer = nullptr;
+
+        PrintLoadServerStats(loadServer);
+        return true;
+    }
+    catch(const std::exception & ex) {
+        std::cout << "Error: RunLoadServer exception: " << ex.what() << std::endl;
+    }
+    return false;
+}
+
 int main(int argc, char** argv)
 {
     auto cmdargs = ParseCmdLine(argc, argv);
 
-    if (!RunMockServer(cmdargs)) {
+    auto isOK = cmdargs.useLoadServer? RunLoadServer(cmdargs) : RunMockServer(cmdargs);
+    if (!isOK) {
         return 1;
     }
 
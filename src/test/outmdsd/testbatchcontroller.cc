@@ -0,0 +1,96 @@
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+
+#include "BatchController.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testbatchcontroller)
+
+static const std::chrono::microseconds MaxLinger(2000);
+static const std::chrono::microseconds FastSend(100);
+
+BOOST_AUTO_TEST_CASE(Test_BatchController_Invalid)
+{
+    BOOST_CHECK_THROW(BatchController(0, 1000, MaxLinger), std::invalid_argument);
+    BOOST_CHECK_THROW(BatchController(10, 0, MaxLinger), std::invalid_argument);
+
+    BatchController ctl(10, 1000, MaxLinger);
+    BOOST_CHECK_THROW(ctl.SetLimits(0, 1000, MaxLinger), std::invalid_argument);
+}
+
+// Validate that the limits grow while full batches leave a backlog, and
+// shrink back to single items once the queue is drained.
+BOOST_AUTO_TEST_CASE(Test_BatchController_GrowAndShrink)
+{
+    BatchController ctl(64, 1024*1024, MaxLinger);
+    BOOST_CHECK_EQUAL(1, ctl.GetBatchItems());
+    BOOST_CHECK_EQUAL(4096, ctl.GetBatchBytes());
+    BOOST_CHECK_EQUAL(0, ctl.GetLinger().count());
+
+    // A full batch without backlog doesn't grow.
+    ctl.OnBatchSent(1, 100, 0, FastSend);
+    BOOST_CHECK_EQUAL(1, ctl.GetBatchItems());
+
+    size_t expected = 1;
+    for (int i = 0; i < 10; i++) {
+        ctl.OnBatchSent(ctl.GetBatchItems(), 100, 1000, FastSend);
+        expected = std::min<size_t>(64, expected * 2);
+        BOOST_CHECK_EQUAL(expected, ctl.GetBatchItems());
+    }
+    BOOST_CHECK_EQUAL(1024*1024, ctl.GetBatchBytes());
+    BOOST_CHECK_EQUAL(MaxLinger.count(), ctl.GetLinger().count());
+
+    // A partial batch with backlog keeps the limits.
+    ctl.OnBatchSent(10, 1000, 1000, FastSend);
+    BOOST_CHECK_EQUAL(64, ctl.GetBatchItems());
+
+    for (int i = 0; i < 10; i++) {
+        ctl.OnBatchSent(1, 100, 0, FastSend);
+    }
+    BOOST_CHECK_EQUAL(1, ctl.GetBatchItems());
+    BOOST_CHECK_EQUAL(4096, ctl.GetBatchBytes());
+    BOOST_CHECK_EQUAL(0, ctl.GetLinger().count());
+}
+
+// Validate that a batch filled by bytes grows the limits too, and that a
+// batch slower than the linger bound doesn't.
+BOOST_AUTO_TEST_CASE(Test_BatchController_Bytes)
+{
+    BatchController ctl(64, 64*1024, MaxLinger);
+
+    ctl.OnBatchSent(1, 10000, 100, FastSend);
+    BOOST_CHECK_EQUAL(2, ctl.GetBatchItems());
+    BOOST_CHECK_EQUAL(8192, ctl.GetBatchBytes());
+
+    ctl.OnBatchSent(1, 10000, 100, MaxLinger + std::chrono::microseconds(1));
+    BOOST_CHECK_EQUAL(2, ctl.GetBatchItems());
+    BOOST_CHECK_EQUAL(8192, ctl.GetBatchBytes());
+
+    // Changing the limits restarts from single items.
+    ctl.SetLimits(1, 64*1024, MaxLinger);
+    for (int i = 0; i < 5; i++) {
+        ctl.OnBatchSent(1, 100, 100, FastSend);
+    }
+    BOOST_CHECK_EQUAL(1, ctl.GetBatchItems());
+    BOOST_CHECK_EQUAL(0, ctl.GetLinger().count());
+}
+
+// Validate that the linger follows 1/8 of the ack latency, up to the max linger.
+BOOST_AUTO_TEST_CASE(Test_BatchController_Linger)
+{
+    BatchController ctl(64, 1024*1024, MaxLinger);
+    ctl.OnAckLatency(std::chrono::microseconds(800));
+    BOOST_CHECK_EQUAL(0, ctl.GetLinger().count());
+
+    ctl.OnBatchSent(1, 100, 100, FastSend);
+    BOOST_CHECK_EQUAL(100, ctl.GetLinger().count());
+
+    ctl.OnAckLatency(std::chrono::seconds(1));
+    BOOST_CHECK_EQUAL(MaxLinger.count(), ctl.GetLinger().count());
+
+    ctl.OnAckLatency(std::chrono::microseconds(0));
+    BOOST_CHECK_EQUAL(MaxLinger.count(), ctl.GetLinger().count());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,8 +1,11 @@
 #include <boost/test/unit_test.hpp>
+#include <future>
 #include "BufferedLogger.h"
+#include "DataResender.h"
 #include "DjsonLogItem.h"
 #include "testutil.h"
 #include "MockServer.h"
+#include "LoadServer.h"
 
 using namespace EndpointLog;
 
@@ -121,7 +124,10 @@ ValidateServerResults(
 }
 
 static void
-RunE2ETest(size_t nitems)
+RunE2ETest(
+    size_t nitems,
+    unsigned int encodeThreads = 0
+    )
 {
     const std::string sockfile = TestUtil::GetCurrDir() + "/buflog-e2e";
     auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile, true);
@@ -130,6 +136,7 @@ RunE2ETest(size_t nitems)
     auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
 
     BufferedLogger bLogger(sockfile, 1000000, 100, 100, nitems*2);
+    bLogger.SetEncodeThreads(encodeThreads);
 
     size_t totalSend = 0;
     for (size_t i = 0; i < nitems; i++) {
@@ -142,6 +149,7 @@ RunE2ETest(size_t nitems)
     LogItemPtr eot(new DjsonLogItem("testsource", TestUtil::EndOfTest()));
     bLogger.AddData(eot);
     totalSend += TestUtil::EndOfTest().size();
+    BOOST_CHECK_THROW(bLogger.SetEncodeThreads(encodeThreads), std::logic_error);
 
     BOOST_CHECK(bLogger.WaitUntilAllSend(1000));
     BOOST_CHECK(mockServer->WaitForTestsDone(1000));
@@ -161,6 +169,16 @@ RunE2ETest(size_t nitems)
 
     BOOST_CHECK_LE(nitems+1, bLogger.GetTotalSend());
     BOOST_CHECK_EQUAL(0, bLogger.GetNumItemsInCache());
+
+    auto stats = bLogger.GetStats();
+    if (encodeThreads) {
+        auto expected = "\"encode_threads\":" + std::to_string(encodeThreads);
+        BOOST_CHECK_MESSAGE(stats.find(expected) != std::string::npos, "Not found '" << expected << "' in " << stats);
+        BOOST_CHECK(stats.find("\"encode_queue_depth\":0") != std::string::npos);
+    }
+    else {
+        BOOST_CHECK(stats.find("encode_threads") == std::string::npos);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(Test_BufferedLogger_E2E_1)
@@ -183,4 +201,53 @@ BOOST_AUTO_TEST_CASE(Test_BufferedLogger_E2E_1000)
     }
 }
 
+// Validate that items encoded by encode threads are all sent.
+BOOST_AUTO_TEST_CASE(Test_BufferedLogger_E2E_Encode)
+{
+    try {
+        RunE2ETest(1000, 4);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that items sent while the endpoint comes up are received once:
+// they must not be replayed on the connection they are sent on.
+BOOST_AUTO_TEST_CASE(Test_BufferedLogger_SendOnceOnConnect)
+{
+    try {
+        for (auto policy : { ReplayPolicy::Interleave, ReplayPolicy::ReplayFirst }) {
+            const std::string sockfile = TestUtil::GetCurrDir() + "/buflog-sendonce";
+            unlink(sockfile.c_str());
+
+            BufferedLogger b(sockfile, 100000, 100000, 5000, 100);
+            b.SetReplayPolicy(policy);
+            const size_t nitems = 10;
+            for (size_t i = 0; i < nitems; i++) {
+                b.AddData(LogItemPtr(new DjsonLogItem("testsource", TestUtil::CreateMsg(i))));
+            }
+
+            // Start the server after the first connect attempts fail.
+            usleep(300*1000);
+            TestUtil::LoadServerConfig config;
+            config.ackDropPercent = 100;
+            TestUtil::LoadServer server(sockfile, config);
+            server.Init();
+            auto serverTask = std::async(std::launch::async, [&server]() { server.Run(); });
+
+            BOOST_CHECK(b.WaitUntilAllSend(5000));
+            // Leave time for a replay on the new connection.
+            usleep(300*1000);
+            BOOST_CHECK_EQUAL(nitems, server.GetTotalRecords());
+
+            server.Stop();
+            serverTask.get();
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
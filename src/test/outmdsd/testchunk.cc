@@ -0,0 +1,411 @@
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include "MsgpackChunkEncoder.h"
+#include "MsgpackReader.h"
+#include "SocketLogger.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testchunk)
+
+// A minimal MessagePack packer to create test chunks.
+class Packer
+{
+public:
+    Packer & Nil() { m_data.append(1, '\xc0'); return *this; }
+    Packer & Bool(bool v) { m_data.append(1, v? '\xc3' : '\xc2'); return *this; }
+
+    Packer & Int(int64_t v)
+    {
+        if (v >= 0 && v <= 0x7f) {
+            m_data.append(1, static_cast<char>(v));
+        }
+        else if (v < 0 && v >= -32) {
+            m_data.append(1, static_cast<char>(v));
+        }
+        else {
+            m_data.append(1, '\xd3');
+            AppendBigEndian(static_cast<uint64_t>(v), 8);
+        }
+        return *this;
+    }
+
+    Packer & UInt64(uint64_t v)
+    {
+        m_data.append(1, '\xcf');
+        AppendBigEndian(v, 8);
+        return *this;
+    }
+
+    Packer & Double(double v)
+    {
+        uint64_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        m_data.append(1, '\xcb');
+        AppendBigEndian(bits, 8);
+        return *this;
+    }
+
+    Packer & Str(const std::string & s)
+    {
+        if (s.size() < 32) {
+            m_data.append(1, static_cast<char>(0xa0 | s.size()));
+        }
+        else {
+            m_data.append(1, '\xdb');
+            AppendBigEndian(s.size(), 4);
+        }
+        m_data.append(s);
+        return *this;
+    }
+
+    Packer & Array(uint32_t n)
+    {
+        m_data.append(1, '\xdd');
+        AppendBigEndian(n, 4);
+        return *this;
+    }
+
+    Packer & Map(uint32_t n)
+    {
+        m_data.append(1, '\xdf');
+        AppendBigEndian(n, 4);
+        return *this;
+    }
+
+    Packer & EventTime(uint32_t sec, uint32_t nsec)
+    {
+        m_data.append(1, '\xd7').append(1, '\0');
+        AppendBigEndian(sec, 4);
+        AppendBigEndian(nsec, 4);
+        return *this;
+    }
+
+    const std::string & GetData() const { return m_data; }
+
+private:
+    void AppendBigEndian(uint64_t v, int nbytes)
+    {
+        for (int i = nbytes-1; i >= 0; i--) {
+            m_data.append(1, static_cast<char>((v >> (8*i)) & 0xff));
+        }
+    }
+
+private:
+    std::string m_data;
+};
+
+using SentList = std::vector<std::pair<std::string, std::string>>;
+
+static MsgpackChunkEncoder::SendFunc
+CreateSendFunc(
+    SentList & sentList
+    )
+{
+    return [&sentList](const std::string & source, const std::string & data) {
+        sentList.emplace_back(source, data);
+        return true;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(Test_MsgpackReader_Types)
+{
+    Packer p;
+    p.Nil().Bool(true).Int(5).Int(-3).Int(-100000).UInt64(UINT64_MAX).Double(1.5).Str("abc");
+    p.Array(2).Int(1).Map(1).Str("k").Str("v").EventTime(10, 20);
+
+    MsgpackReader reader(p.GetData().data(), p.GetData().size());
+    BOOST_CHECK(MsgpackReader::Type::Nil == reader.Next().type);
+    BOOST_CHECK(reader.Next().boolValue);
+    BOOST_CHECK_EQUAL(5, reader.Next().uintValue);
+    BOOST_CHECK_EQUAL(-3, reader.Next().intValue);
+    BOOST_CHECK_EQUAL(-100000, reader.Next().intValue);
+    BOOST_CHECK_EQUAL(UINT64_MAX, reader.Next().uintValue);
+    BOOST_CHECK_EQUAL(1.5, reader.Next().floatValue);
+    BOOST_CHECK_EQUAL("abc", reader.Next().ToString());
+
+    auto arr = reader.Next();
+    BOOST_CHECK(MsgpackReader::Type::Array == arr.type);
+    BOOST_CHECK_EQUAL(2, arr.size);
+    reader.Skip();
+    reader.Skip();
+
+    auto ext = reader.Next();
+    BOOST_CHECK(MsgpackReader::Type::Ext == ext.type);
+    BOOST_CHECK_EQUAL(0, ext.extType);
+    BOOST_CHECK_EQUAL(8, ext.size);
+    BOOST_CHECK(reader.AtEnd());
+}
+
+BOOST_AUTO_TEST_CASE(Test_MsgpackReader_Truncated)
+{
+    Packer p;
+    p.Str("abcdef");
+    auto data = p.GetData();
+
+    MsgpackReader reader(data.data(), data.size()-1);
+    BOOST_CHECK_THROW(reader.Next(), std::runtime_error);
+
+    const char invalid[] = { '\xc1' };
+    MsgpackReader reader2(invalid, sizeof(invalid));
+    BOOST_CHECK_THROW(reader2.Next(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(Test_Encoder_SourceTime)
+{
+    MsgpackChunkEncoder encoder({ "^mdsd\\.syslog" }, "ts", true, 1024);
+
+    Packer p;
+    p.Array(3).Str("mdsd.syslog.user").EventTime(1493671442, 5);
+    p.Map(3).Str("msg").Str("hi \"x\"").Str("n").Int(-7).Str("ok").Bool(false);
+    p.Array(3).Str("other").Int(100);
+    p.Map(3).Str("msg").Str("a").Str("n").Int(1).Str("ok").Bool(true);
+    p.Array(3).Str("other").Double(12.5);
+    p.Map(2).Str("d").Double(0.1).Str("z").Nil();
+
+    SentList sentList;
+    BOOST_CHECK(encoder.EncodeChunk(p.GetData().data(), p.GetData().size(), CreateSendFunc(sentList)));
+    BOOST_REQUIRE_EQUAL(3, sentList.size());
+
+    BOOST_CHECK_EQUAL("mdsd.syslog", sentList[0].first);
+    BOOST_CHECK_EQUAL(R"(1,[3,["msg","FT_STRING"],["n","FT_INT64"],["ok","FT_BOOL"],["ts","FT_TIME"]],)"
+                      R"(["hi \"x\"",-7,false,[1493671442,5]])", sentList[0].second);
+
+    BOOST_CHECK_EQUAL("other", sentList[1].first);
+    BOOST_CHECK_EQUAL(R"(1,[3,["msg","FT_STRING"],["n","FT_INT64"],["ok","FT_BOOL"],["ts","FT_TIME"]],)"
+                      R"(["a",1,true,[100,0]])", sentList[1].second);
+
+    BOOST_CHECK_EQUAL(R"(2,[2,["d","FT_DOUBLE"],["z","FT_STRING"],["ts","FT_TIME"]],)"
+                      R"([0.1,"null",[12,500000000]])", sentList[2].second);
+
+    BOOST_CHECK_EQUAL(3, encoder.GetNumRecordsSent());
+    BOOST_CHECK_EQUAL(2, encoder.GetNumSchemas());
+}
+
+BOOST_AUTO_TEST_CASE(Test_Encoder_NestedAndTimestampField)
+{
+    MsgpackChunkEncoder encoder({}, "ts", false, 1024);
+
+    Packer p;
+    p.Array(2).Str("tag");
+    p.Map(3).Str("ts").Str("old").Str("obj");
+    p.Map(2).Str("a").Array(2).Int(1).Str("x").Str("b").Double(1e20);
+    p.Str("last").Int(2);
+
+    SentList sentList;
+    BOOST_CHECK(encoder.EncodeChunk(p.GetData().data(), p.GetData().size(), CreateSendFunc(sentList)));
+    BOOST_REQUIRE_EQUAL(1, sentList.size());
+
+    // The existing timestamp field keeps its position. Time is current time.
+    const std::string prefix = R"(1,[2,["ts","FT_TIME"],["obj","FT_STRING"],["last","FT_INT64"]],[[)";
+    const auto & data = sentList[0].second;
+    BOOST_CHECK_EQUAL(prefix, data.substr(0, prefix.size()));
+
+    const std::string suffix = R"(],"{\"a\":[1,\"x\"],\"b\":1.0e+20}",2])";
+    BOOST_REQUIRE_GT(data.size(), suffix.size());
+    BOOST_CHECK_EQUAL(suffix, data.substr(data.size()-suffix.size()));
+}
+
+BOOST_AUTO_TEST_CASE(Test_Encoder_DoubleFormat)
+{
+    MsgpackChunkEncoder encoder({}, "ts", true, 1024);
+
+    const std::vector<std::pair<double, std::string>> testData = {
+        { 1, "1.0" }, { -2.5, "-2.5" }, { 0.0001, "0.0001" }, { 0.00001, "1.0e-05" },
+        { 1e15, "1000000000000000.0" }, { 1e16, "1.0e+16" }, { 123.456, "123.456" },
+        { 1.0/3, "0.3333333333333333" }
+    };
+
+    for (const auto & item : testData) {
+        Packer p;
+        p.Array(3).Str("tag").Int(1).Map(1).Str("d").Double(item.first);
+
+        SentList sentList;
+        BOOST_CHECK(encoder.EncodeChunk(p.GetData().data(), p.GetData().size(), CreateSendFunc(sentList)));
+        BOOST_REQUIRE_EQUAL(1, sentList.size());
+        auto expected = R"(1,[1,["d","FT_DOUBLE"],["ts","FT_TIME"]],[)" + item.second + ",[1,0]]";
+        BOOST_CHECK_EQUAL(expected, sentList[0].second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_Encoder_DropTooLarge)
+{
+    MsgpackChunkEncoder encoder({}, "ts", true, 100);
+
+    Packer p;
+    p.Array(3).Str("tag").Int(1).Map(1).Str("s").Str(std::string(200, 'x'));
+    p.Array(3).Str("tag").Int(1).Map(1).Str("s").Str("small");
+
+    SentList sentList;
+    BOOST_CHECK(encoder.EncodeChunk(p.GetData().data(), p.GetData().size(), CreateSendFunc(sentList)));
+    BOOST_CHECK_EQUAL(1, sentList.size());
+    BOOST_CHECK_EQUAL(1, encoder.GetNumRecordsSent());
+    BOOST_CHECK_EQUAL(1, encoder.GetNumRecordsDropped());
+}
+
+BOOST_AUTO_TEST_CASE(Test_Encoder_SendFailure)
+{
+    MsgpackChunkEncoder encoder({}, "ts", true, 1024);
+
+    Packer p;
+    for (int i = 0; i < 3; i++) {
+        p.Array(3).Str("tag").Int(i).Map(1).Str("n").Int(i);
+    }
+
+    size_t ncalls = 0;
+    auto failSecond = [&ncalls](const std::string &, const std::string &) {
+        return (++ncalls < 2);
+    };
+    BOOST_CHECK(!encoder.EncodeChunk(p.GetData().data(), p.GetData().size(), failSecond));
+    BOOST_CHECK_EQUAL(2, ncalls);
+    BOOST_CHECK_EQUAL(1, encoder.GetNumRecordsSent());
+}
+
+BOOST_AUTO_TEST_CASE(Test_Encoder_BadChunk)
+{
+    MsgpackChunkEncoder encoder({ "[invalid" }, "ts", true, 1024);
+
+    Packer p;
+    p.Array(3).Str("tag").Int(1).Map(1).Str("n");
+    SentList sentList;
+    BOOST_CHECK_THROW(encoder.EncodeChunk(p.GetData().data(), p.GetData().size(), CreateSendFunc(sentList)),
+                      std::runtime_error);
+
+    // A map size bigger than the data left is not trusted.
+    Packer hugeMap;
+    hugeMap.Array(3).Str("tag").Int(1).Map(0xffffffff).Str("n").Int(1);
+    BOOST_CHECK_THROW(encoder.EncodeChunk(hugeMap.GetData().data(), hugeMap.GetData().size(),
+                      CreateSendFunc(sentList)), std::runtime_error);
+
+    Packer notArray;
+    notArray.Map(0);
+    BOOST_CHECK_THROW(encoder.EncodeChunk(notArray.GetData().data(), notArray.GetData().size(),
+                      CreateSendFunc(sentList)), std::runtime_error);
+
+    // SWIG-visible methods return false instead of throwing.
+    SocketLogger logger("/tmp/nosuchsocket_testchunk", 100, 1000, 1);
+    BOOST_CHECK(!encoder.SendChunkData(logger, p.GetData()));
+    BOOST_CHECK(!encoder.SendChunkFile(logger, "/tmp/nosuchfile_testchunk"));
+    BOOST_CHECK(sentList.empty());
+}
+
+BOOST_AUTO_TEST_CASE(Test_Encoder_ChunkFile)
+{
+    MsgpackChunkEncoder encoder({ "^a\\.\\w+" }, "ts", true, 1024);
+
+    Packer p;
+    const int nrecords = 1000;
+    for (int i = 0; i < nrecords; i++) {
+        p.Array(3).Str("a.b.c" + std::to_string(i % 3)).EventTime(i, 0).Map(1).Str("n").Int(i);
+    }
+
+    const std::string filepath = "/tmp/testchunk_" + std::to_string(getpid()) + ".buf";
+    {
+        std::ofstream fout(filepath, std::ios::binary);
+        fout.write(p.GetData().data(), p.GetData().size());
+    }
+
+    SentList sentList;
+    BOOST_CHECK(encoder.EncodeChunkFile(filepath, CreateSendFunc(sentList)));
+    BOOST_REQUIRE_EQUAL(nrecords, sentList.size());
+    for (int i = 0; i < nrecords; i++) {
+        BOOST_CHECK_EQUAL("a.b", sentList[i].first);
+        auto expected = R"(1,[1,["n","FT_INT64"],["ts","FT_TIME"]],[)" + std::to_string(i) +
+                        ",[" + std::to_string(i) + ",0]]";
+        BOOST_CHECK_EQUAL(expected, sentList[i].second);
+    }
+
+    // empty chunk file
+    std::ofstream(filepath, std::ios::trunc);
+    sentList.clear();
+    BOOST_CHECK(encoder.EncodeChunkFile(filepath, CreateSendFunc(sentList)));
+    BOOST_CHECK(sentList.empty());
+
+    remove(filepath.c_str());
+}
+
+// Validate that a chunk is resumed from the failed record, and that the
+// failure is classified as retryable or permanent.
+BOOST_AUTO_TEST_CASE(Test_Encoder_Resume)
+{
+    MsgpackChunkEncoder encoder({}, "ts", true, 100);
+
+    Packer p;
+    for (int i = 0; i < 5; i++) {
+        p.Array(3).Str("tag").Int(i).Map(1).Str("n").Int(i);
+    }
+    p.Array(3).Str("tag").Int(5).Map(1).Str("s").Str(std::string(200, 'x'));
+    p.Array(3).Str("").Int(6).Map(1).Str("n").Int(6);
+    p.Array(3).Str("tag").Int(7).Map(1).Str("n").Int(7);
+    const auto & data = p.GetData();
+
+    // Records 0 and 1 are sent. Record 2 fails.
+    SentList sentList;
+    auto failThird = [&sentList](const std::string & source, const std::string & schemaAndData) {
+        if (2 == sentList.size()) {
+            return false;
+        }
+        sentList.emplace_back(source, schemaAndData);
+        return true;
+    };
+    SendResult result;
+    encoder.EncodeChunk(data.data(), data.size(), 0, failThird, result);
+    BOOST_CHECK(!result.success);
+    BOOST_CHECK(result.retryable);
+    BOOST_CHECK_EQUAL(2, result.numAccepted);
+    BOOST_CHECK_EQUAL(2, result.failedIndex);
+
+    // Resume from record 2. The too large record 5 is accepted. Record 6 has
+    // an empty source name, which fails permanently.
+    SentList resentList;
+    auto sendValid = [&resentList](const std::string & source, const std::string & schemaAndData) {
+        resentList.emplace_back(source, schemaAndData);
+        return IsValidDjson(source, schemaAndData);
+    };
+    auto startIndex = result.failedIndex;
+    result = SendResult();
+    encoder.EncodeChunk(data.data(), data.size(), startIndex, sendValid, result);
+    BOOST_CHECK(!result.success);
+    BOOST_CHECK(!result.retryable);
+    BOOST_CHECK_EQUAL(4, result.numAccepted);
+    BOOST_CHECK_EQUAL(6, result.failedIndex);
+    BOOST_REQUIRE_EQUAL(4, resentList.size());
+    BOOST_CHECK_EQUAL(R"(1,[1,["n","FT_INT64"],["ts","FT_TIME"]],[2,[2,0]])", resentList[0].second);
+
+    result = SendResult();
+    encoder.EncodeChunk(data.data(), data.size(), 7, sendValid, result);
+    BOOST_CHECK(result.success);
+    BOOST_CHECK_EQUAL(1, result.numAccepted);
+
+    // A chunk that can't be decoded fails permanently where decoding fails,
+    // even if it is before the start index.
+    Packer bad;
+    bad.Array(3).Str("tag").Int(0).Map(1).Str("n").Int(0);
+    bad.Array(3).Str("tag").Int(1).Map(1).Str("n");
+    SocketLogger logger("/tmp/nosuchsocket_testchunk", 100, 1000, 1);
+    result = encoder.SendChunkDataFrom(logger, bad.GetData(), 2);
+    BOOST_CHECK(!result.success);
+    BOOST_CHECK(!result.retryable);
+    BOOST_CHECK_EQUAL(1, result.failedIndex);
+
+    // A socket failure is retryable.
+    result = encoder.SendChunkDataFrom(logger, data, 3);
+    BOOST_CHECK(!result.success);
+    BOOST_CHECK(result.retryable);
+    BOOST_CHECK_EQUAL(0, result.numAccepted);
+    BOOST_CHECK_EQUAL(3, result.failedIndex);
+
+    result = encoder.SendChunkFileFrom(logger, "/tmp/nosuchfile_testchunk", 3);
+    BOOST_CHECK(!result.success);
+    BOOST_CHECK(!result.retryable);
+    BOOST_CHECK_EQUAL(3, result.failedIndex);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
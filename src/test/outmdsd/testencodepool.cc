@@ -0,0 +1,170 @@
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <random>
+#include <thread>
+
+#include "EncodePool.h"
+#include "DjsonLogItem.h"
+#include "DataFrame.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testencodepool)
+
+// An item that takes a random time to encode, so that the workers finish
+// the items out of order.
+class SlowLogItem : public DjsonLogItem
+{
+public:
+    SlowLogItem(int delayUS) :
+        DjsonLogItem("testsource", "testdata"),
+        m_delayUS(delayUS)
+    {
+    }
+
+    void Encode() override
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(m_delayUS));
+        m_encodeThread = std::this_thread::get_id();
+        DjsonLogItem::Encode();
+    }
+
+    std::thread::id GetEncodeThread() const { return m_encodeThread; }
+
+private:
+    int m_delayUS;
+    std::thread::id m_encodeThread;
+};
+
+static void
+RunOrderTest(
+    size_t nthreads,
+    size_t maxPending
+    )
+{
+    std::vector<LogItemPtr> handedOff;
+    EncodePool pool(nthreads, [&handedOff](LogItemPtr item) { handedOff.push_back(std::move(item)); },
+                    maxPending);
+    BOOST_CHECK_EQUAL(nthreads, pool.GetNumThreads());
+
+    const size_t nitems = 500;
+    std::vector<LogItemPtr> items;
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> delayDist(0, 200);
+    for (size_t i = 0; i < nitems; i++) {
+        items.emplace_back(new SlowLogItem(delayDist(rng)));
+        pool.Push(items.back());
+    }
+    BOOST_CHECK(pool.WaitUntilEmpty(10000));
+    BOOST_CHECK_EQUAL(0, pool.Size());
+    BOOST_CHECK_GT(pool.GetBusyMicroSeconds(), 0);
+
+    BOOST_REQUIRE_EQUAL(nitems, handedOff.size());
+    for (size_t i = 0; i < nitems; i++) {
+        BOOST_CHECK(items[i] == handedOff[i]);
+    }
+
+    pool.Stop();
+    BOOST_CHECK_THROW(pool.Push(items[0]), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(Test_EncodePool_Invalid)
+{
+    auto handOff = [](LogItemPtr) {};
+    BOOST_CHECK_THROW(EncodePool(0, handOff), std::invalid_argument);
+    BOOST_CHECK_THROW(EncodePool(1, handOff, 0), std::invalid_argument);
+    BOOST_CHECK_THROW(EncodePool(1, nullptr), std::invalid_argument);
+
+    EncodePool pool(1, handOff);
+    BOOST_CHECK_THROW(pool.Push(nullptr), std::invalid_argument);
+}
+
+// Validate that items are handed off in push order.
+BOOST_AUTO_TEST_CASE(Test_EncodePool_Order)
+{
+    try {
+        RunOrderTest(1, EncodePool::DefaultMaxPending);
+        RunOrderTest(4, EncodePool::DefaultMaxPending);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that the caller encodes its items when the workers are behind,
+// and that the items are still handed off in push order.
+BOOST_AUTO_TEST_CASE(Test_EncodePool_Backlog)
+{
+    try {
+        RunOrderTest(2, 1);
+
+        std::vector<LogItemPtr> handedOff;
+        EncodePool pool(1, [&handedOff](LogItemPtr item) { handedOff.push_back(std::move(item)); }, 1);
+        std::vector<std::shared_ptr<SlowLogItem>> items;
+        for (int i = 0; i < 20; i++) {
+            items.push_back(std::make_shared<SlowLogItem>(10000));
+            pool.Push(items.back());
+        }
+        BOOST_CHECK(pool.WaitUntilEmpty(10000));
+        BOOST_REQUIRE_EQUAL(items.size(), handedOff.size());
+
+        size_t nEncodedByCaller = 0;
+        for (const auto & item : items) {
+            if (std::this_thread::get_id() == item->GetEncodeThread()) {
+                nEncodedByCaller++;
+            }
+        }
+        BOOST_CHECK_GT(nEncodedByCaller, 0);
+        BOOST_CHECK_LT(nEncodedByCaller, items.size());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that Stop() hands off all the items pushed before.
+BOOST_AUTO_TEST_CASE(Test_EncodePool_Stop)
+{
+    try {
+        std::atomic<size_t> nHandedOff{0};
+        EncodePool pool(2, [&nHandedOff](LogItemPtr) { nHandedOff++; });
+        for (int i = 0; i < 100; i++) {
+            pool.Push(std::make_shared<SlowLogItem>(100));
+        }
+        pool.Stop();
+        BOOST_CHECK_EQUAL(100, nHandedOff);
+        BOOST_CHECK_EQUAL(0, pool.Size());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that an encoded DJSON item has the same frames as one that isn't.
+BOOST_AUTO_TEST_CASE(Test_DjsonLogItem_Encode)
+{
+    try {
+        DjsonLogItem item1("testsource");
+        item1.AddData("msg", "hello");
+        item1.AddData("count", int32_t(3));
+        item1.Encode();
+
+        DjsonLogItem item2("testsource", item1.GetSchemaAndData());
+        item2.Encode();
+
+        for (auto item : { static_cast<LogItem*>(&item1), static_cast<LogItem*>(&item2) }) {
+            DataFrame frame;
+            item->GetFrame(frame);
+            BOOST_CHECK_EQUAL(item->GetData(), frame.ToString());
+
+            DataFrame frameNoSchema;
+            item->GetFrameNoSchema(frameNoSchema);
+            BOOST_CHECK_EQUAL(item->GetDataNoSchema(), frameNoSchema.ToString());
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,245 @@
+#include <boost/test/unit_test.hpp>
+#include <future>
+#include <map>
+#include <thread>
+
+#include "FairQueue.h"
+#include "DjsonLogItem.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testfairqueue)
+
+// Create an item whose size hint is exactly 'nbytes'.
+static LogItemPtr
+CreateItem(
+    const std::string & source,
+    size_t nbytes
+    )
+{
+    return LogItemPtr(new DjsonLogItem(source, std::string(nbytes - source.size(), 'A')));
+}
+
+// Pop 'nitems' items and return the number of items popped for each source.
+static std::map<std::string, size_t>
+PopItems(
+    FairQueue & q,
+    size_t nitems
+    )
+{
+    std::map<std::string, size_t> counts;
+    for (size_t i = 0; i < nitems; i++) {
+        auto item = q.WaitAndPop();
+        BOOST_REQUIRE(item);
+        counts[item->GetSourceName()]++;
+    }
+    return counts;
+}
+
+BOOST_AUTO_TEST_CASE(Test_FairQueue_BVT)
+{
+    try {
+        FairQueue q;
+        BOOST_CHECK_THROW(q.Push(nullptr), std::invalid_argument);
+        BOOST_CHECK_THROW(q.SetSourceWeight("src", 0), std::invalid_argument);
+        BOOST_CHECK_THROW(FairQueue(10, 0), std::invalid_argument);
+
+        // Items of the same source keep their order.
+        for (int i = 0; i < 10; i++) {
+            q.Push(CreateItem("src", 10+i));
+        }
+        BOOST_CHECK_EQUAL(10, q.Size());
+        BOOST_CHECK_EQUAL(10, q.GetSourceStats("src").numItems);
+
+        for (int i = 0; i < 10; i++) {
+            auto item = q.WaitAndPop();
+            BOOST_REQUIRE(item);
+            BOOST_CHECK_EQUAL(10+i, item->GetSizeHint());
+        }
+        BOOST_CHECK(q.Empty());
+        BOOST_CHECK_EQUAL(0, q.GetSourceStats("src").numBytes);
+
+        auto popTask = std::async(std::launch::async, [&q] () { return q.WaitAndPop(); });
+        BOOST_CHECK(std::future_status::timeout == popTask.wait_for(std::chrono::milliseconds(10)));
+        q.StopOnceEmpty();
+        BOOST_CHECK(nullptr == popTask.get());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a source with a few items is not stuck behind a noisy source.
+BOOST_AUTO_TEST_CASE(Test_FairQueue_NoisySource)
+{
+    try {
+        FairQueue q(0, 100);
+        for (int i = 0; i < 1000; i++) {
+            q.Push(CreateItem("noisy", 100));
+        }
+        for (int i = 0; i < 10; i++) {
+            q.Push(CreateItem("quiet", 100));
+        }
+
+        auto counts = PopItems(q, 20);
+        BOOST_CHECK_EQUAL(10, counts["noisy"]);
+        BOOST_CHECK_EQUAL(10, counts["quiet"]);
+        BOOST_CHECK_EQUAL(990, q.Size());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that the sources share the bytes by their weights, no matter
+// how big their items are.
+BOOST_AUTO_TEST_CASE(Test_FairQueue_Weight)
+{
+    try {
+        FairQueue q(0, 100);
+        q.SetSourceWeight("heavy", 3);
+        for (int i = 0; i < 100; i++) {
+            q.Push(CreateItem("heavy", 100));
+            q.Push(CreateItem("light", 100));
+            q.Push(CreateItem("light", 100));
+        }
+        // Items of 'big' are 4 times as large, so it gets 1/4 of the items.
+        for (int i = 0; i < 100; i++) {
+            q.Push(CreateItem("big", 400));
+        }
+
+        // Each round pops 3 'heavy', 1 'light' and 1/4 'big'.
+        auto counts = PopItems(q, 4*(3+1)+1);
+        BOOST_CHECK_EQUAL(12, counts["heavy"]);
+        BOOST_CHECK_EQUAL(4, counts["light"]);
+        BOOST_CHECK_EQUAL(1, counts["big"]);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a source over its byte limit only drops its own oldest items.
+BOOST_AUTO_TEST_CASE(Test_FairQueue_ByteLimit)
+{
+    try {
+        FairQueue q;
+        q.SetDefaultByteLimit(1000);
+        q.SetSourceByteLimit("small", 250);
+
+        for (int i = 0; i < 20; i++) {
+            q.Push(CreateItem("small", 100));
+            q.Push(CreateItem("default", 100));
+            q.Push(CreateItem("other", 10));
+        }
+
+        auto small = q.GetSourceStats("small");
+        BOOST_CHECK_EQUAL(2, small.numItems);
+        BOOST_CHECK_EQUAL(200, small.numBytes);
+        BOOST_CHECK_EQUAL(18, small.numDropped);
+        BOOST_CHECK_EQUAL(1800, small.numBytesDropped);
+
+        auto def = q.GetSourceStats("default");
+        BOOST_CHECK_EQUAL(10, def.numItems);
+        BOOST_CHECK_EQUAL(10, def.numDropped);
+
+        auto other = q.GetSourceStats("other");
+        BOOST_CHECK_EQUAL(20, other.numItems);
+        BOOST_CHECK_EQUAL(0, other.numDropped);
+
+        BOOST_CHECK_EQUAL(28, q.GetTotalDropped());
+        BOOST_CHECK_EQUAL(32, q.Size());
+
+        // An item larger than the limit is still kept.
+        q.Push(CreateItem("small", 500));
+        BOOST_CHECK_EQUAL(1, q.GetSourceStats("small").numItems);
+        BOOST_CHECK_EQUAL(20, q.GetSourceStats("small").numDropped);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that when the queue is full, the source that uses the most
+// bytes per weight loses its items.
+BOOST_AUTO_TEST_CASE(Test_FairQueue_MaxItems)
+{
+    try {
+        const size_t maxItems = 10;
+        FairQueue q(maxItems);
+
+        for (int i = 0; i < 20; i++) {
+            q.Push(CreateItem("noisy", 100));
+        }
+        q.Push(CreateItem("quiet", 100));
+        q.Push(CreateItem("quiet", 100));
+
+        BOOST_CHECK_EQUAL(maxItems, q.Size());
+        BOOST_CHECK_EQUAL(2, q.GetSourceStats("quiet").numItems);
+        BOOST_CHECK_EQUAL(0, q.GetSourceStats("quiet").numDropped);
+        BOOST_CHECK_EQUAL(8, q.GetSourceStats("noisy").numItems);
+        BOOST_CHECK_EQUAL(12, q.GetSourceStats("noisy").numDropped);
+        BOOST_CHECK_EQUAL(0, q.GetSourceStats("unknown").numDropped);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a batch pop stops at the item and byte limits, and waits up
+// to the linger time for more items.
+BOOST_AUTO_TEST_CASE(Test_FairQueue_PopBatch)
+{
+    try {
+        FairQueue q;
+        for (int i = 0; i < 10; i++) {
+            q.Push(CreateItem("src", 100));
+        }
+
+        std::vector<LogItemPtr> items;
+        BOOST_CHECK_EQUAL(400, q.WaitAndPopBatch(items, 4, 100000, std::chrono::microseconds(0)));
+        BOOST_CHECK_EQUAL(4, items.size());
+
+        // The byte limit can be exceeded by one item.
+        items.clear();
+        BOOST_CHECK_EQUAL(300, q.WaitAndPopBatch(items, 100, 250, std::chrono::microseconds(0)));
+        BOOST_CHECK_EQUAL(3, items.size());
+
+        // The first item is popped even if it is bigger than the byte limit.
+        items.clear();
+        BOOST_CHECK_EQUAL(100, q.WaitAndPopBatch(items, 100, 1, std::chrono::microseconds(0)));
+        BOOST_CHECK_EQUAL(1, items.size());
+
+        // No linger: only the items already in queue are popped.
+        items.clear();
+        BOOST_CHECK_EQUAL(200, q.WaitAndPopBatch(items, 100, 100000, std::chrono::microseconds(0)));
+        BOOST_CHECK_EQUAL(2, items.size());
+
+        // Linger: an item pushed during the wait is popped with the first one.
+        q.Push(CreateItem("src", 100));
+        auto pushTask = std::async(std::launch::async, [&q]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            q.Push(CreateItem("src", 100));
+        });
+        items.clear();
+        BOOST_CHECK_EQUAL(200, q.WaitAndPopBatch(items, 2, 100000, std::chrono::seconds(5)));
+        BOOST_CHECK_EQUAL(2, items.size());
+        pushTask.get();
+
+        // A stopped queue doesn't linger, and returns no item once empty.
+        q.Push(CreateItem("src", 100));
+        q.StopOnceEmpty();
+        items.clear();
+        auto startTime = std::chrono::steady_clock::now();
+        BOOST_CHECK_EQUAL(100, q.WaitAndPopBatch(items, 10, 100000, std::chrono::seconds(5)));
+        BOOST_CHECK(std::chrono::steady_clock::now() - startTime < std::chrono::seconds(1));
+        items.clear();
+        BOOST_CHECK_EQUAL(0, q.WaitAndPopBatch(items, 10, 100000, std::chrono::seconds(5)));
+        BOOST_CHECK(items.empty());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,230 @@
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <map>
+#include <future>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "FlightRecorder.h"
+#include "MockServer.h"
+#include "SocketLogger.h"
+#include "testutil.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testflightrecorder)
+
+BOOST_AUTO_TEST_CASE(Test_FlightRecorder_Sampling)
+{
+    FlightRecorder::SetSampleRate(0);
+    BOOST_CHECK(!FlightRecorder::IsSampled(0));
+    BOOST_CHECK(!FlightRecorder::IsSampled(100));
+
+    FlightRecorder::SetSampleRate(4);
+    BOOST_CHECK(FlightRecorder::IsSampled(8));
+    BOOST_CHECK(!FlightRecorder::IsSampled(9));
+
+    size_t nsampled = 0;
+    for (uint64_t i = 1; i <= 1000; i++) {
+        nsampled += FlightRecorder::IsSampled(i);
+    }
+    BOOST_CHECK_EQUAL(250, nsampled);
+
+    FlightRecorder::SetSampleRate(0);
+}
+
+BOOST_AUTO_TEST_CASE(Test_FlightRecorder_Wraparound)
+{
+    FlightRecorder::Clear();
+    BOOST_CHECK_EQUAL(0, FlightRecorder::GetEvents().size());
+
+    const size_t capacity = FlightRecorder::Capacity;
+    const size_t nextra = 10;
+    for (size_t i = 0; i < capacity + nextra; i++) {
+        FlightRecorder::Record(i, FlightStage::Enqueue);
+    }
+
+    auto events = FlightRecorder::GetEvents();
+    BOOST_REQUIRE_EQUAL(capacity, events.size());
+    BOOST_CHECK_EQUAL(nextra, events.front().itemId);
+    BOOST_CHECK_EQUAL(capacity + nextra - 1, events.back().itemId);
+    FlightRecorder::Clear();
+}
+
+BOOST_AUTO_TEST_CASE(Test_FlightRecorder_MultiThreads)
+{
+    FlightRecorder::Clear();
+    const int nthreads = 8;
+    const int nevents = 2000;
+
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < nthreads; i++) {
+        tasks.push_back(std::async(std::launch::async, [i] {
+            for (int j = 0; j < nevents; j++) {
+                FlightRecorder::Record(i, FlightStage::Send);
+            }
+        }));
+    }
+    for (auto & task : tasks) {
+        task.get();
+    }
+
+    auto events = FlightRecorder::GetEvents();
+    BOOST_CHECK_EQUAL(nthreads * nevents, events.size());
+
+    std::vector<int> counts(nthreads, 0);
+    for (const auto & e : events) {
+        BOOST_REQUIRE_LT(e.itemId, nthreads);
+        counts[e.itemId]++;
+        BOOST_CHECK_EQUAL(static_cast<uint32_t>(FlightStage::Send), e.stage);
+    }
+    for (auto n : counts) {
+        BOOST_CHECK_EQUAL(nevents, n);
+    }
+    FlightRecorder::Clear();
+}
+
+// Validate that writers a whole ring apart don't mix their fields in a slot.
+BOOST_AUTO_TEST_CASE(Test_FlightRecorder_MultiThreadsWraparound)
+{
+    FlightRecorder::Clear();
+    const uint64_t nthreads = 4;
+    const uint64_t nevents = 4 * FlightRecorder::Capacity;
+    const auto nstages = static_cast<uint64_t>(FlightStage::NumStages);
+
+    // Each thread returns its thread id, to be checked here.
+    std::vector<std::future<uint32_t>> tasks;
+    for (uint64_t i = 0; i < nthreads; i++) {
+        tasks.push_back(std::async(std::launch::async, [i, nevents, nstages] {
+            for (uint64_t j = 0; j < nevents; j++) {
+                auto itemId = (i << 32) | j;
+                FlightRecorder::Record(itemId, static_cast<FlightStage>(itemId % nstages));
+            }
+            return static_cast<uint32_t>(syscall(SYS_gettid));
+        }));
+    }
+    std::vector<uint32_t> threadIds;
+    for (auto & task : tasks) {
+        threadIds.push_back(task.get());
+    }
+
+    auto events = FlightRecorder::GetEvents();
+    BOOST_CHECK_GT(events.size(), 0);
+    size_t nbad = 0;
+    for (const auto & e : events) {
+        auto t = e.itemId >> 32;
+        if (t >= nthreads || e.stage != e.itemId % nstages || e.threadId != threadIds[t]) {
+            nbad++;
+        }
+    }
+    BOOST_CHECK_EQUAL(0, nbad);
+    FlightRecorder::Clear();
+}
+
+BOOST_AUTO_TEST_CASE(Test_FlightRecorder_DumpJson)
+{
+    FlightRecorder::Clear();
+    FlightRecorder::Record(5, FlightStage::Enqueue);
+    FlightRecorder::Record(6, FlightStage::Enqueue);
+    FlightRecorder::Record(5, FlightStage::Ack);
+
+    auto json = FlightRecorder::DumpJson();
+    BOOST_TEST_MESSAGE("json: " << json);
+    BOOST_CHECK_EQUAL(0, json.find("{\"sample_rate\":0,\"items\":[{\"id\":5,"));
+    BOOST_CHECK(json.find("\"events\":[[\"enqueue\",0,") != std::string::npos);
+    BOOST_CHECK(json.find("[\"ack\",") != std::string::npos);
+    BOOST_CHECK(json.find("{\"id\":6,") > json.find("[\"ack\","));
+
+    FlightRecorder::Clear();
+    BOOST_CHECK_EQUAL("{\"sample_rate\":0,\"items\":[]}", FlightRecorder::DumpJson());
+}
+
+BOOST_AUTO_TEST_CASE(Test_FlightRecorder_DumpSignal)
+{
+    try {
+        FlightRecorder::Clear();
+        FlightRecorder::Record(7, FlightStage::Dequeue);
+        FlightRecorder::Record(7, FlightStage::Drop);
+
+        auto dump = FlightRecorder::DumpBinary();
+        BOOST_CHECK_EQUAL(8 + 2 * sizeof(FlightEvent), dump.size());
+        BOOST_CHECK_EQUAL("OMDSDFR1", dump.substr(0, 8));
+
+        const std::string dumpfile = TestUtil::GetCurrDir() + "/flightrecorder.bin";
+        FlightRecorder::SetDumpSignal(SIGUSR2, dumpfile);
+        raise(SIGUSR2);
+        signal(SIGUSR2, SIG_DFL);
+
+        std::ifstream fin(dumpfile, std::ios::binary);
+        std::ostringstream fileData;
+        fileData << fin.rdbuf();
+        BOOST_CHECK(dump == fileData.str());
+        unlink(dumpfile.c_str());
+
+        BOOST_CHECK_THROW(FlightRecorder::SetDumpSignal(SIGUSR2, ""), std::invalid_argument);
+        FlightRecorder::Clear();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_FlightRecorder_SocketLogger)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/flightrecorder-bvt";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        FlightRecorder::Clear();
+        FlightRecorder::SetSampleRate(1);
+
+        SocketLogger eplog(sockfile, 100000, 100000);
+        const int nmsgs = 10;
+        for (int i = 0; i < nmsgs; i++) {
+            BOOST_CHECK(eplog.SendDjson("testSource", TestUtil::CreateMsg(i)));
+        }
+        // Don't use WaitUntilAllAcked(), which resends the items not acked yet.
+        for (int i = 0; i < 500 && eplog.GetNumItemsInCache(); i++) {
+            usleep(10*1000);
+        }
+        BOOST_CHECK_EQUAL(0, eplog.GetNumItemsInCache());
+        FlightRecorder::SetSampleRate(0);
+
+        // Each item goes through enqueue, encode, lock, send and ack. The ack
+        // can be recorded before the send by the reader thread, so the order is
+        // not checked except for the first stage.
+        std::map<uint64_t, std::vector<uint32_t>> stages;
+        for (const auto & e : FlightRecorder::GetEvents()) {
+            stages[e.itemId].push_back(e.stage);
+        }
+        BOOST_CHECK_EQUAL(nmsgs, stages.size());
+
+        const std::vector<uint32_t> expected = {
+            static_cast<uint32_t>(FlightStage::Enqueue),
+            static_cast<uint32_t>(FlightStage::Encode),
+            static_cast<uint32_t>(FlightStage::Lock),
+            static_cast<uint32_t>(FlightStage::Send),
+            static_cast<uint32_t>(FlightStage::Ack)
+        };
+        for (auto & item : stages) {
+            BOOST_CHECK_EQUAL(expected.front(), item.second.front());
+            std::sort(item.second.begin(), item.second.end());
+            BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), item.second.begin(), item.second.end());
+        }
+
+        mockServer->Stop();
+        serverTask.get();
+        FlightRecorder::Clear();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,215 @@
+#include <boost/test/unit_test.hpp>
+#include <future>
+
+#include "InflightRing.h"
+#include "DjsonLogItem.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testinflightring)
+
+static std::vector<LogItemPtr>
+CreateItems(
+    size_t nitems
+    )
+{
+    std::vector<LogItemPtr> items;
+    for (size_t i = 0; i < nitems; i++) {
+        items.emplace_back(new DjsonLogItem("testsource", "testvalue-" + std::to_string(i)));
+    }
+    return items;
+}
+
+static std::vector<uint64_t>
+GetIds(
+    const std::vector<LogItemPtr> & items
+    )
+{
+    std::vector<uint64_t> ids;
+    for (const auto & item : items) {
+        ids.push_back(item->GetId());
+    }
+    return ids;
+}
+
+BOOST_AUTO_TEST_CASE(Test_LogItem_ParseTag)
+{
+    auto items = CreateItems(1);
+    uint64_t id = 0;
+    BOOST_CHECK(LogItem::ParseTag(items[0]->GetTag(), id));
+    BOOST_CHECK_EQUAL(items[0]->GetId(), id);
+
+    BOOST_CHECK(LogItem::ParseTag("18446744073709551615", id));
+    BOOST_CHECK_EQUAL(UINT64_MAX, id);
+
+    BOOST_CHECK(!LogItem::ParseTag("", id));
+    BOOST_CHECK(!LogItem::ParseTag("12a", id));
+    BOOST_CHECK(!LogItem::ParseTag("-1", id));
+    BOOST_CHECK(!LogItem::ParseTag("18446744073709551616", id));
+}
+
+// Validate that items added out of order are read in id order, and that the
+// ring grows to hold the window.
+BOOST_AUTO_TEST_CASE(Test_InflightRing_Order)
+{
+    try {
+        InflightRing ring(64);
+        BOOST_CHECK_EQUAL(64, ring.GetCapacity());
+        BOOST_CHECK_THROW(ring.Add(nullptr), std::invalid_argument);
+
+        auto items = CreateItems(200);
+        for (size_t i = 0; i < items.size(); i += 2) {
+            ring.Add(items[i]);
+        }
+        for (size_t i = 1; i < items.size(); i += 2) {
+            ring.Add(items[items.size() - i]);
+        }
+        BOOST_CHECK_EQUAL(items.size(), ring.Size());
+        BOOST_CHECK_EQUAL(256, ring.GetCapacity());
+
+        auto expected = GetIds(items);
+        auto values = GetIds(ring.GetValues());
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), values.begin(), values.end());
+
+        // A re-added item replaces the old one.
+        ring.Add(items[10]);
+        BOOST_CHECK_EQUAL(items.size(), ring.Size());
+        BOOST_CHECK(items[10] == ring.Get(items[10]->GetId()));
+
+        // Erase items in the middle first, then the oldest ones.
+        for (size_t i = 100; i < items.size(); i++) {
+            BOOST_CHECK_EQUAL(1, ring.Erase(items[i]->GetId()));
+        }
+        BOOST_CHECK_EQUAL(0, ring.Erase(items[100]->GetId()));
+        BOOST_CHECK(!ring.Get(items[100]->GetId()));
+
+        LogItemPtr erasedItem;
+        BOOST_CHECK_EQUAL(1, ring.Erase(items[0]->GetId(), erasedItem));
+        BOOST_CHECK(items[0] == erasedItem);
+
+        // An item older than the base is added again.
+        ring.Add(items[0]);
+        expected.assign(expected.begin(), expected.begin() + 100);
+        values = GetIds(ring.GetValues());
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), values.begin(), values.end());
+
+        auto erasedItems = ring.EraseIf([](const LogItemPtr & item) { return item->GetId() % 2; });
+        BOOST_CHECK_EQUAL(50, erasedItems.size());
+        BOOST_CHECK_EQUAL(50, ring.Size());
+
+        BOOST_CHECK(!ring.WaitUntilEmpty(1));
+        BOOST_CHECK_EQUAL(50, ring.Erase(std::vector<LogItemPtr>(items.begin(), items.begin() + 100)));
+        BOOST_CHECK_EQUAL(0, ring.Size());
+        BOOST_CHECK(ring.WaitUntilEmpty(0));
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that an item older than the max window doesn't make the ring grow.
+BOOST_AUTO_TEST_CASE(Test_InflightRing_Straggler)
+{
+    try {
+        InflightRing ring(64, 128);
+        auto items = CreateItems(1000);
+
+        ring.Add(items[0]);
+        for (size_t i = 500; i < items.size(); i++) {
+            ring.Add(items[i]);
+            ring.Erase(items[i-1]->GetId());
+        }
+        BOOST_CHECK_EQUAL(2, ring.Size());
+        BOOST_CHECK_EQUAL(64, ring.GetCapacity());
+        BOOST_CHECK(items[0] == ring.Get(items[0]->GetId()));
+
+        // Too old for the ring.
+        ring.Add(items[1]);
+        BOOST_CHECK_EQUAL(3, ring.Size());
+        BOOST_CHECK_EQUAL(64, ring.GetCapacity());
+
+        std::vector<uint64_t> expected = { items[0]->GetId(), items[1]->GetId(), items.back()->GetId() };
+        auto values = GetIds(ring.GetValues());
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), values.begin(), values.end());
+
+        BOOST_CHECK_EQUAL(1, ring.Erase(items[0]->GetId()));
+        auto erasedItems = ring.EraseIf([&items](const LogItemPtr & item) { return item == items[1]; });
+        BOOST_CHECK_EQUAL(1, erasedItems.size());
+        BOOST_CHECK_EQUAL(1, ring.Erase(items.back()->GetId()));
+        BOOST_CHECK(ring.WaitUntilEmpty(0));
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that the byte total follows adds, replacements, stragglers and erases.
+BOOST_AUTO_TEST_CASE(Test_InflightRing_Bytes)
+{
+    try {
+        InflightRing ring(64, 128);
+        auto items = CreateItems(1000);
+        std::vector<size_t> sizes;
+        for (const auto & item : items) {
+            sizes.push_back(item->GetSizeHint());
+        }
+
+        ring.Add(items[0]);
+        ring.Add(items[1]);
+        ring.Add(items[0]);
+        BOOST_CHECK_EQUAL(sizes[0] + sizes[1], ring.GetBytes());
+
+        // Move items[0] and items[1] to the stragglers.
+        for (size_t i = 500; i < items.size(); i++) {
+            ring.Add(items[i]);
+            if (i > 500) {
+                ring.Erase(items[i-1]->GetId());
+            }
+        }
+        ring.Erase(items[500]->GetId());
+        ring.Add(items[1]);
+        BOOST_CHECK_EQUAL(3, ring.Size());
+        BOOST_CHECK_EQUAL(sizes[0] + sizes[1] + sizes.back(), ring.GetBytes());
+
+        BOOST_CHECK_EQUAL(1, ring.Erase(items[0]->GetId()));
+        BOOST_CHECK_EQUAL(sizes[1] + sizes.back(), ring.GetBytes());
+        ring.EraseIf([&items](const LogItemPtr & item) { return item == items[1]; });
+        BOOST_CHECK_EQUAL(sizes.back(), ring.GetBytes());
+        BOOST_CHECK_EQUAL(1, ring.Erase(std::vector<LogItemPtr>{ items.back() }));
+        BOOST_CHECK_EQUAL(0, ring.GetBytes());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that acks erase items while other threads add them.
+BOOST_AUTO_TEST_CASE(Test_InflightRing_MultiThreads)
+{
+    try {
+        auto ring = std::make_shared<InflightRing>(64);
+        const size_t nitems = 10000;
+        // Boost.Test assertions are not thread-safe, so each thread returns
+        // its number of erased items to be checked here.
+        std::vector<std::future<size_t>> tasks;
+        for (int t = 0; t < 4; t++) {
+            tasks.push_back(std::async(std::launch::async, [ring]() {
+                size_t nerased = 0;
+                for (auto & item : CreateItems(nitems)) {
+                    ring->Add(item);
+                    nerased += ring->Erase(item->GetId());
+                }
+                return nerased;
+            }));
+        }
+        for (auto & task : tasks) {
+            BOOST_CHECK_EQUAL(nitems, task.get());
+        }
+        BOOST_CHECK_EQUAL(0, ring->Size());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+#include <boost/test/unit_test.hpp>
+#include <future>
+#include <cstring>
+
+extern "C" {
+#include <unistd.h>
+#include <sys/socket.h>
+}
+
+#include "IoUring.h"
+#include "MockServer.h"
+#include "SocketClient.h"
+#include "SocketLogger.h"
+#include "DjsonLogItem.h"
+#include "Exceptions.h"
+#include "testutil.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testiouring)
+
+BOOST_AUTO_TEST_CASE(Test_IoEngine_Names)
+{
+    BOOST_CHECK(IoEngine::Poll == SocketClient::ParseIoEngine("poll"));
+    BOOST_CHECK(IoEngine::IoUring == SocketClient::ParseIoEngine("io_uring"));
+    BOOST_CHECK_THROW(SocketClient::ParseIoEngine("epoll"), std::invalid_argument);
+    BOOST_CHECK_EQUAL("io_uring", SocketClient::GetIoEngineName(IoEngine::IoUring));
+    BOOST_CHECK_THROW(SocketLogger("/tmp/nosuchfile", 100, 100, 100, "uring"), std::invalid_argument);
+}
+
+// Validate that a multishot recv fills the registered buffers.
+BOOST_AUTO_TEST_CASE(Test_IoUring_RecvMultishot)
+{
+    if (!IoUring::IsSupported()) {
+        BOOST_TEST_MESSAGE("io_uring is not supported. Skip test.");
+        return;
+    }
+    int sv[2];
+    BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+
+    try {
+        IoUring ring(4);
+        BOOST_CHECK_THROW(ring.RegisterBufRing(0, 3, 64), std::invalid_argument);
+        ring.RegisterBufRing(0, 4, 64);
+
+        auto sqe = ring.GetSqe();
+        BOOST_REQUIRE(sqe);
+        IoUring::PrepRecvMultishot(sqe, sv[0], 0);
+        sqe->user_data = 123;
+        ring.Submit();
+
+        std::string received;
+        const std::vector<std::string> msgs = { "hello", "io_uring", std::string(100, 'x') };
+        for (const auto & msg : msgs) {
+            BOOST_REQUIRE_EQUAL(msg.size(), write(sv[1], msg.data(), msg.size()));
+            size_t nbytes = 0;
+            while(nbytes < msg.size()) {
+                auto cqe = ring.PeekCqe();
+                if (!cqe) {
+                    BOOST_REQUIRE(ring.Submit(1, 1000));
+                    continue;
+                }
+                BOOST_CHECK_EQUAL(123, cqe->user_data);
+                BOOST_REQUIRE_GT(cqe->res, 0);
+                BOOST_REQUIRE(cqe->flags & IORING_CQE_F_BUFFER);
+                BOOST_CHECK(cqe->flags & IORING_CQE_F_MORE);
+                uint16_t bufId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                received.append(ring.GetBuf(bufId), cqe->res);
+                nbytes += cqe->res;
+                ring.SeenCqe();
+                ring.RecycleBuf(bufId);
+            }
+        }
+        BOOST_CHECK_EQUAL(msgs[0] + msgs[1] + msgs[2], received);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+    close(sv[0]);
+    close(sv[1]);
+}
+
+// Validate that items sent one by one and in batches arrive in full and in
+// order, and that a schema is sent once per connection, including in a batch.
+BOOST_AUTO_TEST_CASE(Test_SocketClient_IoUring_Send)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/sockclient-iouring";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+
+        auto serverTask = std::async(std::launch::async, [mockServer]() {
+            mockServer->Run();
+            return mockServer->GetTotalBytesRead();
+        });
+
+        SocketClient client(sockfile, 100, IoEngine::IoUring);
+        BOOST_CHECK(IoUring::IsSupported() == (IoEngine::IoUring == client.GetIoEngine()));
+        BOOST_CHECK_EQUAL(IoUring::IsSupported(), client.GetReadEventFd() >= 0);
+
+        size_t totalSend = 0;
+        std::vector<std::string> values;
+
+        // Large items that can't be sent by one sendmsg().
+        for (int i = 0; i < 3; i++) {
+            values.push_back(std::string(256*1024-1, 'a'+i));
+            DjsonLogItem item("testsource", values.back());
+            client.Send(item);
+            totalSend += strlen(item.GetData());
+        }
+
+        const std::string schemaAndData = R"(3,[0,["msg","FT_STRING"]],["abc"])";
+        std::vector<LogItemPtr> batch;
+        for (int i = 0; i < 200; i++) {
+            batch.push_back(std::make_shared<DjsonLogItem>("testsource", schemaAndData));
+        }
+        client.SendBatch(batch);
+        totalSend += strlen(batch[0]->GetData());
+        for (size_t i = 1; i < batch.size(); i++) {
+            totalSend += strlen(batch[i]->GetDataNoSchema());
+        }
+
+        client.Send(TestUtil::EndOfTest().c_str());
+        totalSend += TestUtil::EndOfTest().size();
+
+        BOOST_CHECK(mockServer->WaitForTestsDone(1000));
+
+        client.Stop();
+        client.Close();
+        mockServer->Stop();
+        BOOST_CHECK_EQUAL(totalSend, serverTask.get());
+
+        auto dataSet = mockServer->GetUniqDataRead();
+        for (const auto & value : values) {
+            BOOST_CHECK_EQUAL(1, dataSet.count(value));
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+// Validate that acks received by the multishot recv reach DataReader.
+BOOST_AUTO_TEST_CASE(Test_SocketLogger_IoUring_Ack)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/eplog-iouring";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        SocketLogger eplog(sockfile, 100000, 100000, 60*1000, "io_uring");
+        BOOST_CHECK_EQUAL(IoUring::IsSupported()? "io_uring" : "poll", eplog.GetIoEngine());
+
+        const int nmsgs = 1000;
+        for (int i = 0; i < nmsgs; i++) {
+            BOOST_CHECK(eplog.SendDjson("testSource", TestUtil::CreateMsg(i)));
+        }
+        // Don't use WaitUntilAllAcked(), which resends the items not acked yet.
+        for (int i = 0; i < 500 && eplog.GetNumItemsInCache(); i++) {
+            usleep(10*1000);
+        }
+        BOOST_CHECK_EQUAL(0, eplog.GetNumItemsInCache());
+        BOOST_CHECK_EQUAL(nmsgs, eplog.GetNumTagsRead());
+        BOOST_CHECK_EQUAL(0, eplog.GetTotalResend());
+
+        mockServer->Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+#include <boost/test/unit_test.hpp>
+#include <random>
+
+#include "JsonString.h"
+#include "DjsonLogItem.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testjson)
+
+static const JsonString::Scanner AllScanners[] = {
+    JsonString::Scanner::Scalar,
+    JsonString::Scanner::Sse42,
+    JsonString::Scanner::Avx2
+};
+
+// Reference implementation: escape byte by byte.
+static std::string
+QuoteByteByByte(
+    const std::string & str
+    )
+{
+    std::string out = "\"";
+    for (size_t i = 0; i < str.size(); i++) {
+        unsigned char c = str[i];
+        if ('"' == c || '\\' == c) {
+            out.append(1, '\\').append(1, c);
+        }
+        else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out.append(buf);
+        }
+        else if (c < 0x80) {
+            out.append(1, c);
+        }
+        else {
+            out.append("\\ufffd");
+        }
+    }
+    return out + "\"";
+}
+
+BOOST_AUTO_TEST_CASE(Test_JsonString_Escape)
+{
+    auto origScanner = JsonString::GetScanner();
+
+    for (auto scanner : AllScanners) {
+        if (!JsonString::SetScanner(scanner)) {
+            BOOST_TEST_MESSAGE("Scanner " << static_cast<int>(scanner) << " is not supported. Skip it.");
+            continue;
+        }
+        BOOST_CHECK_EQUAL("\"\"", JsonString::Quote(""));
+        BOOST_CHECK_EQUAL("\"plain text\"", JsonString::Quote("plain text"));
+        BOOST_CHECK_EQUAL(R"("a\"b\\c")", JsonString::Quote("a\"b\\c"));
+        BOOST_CHECK_EQUAL(R"("\b\f\n\r\t\u0001\u001f")", JsonString::Quote("\b\f\n\r\t\x01\x1f"));
+        BOOST_CHECK_EQUAL(R"("\u0000x")", JsonString::Quote(std::string("\0x", 2)));
+
+        // special chars at each position of a 32-byte and a 16-byte block
+        const std::string plain(70, 'x');
+        for (size_t i = 0; i < plain.size(); i++) {
+            auto str = plain;
+            str[i] = '"';
+            BOOST_CHECK_EQUAL(QuoteByteByByte(str), JsonString::Quote(str));
+        }
+    }
+    JsonString::SetScanner(origScanner);
+}
+
+BOOST_AUTO_TEST_CASE(Test_JsonString_Utf8)
+{
+    auto origScanner = JsonString::GetScanner();
+
+    for (auto scanner : AllScanners) {
+        if (!JsonString::SetScanner(scanner)) {
+            continue;
+        }
+        const std::string valid = "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80";
+        BOOST_CHECK_EQUAL("\"" + valid + "\"", JsonString::Quote(valid));
+
+        std::string out;
+        BOOST_CHECK_EQUAL(1, JsonString::Append(out, "a\xffz", 3));
+        BOOST_CHECK_EQUAL(R"("a\ufffdz")", out);
+
+        // overlong, surrogate, above U+10FFFF, truncated
+        BOOST_CHECK_EQUAL(R"("\ufffd\ufffd")", JsonString::Quote("\xc0\xaf"));
+        BOOST_CHECK_EQUAL(R"("\ufffd\ufffd\ufffd")", JsonString::Quote("\xed\xa0\x80"));
+        BOOST_CHECK_EQUAL(R"("\ufffd\ufffd\ufffd\ufffd")", JsonString::Quote("\xf4\x90\x80\x80"));
+        BOOST_CHECK_EQUAL(R"("x\ufffd\ufffd")", JsonString::Quote("x\xe2\x82"));
+    }
+    JsonString::SetScanner(origScanner);
+}
+
+// Validate that all the scanners give the same results as the scalar one.
+BOOST_AUTO_TEST_CASE(Test_JsonString_Scanners)
+{
+    auto origScanner = JsonString::GetScanner();
+
+    std::mt19937 randGen(12345);
+    std::uniform_int_distribution<int> lenDist(0, 200);
+    std::uniform_int_distribution<int> charDist(0, 255);
+
+    std::vector<std::string> inputs;
+    for (int i = 0; i < 500; i++) {
+        std::string str(lenDist(randGen), 'a');
+        // mostly plain ASCII with a few special chars
+        for (size_t k = 0; k < str.size(); k += 1 + lenDist(randGen) % 40) {
+            str[k] = static_cast<char>(charDist(randGen));
+        }
+        inputs.push_back(str);
+    }
+
+    JsonString::SetScanner(JsonString::Scanner::Scalar);
+    std::vector<std::string> expected;
+    for (const auto & str : inputs) {
+        expected.push_back(JsonString::Quote(str));
+    }
+
+    for (auto scanner : AllScanners) {
+        if (!JsonString::SetScanner(scanner)) {
+            continue;
+        }
+        for (size_t i = 0; i < inputs.size(); i++) {
+            BOOST_CHECK_EQUAL(expected[i], JsonString::Quote(inputs[i]));
+        }
+    }
+    JsonString::SetScanner(origScanner);
+}
+
+BOOST_AUTO_TEST_CASE(Test_DjsonLogItem_EscapeString)
+{
+    DjsonLogItem item("testsource");
+    item.AddData("my \"name\"", std::string("line1\nline2 \"quoted\""));
+
+    std::string data = item.GetData();
+    const std::string expected = R"([["my \"name\"","FT_STRING"]],["line1\nline2 \"quoted\""]])";
+    BOOST_CHECK_MESSAGE(data.find(expected) != std::string::npos,
+        "Actual='" << data << "'; Expected='" << expected << "'");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
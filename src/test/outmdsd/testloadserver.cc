@@ -0,0 +1,201 @@
+#include <boost/test/unit_test.hpp>
+#include <future>
+#include <cstring>
+
+extern "C" {
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+}
+
+#include "LoadServer.h"
+#include "SocketLogger.h"
+#include "testutil.h"
+
+using namespace EndpointLog;
+using namespace TestUtil;
+
+BOOST_AUTO_TEST_SUITE(testloadserver)
+
+// Wait until the number of items in logger cache equals to 'nexpected', or timeout.
+// Return true if the number is expected, false otherwise.
+static bool
+WaitForCacheSize(
+    const SocketLogger & logger,
+    size_t nexpected,
+    uint32_t timeoutMS
+    )
+{
+    for (uint32_t i = 0; i < timeoutMS; i++) {
+        if (nexpected == logger.GetNumItemsInCache()) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return (nexpected == logger.GetNumItemsInCache());
+}
+
+// Send 'nmsgs' to a LoadServer. Return the cache size of the logger
+// after all acks are processed or after timeout.
+static size_t
+SendToLoadServer(
+    LoadServer & server,
+    const std::string & sockfile,
+    int nmsgs,
+    size_t nexpectedInCache
+    )
+{
+    server.Init();
+    auto serverTask = std::async(std::launch::async, [&server]() { server.Run(); });
+
+    size_t ncache = 0;
+    {
+        // Use long resend interval so that no item is resent in the test.
+        SocketLogger logger(sockfile, 100000, 100000);
+        for (int i = 0; i < nmsgs; i++) {
+            BOOST_CHECK(logger.SendDjson("testsource", CreateMsg(i)));
+        }
+        for (int i = 0; i < 5000 && server.GetTotalRecords() < static_cast<size_t>(nmsgs); i++) {
+            usleep(1000);
+        }
+        WaitForCacheSize(logger, nexpectedInCache, 5000);
+        ncache = logger.GetNumItemsInCache();
+    }
+
+    server.Stop();
+    serverTask.get();
+    return ncache;
+}
+
+BOOST_AUTO_TEST_CASE(Test_LoadServer_Config)
+{
+    try {
+        LoadServerConfig config;
+
+        config.ParseLatency("fixed:100");
+        BOOST_CHECK(LoadServerConfig::LatencyType::Fixed == config.latencyType);
+        BOOST_CHECK_EQUAL(100, config.ackLatencyUS);
+
+        config.ParseLatency("uniform:10:200");
+        BOOST_CHECK(LoadServerConfig::LatencyType::Uniform == config.latencyType);
+        BOOST_CHECK_EQUAL(10, config.ackLatencyMinUS);
+        BOOST_CHECK_EQUAL(200, config.ackLatencyUS);
+
+        config.ParseLatency("exp:300");
+        BOOST_CHECK(LoadServerConfig::LatencyType::Exponential == config.latencyType);
+        BOOST_CHECK_EQUAL(300, config.ackLatencyUS);
+
+        for (const auto & str : { "fixed", "normal:10", "uniform:20:10", "uniform:10", "exp:abc" }) {
+            BOOST_CHECK_THROW(config.ParseLatency(str), std::invalid_argument);
+        }
+
+        config.ParseAckStatus("2:1.5");
+        BOOST_CHECK_EQUAL(1.5, config.ackStatusPercent[2]);
+
+        for (const auto & str : { "2", "0:10", "3:101", "x:1" }) {
+            BOOST_CHECK_THROW(config.ParseAckStatus(str), std::invalid_argument);
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that all records are acked with random latency, batching and reordering.
+BOOST_AUTO_TEST_CASE(Test_LoadServer_BVT)
+{
+    try {
+        const std::string sockfile = GetCurrDir() + "/loadserver-bvt";
+        const int nmsgs = 1000;
+
+        LoadServerConfig config;
+        config.ParseLatency("uniform:0:2000");
+        config.ackBatchSize = 8;
+        config.ackBatchTimeoutUS = 500;
+        config.ackReorderPercent = 30;
+        config.retainData = true;
+
+        LoadServer server(sockfile, config);
+        auto ncache = SendToLoadServer(server, sockfile, nmsgs, 0);
+
+        BOOST_CHECK_EQUAL(0, ncache);
+        BOOST_CHECK_EQUAL(nmsgs, server.GetTotalRecords());
+        BOOST_CHECK_EQUAL(nmsgs, server.GetTotalAcksSent());
+        BOOST_CHECK_EQUAL(nmsgs, server.GetTotalAcksByStatus(0));
+        BOOST_CHECK_EQUAL(nmsgs, server.GetDataRead().size());
+        BOOST_CHECK_EQUAL(1, server.GetTotalConnections());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that injected failure status and dropped acks keep records in logger cache.
+BOOST_AUTO_TEST_CASE(Test_LoadServer_AckFailures)
+{
+    try {
+        const std::string sockfile = GetCurrDir() + "/loadserver-failures";
+        const int nmsgs = 100;
+
+        LoadServerConfig config;
+        config.ParseAckStatus("3:50");
+        config.ackDropPercent = 100;
+
+        LoadServer server(sockfile, config);
+        auto ncache = SendToLoadServer(server, sockfile, nmsgs, nmsgs);
+
+        BOOST_CHECK_EQUAL(nmsgs, ncache);
+        BOOST_CHECK_EQUAL(nmsgs, server.GetTotalRecords());
+        BOOST_CHECK_EQUAL(nmsgs, server.GetTotalAcksDropped());
+        BOOST_CHECK_EQUAL(0, server.GetTotalAcksSent());
+        BOOST_CHECK(server.GetDataRead().empty());
+
+        LoadServerConfig config2;
+        config2.ParseAckStatus("3:100");
+        LoadServer server2(sockfile, config2);
+        ncache = SendToLoadServer(server2, sockfile, nmsgs, nmsgs);
+
+        BOOST_CHECK_EQUAL(nmsgs, ncache);
+        BOOST_CHECK_EQUAL(nmsgs, server2.GetTotalAcksByStatus(3));
+        BOOST_CHECK_EQUAL(0, server2.GetTotalAcksByStatus(0));
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a connection with an invalid frame length is closed.
+BOOST_AUTO_TEST_CASE(Test_LoadServer_InvalidFrame)
+{
+    try {
+        const std::string sockfile = GetCurrDir() + "/loadserver-invalid";
+        LoadServer server(sockfile, LoadServerConfig());
+        server.Init();
+        auto serverTask = std::async(std::launch::async, [&server]() { server.Run(); });
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        BOOST_REQUIRE_GE(fd, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, sockfile.c_str(), sizeof(addr.sun_path)-1);
+        BOOST_REQUIRE_EQUAL(0, connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)));
+
+        const std::string frame = "12x\n";
+        BOOST_CHECK_EQUAL(frame.size(), write(fd, frame.c_str(), frame.size()));
+
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        BOOST_CHECK_EQUAL(1, poll(&pfd, 1, 5000));
+        char buf[16];
+        BOOST_CHECK_EQUAL(0, read(fd, buf, sizeof(buf)));
+        close(fd);
+
+        server.Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
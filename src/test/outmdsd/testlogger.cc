@@ -1,7 +1,9 @@
 #include <boost/test/unit_test.hpp>
 #include <vector>
+#include <future>
 
 #include "MockServer.h"
+#include "LoadServer.h"
 #include "SocketLogger.h"
 #include "SocketClient.h"
 #include "DataReader.h"
@@ -38,6 +40,68 @@ BOOST_AUTO_TEST_CASE(Test_SocketLogger_Error)
     }
 }
 
+// Validate that a send to a dead endpoint waits for the connect retry timeout
+// once, not once to connect before caching and again to send.
+BOOST_AUTO_TEST_CASE(Test_SocketLogger_ConnectTimeoutOnce)
+{
+    try {
+        const unsigned int connRetryTimeoutMS = 300;
+        for (const std::string policy : { "interleave", "replay_first" }) {
+            SocketLogger eplog("/tmp/unknownfile", 100, 1000, connRetryTimeoutMS);
+            BOOST_CHECK(eplog.SetReplayPolicy(policy));
+
+            auto startTime = std::chrono::steady_clock::now();
+            BOOST_CHECK(!eplog.SendDjson("testSource", TestUtil::CreateMsg(0)));
+            auto runTimeMS = (std::chrono::steady_clock::now() - startTime) / std::chrono::milliseconds(1);
+
+            BOOST_CHECK_MESSAGE(runTimeMS >= connRetryTimeoutMS, policy << ": " << runTimeMS << " ms");
+            BOOST_CHECK_MESSAGE(runTimeMS < 2*connRetryTimeoutMS, policy << ": " << runTimeMS << " ms");
+            BOOST_CHECK_EQUAL(0, eplog.GetNumItemsInCache());
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a record sent while the endpoint comes up is received once.
+// It is cached before the connection is created, but it is sent on that
+// connection, so it must not be replayed on it too.
+BOOST_AUTO_TEST_CASE(Test_SocketLogger_SendOnceOnConnect)
+{
+    try {
+        for (const std::string policy : { "interleave", "replay_first" }) {
+            const std::string sockfile = TestUtil::GetCurrDir() + "/logger-sendonce-" + policy;
+            unlink(sockfile.c_str());
+
+            SocketLogger eplog(sockfile, 100000, 100000, 5000);
+            BOOST_CHECK(eplog.SetReplayPolicy(policy));
+            auto sendTask = std::async(std::launch::async, [&eplog]() {
+                return eplog.SendDjson("testSource", TestUtil::CreateMsg(0));
+            });
+
+            // Start the server after the first connect attempts fail.
+            usleep(300*1000);
+            TestUtil::LoadServerConfig config;
+            config.ackDropPercent = 100;
+            TestUtil::LoadServer server(sockfile, config);
+            server.Init();
+            auto serverTask = std::async(std::launch::async, [&server]() { server.Run(); });
+
+            BOOST_CHECK_MESSAGE(sendTask.get(), policy);
+            // Leave time for a replay on the new connection.
+            usleep(300*1000);
+            BOOST_CHECK_MESSAGE(1 == server.GetTotalRecords(), policy << ": " << server.GetTotalRecords());
+
+            server.Stop();
+            serverTask.get();
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
 // Return number of bytes sent.
 // If SendDjson() fails, return 0.
 // Save the index of each failed send to 'failedMsgList' for future resend.
@@ -244,5 +308,135 @@ BOOST_AUTO_TEST_CASE(Test_SocketLogger_Failure_1000)
     TestClientServerE2E(1000, 1, true);
 }
 
+// Validate that WaitUntilAllAcked() waits for the delayed acks.
+BOOST_AUTO_TEST_CASE(Test_SocketLogger_WaitUntilAllAcked)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/eplog-drain";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+        mockServer->SetAckDelay(100);
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        SocketLogger eplog(sockfile, 100000, 100000);
+        BOOST_CHECK(eplog.WaitUntilAllAcked(0));
+
+        const int nmsgs = 20;
+        for (int i = 0; i < nmsgs; i++) {
+            BOOST_CHECK(eplog.SendDjson("testSource", TestUtil::CreateMsg(i)));
+        }
+        BOOST_CHECK(eplog.WaitUntilAllAcked(5000));
+        BOOST_CHECK_EQUAL(0, eplog.GetNumItemsInCache());
+
+        mockServer->Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that the data not acked at shutdown are saved to a spill file,
+// and are sent by the next logger.
+BOOST_AUTO_TEST_CASE(Test_SocketLogger_SpillAndReplay)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/eplog-spill";
+        const std::string spillfile = TestUtil::GetCurrDir() + "/eplog-spill.dat";
+        TestUtil::RemoveFileIfExists(spillfile);
+        const int nmsgs = 10;
+
+        {
+            auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+            mockServer->Init();
+            mockServer->SetAckDropRate(100);
+            auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+            SocketLogger eplog(sockfile, 100000, 100000);
+            for (int i = 0; i < nmsgs; i++) {
+                BOOST_CHECK(eplog.SendDjson("testSource", TestUtil::CreateMsg(i)));
+            }
+            BOOST_CHECK(!eplog.WaitUntilAllAcked(100));
+            BOOST_CHECK_EQUAL(nmsgs, eplog.GetNumItemsInCache());
+
+            BOOST_CHECK_EQUAL(nmsgs, eplog.SpillUnacked(spillfile));
+            BOOST_CHECK_EQUAL(0, eplog.GetNumItemsInCache());
+
+            mockServer->Stop();
+            serverTask.get();
+        }
+
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        SocketLogger eplog(sockfile, 100000, 100000);
+        BOOST_CHECK_EQUAL(nmsgs, eplog.ReplaySpillFile(spillfile));
+        BOOST_CHECK(eplog.WaitUntilAllAcked(5000));
+        BOOST_CHECK(!TestUtil::IsFileExists(spillfile));
+
+        mockServer->Stop();
+        serverTask.get();
+
+        auto dataSet = mockServer->GetUniqDataRead();
+        BOOST_CHECK_EQUAL(nmsgs, dataSet.size());
+        for (int i = 0; i < nmsgs; i++) {
+            BOOST_CHECK_EQUAL(1, dataSet.count(TestUtil::CreateMsg(i)));
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a batch send stops at the first failure, and tells if the
+// failed record can be retried.
+BOOST_AUTO_TEST_CASE(Test_SocketLogger_SendDjsonBatch)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/eplog-batch";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        SocketLogger eplog(sockfile, 100000, 100000);
+        std::vector<std::string> sources = { "testSource", "testSource", "", "testSource" };
+        std::vector<std::string> data;
+        for (int i = 0; i < 4; i++) {
+            data.push_back(TestUtil::CreateMsg(i));
+        }
+
+        auto result = eplog.SendDjsonBatch(sources, data);
+        BOOST_CHECK(!result.success);
+        BOOST_CHECK(!result.retryable);
+        BOOST_CHECK_EQUAL(2, result.numAccepted);
+        BOOST_CHECK_EQUAL(2, result.failedIndex);
+
+        sources[2] = "testSource";
+        result = eplog.SendDjsonBatch(sources, data);
+        BOOST_CHECK(result.success);
+        BOOST_CHECK_EQUAL(4, result.numAccepted);
+
+        result = eplog.SendDjsonBatch(sources, { "a" });
+        BOOST_CHECK(!result.success);
+        BOOST_CHECK(!result.retryable);
+        BOOST_CHECK_EQUAL(0, result.numAccepted);
+
+        BOOST_CHECK(eplog.WaitUntilAllAcked(5000));
+        mockServer->Stop();
+        serverTask.get();
+
+        // No socket server.
+        SocketLogger badlog("/tmp/unknownfile", 100, 1000, 1);
+        result = badlog.SendDjsonBatch(sources, data);
+        BOOST_CHECK(!result.success);
+        BOOST_CHECK(result.retryable);
+        BOOST_CHECK_EQUAL(0, result.failedIndex);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -1,9 +1,15 @@
 #include <boost/test/unit_test.hpp>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #include "LogItem.h"
+#include "LogItemPtr.h"
 #include "DjsonLogItem.h"
 #include "EtwLogItem.h"
+#include "DjsonRecord.h"
 #include "IdMgr.h"
+#include "DataFrame.h"
 #include "testutil.h"
 
 using namespace EndpointLog;
@@ -205,6 +211,231 @@ BOOST_AUTO_TEST_CASE(Test_EtwLogItem_NameOrder)
     }
 }
 
+// Validate DJSON string without schema array for items using AddData()
+static void
+TestLogItemNoSchema()
+{
+    EtwLogItem item1("testsource", "testguid", 123);
+    item1.AddData("nsdata", 1);
+    auto schemaId = item1.GetSchemaId();
+    BOOST_CHECK_NE(0, schemaId);
+
+    std::string data = item1.GetDataNoSchema();
+    auto tag = item1.GetTag();
+    const std::string payload = "[\"testsource\"," + tag + "," + std::to_string(schemaId) + ",[\"testguid\",123,1]]";
+    BOOST_CHECK_EQUAL(std::to_string(payload.size()) + "\n" + payload, data);
+
+    // Full data still contains schema array
+    std::string fullData = item1.GetData();
+    BOOST_CHECK(fullData.find(R"(["nsdata","FT_INT32"])") != std::string::npos);
+
+    EtwLogItem item2("testsource", "testguid", 456);
+    item2.AddData("nsdata", 2);
+    BOOST_CHECK_EQUAL(schemaId, item2.GetSchemaId());
+}
+
+BOOST_AUTO_TEST_CASE(Test_LogItem_NoSchema)
+{
+    try {
+        TestLogItemNoSchema();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+// Validate schema id parsing for items created from schema and data string
+BOOST_AUTO_TEST_CASE(Test_LogItem_NoSchema_Parse)
+{
+    try {
+        // schema field names and data values can contain '[', ']' and escaped '"'.
+        const std::string schemaAndData = R"(12,[1,["a]\"[","FT_STRING"],["t","FT_TIME"]],["x]\"y",[1,2]])";
+        DjsonLogItem item1("testsource", schemaAndData);
+        BOOST_CHECK_EQUAL(12, item1.GetSchemaId());
+
+        std::string data = item1.GetDataNoSchema();
+        const std::string expected = R"(12,["x]\"y",[1,2]]])";
+        BOOST_CHECK_MESSAGE(data.find(expected) != std::string::npos, "Actual='" << data << "'");
+
+        std::vector<std::string> invalidList = {
+            "testSchemaAndData",
+            "a1,[[\"a\",\"FT_INT32\"]],[1]",
+            "1,[[\"a\",\"FT_INT32\"]]",
+            "1,[[\"a\",\"FT_INT32\"],[1]",
+            "1,2,[1]"
+        };
+        for (const auto & str : invalidList) {
+            DjsonLogItem item("testsource", str);
+            BOOST_CHECK_MESSAGE(0 == item.GetSchemaId(), "Unexpected schema id for '" << str << "'");
+            BOOST_CHECK_EQUAL(std::string(item.GetData()), std::string(item.GetDataNoSchema()));
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+// Validate that item frames have the same bytes as the composed strings,
+// and that the payload is not copied into the frame.
+BOOST_AUTO_TEST_CASE(Test_LogItem_Frame)
+{
+    try {
+        const std::string largeValue(128*1024, 'x');
+        DjsonLogItem item1("testsource", "5,[0,[\"msg\",\"FT_STRING\"]],[\"" + largeValue + "\"]");
+
+        DataFrame frame1;
+        item1.GetFrame(frame1);
+        BOOST_CHECK_EQUAL(3, frame1.GetCount());
+        BOOST_CHECK(item1.GetSchemaAndData().data() == frame1.GetSegments()[1].iov_base);
+        BOOST_CHECK(std::string(item1.GetData()) == frame1.ToString());
+
+        DataFrame frame2;
+        item1.GetFrameNoSchema(frame2);
+        BOOST_CHECK_LT(frame2.GetTotalSize(), frame1.GetTotalSize());
+        BOOST_CHECK(std::string(item1.GetDataNoSchema()) == frame2.ToString());
+
+        DjsonLogItem item2("testsource");
+        item2.AddData("name", "value");
+        item2.AddData("count", 3);
+        DataFrame frame3;
+        item2.GetFrame(frame3);
+        BOOST_CHECK_EQUAL(std::string(item2.GetData()), frame3.ToString());
+
+        // No schema id: GetFrameNoSchema() is the same as GetFrame().
+        DjsonLogItem item3("testsource", "testSchemaAndData");
+        DataFrame frame4;
+        item3.GetFrameNoSchema(frame4);
+        BOOST_CHECK_EQUAL(std::string(item3.GetData()), frame4.ToString());
+
+        const size_t maxSegments = DataFrame::MaxSegments;
+        DataFrame frame5;
+        for (size_t i = 0; i < maxSegments; i++) {
+            frame5.Add("a", 1);
+        }
+        frame5.Add("", 0);
+        BOOST_CHECK_THROW(frame5.Add("a", 1), std::length_error);
+        BOOST_CHECK_EQUAL(maxSegments, frame5.GetTotalSize());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+// Validate that items created by MakeLogItem() work as normal items,
+// and that freed memory blocks are reused.
+BOOST_AUTO_TEST_CASE(Test_LogItem_Pool)
+{
+    try {
+        auto item1 = MakeLogItem<DjsonLogItem>("testsource", "testSchemaAndData");
+        BOOST_CHECK(item1);
+        std::string data = item1->GetData();
+        BOOST_CHECK_MESSAGE(data.find("testSchemaAndData") != std::string::npos, "Actual='" << data << "'");
+
+        auto addr1 = item1.get();
+        item1.reset();
+
+        auto item2 = MakeLogItem<DjsonLogItem>("testsource", "testSchemaAndData2");
+        BOOST_CHECK_EQUAL(addr1, item2.get());
+
+        auto item3 = MakeLogItem<EtwLogItem>("testsource", "testguid", 1);
+        BOOST_CHECK_NE(item2.get(), item3.get());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+// Validate that items freed in another thread can be reused.
+BOOST_AUTO_TEST_CASE(Test_LogItem_Pool_MultiThreads)
+{
+    try {
+        const size_t nitems = 1000;
+        std::vector<LogItemPtr> itemList;
+        std::unordered_set<LogItem*> addrSet;
+        for (size_t i = 0; i < nitems; i++) {
+            itemList.push_back(MakeLogItem<DjsonLogItem>("testsource", std::to_string(i)));
+            addrSet.insert(itemList.back().get());
+        }
+        BOOST_CHECK_EQUAL(nitems, addrSet.size());
+
+        std::thread([&itemList] { itemList.clear(); }).join();
+
+        size_t nreused = 0;
+        for (size_t i = 0; i < nitems; i++) {
+            itemList.push_back(MakeLogItem<DjsonLogItem>("testsource", std::to_string(i)));
+            if (addrSet.count(itemList.back().get())) {
+                nreused++;
+            }
+        }
+        // Some blocks may come from blocks cached by current thread before.
+        BOOST_CHECK_MESSAGE(nreused > nitems / 2, "nreused=" << nreused);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+DJSON_FIELD(RecBoolField, "bool_data", bool);
+DJSON_FIELD(RecInt32Field, "int32_data", int32_t);
+DJSON_FIELD(RecInt64Field, "int64_data", int64_t);
+DJSON_FIELD(RecDoubleField, "double_data", double);
+DJSON_FIELD(RecTimeField, "time_data", DjsonTime);
+DJSON_FIELD(RecStrField, "str \"data\"", std::string);
+
+// Validate that a DjsonRecord has the same schema id, schema and data as a
+// DjsonLogItem with the same fields.
+BOOST_AUTO_TEST_CASE(Test_DjsonRecord_BVT)
+{
+    try {
+        using TestRecord = DjsonRecord<RecBoolField, RecInt32Field, RecInt64Field,
+                                       RecDoubleField, RecTimeField, RecStrField>;
+
+        for (int i = 0; i < 3; i++) {
+            DjsonLogItem item("testsource");
+            item.AddData("bool_data", true);
+            item.AddData("int32_data", -i);
+            item.AddData("int64_data", static_cast<int64_t>(1) << 40);
+            item.AddData("double_data", 0.0000004);
+            item.AddData("time_data", 11, 22);
+            item.AddData("str \"data\"", std::string("line ") + std::to_string(i) + "\n");
+
+            TestRecord record("testsource", true, -i, static_cast<int64_t>(1) << 40, 0.0000004,
+                              DjsonTime(11, 22), std::string("line ") + std::to_string(i) + "\n");
+
+            BOOST_CHECK_EQUAL(item.GetSchemaAndData(), record.GetSchemaAndData());
+            BOOST_CHECK_EQUAL(item.GetSchemaId(), record.GetSchemaId());
+            BOOST_CHECK_EQUAL(item.GetSizeHint(), record.GetSizeHint());
+
+            std::string dataNoSchema = record.GetDataNoSchema();
+            auto expected = std::to_string(record.GetSchemaId()) + R"(,[true,)";
+            BOOST_CHECK_MESSAGE(dataNoSchema.find(expected) != std::string::npos,
+                "Actual='" << dataNoSchema << "'; Expected='" << expected << "'");
+        }
+        BOOST_CHECK_EQUAL(0, TestRecord::GetSchemaPrefix().find(
+            std::to_string(TestRecord("s", false, 0, 0, 0, DjsonTime(), "").GetSchemaId()) + ",[["));
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_EtwRecord_BVT)
+{
+    try {
+        EtwLogItem etwlog("testsource", "testguid", 123);
+        etwlog.AddData("int64_data", static_cast<int64_t>(7));
+
+        auto record = MakeLogItem<EtwRecord<RecInt64Field>>("testsource", "testguid", 123, 7);
+        auto djsonRecord = static_cast<DjsonLogItem*>(record.get());
+
+        BOOST_CHECK_EQUAL(etwlog.GetSchemaAndData(), djsonRecord->GetSchemaAndData());
+        BOOST_CHECK_EQUAL(etwlog.GetSchemaId(), record->GetSchemaId());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
 static void
 CreateEtwLogItems(size_t nitems)
 {
@@ -0,0 +1,134 @@
+#include <boost/test/unit_test.hpp>
+#include <future>
+#include <vector>
+
+#include "Metrics.h"
+#include "MockServer.h"
+#include "SocketLogger.h"
+#include "testutil.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testmetrics)
+
+BOOST_AUTO_TEST_CASE(Test_Counter_MultiThreads)
+{
+    Counter counter;
+    const int nthreads = 16;
+    const int nadds = 10000;
+
+    std::vector<std::future<void>> tasks;
+    for (int i = 0; i < nthreads; i++) {
+        tasks.push_back(std::async(std::launch::async, [&counter] {
+            for (int j = 0; j < nadds; j++) {
+                counter.Add();
+            }
+        }));
+    }
+    for (auto & task : tasks) {
+        task.get();
+    }
+    BOOST_CHECK_EQUAL(nthreads * nadds, counter.Get());
+
+    counter.Add(5);
+    BOOST_CHECK_EQUAL(nthreads * nadds + 5, counter.Get());
+}
+
+BOOST_AUTO_TEST_CASE(Test_Histogram_Buckets)
+{
+    // Every value is in a bucket whose max value is no less than the value,
+    // and no more than 12.5% bigger.
+    for (uint64_t v = 0; v < 100000; v += (v < 1000? 1 : 97)) {
+        auto index = Histogram::GetBucketIndex(v);
+        auto maxValue = Histogram::GetBucketMaxValue(index);
+        BOOST_REQUIRE_GE(maxValue, v);
+        BOOST_REQUIRE_LE(maxValue, v + v / 8);
+        if (index > 0) {
+            BOOST_REQUIRE_LT(Histogram::GetBucketMaxValue(index-1), v);
+        }
+    }
+
+    // values too big are in the last bucket.
+    BOOST_CHECK_EQUAL(Histogram::GetBucketIndex(UINT64_MAX), Histogram::GetBucketIndex(1ULL << 45));
+}
+
+BOOST_AUTO_TEST_CASE(Test_Histogram_Percentiles)
+{
+    Histogram h;
+    auto empty = h.GetSnapshot();
+    BOOST_CHECK_EQUAL(0, empty.count);
+    BOOST_CHECK_EQUAL(0, empty.p99);
+
+    for (uint64_t v = 1; v <= 1000; v++) {
+        h.Record(v);
+    }
+    auto s = h.GetSnapshot();
+    BOOST_CHECK_EQUAL(1000, s.count);
+    BOOST_CHECK_EQUAL(500500, s.sum);
+    BOOST_CHECK_EQUAL(1000, s.max);
+
+    BOOST_CHECK_GE(s.p50, 500);
+    BOOST_CHECK_LE(s.p50, 500 * 1.125);
+    BOOST_CHECK_GE(s.p90, 900);
+    BOOST_CHECK_LE(s.p90, 900 * 1.125);
+    BOOST_CHECK_GE(s.p99, 990);
+    BOOST_CHECK_LE(s.p99, 1000);
+    BOOST_CHECK_EQUAL(1000, s.p999);
+}
+
+BOOST_AUTO_TEST_CASE(Test_MetricsRegistry_Stats)
+{
+    MetricsRegistry metrics;
+    BOOST_CHECK_EQUAL("{}", metrics.GetStats());
+
+    auto & counter = metrics.GetCounter("b_count");
+    BOOST_CHECK_EQUAL(&counter, &metrics.GetCounter("b_count"));
+    counter.Add(3);
+    metrics.GetHistogram("a_us").Record(7);
+    metrics.SetGauge("c_depth", [] { return 42; });
+
+    BOOST_CHECK_EQUAL(3, metrics.GetCounterValue("b_count"));
+    BOOST_CHECK_EQUAL(0, metrics.GetCounterValue("nosuchcounter"));
+    BOOST_CHECK_EQUAL("{\"a_us\":{\"count\":1,\"sum\":7,\"max\":7,\"p50\":7,\"p90\":7,\"p99\":7,\"p999\":7},"
+                      "\"b_count\":3,\"c_depth\":42}", metrics.GetStats());
+}
+
+// Validate the metrics of a logger that sends data to a mock mdsd.
+BOOST_AUTO_TEST_CASE(Test_SocketLogger_Stats)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/metrics-bvt";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        SocketLogger eplog(sockfile, 100000, 100000);
+        const int nmsgs = 20;
+        for (int i = 0; i < nmsgs; i++) {
+            BOOST_CHECK(eplog.SendDjson("testSource", TestUtil::CreateMsg(i)));
+        }
+        // Don't use WaitUntilAllAcked(), which resends the items not acked yet.
+        for (int i = 0; i < 500 && eplog.GetNumItemsInCache(); i++) {
+            usleep(10*1000);
+        }
+        BOOST_CHECK_EQUAL(0, eplog.GetNumItemsInCache());
+
+        auto stats = eplog.GetStats();
+        BOOST_TEST_MESSAGE("stats: " << stats);
+        BOOST_CHECK(stats.find("\"ack_count.ACK_SUCCESS\":" + std::to_string(nmsgs)) != std::string::npos);
+        BOOST_CHECK(stats.find("\"cache_items\":0") != std::string::npos);
+        BOOST_CHECK(stats.find("\"connect_count\":1") != std::string::npos);
+        BOOST_CHECK(stats.find("\"drop_count.ack_timeout\":0") != std::string::npos);
+        BOOST_CHECK(stats.find("\"send_to_ack_us\":{\"count\":" + std::to_string(nmsgs)) != std::string::npos);
+        BOOST_CHECK(stats.find("\"enqueue_to_send_us\":{\"count\":" + std::to_string(nmsgs)) != std::string::npos);
+        BOOST_CHECK(stats.find("\"send_bytes\":0") == std::string::npos);
+
+        mockServer->Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,26 +7,13 @@
 #include "DataReader.h"
 #include "testutil.h"
 #include "LogItemPtr.h"
-#include "ConcurrentMap.h"
+#include "InflightRing.h"
 
 using namespace EndpointLog;
 
 BOOST_AUTO_TEST_SUITE(testreader)
 
 
-void
-StartSocketReader(
-    std::promise<void>& threadReady,
-    const std::shared_ptr<DataReader>& sr,
-    bool& stopRunLoop
-    )
-{
-    threadReady.set_value();
-    sr->Run();
-    // Test that when Run() is done, stopRunLoop must be set to be true.
-    BOOST_CHECK(stopRunLoop);
-}
-
 // This test will do
 // - start socket server
 // - start a socket client to send data to the server.
@@ -48,11 +35,11 @@ SendDataToServer(int nmsgs)
         });
 
         auto sockClient = std::make_shared<SocketClient>(sockfile, 1);
-        auto dataCache = std::make_shared<ConcurrentMap<LogItemPtr>>();
+        auto dataCache = std::make_shared<InflightRing>();
 
-        // start reader in a thread
+        // read in the reactor thread
         auto sockReader = std::make_shared<DataReader>(sockClient, dataCache);
-        auto readerTask = std::async(std::launch::async, [sockReader]() { sockReader->Run(); });
+        sockReader->Start();
 
         size_t totalSend = 0;
 
@@ -68,15 +55,19 @@ SendDataToServer(int nmsgs)
         bool mockServerDone = mockServer->WaitForTestsDone(500);
         BOOST_CHECK(mockServerDone);
 
+        // The reactor reads the acks asynchronously.
+        auto nTagsWrite = mockServer->GetTotalTags();
+        for (int i = 0; i < 100 && sockReader->GetNumTagsRead() < nTagsWrite; i++) {
+            usleep(10*1000);
+        }
+
+        sockReader->Stop();
         sockClient->Stop();
         sockClient->Close();
-        sockReader->Stop();
-        readerTask.get();
 
         mockServer->Stop();
 
         auto nTagsRead = sockReader->GetNumTagsRead();
-        auto nTagsWrite = mockServer->GetTotalTags();
         BOOST_CHECK_EQUAL(nTagsWrite, nTagsRead);
 
         auto totalReceived = serverTask.get();
@@ -93,29 +84,22 @@ BOOST_AUTO_TEST_CASE(Test_SocketReader_Error)
     try {
         const std::string socketfile = "/tmp/nosuchfile";
         auto sockClient = std::make_shared<SocketClient>(socketfile, 1);
-        auto dataCache = std::make_shared<ConcurrentMap<LogItemPtr>>();
-
-        std::promise<void> threadReady;
-        bool stopRunLoop = false;
+        auto dataCache = std::make_shared<InflightRing>();
 
         auto sockReader = std::make_shared<DataReader>(sockClient, dataCache);
-        auto readerTask = std::async(std::launch::async, StartSocketReader,
-            std::ref(threadReady),sockReader, std::ref(stopRunLoop));
-
-        // wait until StartSocketReader thread starts
-        threadReady.get_future().wait();
+        sockReader->Start();
 
+        // The socket never connects, so nothing is read.
         usleep(100*1000);
+        BOOST_CHECK_EQUAL(0, sockReader->GetNumTagsRead());
 
         sockClient->Stop();
-        // sockReader->Stop() should break sockReader's Run() loop.
-        stopRunLoop = true;
-        sockReader->Stop();
+        auto stopTask = std::async(std::launch::async, [sockReader]() { sockReader->Stop(); });
 
-        // Validate that once DataReader::Stop() is called, it shouldn't take
-        // more than N milliseconds for DataReader::Run() thread to break.
+        // Validate that DataReader::Stop() doesn't take more than N milliseconds
+        // to detach the reader from the reactor thread.
         // There is no exact value for N. The test uses some reasonable small number.
-        BOOST_CHECK(TestUtil::WaitForTask(readerTask, 5));
+        BOOST_CHECK(TestUtil::WaitForTask(stopTask, 100));
     }
     catch(const std::exception & ex) {
         BOOST_FAIL("Test exception " << ex.what());
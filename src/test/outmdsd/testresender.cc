@@ -1,9 +1,14 @@
 #include <boost/test/unit_test.hpp>
 #include <future>
-#include "ConcurrentMap.h"
+#include <atomic>
+#include "InflightRing.h"
 #include "SocketClient.h"
 #include "DataResender.h"
 #include "DjsonLogItem.h"
+#include "LoadServer.h"
+#include "Metrics.h"
+#include "SocketLogger.h"
+#include "WorkerRuntime.h"
 #include "testutil.h"
 
 using namespace EndpointLog;
@@ -29,16 +34,15 @@ StartDataResender(
 std::shared_ptr<DataResender>
 CreateDataResender(
     const std::shared_ptr<SocketClient>& sockClient,
-    std::shared_ptr<ConcurrentMap<LogItemPtr>> dataCache,
+    std::shared_ptr<InflightRing> dataCache,
     size_t cacheSize,
     uint32_t retryMS
     )
 {
     for (size_t i = 0; i < cacheSize; i++) {
         auto indexStr = std::to_string(i+1);
-        auto key = "testkey-" + indexStr;
         LogItemPtr value(new DjsonLogItem("testsource", "testvalue-" + indexStr));
-        dataCache->Add(key, value);
+        dataCache->Add(value);
     }
 
     return std::make_shared<DataResender>(sockClient, dataCache, 1, retryMS);
@@ -56,7 +60,7 @@ BOOST_AUTO_TEST_CASE(Test_DataResender_EmptyCache)
         bool stopRunLoop = false;
 
         auto sockClient = std::make_shared<SocketClient>("/tmp/nosuchfile", 1);
-        auto resender = CreateDataResender(sockClient, std::make_shared<ConcurrentMap<LogItemPtr>>(), 0, retryMS);
+        auto resender = CreateDataResender(sockClient, std::make_shared<InflightRing>(), 0, retryMS);
         auto task = std::async(std::launch::async, StartDataResender, std::ref(threadReady), resender, std::ref(stopRunLoop));
 
         // Wait until StartDataResender is ready before starting timer
@@ -90,7 +94,7 @@ BOOST_AUTO_TEST_CASE(Test_DataResender_OneItem)
         bool stopRunLoop = false;
 
         auto sockClient = std::make_shared<SocketClient>("/tmp/nosuchfile", 1);
-        auto dataCache = std::make_shared<ConcurrentMap<LogItemPtr>>();
+        auto dataCache = std::make_shared<InflightRing>();
         auto resender = CreateDataResender(sockClient, dataCache, 10, retryMS);
         auto task = std::async(std::launch::async, StartDataResender, std::ref(threadReady), resender, std::ref(stopRunLoop));
 
@@ -119,5 +123,325 @@ BOOST_AUTO_TEST_CASE(Test_DataResender_OneItem)
     }
 }
 
+// Validate that a resending turn doesn't wait for the connect retry timeout
+// when the endpoint is down, and keeps the items that are not expired.
+BOOST_AUTO_TEST_CASE(Test_DataResender_DeadEndpoint)
+{
+    try {
+        const uint32_t retryMS = 50;
+        const uint32_t ackTimeoutMS = 60*1000;
+
+        std::promise<void> threadReady;
+        bool stopRunLoop = false;
+
+        auto sockClient = std::make_shared<SocketClient>("/tmp/nosuchfile", 60*1000);
+        auto dataCache = std::make_shared<InflightRing>();
+        for (int i = 0; i < 10; i++) {
+            dataCache->Add(MakeLogItem<DjsonLogItem>("testsource", TestUtil::CreateMsg(i)));
+        }
+        auto resender = std::make_shared<DataResender>(sockClient, dataCache, ackTimeoutMS, retryMS);
+        auto task = std::async(std::launch::async, StartDataResender, std::ref(threadReady), resender, std::ref(stopRunLoop));
+
+        threadReady.get_future().wait();
+        usleep((retryMS*3 + retryMS/2)*1000);
+
+        stopRunLoop = true;
+        resender->Stop();
+        // A turn blocked in connect retries would hold Run() for 60 seconds.
+        BOOST_CHECK(TestUtil::WaitForTask(task, 500));
+
+        sockClient->Stop();
+        BOOST_CHECK_EQUAL(3, task.get());
+        BOOST_CHECK_EQUAL(10, dataCache->Size());
+        BOOST_CHECK(!sockClient->IsConnected());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Return the tags of the records read by a LoadServer, in the order they are read.
+static std::vector<std::string>
+GetTagsRead(
+    const TestUtil::LoadServer & server
+    )
+{
+    std::vector<std::string> tags;
+    for (const auto & data : server.GetDataRead()) {
+        // data: ["source",tag,...
+        auto p1 = data.find(',');
+        auto p2 = data.find(',', p1+1);
+        tags.push_back(data.substr(p1+1, p2-p1-1));
+    }
+    return tags;
+}
+
+static bool
+WaitForRecords(
+    const TestUtil::LoadServer & server,
+    size_t nexpected
+    )
+{
+    for (int i = 0; i < 5000 && server.GetTotalRecords() < nexpected; i++) {
+        usleep(1000);
+    }
+    return (nexpected == server.GetTotalRecords());
+}
+
+// Validate that the cached items are replayed in the order they are created,
+// once for each new connection.
+BOOST_AUTO_TEST_CASE(Test_DataResender_ReplayInOrder)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/resender-replay";
+        TestUtil::LoadServerConfig config;
+        config.ackDropPercent = 100;
+        config.retainData = true;
+        TestUtil::LoadServer server(sockfile, config);
+        server.Init();
+        auto serverTask = std::async(std::launch::async, [&server]() { server.Run(); });
+
+        // Add items in the reverse order they are created. They are replayed
+        // in the order they are created, i.e. in tag order.
+        const int nitems = 20;
+        std::vector<LogItemPtr> items;
+        std::vector<std::string> expectedTags;
+        for (int i = 0; i < nitems; i++) {
+            items.emplace_back(new DjsonLogItem("testsource", TestUtil::CreateMsg(i)));
+            expectedTags.push_back(items.back()->GetTag());
+        }
+        auto dataCache = std::make_shared<InflightRing>();
+        for (auto iter = items.rbegin(); iter != items.rend(); iter++) {
+            dataCache->Add(*iter);
+        }
+
+        auto sockClient = std::make_shared<SocketClient>(sockfile, 1000);
+        DataResender resender(sockClient, dataCache, 100000, 100000);
+
+        // Not connected yet.
+        BOOST_CHECK_EQUAL(0, resender.ReplayIfReconnected());
+
+        sockClient->Connect();
+        BOOST_CHECK_EQUAL(nitems, resender.ReplayIfReconnected());
+        BOOST_CHECK_EQUAL(0, resender.ReplayIfReconnected());
+
+        // An item cached on the 1st connection is replayed on the 2nd one.
+        // An item cached after the 2nd connection is created is not.
+        LogItemPtr item1(new DjsonLogItem("testsource", TestUtil::CreateMsg(nitems)));
+        item1->Touch();
+        dataCache->Add(item1);
+
+        sockClient->Close();
+        sockClient->Connect();
+
+        LogItemPtr item2(new DjsonLogItem("testsource", TestUtil::CreateMsg(nitems+1)));
+        item2->Touch();
+        dataCache->Add(item2);
+
+        BOOST_CHECK_EQUAL(nitems+1, resender.ReplayIfReconnected());
+
+        BOOST_CHECK(WaitForRecords(server, 2*nitems+1));
+        auto tags = GetTagsRead(server);
+        auto firstReplayTags = expectedTags;
+        expectedTags.insert(expectedTags.end(), firstReplayTags.begin(), firstReplayTags.end());
+        expectedTags.push_back(item1->GetTag());
+        BOOST_CHECK_EQUAL_COLLECTIONS(expectedTags.begin(), expectedTags.end(), tags.begin(), tags.end());
+
+        auto & metrics = sockClient->GetMetrics();
+        BOOST_CHECK_EQUAL(2, metrics.GetCounterValue(MetricNames::ReplayCount));
+        BOOST_CHECK_EQUAL(2*nitems+1, metrics.GetCounterValue(MetricNames::ReplayItems));
+
+        resender.Stop();
+        sockClient->Stop();
+        server.Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a paced replay waits between items, and still sends all
+// the items in order.
+BOOST_AUTO_TEST_CASE(Test_DataResender_ResendShare)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/resender-share";
+        TestUtil::LoadServerConfig config;
+        config.ackDropPercent = 100;
+        config.retainData = true;
+        TestUtil::LoadServer server(sockfile, config);
+        server.Init();
+        auto serverTask = std::async(std::launch::async, [&server]() { server.Run(); });
+
+        const int nitems = 400;
+        const std::string bigValue(16*1024, 'x');
+        auto dataCache = std::make_shared<InflightRing>();
+        std::vector<std::string> expectedTags;
+        for (int i = 0; i < nitems; i++) {
+            LogItemPtr item(new DjsonLogItem("testsource", TestUtil::CreateMsg(i) + bigValue));
+            dataCache->Add(item);
+            expectedTags.push_back(item->GetTag());
+        }
+
+        auto sockClient = std::make_shared<SocketClient>(sockfile, 1000);
+        DataResender resender(sockClient, dataCache, 100000, 100000);
+        BOOST_CHECK_EQUAL(100, resender.GetResendShare());
+        BOOST_CHECK_THROW(resender.SetResendShare(0), std::invalid_argument);
+        BOOST_CHECK_THROW(resender.SetResendShare(101), std::invalid_argument);
+
+        resender.SetResendShare(20);
+        BOOST_CHECK_EQUAL(20, resender.GetResendShare());
+
+        // The paced replay is sent by the resending turns started by the connection.
+        resender.Start();
+        sockClient->Connect();
+
+        BOOST_CHECK(WaitForRecords(server, nitems));
+        auto tags = GetTagsRead(server);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expectedTags.begin(), expectedTags.end(), tags.begin(), tags.end());
+
+        auto & metrics = sockClient->GetMetrics();
+        // The items take more socket time than the pacer's burst.
+        BOOST_CHECK_GT(metrics.GetCounterValue(MetricNames::ResendPaceWaitMicroSeconds), 0);
+        BOOST_CHECK_EQUAL(nitems, metrics.GetCounterValue(MetricNames::ReplayItems));
+        BOOST_CHECK_EQUAL(1, metrics.GetCounterValue(MetricNames::ReplayCount));
+
+        resender.Stop();
+        sockClient->Stop();
+        server.Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a logger pacing a big backlog doesn't hold a worker thread of
+// the shared WorkerRuntime while it waits, so that another logger on the only
+// free worker is still serviced.
+BOOST_AUTO_TEST_CASE(Test_DataResender_PacingSharedWorker)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/resender-sharedworker";
+        TestUtil::LoadServerConfig config;
+        config.ackDropPercent = 100;
+        TestUtil::LoadServer server(sockfile, config);
+        server.Init();
+        auto serverTask = std::async(std::launch::async, [&server]() { server.Run(); });
+
+        // Keep all the workers but one busy.
+        auto runtime = WorkerRuntime::Get();
+        const size_t nbusy = runtime->GetNumThreads() - 2;
+        std::atomic<bool> releaseWorkers{false};
+        std::atomic<size_t> nrunning{0};
+        std::vector<uint64_t> busyTimers;
+        for (size_t i = 0; i < nbusy; i++) {
+            busyTimers.push_back(runtime->AddTimer(100000, [&releaseWorkers, &nrunning] {
+                nrunning++;
+                while(!releaseWorkers) {
+                    usleep(1000);
+                }
+            }));
+            runtime->TriggerTimer(busyTimers.back());
+        }
+        for (int i = 0; i < 1000 && nrunning < nbusy; i++) {
+            usleep(1000);
+        }
+        BOOST_REQUIRE_EQUAL(nbusy, nrunning);
+
+        const int nitems = 1000;
+        const uint32_t resendIntervalMS = 50;
+        const std::string bigValue(16*1024, 'x');
+        SocketLogger pacedLogger(sockfile, 100000, resendIntervalMS);
+        BOOST_CHECK(pacedLogger.SetResendShare(1));
+        for (int i = 0; i < nitems; i++) {
+            BOOST_CHECK(pacedLogger.SendDjson("testsource", TestUtil::CreateMsg(i) + bigValue));
+        }
+
+        SocketLogger otherLogger(sockfile, 100000, resendIntervalMS);
+        BOOST_CHECK(otherLogger.SendDjson("testsource", TestUtil::CreateMsg(nitems)));
+
+        usleep(1000*1000);
+        auto npaced = pacedLogger.GetTotalResend();
+        auto nother = otherLogger.GetTotalResend();
+
+        releaseWorkers = true;
+        for (auto timerId : busyTimers) {
+            runtime->RemoveTimer(timerId);
+        }
+
+        // The backlog is still being paced, while the other logger resends
+        // at about its resend interval.
+        BOOST_CHECK_LT(npaced, nitems);
+        BOOST_CHECK_GE(nother, 5);
+
+        server.Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that with replay_first policy, the unacked items are replayed in
+// order on a new connection before any new item is sent.
+BOOST_AUTO_TEST_CASE(Test_DataResender_ReplayFirst)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/resender-replayfirst";
+        const int nmsgs = 10;
+
+        TestUtil::LoadServerConfig config1;
+        config1.ackDropPercent = 100;
+        auto server1 = std::make_shared<TestUtil::LoadServer>(sockfile, config1);
+        server1->Init();
+        auto serverTask1 = std::async(std::launch::async, [server1]() { server1->Run(); });
+
+        SocketLogger logger(sockfile, 100000, 100000, 1000);
+        BOOST_CHECK(!logger.SetReplayPolicy("nosuchpolicy"));
+        BOOST_CHECK(logger.SetReplayPolicy("replay_first"));
+
+        for (int i = 0; i < nmsgs; i++) {
+            BOOST_CHECK(logger.SendDjson("testsource", TestUtil::CreateMsg(i)));
+        }
+        BOOST_CHECK(WaitForRecords(*server1, nmsgs));
+        BOOST_CHECK_EQUAL(nmsgs, logger.GetNumItemsInCache());
+
+        // Close the connection.
+        server1->Stop();
+        serverTask1.get();
+        server1.reset();
+
+        TestUtil::LoadServerConfig config2;
+        config2.ackDropPercent = 100;
+        config2.retainData = true;
+        TestUtil::LoadServer server2(sockfile, config2);
+        server2.Init();
+        auto serverTask2 = std::async(std::launch::async, [&server2]() { server2.Run(); });
+
+        // The send fails until the closed connection is found.
+        bool isSent = false;
+        for (int i = 0; i < 100 && !isSent; i++) {
+            isSent = logger.SendDjson("testsource", TestUtil::CreateMsg(nmsgs));
+        }
+        BOOST_CHECK(isSent);
+        BOOST_CHECK(WaitForRecords(server2, nmsgs+1));
+
+        auto data = server2.GetDataRead();
+        BOOST_REQUIRE_EQUAL(nmsgs+1, data.size());
+        for (int i = 0; i <= nmsgs; i++) {
+            BOOST_CHECK(data[i].find("," + TestUtil::CreateMsg(i) + "]") != std::string::npos);
+        }
+        BOOST_CHECK(logger.GetStats().find("\"replay_items\":" + std::to_string(nmsgs)) != std::string::npos);
+
+        logger.Stop();
+        server2.Stop();
+        serverTask2.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
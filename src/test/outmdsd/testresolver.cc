@@ -0,0 +1,99 @@
+#include <boost/test/unit_test.hpp>
+#include <future>
+
+#include "SourceResolver.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testresolver)
+
+BOOST_AUTO_TEST_CASE(Test_SourceResolver_Match)
+{
+    SourceResolver resolver({ "^mdsd\\.syslog\\.\\w+", "^mdsd\\.ext" });
+
+    BOOST_CHECK_EQUAL(2, resolver.GetNumPatterns());
+    BOOST_CHECK_EQUAL("mdsd.syslog.user", resolver.Resolve("mdsd.syslog.user.info"));
+    BOOST_CHECK_EQUAL("mdsd.syslog.local1", resolver.Resolve("mdsd.syslog.local1.err"));
+    BOOST_CHECK_EQUAL("mdsd.ext", resolver.Resolve("mdsd.ext.abc"));
+    BOOST_CHECK_EQUAL("other.tag", resolver.Resolve("other.tag"));
+    BOOST_CHECK_EQUAL(4, resolver.GetNumCachedTags());
+
+    // cached results
+    BOOST_CHECK_EQUAL("mdsd.syslog.user", resolver.Resolve("mdsd.syslog.user.info"));
+    BOOST_CHECK_EQUAL(4, resolver.GetNumCachedTags());
+}
+
+BOOST_AUTO_TEST_CASE(Test_SourceResolver_NoPattern)
+{
+    SourceResolver resolver({ "[invalid" });
+
+    BOOST_CHECK_EQUAL(0, resolver.GetNumPatterns());
+    BOOST_CHECK_EQUAL("a.b.c", resolver.Resolve("a.b.c"));
+    BOOST_CHECK_EQUAL(0, resolver.GetNumCachedTags());
+}
+
+// Validate that Ruby regex syntax that ECMAScript reads differently is not
+// used silently.
+BOOST_AUTO_TEST_CASE(Test_SourceResolver_RubyOnlySyntax)
+{
+    for (const std::string pattern : { "\\Amdsd", "mdsd\\z", "(?<name>mdsd)", "(?i)mdsd",
+                                       "(?>mdsd)", "md*+sd", "m\\w++", "a{1,2}+" }) {
+        BOOST_CHECK_MESSAGE(!SourceResolver::FindRubyOnlySyntax(pattern).empty(), pattern);
+    }
+    for (const std::string pattern : { "^mdsd\\.syslog\\.\\w+", "a+?b", "\\\\A", "\\++",
+                                       "[*+]+", "(?:ab)+", "(?=a)b", "a{2}" }) {
+        BOOST_CHECK_MESSAGE(SourceResolver::FindRubyOnlySyntax(pattern).empty(), pattern);
+    }
+
+    SourceResolver resolver({ "\\Amdsd\\.\\w+", "^mdsd\\.\\w+" });
+    BOOST_CHECK_EQUAL(1, resolver.GetNumPatterns());
+    BOOST_CHECK_EQUAL("mdsd.syslog", resolver.Resolve("mdsd.syslog.user"));
+}
+
+BOOST_AUTO_TEST_CASE(Test_SourceResolver_Bounded)
+{
+    const size_t maxTags = 10;
+    SourceResolver resolver({ "^a\\.\\w+" }, maxTags);
+
+    for (size_t i = 0; i < 100; i++) {
+        auto tag = "a.b" + std::to_string(i) + ".c";
+        BOOST_CHECK_EQUAL("a.b" + std::to_string(i), resolver.Resolve(tag));
+        BOOST_CHECK_LE(resolver.GetNumCachedTags(), maxTags);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_SourceResolver_Batch)
+{
+    SourceResolver resolver({ "^a\\.\\w+" });
+
+    std::vector<std::string> tags = { "a.x.1", "a.x.1", "a.x.1", "b.y", "b.y", "a.z.2" };
+    std::vector<std::string> expected = { "a.x", "a.x", "a.x", "b.y", "b.y", "a.z" };
+    auto sources = resolver.ResolveBatch(tags);
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), sources.begin(), sources.end());
+    BOOST_CHECK_EQUAL(3, resolver.GetNumCachedTags());
+    BOOST_CHECK(resolver.ResolveBatch({}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(Test_SourceResolver_MultiThreads)
+{
+    SourceResolver resolver({ "^t\\d" }, 8);
+
+    std::vector<std::future<bool>> tasks;
+    for (int n = 0; n < 4; n++) {
+        tasks.push_back(std::async(std::launch::async, [&resolver] {
+            for (int i = 0; i < 1000; i++) {
+                auto id = std::to_string(i % 20);
+                if (("t" + id.substr(0, 1)) != resolver.Resolve("t" + id + ".x")) {
+                    return false;
+                }
+            }
+            return true;
+        }));
+    }
+    for (auto & task : tasks) {
+        BOOST_CHECK(task.get());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,221 @@
+#include <boost/test/unit_test.hpp>
+#include <vector>
+#include <future>
+
+#include "MockServer.h"
+#include "RoutingLogger.h"
+#include "testutil.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testrouting)
+
+// A group of MockServers, each running in its own thread.
+class MockServerGroup
+{
+public:
+    MockServerGroup(const std::string & prefix, size_t nservers) :
+        m_servers(nservers)
+    {
+        for (size_t i = 0; i < nservers; i++) {
+            m_sockfiles.push_back(TestUtil::GetCurrDir() + "/" + prefix + "-" + std::to_string(i));
+        }
+    }
+
+    ~MockServerGroup()
+    {
+        StopAll();
+    }
+
+    void Start(size_t index)
+    {
+        auto server = std::make_shared<TestUtil::MockServer>(m_sockfiles[index]);
+        server->Init();
+        m_tasks.push_back(std::async(std::launch::async, [server]() { server->Run(); }));
+        m_servers[index] = server;
+    }
+
+    // Stop all the servers and wait for them to finish, so that the data
+    // they read can be checked.
+    void StopAll()
+    {
+        for (auto & server : m_servers) {
+            if (server) {
+                server->Stop();
+            }
+        }
+        for (auto & task : m_tasks) {
+            task.get();
+        }
+        m_tasks.clear();
+    }
+
+    const std::vector<std::string> & GetSocketFiles() const { return m_sockfiles; }
+
+    // Return the MockServer started for the index-th socket file, or nullptr.
+    std::shared_ptr<TestUtil::MockServer> GetServer(size_t index) const { return m_servers[index]; }
+
+private:
+    std::vector<std::string> m_sockfiles;
+    std::vector<std::shared_ptr<TestUtil::MockServer>> m_servers;
+    std::vector<std::future<void>> m_tasks;
+};
+
+// Wait until the logger has nothing in cache, i.e. all the data are acked.
+static bool
+WaitForAllAcked(
+    const RoutingLogger & logger,
+    uint32_t timeoutMS
+    )
+{
+    for (uint32_t i = 0; i < timeoutMS; i++) {
+        if (0 == logger.GetNumItemsInCache()) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(Test_RoutingLogger_Constructor)
+{
+    try {
+        BOOST_CHECK_THROW(RoutingLogger({}, 100, 1000), std::invalid_argument);
+        BOOST_CHECK_THROW(RoutingLogger({"/tmp/a", "/tmp/b", "/tmp/a"}, 100, 1000), std::invalid_argument);
+
+        RoutingLogger logger({"/tmp/unknownfile1", "/tmp/unknownfile2"}, 100, 1000);
+        BOOST_CHECK_EQUAL(2, logger.GetNumEndpoints());
+        BOOST_CHECK(!logger.SendDjson("", "testdata"));
+        BOOST_CHECK(!logger.SendDjson("testSource", ""));
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that sources are sharded among all the sockets, and that each
+// source always goes to the same socket.
+BOOST_AUTO_TEST_CASE(Test_RoutingLogger_Shard)
+{
+    try {
+        const size_t nservers = 3;
+        const int nsources = 60;
+        MockServerGroup servers("routing-shard", nservers);
+        for (size_t i = 0; i < nservers; i++) {
+            servers.Start(i);
+        }
+
+        RoutingLogger logger(servers.GetSocketFiles(), 5000, 1000);
+
+        std::vector<std::unordered_set<std::string>> expected(nservers);
+        for (int i = 0; i < nsources; i++) {
+            auto source = "source" + std::to_string(i);
+            auto data = TestUtil::CreateMsg(i);
+            BOOST_CHECK(logger.SendDjson(source, data));
+            expected[logger.GetEndpointIndex(source)].insert(data);
+        }
+        BOOST_CHECK(WaitForAllAcked(logger, 2000));
+        BOOST_CHECK_EQUAL(0, logger.GetTotalFailover());
+
+        servers.StopAll();
+        for (size_t i = 0; i < nservers; i++) {
+            // with 60 sources, each socket should get some of them.
+            BOOST_CHECK_GT(expected[i].size(), 0);
+            BOOST_CHECK(expected[i] == servers.GetServer(i)->GetUniqDataRead());
+        }
+
+        // Removing a socket only moves the sources that were on it.
+        std::vector<std::string> twoSockets(servers.GetSocketFiles().begin(), servers.GetSocketFiles().begin()+2);
+        RoutingLogger logger2(twoSockets, 100, 1000);
+        for (int i = 0; i < nsources; i++) {
+            auto source = "source" + std::to_string(i);
+            auto index = logger.GetEndpointIndex(source);
+            if (index < 2) {
+                BOOST_CHECK_EQUAL(index, logger2.GetEndpointIndex(source));
+            }
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a mirrored source is sent to every socket.
+BOOST_AUTO_TEST_CASE(Test_RoutingLogger_Mirror)
+{
+    try {
+        const size_t nservers = 2;
+        const int nmsgs = 20;
+        MockServerGroup servers("routing-mirror", nservers);
+        for (size_t i = 0; i < nservers; i++) {
+            servers.Start(i);
+        }
+
+        RoutingLogger logger(servers.GetSocketFiles(), 5000, 1000);
+        logger.AddMirrorSource("critical");
+
+        std::unordered_set<std::string> expected;
+        for (int i = 0; i < nmsgs; i++) {
+            auto data = TestUtil::CreateMsg(i);
+            BOOST_CHECK(logger.SendDjson("critical", data));
+            expected.insert(data);
+        }
+        BOOST_CHECK(WaitForAllAcked(logger, 2000));
+        BOOST_CHECK_EQUAL(nmsgs*nservers, logger.GetTotalSend());
+
+        servers.StopAll();
+        for (size_t i = 0; i < nservers; i++) {
+            BOOST_CHECK(expected == servers.GetServer(i)->GetUniqDataRead());
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that records fail over to a healthy socket while the other one
+// is down, and go back to it after it is up again.
+BOOST_AUTO_TEST_CASE(Test_RoutingLogger_Failover)
+{
+    try {
+        const int nsources = 40;
+        MockServerGroup servers("routing-failover", 2);
+        TestUtil::RemoveFileIfExists(servers.GetSocketFiles()[1]);
+        servers.Start(0);
+
+        RoutingLogger logger(servers.GetSocketFiles(), 5000, 1000, 200);
+
+        for (int i = 0; i < nsources; i++) {
+            BOOST_CHECK(logger.SendDjson("source" + std::to_string(i), TestUtil::CreateMsg(i)));
+        }
+        BOOST_CHECK(WaitForAllAcked(logger, 2000));
+        BOOST_CHECK(logger.IsEndpointUp(0));
+        BOOST_CHECK(!logger.IsEndpointUp(1));
+        BOOST_CHECK_GT(logger.GetTotalFailover(), 0);
+        BOOST_CHECK_EQUAL(nsources, servers.GetServer(0)->GetTotalTags());
+
+        servers.Start(1);
+
+        // Keep sending until the down socket is reconnected.
+        bool isUp = false;
+        for (int i = 0; i < 200 && !isUp; i++) {
+            BOOST_CHECK(logger.SendDjson("source" + std::to_string(i % nsources), TestUtil::CreateMsg(i)));
+            usleep(10*1000);
+            isUp = logger.IsEndpointUp(1);
+        }
+        BOOST_REQUIRE(isUp);
+
+        auto nfailover = logger.GetTotalFailover();
+        for (int i = 0; i < nsources; i++) {
+            BOOST_CHECK(logger.SendDjson("source" + std::to_string(i), TestUtil::CreateMsg(i)));
+        }
+        BOOST_CHECK(WaitForAllAcked(logger, 2000));
+        BOOST_CHECK_EQUAL(nfailover, logger.GetTotalFailover());
+        BOOST_CHECK_GT(servers.GetServer(1)->GetTotalTags(), 0);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,209 @@
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include <unistd.h>
+#include <sys/socket.h>
+}
+
+#include "WorkerRuntime.h"
+#include "SocketLogger.h"
+#include "MockServer.h"
+#include "testutil.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testruntime)
+
+// Wait until 'pred' is true or until timeout. Return the value of 'pred'.
+template<typename Pred>
+static bool
+WaitFor(
+    Pred pred,
+    unsigned int timeoutMS
+    )
+{
+    auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMS);
+    while(!pred() && std::chrono::steady_clock::now() < endTime) {
+        usleep(10*1000);
+    }
+    return pred();
+}
+
+// Return number of threads of current process.
+static size_t
+GetNumThreads()
+{
+    std::ifstream fin("/proc/self/status");
+    std::string line;
+    while(std::getline(fin, line)) {
+        if (0 == line.compare(0, 8, "Threads:")) {
+            return std::stoul(line.substr(8));
+        }
+    }
+    return 0;
+}
+
+BOOST_AUTO_TEST_CASE(Test_WorkerRuntime_Timer)
+{
+    try {
+        auto runtime = WorkerRuntime::Get();
+        BOOST_CHECK_EQUAL(runtime, WorkerRuntime::Get());
+
+        std::atomic<int> counter{0};
+        auto timerId = runtime->AddTimer(20, [&counter] { counter++; });
+        usleep(300*1000);
+        runtime->RemoveTimer(timerId);
+
+        int ncalls = counter;
+        BOOST_CHECK_GE(ncalls, 5);
+        BOOST_CHECK_LE(ncalls, 16);
+
+        usleep(100*1000);
+        BOOST_CHECK_EQUAL(ncalls, counter);
+
+        BOOST_CHECK_THROW(runtime->AddTimer(0, [] {}), std::invalid_argument);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that TriggerTimer() calls the callback without waiting for the interval,
+// and that RemoveTimer() waits for the running callback.
+BOOST_AUTO_TEST_CASE(Test_WorkerRuntime_TriggerTimer)
+{
+    try {
+        auto runtime = WorkerRuntime::Get();
+
+        std::atomic<int> counter{0};
+        std::atomic<bool> isDone{false};
+        auto timerId = runtime->AddTimer(100000, [&counter, &isDone] {
+            counter++;
+            usleep(200*1000);
+            isDone = true;
+        });
+
+        runtime->TriggerTimer(timerId);
+        BOOST_CHECK(WaitFor([&counter] { return counter > 0; }, 1000));
+
+        runtime->RemoveTimer(timerId);
+        BOOST_CHECK(isDone);
+        BOOST_CHECK_EQUAL(1, counter);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that DelayTimer() called from the callback delays only its next call,
+// and that the worker thread is free meanwhile.
+BOOST_AUTO_TEST_CASE(Test_WorkerRuntime_DelayTimer)
+{
+    try {
+        auto runtime = WorkerRuntime::Get();
+
+        uint64_t timerId = 0;
+        std::atomic<int> counter{0};
+        std::mutex mutex;
+        std::vector<std::chrono::steady_clock::time_point> callTimes;
+        timerId = runtime->AddTimer(20, [&] {
+            std::lock_guard<std::mutex> lck(mutex);
+            callTimes.push_back(std::chrono::steady_clock::now());
+            if (1 == ++counter) {
+                runtime->DelayTimer(timerId, std::chrono::milliseconds(300));
+            }
+        });
+
+        BOOST_CHECK(WaitFor([&counter] { return counter >= 3; }, 2000));
+        runtime->RemoveTimer(timerId);
+
+        std::lock_guard<std::mutex> lck(mutex);
+        BOOST_REQUIRE_GE(callTimes.size(), 3);
+        BOOST_CHECK_GE((callTimes[1] - callTimes[0]) / std::chrono::milliseconds(1), 300);
+        BOOST_CHECK_LT((callTimes[2] - callTimes[1]) / std::chrono::milliseconds(1), 300);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that the read handler is called when the socket is readable,
+// and that the socket is no longer watched after the other side closes it.
+BOOST_AUTO_TEST_CASE(Test_WorkerRuntime_ReadHandler)
+{
+    try {
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+        auto runtime = WorkerRuntime::Get();
+        std::atomic<size_t> nread{0};
+        std::atomic<int> ncalls{0};
+        auto handlerId = runtime->AddReadHandler([&nread, &ncalls, fds] {
+            ncalls++;
+            char buf[64];
+            ssize_t n = 0;
+            while((n = recv(fds[0], buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                nread += n;
+            }
+        });
+        runtime->WatchSocket(handlerId, fds[0]);
+
+        BOOST_REQUIRE_EQUAL(5, write(fds[1], "hello", 5));
+        BOOST_CHECK(WaitFor([&nread] { return 5 == nread; }, 1000));
+
+        close(fds[1]);
+        BOOST_CHECK(WaitFor([&ncalls] { return ncalls >= 2; }, 1000));
+        usleep(100*1000);
+        int ncallsAtClose = ncalls;
+        usleep(100*1000);
+        BOOST_CHECK_EQUAL(ncallsAtClose, ncalls);
+
+        runtime->RemoveReadHandler(handlerId);
+        close(fds[0]);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that more loggers don't add more threads in the client side.
+BOOST_AUTO_TEST_CASE(Test_WorkerRuntime_SharedByLoggers)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/runtime-shared";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        auto runtime = WorkerRuntime::Get();
+        auto nthreadsBefore = GetNumThreads();
+
+        const size_t nloggers = 10;
+        std::vector<std::unique_ptr<SocketLogger>> loggers;
+        for (size_t i = 0; i < nloggers; i++) {
+            loggers.emplace_back(new SocketLogger(sockfile, 100000, 100));
+            BOOST_CHECK(loggers.back()->SendDjson("testSource", TestUtil::CreateMsg(i)));
+        }
+        for (auto & logger : loggers) {
+            BOOST_CHECK(logger->WaitUntilAllAcked(5000));
+            BOOST_CHECK_GE(logger->GetNumTagsRead(), 1);
+        }
+
+        // The only new threads are the MockServer threads, one per connection.
+        BOOST_CHECK_LE(GetNumThreads(), nthreadsBefore + nloggers);
+
+        loggers.clear();
+        mockServer->Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,10 +1,11 @@
 #include <boost/test/unit_test.hpp>
 #include <future>
 
-#include "ConcurrentMap.h"
-#include "ConcurrentQueue.h"
+#include "InflightRing.h"
+#include "FairQueue.h"
 #include "DataSender.h"
 #include "SocketClient.h"
+#include "Metrics.h"
 #include "DjsonLogItem.h"
 #include "testutil.h"
 #include "MockServer.h"
@@ -28,7 +29,7 @@ RunSender(
 
 static void
 AddItemsToQueue(
-    const std::shared_ptr<ConcurrentQueue<LogItemPtr>>& q,
+    const std::shared_ptr<FairQueue>& q,
     size_t nitems,
     size_t nbytesPerItem,
     int delayMicroSeconds // number of micro-seconds to delay between send
@@ -38,7 +39,7 @@ AddItemsToQueue(
 
     for (size_t i = 0; i < nitems; i++) {
         LogItemPtr p(new DjsonLogItem("testsource", testdata));
-        q->push(std::move(p));
+        q->Push(std::move(p));
 
         if (delayMicroSeconds > 0) {
             usleep(delayMicroSeconds);
@@ -48,11 +49,11 @@ AddItemsToQueue(
 
 static void
 AddEndOfTestToQueue(
-    const std::shared_ptr<ConcurrentQueue<LogItemPtr>>& q
+    const std::shared_ptr<FairQueue>& q
     )
 {
     LogItemPtr p(new DjsonLogItem("testsource", TestUtil::EndOfTest()));
-    q->push(std::move(p));
+    q->Push(std::move(p));
 }
 
 // This test validates DataSender APIs only. It doesn't validate the data flow
@@ -68,11 +69,11 @@ RunAPITest(
 
         const std::string socketfile = "/tmp/nosuchfile";
         auto sockClient = std::make_shared<SocketClient>(socketfile, 1);
-        auto q = std::make_shared<ConcurrentQueue<LogItemPtr>>();
+        auto q = std::make_shared<FairQueue>();
 
-        std::shared_ptr<ConcurrentMap<LogItemPtr>> cache;
+        std::shared_ptr<InflightRing> cache;
         if (useDataCache) {
-            cache = std::make_shared<ConcurrentMap<LogItemPtr>>();
+            cache = std::make_shared<InflightRing>();
         }
 
         const size_t nitems = 2;
@@ -86,10 +87,10 @@ RunAPITest(
         usleep(10*1000);
         stopSender = true;
         sender.Stop();
-        q->stop_once_empty();
+        q->StopOnceEmpty();
 
         BOOST_CHECK_EQUAL(nitems, sender.GetNumSend());
-        BOOST_CHECK_EQUAL(0, q->size());
+        BOOST_CHECK_EQUAL(0, q->Size());
         BOOST_CHECK_EQUAL(0, sender.GetNumSuccess());
 
         // Validate that once DataSender::Stop() is called, it shouldn't take
@@ -132,8 +133,8 @@ RunE2ETest(size_t nitems, size_t nbytesPerItem)
     auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
 
     auto sockClient = std::make_shared<SocketClient>(sockfile, 20);
-    auto incomingQueue = std::make_shared<ConcurrentQueue<LogItemPtr>>();
-    auto dataCache = std::make_shared<ConcurrentMap<LogItemPtr>>();
+    auto incomingQueue = std::make_shared<FairQueue>();
+    auto dataCache = std::make_shared<InflightRing>();
 
     std::promise<void> threadReady;
     DataSender sender(sockClient, dataCache, incomingQueue);
@@ -151,14 +152,14 @@ RunE2ETest(size_t nitems, size_t nbytesPerItem)
 
     mockServer->Stop();
     sender.Stop();
-    incomingQueue->stop_once_empty();
+    incomingQueue->StopOnceEmpty();
     // Wait until sender task is finished or timed out.
     // Without this, senderTask could be in the middle of sending, such that the sender
     // counters (e.g. GetNumSend(), GetNumSuccess(), etc) can be invalid.
     BOOST_CHECK(TestUtil::WaitForTask(senderTask, 500));
 
     BOOST_CHECK_EQUAL(nitems, sender.GetNumSend());
-    BOOST_CHECK_EQUAL(0, incomingQueue->size());
+    BOOST_CHECK_EQUAL(0, incomingQueue->Size());
 
     BOOST_CHECK_EQUAL(sender.GetNumSend(), sender.GetNumSuccess());
     BOOST_CHECK_EQUAL(sender.GetNumSend(), dataCache->Size());
@@ -189,4 +190,59 @@ BOOST_AUTO_TEST_CASE(Test_DataSender_Stress)
     }
 }
 
+// Validate that items queued faster than they are sent go out in batches,
+// and that the batch limits shrink back to single items when idle.
+BOOST_AUTO_TEST_CASE(Test_DataSender_AdaptiveBatch)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/datasender-batch";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile, false);
+        mockServer->Init();
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        auto sockClient = std::make_shared<SocketClient>(sockfile, 20);
+        auto incomingQueue = std::make_shared<FairQueue>();
+        auto dataCache = std::make_shared<InflightRing>();
+
+        DataSender sender(sockClient, dataCache, incomingQueue);
+        BOOST_CHECK_THROW(sender.SetBatchLimits(0, 1000, std::chrono::microseconds(0)), std::invalid_argument);
+        sender.SetBatchLimits(32, 1024*1024, std::chrono::microseconds(2000));
+
+        // A backlog is queued before the sender starts.
+        const size_t nitems = 5000;
+        AddItemsToQueue(incomingQueue, nitems, 100, 0);
+        auto senderTask = std::async(std::launch::async, [&sender]() { sender.Run(); });
+
+        // Then items trickle in.
+        usleep(100*1000);
+        AddItemsToQueue(incomingQueue, 20, 100, 5000);
+        AddEndOfTestToQueue(incomingQueue);
+        BOOST_CHECK(mockServer->WaitForTestsDone(3000));
+
+        mockServer->Stop();
+        sender.Stop();
+        incomingQueue->StopOnceEmpty();
+        BOOST_CHECK(TestUtil::WaitForTask(senderTask, 500));
+
+        BOOST_CHECK_EQUAL(nitems + 21, sender.GetNumSend());
+        BOOST_CHECK_EQUAL(sender.GetNumSend(), sender.GetNumSuccess());
+        BOOST_CHECK_EQUAL(sender.GetNumSend(), dataCache->Size());
+
+        auto & metrics = sockClient->GetMetrics();
+        auto batchItems = metrics.GetHistogram(MetricNames::SenderBatchItems).GetSnapshot();
+        BOOST_TEST_MESSAGE("batch items: count=" << batchItems.count << " p50=" << batchItems.p50
+                           << " max=" << batchItems.max);
+        BOOST_CHECK_GT(batchItems.max, 1);
+        BOOST_CHECK_LE(batchItems.max, 32);
+        BOOST_CHECK_LT(batchItems.count, nitems);
+
+        auto stats = metrics.GetStats();
+        BOOST_CHECK(stats.find(std::string("\"") + MetricNames::SenderBatchItemsLimit + "\":1,") != std::string::npos);
+        BOOST_CHECK(stats.find(std::string("\"") + MetricNames::SenderLingerMicroSeconds + "\":0") != std::string::npos);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with exception " << ex.what());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
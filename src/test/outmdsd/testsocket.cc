@@ -2,6 +2,12 @@
 #include <future>
 #include <sstream>
 
+extern "C" {
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+}
+
 #include "MockServer.h"
 #include "SocketClient.h"
 #include "Exceptions.h"
@@ -10,6 +16,7 @@
 #include "testutil.h"
 #include "DjsonLogItem.h"
 #include "CounterCV.h"
+#include "Metrics.h"
 
 using namespace EndpointLog;
 
@@ -151,6 +158,106 @@ BOOST_AUTO_TEST_CASE(Test_SocketClient_Msg_1M)
     SendDataToServer(10, 1024*1024, false, 500);
 }
 
+// Validate that items with the same schema are sent with schema array only once
+// per connection, and that schema arrays are sent again after reconnection.
+static void
+TestSendSchemaOnce()
+{
+    const std::string sockfile = TestUtil::GetCurrDir() + "/sockclient-schema";
+    auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile, false);
+    mockServer->Init();
+
+    auto serverTask = std::async(std::launch::async, [mockServer]() {
+        mockServer->Run();
+        return mockServer->GetTotalBytesRead();
+    });
+
+    SocketClient client(sockfile, 100);
+    size_t totalSend = 0;
+
+    const std::string schemaAndData = R"(3,[0,["msg","FT_STRING"]],["abc"])";
+    DjsonLogItem item1("testsource", schemaAndData);
+    DjsonLogItem item2("testsource", schemaAndData);
+    DjsonLogItem item3("testsource", schemaAndData);
+
+    client.Send(item1);
+    totalSend += strlen(item1.GetData());
+
+    client.Send(item2);
+    totalSend += strlen(item2.GetDataNoSchema());
+    BOOST_CHECK_LT(strlen(item2.GetDataNoSchema()), strlen(item2.GetData()));
+
+    // A new connection doesn't know any schema.
+    client.Close();
+    client.Send(item3);
+    totalSend += strlen(item3.GetData());
+
+    client.Send(TestUtil::EndOfTest().c_str());
+    totalSend += TestUtil::EndOfTest().size();
+
+    BOOST_CHECK(mockServer->WaitForTestsDone(500));
+
+    client.Stop();
+    client.Close();
+    mockServer->Stop();
+    auto totalReceived = serverTask.get();
+
+    BOOST_CHECK_EQUAL(totalSend, totalReceived);
+}
+
+BOOST_AUTO_TEST_CASE(Test_SocketClient_Send_Schema_Once)
+{
+    try {
+        TestSendSchemaOnce();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+// Validate that large items sent as frames arrive in full.
+BOOST_AUTO_TEST_CASE(Test_SocketClient_Send_Large_Frame)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/sockclient-frame";
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        mockServer->Init();
+
+        auto serverTask = std::async(std::launch::async, [mockServer]() {
+            mockServer->Run();
+            return mockServer->GetTotalBytesRead();
+        });
+
+        SocketClient client(sockfile, 100);
+        size_t totalSend = 0;
+        std::vector<std::string> values;
+
+        for (int i = 0; i < 5; i++) {
+            values.push_back(std::string(128*1024-1, 'a'+i));
+            DjsonLogItem item("testsource", values.back());
+            client.Send(item);
+            totalSend += strlen(item.GetData());
+        }
+        client.Send(TestUtil::EndOfTest().c_str());
+        totalSend += TestUtil::EndOfTest().size();
+
+        BOOST_CHECK(mockServer->WaitForTestsDone(1000));
+
+        client.Stop();
+        client.Close();
+        mockServer->Stop();
+        BOOST_CHECK_EQUAL(totalSend, serverTask.get());
+
+        auto dataSet = mockServer->GetUniqDataRead();
+        for (const auto & value : values) {
+            BOOST_CHECK_EQUAL(1, dataSet.count(value));
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
 // Failure handling tests:
 // - when socket server is down, Send() should throw exception.
 // - when socket server is up, continue Send() should succeed.
@@ -219,6 +326,87 @@ BOOST_AUTO_TEST_CASE(Test_SocketClient_Send_Retry)
     }
 }
 
+static uint32_t
+GetElapsedMS(
+    const std::chrono::steady_clock::time_point & startTime
+    )
+{
+    return static_cast<uint32_t>((std::chrono::steady_clock::now()-startTime)/std::chrono::milliseconds(1));
+}
+
+// Test that a send that may not connect fails at once when the socket is
+// not connected, instead of retrying the connect until the timeout.
+BOOST_AUTO_TEST_CASE(Test_SocketClient_Send_NoConnect)
+{
+    try {
+        SocketClient sockClient("/tmp/nosuchfile_testsocket", 60*1000);
+        auto item = MakeLogItem<DjsonLogItem>("testSource", TestUtil::CreateMsg(0));
+
+        auto startTime = std::chrono::steady_clock::now();
+        BOOST_CHECK_THROW(sockClient.Send(item, false), SocketException);
+        BOOST_CHECK_THROW(sockClient.SendBatch({ item, item }, false), SocketException);
+        BOOST_CHECK_LT(GetElapsedMS(startTime), 1000);
+        BOOST_CHECK_EQUAL(0, sockClient.GetNumReConnect());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+// Test that Connect() reconnects as soon as the socket file is created,
+// instead of waiting for the long backoff delay to finish.
+BOOST_AUTO_TEST_CASE(Test_SocketClient_Reconnect_OnCreate)
+{
+    try {
+        const std::string sockfile = TestUtil::GetCurrDir() + "/reconnect-oncreate";
+        TestUtil::RemoveFileIfExists(sockfile);
+
+        SocketClient client(sockfile, 20000);
+        auto connectTask = std::async(std::launch::async, [&client]() { client.Connect(); });
+
+        // Let the backoff delay grow to about 1.6 seconds.
+        usleep(1600*1000);
+        BOOST_CHECK(!TestUtil::WaitForTask(connectTask, 0));
+
+        auto mockServer = std::make_shared<TestUtil::MockServer>(sockfile);
+        auto startTime = std::chrono::steady_clock::now();
+        mockServer->Init();
+        auto serverTask = std::async(std::launch::async, [mockServer]() { mockServer->Run(); });
+
+        BOOST_CHECK(TestUtil::WaitForTask(connectTask, 1000));
+        auto connectMS = GetElapsedMS(startTime);
+        BOOST_CHECK_MESSAGE(connectMS < 500, "Reconnect took " << connectMS << " ms");
+
+        client.Stop();
+        mockServer->Stop();
+        serverTask.get();
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
+// Test that Stop() interrupts the wait between connect() retries immediately.
+BOOST_AUTO_TEST_CASE(Test_SocketClient_Stop_During_Reconnect)
+{
+    try {
+        SocketClient client("/tmp/nosuchfile", 20000);
+        auto connectTask = std::async(std::launch::async, [&client]() { client.Connect(); });
+
+        usleep(1600*1000);
+        BOOST_CHECK(!TestUtil::WaitForTask(connectTask, 0));
+
+        auto startTime = std::chrono::steady_clock::now();
+        client.Stop();
+        BOOST_CHECK(TestUtil::WaitForTask(connectTask, 1000));
+        auto stopMS = GetElapsedMS(startTime);
+        BOOST_CHECK_MESSAGE(stopMS < 100, "Stop took " << stopMS << " ms");
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+}
+
 static void
 DoSend(
     const std::shared_ptr<SocketClient>& sockClient,
@@ -406,4 +594,126 @@ BOOST_AUTO_TEST_CASE(Test_SocketClient_N_Sender_Reader)
     }
 }
 
+// Listen on a TCP port of the loopback address. Return the listening fd, and
+// save the port to 'port'.
+static int
+ListenTcp(
+    int & port
+    )
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    BOOST_REQUIRE_GE(fd, 0);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    BOOST_REQUIRE_EQUAL(0, bind(fd, reinterpret_cast<struct sockaddr*>(&addr), addrLen));
+    BOOST_REQUIRE_EQUAL(0, listen(fd, 1));
+    BOOST_REQUIRE_EQUAL(0, getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &addrLen));
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// Accept one connection and read until it is closed. Return bytes read.
+static size_t
+AcceptAndReadAll(
+    int listenfd
+    )
+{
+    int fd = accept(listenfd, nullptr, nullptr);
+    if (fd < 0) {
+        return 0;
+    }
+    size_t total = 0;
+    char buf[64*1024];
+    ssize_t n = 0;
+    while((n = read(fd, buf, sizeof(buf))) > 0) {
+        total += n;
+    }
+    close(fd);
+    return total;
+}
+
+static void
+SendTcp(
+    size_t zeroCopyMinBytes,
+    bool waitForUnpin = true
+    )
+{
+    int port = 0;
+    int listenfd = ListenTcp(port);
+    auto serverTask = std::async(std::launch::async, [listenfd]() { return AcceptAndReadAll(listenfd); });
+
+    try {
+        SocketClient client(port, 1000);
+        client.SetZeroCopy(zeroCopyMinBytes);
+
+        size_t totalSend = 0;
+        std::vector<LogItemPtr> items;
+        for (int i = 0; i < 20; i++) {
+            items.push_back(std::make_shared<DjsonLogItem>("testsource", std::string(64*1024+i, 'a'+i)));
+            client.Send(items.back());
+            totalSend += strlen(items.back()->GetData());
+        }
+        // Small items are always copied.
+        auto smallItem = std::make_shared<DjsonLogItem>("testsource", "small");
+        client.Send(smallItem);
+        totalSend += strlen(smallItem->GetData());
+
+        auto nzc = client.GetMetrics().GetCounterValue(MetricNames::ZeroCopySends);
+        if (zeroCopyMinBytes && !waitForUnpin) {
+            // Close() waits for the pinned items before it resets the connection.
+            BOOST_CHECK_GT(nzc, 0);
+            items.clear();
+            client.Close();
+            BOOST_CHECK_EQUAL(0, client.GetNumZeroCopyPinned());
+            BOOST_CHECK_EQUAL(0, client.GetMetrics().GetCounterValue(
+                std::string(MetricNames::DropCountPrefix) + "zerocopy_close"));
+        }
+        else if (zeroCopyMinBytes) {
+            BOOST_CHECK_GT(nzc, 0);
+
+            // The sent items are still alive while they are pinned.
+            items.clear();
+            char buf[64];
+            for (int i = 0; i < 200 && client.GetNumZeroCopyPinned(); i++) {
+                client.ReadNoWait(buf, sizeof(buf));
+                usleep(10*1000);
+            }
+            BOOST_CHECK_EQUAL(0, client.GetNumZeroCopyPinned());
+        }
+        else {
+            BOOST_CHECK_EQUAL(0, nzc);
+        }
+
+        client.Stop();
+        client.Close();
+        BOOST_CHECK_EQUAL(totalSend, serverTask.get());
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test failed with unexpected exception: " << ex.what());
+    }
+    close(listenfd);
+}
+
+BOOST_AUTO_TEST_CASE(Test_SocketClient_Tcp_Send)
+{
+    SendTcp(0);
+}
+
+// Test that zero-copy sends deliver all the data, and that the items are
+// unpinned after the kernel is done with them.
+BOOST_AUTO_TEST_CASE(Test_SocketClient_Tcp_ZeroCopy)
+{
+    SendTcp(1024);
+}
+
+// Test that Close() right after zero-copy sends doesn't drop the data.
+BOOST_AUTO_TEST_CASE(Test_SocketClient_Tcp_ZeroCopyClose)
+{
+    SendTcp(1024, false);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,211 @@
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <unordered_map>
+#include <atomic>
+#include <future>
+#include <thread>
+
+#include "SpillFile.h"
+#include "DjsonLogItem.h"
+#include "testutil.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testspill)
+
+static std::string
+GetSpillFile()
+{
+    auto filepath = TestUtil::GetCurrDir() + "/testspill.dat";
+    TestUtil::RemoveFileIfExists(filepath);
+    return filepath;
+}
+
+BOOST_AUTO_TEST_CASE(Test_SpillFile_AppendAndRead)
+{
+    try {
+        auto filepath = GetSpillFile();
+        BOOST_CHECK(SpillFile::Read(filepath).empty());
+
+        std::vector<LogItemPtr> items;
+        items.push_back(MakeLogItem<DjsonLogItem>("source1", "data 1"));
+        items.push_back(MakeLogItem<DjsonLogItem>("source2", "data\n2"));
+        BOOST_CHECK_EQUAL(2, SpillFile::Append(filepath, items));
+
+        SpillFile::Append(filepath, { SpillFile::Record("source3", "") });
+
+        auto records = SpillFile::Read(filepath);
+        BOOST_REQUIRE_EQUAL(3, records.size());
+        BOOST_CHECK_EQUAL("source1", records[0].source);
+        BOOST_CHECK_EQUAL("data 1", records[0].schemaAndData);
+        BOOST_CHECK_EQUAL("source2", records[1].source);
+        BOOST_CHECK_EQUAL("data\n2", records[1].schemaAndData);
+        BOOST_CHECK_EQUAL("source3", records[2].source);
+        BOOST_CHECK_EQUAL("", records[2].schemaAndData);
+
+        SpillFile::Remove(filepath);
+        BOOST_CHECK(!TestUtil::IsFileExists(filepath));
+        BOOST_CHECK_NO_THROW(SpillFile::Remove(filepath));
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that a record partially written at crash is ignored, and a file
+// of other format is rejected.
+BOOST_AUTO_TEST_CASE(Test_SpillFile_BadFile)
+{
+    try {
+        auto filepath = GetSpillFile();
+        SpillFile::Append(filepath, { SpillFile::Record("source1", "data1") });
+        {
+            std::ofstream fout(filepath, std::ios::app);
+            fout << "7 100\nsource2partial";
+        }
+        auto records = SpillFile::Read(filepath);
+        BOOST_REQUIRE_EQUAL(1, records.size());
+        BOOST_CHECK_EQUAL("data1", records[0].schemaAndData);
+
+        {
+            std::ofstream fout(filepath, std::ios::trunc);
+            fout << "some other file\n";
+        }
+        BOOST_CHECK_THROW(SpillFile::Read(filepath), std::runtime_error);
+        SpillFile::Remove(filepath);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that concurrent appends to a new file add the version line once,
+// and keep all the records.
+BOOST_AUTO_TEST_CASE(Test_SpillFile_ConcurrentAppend)
+{
+    try {
+        const int nthreads = 8;
+        const int nrecords = 20;
+        for (int round = 0; round < 20; round++) {
+            auto filepath = GetSpillFile();
+            std::atomic<int> nready{0};
+            std::vector<std::future<void>> tasks;
+            for (int i = 0; i < nthreads; i++) {
+                tasks.push_back(std::async(std::launch::async, [&filepath, &nready, i]() {
+                    // Start all the appends at the same time.
+                    nready++;
+                    while(nready < nthreads) {
+                        std::this_thread::yield();
+                    }
+                    for (int j = 0; j < nrecords; j++) {
+                        SpillFile::Append(filepath, { SpillFile::Record("source" + std::to_string(i), "data") });
+                    }
+                }));
+            }
+            for (auto & task : tasks) {
+                task.get();
+            }
+
+            auto records = SpillFile::Read(filepath);
+            BOOST_REQUIRE_EQUAL(nthreads*nrecords, records.size());
+        }
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that Replay() stops at the first failure and keeps the rest.
+BOOST_AUTO_TEST_CASE(Test_SpillFile_Replay)
+{
+    try {
+        auto filepath = GetSpillFile();
+        std::vector<SpillFile::Record> records;
+        for (int i = 0; i < 10; i++) {
+            records.emplace_back("source", TestUtil::CreateMsg(i));
+        }
+        SpillFile::Append(filepath, records);
+
+        std::vector<std::string> sent;
+        auto sendFunc = [&sent](const std::string &, const std::string & data) {
+            if (sent.size() == 4) {
+                return false;
+            }
+            sent.push_back(data);
+            return true;
+        };
+        BOOST_CHECK_EQUAL(4, SpillFile::Replay(filepath, sendFunc));
+
+        auto left = SpillFile::Read(filepath);
+        BOOST_REQUIRE_EQUAL(6, left.size());
+        BOOST_CHECK_EQUAL(TestUtil::CreateMsg(4), left[0].schemaAndData);
+
+        sent.clear();
+        auto sendAll = [&sent](const std::string &, const std::string & data) {
+            sent.push_back(data);
+            return true;
+        };
+        BOOST_CHECK_EQUAL(6, SpillFile::Replay(filepath, sendAll));
+        BOOST_CHECK_EQUAL(TestUtil::CreateMsg(9), sent.back());
+        BOOST_CHECK(!TestUtil::IsFileExists(filepath));
+
+        BOOST_CHECK_EQUAL(0, SpillFile::Replay(filepath, sendAll));
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+// Validate that replayed records don't reuse the schema ids of the new
+// process: a spilled record whose id is also given to a different schema by
+// the new process must be sent with another id.
+BOOST_AUTO_TEST_CASE(Test_SpillFile_ReplaySchemaCollision)
+{
+    try {
+        const std::string schemaA = "[[\"msg\",\"FT_STRING\"]]";
+        const std::string schemaB = "[[\"count\",\"FT_INT64\"]]";
+
+        // Saved by two old processes that both gave id 1 to their first schema.
+        auto filepath = GetSpillFile();
+        SpillFile::Append(filepath, {
+            SpillFile::Record("source", "1," + schemaA + ",[\"a\"]"),
+            SpillFile::Record("source", "1," + schemaB + ",[10]"),
+            SpillFile::Record("source", "2," + schemaA + ",[\"b\"]")
+        });
+
+        std::vector<std::string> sent;
+        BOOST_CHECK_EQUAL(3, SpillFile::Replay(filepath, [&sent](const std::string &, const std::string & data) {
+            sent.push_back(data);
+            return true;
+        }));
+        // The new process gives id 1 to schema B.
+        sent.push_back("1," + schemaB + ",[20]");
+
+        // Like mdsd, remember the schema of each id the first time it is seen.
+        std::unordered_map<uint64_t, std::string> schemaById;
+        std::vector<uint64_t> ids;
+        for (const auto & data : sent) {
+            uint64_t schemaId = 0;
+            size_t schemaPos = 0, dataPos = 0;
+            BOOST_REQUIRE(DjsonLogItem::SplitSchemaAndData(data, schemaId, schemaPos, dataPos));
+            auto schema = data.substr(schemaPos, dataPos - 1 - schemaPos);
+            auto result = schemaById.emplace(schemaId, schema);
+            BOOST_CHECK_EQUAL(schema, result.first->second);
+            ids.push_back(schemaId);
+        }
+
+        BOOST_CHECK_GE(ids[0], SpillFile::ReplaySchemaIdBase);
+        BOOST_CHECK_GE(ids[1], SpillFile::ReplaySchemaIdBase);
+        BOOST_CHECK_NE(ids[0], ids[1]);
+        BOOST_CHECK_EQUAL(ids[0], ids[2]);
+        BOOST_CHECK_EQUAL(std::to_string(ids[2]) + "," + schemaA + ",[\"b\"]", sent[2]);
+
+        // Data of other format is sent as it is.
+        BOOST_CHECK_EQUAL(TestUtil::CreateMsg(1), SpillFile::RenumberSchema(TestUtil::CreateMsg(1)));
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
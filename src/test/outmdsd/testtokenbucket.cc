@@ -0,0 +1,70 @@
+#include <boost/test/unit_test.hpp>
+#include <thread>
+#include <chrono>
+
+#include "TokenBucket.h"
+
+using namespace EndpointLog;
+
+BOOST_AUTO_TEST_SUITE(testtokenbucket)
+
+BOOST_AUTO_TEST_CASE(Test_TokenBucket_Invalid)
+{
+    BOOST_CHECK_THROW(TokenBucket(0, 10), std::invalid_argument);
+    BOOST_CHECK_THROW(TokenBucket(10, 0), std::invalid_argument);
+    BOOST_CHECK_THROW(TokenBucket(-1, 10), std::invalid_argument);
+
+    TokenBucket bucket(10, 10);
+    BOOST_CHECK_THROW(bucket.SetRate(0, 10), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(Test_TokenBucket_Debt)
+{
+    try {
+        // 1000 tokens per second, so 1 token per millisecond.
+        TokenBucket bucket(1000, 100);
+        BOOST_CHECK_EQUAL(0, bucket.GetWaitTime().count());
+
+        // The bucket starts full. No wait until it is in debt.
+        bucket.Consume(100);
+        BOOST_CHECK_LE(bucket.GetTokens(), 100);
+        BOOST_CHECK_EQUAL(0, bucket.GetWaitTime().count());
+
+        bucket.Consume(50);
+        auto waitTime = bucket.GetWaitTime();
+        BOOST_CHECK_GT(waitTime.count(), 30000);
+        BOOST_CHECK_LE(waitTime.count(), 50000);
+
+        std::this_thread::sleep_for(waitTime);
+        BOOST_CHECK_EQUAL(0, bucket.GetWaitTime().count());
+        BOOST_CHECK_GE(bucket.GetTokens(), 0);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Test_TokenBucket_Burst)
+{
+    try {
+        TokenBucket bucket(100000, 10);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        BOOST_CHECK_EQUAL(10, bucket.GetTokens());
+
+        // A smaller burst drops the extra tokens.
+        bucket.SetRate(100000, 5);
+        BOOST_CHECK_EQUAL(5, bucket.GetTokens());
+
+        // A lower rate makes a longer wait for the same debt.
+        bucket.SetRate(1, 5);
+        bucket.Consume(6);
+        auto waitTime = bucket.GetWaitTime();
+        BOOST_CHECK_GT(waitTime.count(), 900000);
+        BOOST_CHECK_LE(waitTime.count(), 1000000);
+    }
+    catch(const std::exception & ex) {
+        BOOST_FAIL("Test exception " << ex.what());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
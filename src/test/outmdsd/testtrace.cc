@@ -1,12 +1,15 @@
 #include <boost/test/unit_test.hpp>
 #include <chrono>
 #include <unordered_set>
+#include <vector>
 
 extern "C" {
 #include <syslog.h>
 }
 
 #include "Trace.h"
+#include "ITracer.h"
+#include "FileTracer.h"
 #include "SyslogTracer.h"
 #include "TraceMacros.h"
 #include "testutil.h"
@@ -141,4 +144,85 @@ BOOST_AUTO_TEST_CASE(Test_Syslog_Level)
 }
 
 
+BOOST_AUTO_TEST_SUITE_END()
+
+// A tracer to save all the logs in memory.
+class MemoryTracer : public ITracer {
+public:
+    MemoryTracer(std::vector<std::string> & logs) : m_logs(logs) {}
+
+    void WriteLog(const std::string & msg) { m_logs.push_back(msg); }
+
+private:
+    std::vector<std::string> & m_logs;
+};
+
+// This test suite doesn't depend on syslog.
+BOOST_AUTO_TEST_SUITE(testtracemacros)
+
+// Set a MemoryTracer for a test. Restore the test log file after test.
+class MemoryTracerFixture {
+public:
+    MemoryTracerFixture()
+    {
+        Trace::SetTracer(new MemoryTracer(logs));
+        Trace::SetTraceLevel(TraceLevel::Trace);
+    }
+
+    ~MemoryTracerFixture()
+    {
+        Trace::SetTracer(new FileTracer(TestUtil::GetCurrDir() + "/outmdsd.log", true));
+        Trace::SetTraceLevel(TraceLevel::Trace);
+    }
+
+    std::vector<std::string> logs;
+};
+
+static void
+RunTraceScope()
+{
+    ADD_DEBUG_TRACE;
+}
+
+BOOST_FIXTURE_TEST_CASE(Test_Trace_Scope, MemoryTracerFixture)
+{
+    Trace::SetTraceLevel(TraceLevel::Info);
+    RunTraceScope();
+    BOOST_CHECK(logs.empty());
+
+    Trace::SetTraceLevel(TraceLevel::Debug);
+    RunTraceScope();
+    BOOST_REQUIRE_EQUAL(2, logs.size());
+    BOOST_CHECK(logs[0].find("Entering RunTraceScope") != std::string::npos);
+    BOOST_CHECK(logs[1].find("Leaving RunTraceScope") != std::string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(Test_Trace_IsEnabled, MemoryTracerFixture)
+{
+    BOOST_CHECK(Trace::IsCompiledIn(TraceLevel::Fatal));
+
+    Trace::SetTraceLevel(TraceLevel::Warning);
+    BOOST_CHECK(!Trace::IsEnabled(TraceLevel::Info));
+    BOOST_CHECK(Trace::IsEnabled(TraceLevel::Warning));
+    BOOST_CHECK(Trace::IsEnabled(TraceLevel::Error));
+}
+
+BOOST_FIXTURE_TEST_CASE(Test_Trace_LogEveryN, MemoryTracerFixture)
+{
+    for (int i = 0; i < 25; i++) {
+        LogEveryN(TraceLevel::Info, 10, "everyN test");
+    }
+    BOOST_REQUIRE_EQUAL(3, logs.size());
+    BOOST_CHECK(logs[0].find("everyN test (count=1, logged every 10)") != std::string::npos);
+    BOOST_CHECK(logs[2].find("everyN test (count=21, logged every 10)") != std::string::npos);
+
+    // No message is counted when the level is disabled.
+    logs.clear();
+    Trace::SetTraceLevel(TraceLevel::Error);
+    for (int i = 0; i < 25; i++) {
+        LogEveryN(TraceLevel::Info, 10, "everyN test");
+    }
+    BOOST_CHECK(logs.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()